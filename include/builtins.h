@@ -0,0 +1,43 @@
+#ifndef _BUILTINS_H_
+#define _BUILTINS_H_
+
+#include "shell.h"
+#include "launch.h"
+
+//The builtin only replaces the program inside a pipeline; on its own the real program runs
+#define BUILTIN_STAGE_ONLY 0x1
+//The builtin changes nothing in the shell and only writes output, so a command substitution runs it in the shell
+#define BUILTIN_OUTPUT_ONLY 0x2
+
+//A command implemented by the shell itself
+typedef struct builtin {
+    const char *name;
+    builtin_main_t *run;
+    int flags;
+} builtin_t;
+
+/**
+ * find_builtin: looks up a command name in the builtin registry.
+ *
+ * name: The command name (argv[0]). Names of the form "!N" find the history re-execution builtin.
+ *
+ * Returns: The registry entry for the builtin; NULL if the name is not a builtin.
+ */
+const builtin_t *find_builtin(const char *name);
+
+/**
+ * run_builtin: runs a builtin inside the shell process and flushes its buffered output.
+ *
+ * shell: The current shell state value.
+ *
+ * builtin: The registry entry of the builtin to run.
+ *
+ * argc: The number of arguments in argv.
+ *
+ * argv: The NULL-terminated arguments of the command, starting with its name.
+ *
+ * Returns: The exit status of the builtin.
+ */
+int run_builtin(msh_t *shell, const builtin_t *builtin, int argc, char **argv);
+
+#endif
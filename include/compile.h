@@ -0,0 +1,99 @@
+#ifndef _COMPILE_H_
+#define _COMPILE_H_
+
+#include "parser.h"
+#include <stdbool.h>
+
+//The instructions of the bytecode compound commands are compiled to (see vm.h for running them)
+typedef enum opcode {
+    //Run pipeline in the foreground; text is the list it is in, for the job table
+    OP_PIPELINE,
+    //Start list in the background (in a subshell running its own program, if it has one)
+    OP_BACKGROUND,
+    //Go to target
+    OP_JUMP,
+    //Go to target if the exit status is 0
+    OP_JUMP_TRUE,
+    //Go to target if the exit status is not 0
+    OP_JUMP_FALSE,
+    //Set the exit status to value
+    OP_STATUS,
+    //Keep the exit status in slot
+    OP_SAVE,
+    //Set the exit status to the one kept in slot
+    OP_LOAD,
+    //Start the for loop of command: its words are expanded into slot, its word counter reset, and the exit status is 0
+    OP_FOR_INIT,
+    //Set the variable of the for loop of command to its next word; go to target after the last one
+    OP_FOR_NEXT,
+    //End the for loop of slot, whether it went through its words or was left by break: its words are popped
+    OP_FOR_DONE,
+    //Define the function of command, whose body follows, then go to target
+    OP_FUNCTION,
+    //Return from the function (or the list) with the exit status value; -1 keeps the last one. With
+    //command, the status is the argument of that return command, once it is expanded.
+    OP_RETURN,
+    //Apply the redirections of the compound command to the shell, keeping in slot what to put back;
+    //if they fail, the exit status is 1 and the command is skipped by going to target
+    OP_REDIRECT,
+    //Put back the descriptors redirected by the OP_REDIRECT of slot (and any redirected after it)
+    OP_RESTORE,
+    //Exit the shell with the status the argument of the exit command gives (see argument_status in vm.h)
+    OP_EXIT
+} opcode_t;
+
+//An instruction. Which operands it uses depends on its opcode.
+typedef struct instruction {
+    opcode_t op;
+    int target;
+    int slot;
+    int value;
+    const char *text;
+    union {
+        const pipeline_t *pipeline;
+        const and_or_t *list;
+        const command_t *command;
+    };
+} instruction_t;
+
+//The bytecode of an and-or list, in the arena of tree. Each run of it has num_slots integers for its loops.
+typedef struct program {
+    int num_instructions;
+    int num_slots;
+    instruction_t *code;
+    parse_tree_t *tree;
+} program_t;
+
+/**
+ * needs_program: checks whether an and-or list holds a compound command or a function definition.
+ * Lists of simple commands are run from the tree as they are, without bytecode.
+ *
+ * list: The and-or list.
+ *
+ * Returns: True if the list has to be compiled before it runs.
+ */
+bool needs_program(const and_or_t *list);
+
+/**
+ * compile_list: compiles an and-or list, and everything nested in it, to bytecode. Branches and loops
+ * become jumps; break, continue and return with literal arguments are resolved here, and exit ends
+ * the run. Pipelines are left to the VM, which runs them with run_pipeline. The list runs in the
+ * foreground; the caller decides whether a background list gets a subshell. Background lists nested
+ * in it that need_program get programs of their own.
+ *
+ * tree: The tree the list is in. The bytecode is allocated in its arena and freed with it.
+ *
+ * list: The and-or list; its program is set.
+ *
+ * Returns: The program, which ends with OP_RETURN.
+ */
+program_t *compile_list(parse_tree_t *tree, and_or_t *list);
+
+/**
+ * compile_tree: compiles every list of a tree that needs_program.
+ *
+ * tree: The parse tree.
+ */
+void compile_tree(parse_tree_t *tree);
+
+#endif
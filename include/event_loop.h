@@ -0,0 +1,51 @@
+#ifndef _EVENT_LOOP_H_
+#define _EVENT_LOOP_H_
+
+#include <stdbool.h>
+
+struct msh;
+
+/**
+ * alloc_event_loop: creates the shell's epoll instance and registers its signalfd with it.
+ *
+ * shell: The current shell state value; its signal_fd must already be open.
+ *
+ * Returns: The epoll descriptor; -1 if it could not be created.
+ */
+int alloc_event_loop(struct msh *shell);
+
+/**
+ * watch_input: registers an input descriptor with the event loop.
+ *
+ * shell: The current shell state value.
+ *
+ * fd: The descriptor commands are read from.
+ *
+ * Returns: True if the descriptor can be waited on; false if it is always ready (e.g., a regular file).
+ */
+bool watch_input(struct msh *shell, int fd);
+
+/**
+ * wait_for_input: blocks until the watched input descriptor is readable,
+ * handling every signal (and reaping every child) that arrives meanwhile.
+ *
+ * shell: The current shell state value.
+ */
+void wait_for_input(struct msh *shell);
+
+/**
+ * wait_for_signals: blocks until at least one signal is pending and handles it.
+ * Input is not read, so a foreground job keeps the terminal to itself.
+ *
+ * shell: The current shell state value.
+ */
+void wait_for_signals(struct msh *shell);
+
+/**
+ * free_event_loop: closes the epoll instance and the signalfd.
+ *
+ * shell: The current shell state value.
+ */
+void free_event_loop(struct msh *shell);
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef _EXPAND_H_
+#define _EXPAND_H_
+
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+struct msh;
+
+//A block of the expansion stack
+typedef struct expand_block {
+    struct expand_block *prev;
+    size_t used;
+    size_t size;
+    char *data;
+} expand_block_t;
+
+//The memory expanded words live in, used as a stack: the words of a command are pushed when it runs
+//and popped when it is done, so the commands run inside it (a function body, a line run by a builtin)
+//push theirs above. Blocks never move once words are in them. spare is a popped block kept for reuse.
+typedef struct expand_stack {
+    expand_block_t *top;
+    expand_block_t *spare;
+} expand_stack_t;
+
+//A position in the expansion stack, to pop everything pushed after it
+typedef struct expand_mark {
+    expand_block_t *block;
+    size_t used;
+} expand_mark_t;
+
+//A variable given a value for one command, with the value it had before
+typedef struct saved_variable {
+    const struct symbol *symbol;
+    const char *value;
+} saved_variable_t;
+
+/**
+ * expand_mark: takes the current position of the expansion stack.
+ *
+ * shell: The current shell state value.
+ *
+ * Returns: The position, for expand_release.
+ */
+expand_mark_t expand_mark(struct msh *shell);
+
+/**
+ * expand_release: pops everything pushed on the expansion stack after a position was taken.
+ *
+ * shell: The current shell state value.
+ *
+ * mark: The position, from expand_mark.
+ */
+void expand_release(struct msh *shell, expand_mark_t mark);
+
+/**
+ * expand_alloc: allocates memory on the expansion stack, for data that lives as long as the words of
+ * the command it belongs to (e.g. its redirections).
+ *
+ * shell: The current shell state value.
+ *
+ * size: The number of bytes.
+ *
+ * Returns: The memory, aligned for pointers. Exits the shell if memory cannot be allocated.
+ */
+void *expand_alloc(struct msh *shell, size_t size);
+
+/**
+ * expand_words: expands the words of a command in one pass over each: parameters are replaced by
+ * their values and the values of unquoted ones are split into fields at the characters of IFS (blank,
+ * tab and newline when it is not set). Fields are built in a buffer on the C stack (on the heap once
+ * they outgrow it) and pushed on the expansion stack at once; words without expansions are not
+ * copied, but point into the tree.
+ *
+ * shell: The current shell state value.
+ *
+ * num_words: The number of words.
+ *
+ * words: The text of the words.
+ *
+ * expand: What each word needs expanded (NULL for a plain word); NULL if no word has expansions.
+ *
+ * argc: Receives the number of fields.
+ *
+ * Returns: The NULL-terminated fields, on the expansion stack; words itself if expand is NULL.
+ */
+char **expand_words(struct msh *shell, int num_words, char **words, word_t **expand, int *argc);
+
+/**
+ * expand_word: expands a word into a single field, without splitting it (e.g. the value of an
+ * assignment or the target of a redirection).
+ *
+ * shell: The current shell state value.
+ *
+ * text: The text of the word.
+ *
+ * expand: What the word needs expanded; NULL for a plain word.
+ *
+ * Returns: The expanded word, on the expansion stack; text itself if expand is NULL.
+ */
+char *expand_word(struct msh *shell, char *text, const word_t *expand);
+
+/**
+ * assign_variables: runs the assignments of a command that has no name: each value is expanded and
+ * the variable set, in order.
+ *
+ * shell: The current shell state value.
+ *
+ * assignments: The assignments.
+ */
+void assign_variables(struct msh *shell, const assignment_t *assignments);
+
+/**
+ * command_environment: the environment of a program run with assignments before its name: the
+ * shell's (see environment in variables.h) with the assigned variables added or replaced.
+ *
+ * shell: The current shell state value.
+ *
+ * assignments: The assignments; NULL for the shell's environment as it is.
+ *
+ * Returns: The NULL-terminated environment, on the expansion stack unless assignments is NULL.
+ */
+char **command_environment(struct msh *shell, const assignment_t *assignments);
+
+/**
+ * push_assignments: gives variables the values assigned before the name of a builtin or function,
+ * for as long as it runs.
+ *
+ * shell: The current shell state value.
+ *
+ * assignments: The assignments.
+ *
+ * count: Receives the number of variables set.
+ *
+ * Returns: The values the variables had, on the expansion stack, for pop_assignments.
+ */
+saved_variable_t *push_assignments(struct msh *shell, const assignment_t *assignments, int *count);
+
+/**
+ * pop_assignments: gives variables back the values they had before push_assignments, unsetting
+ * those that were not set.
+ *
+ * shell: The current shell state value.
+ *
+ * saved: The values, from push_assignments.
+ *
+ * count: The number of variables.
+ */
+void pop_assignments(struct msh *shell, const saved_variable_t *saved, int count);
+
+/**
+ * free_expand_stack: frees the blocks of an expansion stack.
+ *
+ * stack: The stack.
+ */
+void free_expand_stack(expand_stack_t *stack);
+
+#endif
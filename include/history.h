@@ -1,17 +1,92 @@
 #ifndef _HISTORY_H_
 #define _HISTORY_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+
 extern const char *HISTORY_FILE_PATH;
 
-//Represents the state of the history of the shell
+//Commands are appended to the history file as soon as this many are waiting
+#ifndef HISTORY_FLUSH_EVERY
+#define HISTORY_FLUSH_EVERY 1
+#endif
+
+//Formats of the history file: newline-separated text, or length-prefixed varint records
+//(see history_format.h). A new history file is created in HISTORY_FORMAT; an existing one
+//keeps the format it has.
+#define HISTORY_TEXT 0
+#define HISTORY_BINARY 1
+#ifndef HISTORY_FORMAT
+#define HISTORY_FORMAT HISTORY_TEXT
+#endif
+
+//Dedup modes (bits of history->dedup): ignoredups drops a command that repeats the newest
+//one; erasedups erases the older copy of a command when it is added again
+#define HISTORY_IGNOREDUPS 1
+#define HISTORY_ERASEDUPS 2
+
+//The cost of a command: when it started (microseconds since the epoch), how long it ran
+//(wall clock), the CPU time its processes used (all in microseconds) and its exit status.
+//A start of 0 marks a command that was not timed; a negative wall time marks a background
+//job, for which only the start is known.
+typedef struct history_timing {
+    long long start_us;
+    long long wall_us;
+    long long user_us;
+    long long sys_us;
+    int status;
+} history_timing_t;
+
+//Represents the state of the history of the shell: a ring of the last max_history
+//lines, oldest at head. Commands are numbered 1, 2, ... for the whole session, so
+//the stored lines are numbered count - size + 1 through count. The newest pending
+//lines have not been appended to the journal (the history file) yet. Lines loaded at
+//startup stay in the mapped file (lines[slot] is NULL) until they are used. The journal
+//may be shared by several shells: journal_size is how much of it this shell has read or
+//written, and in merge mode the lines other shells append past it join the ring. Lines
+//erased as duplicates keep their slot and number but are marked in erased. In timed mode
+//the newest command (number awaiting_timing) is not journaled until time_line_history
+//gives its timing, which is written before it as a "#+" record; timings holds the timing
+//of each slot once any is known. format is the format of the journal; map_format that of
+//the file the loaded lines were mapped from, which may have been converted since.
 typedef struct history {
     char **lines;
     int max_history;
-    int next;
+    int head;
+    int size;
+    int count;
+    int pending;
+    int flush_every;
+    bool merge;
+    int dedup;
+    bool timed;
+    int awaiting_timing;
+    history_timing_t *timings;
+    int journal_fd;
+    size_t journal_size;
+    int format;
+    int map_format;
+    const char *map;
+    size_t map_size;
+    bool map_owned;
+    size_t *map_offsets;
+    int num_mapped;
+    struct history_index *index;
+    unsigned char *erased;
+    struct dedup_entry *dedup_table;
+    int dedup_capacity;
+    int dedup_used;
 }history_t;
 
 /**
- * alloc_history: allocates and initializes a history structure to store command lines.
+ * alloc_history: allocates and initializes a history structure to store command lines. The
+ * history file is memory-mapped, its format (text or binary) is detected, and its most recent
+ * commands are indexed by offset; a command is only
+ * copied out when it is used. The file is kept open as an append-only
+ * journal that other shells may share; every write to it holds an flock. A file holding more
+ * than twice max_history lines is first compacted to the loaded lines by writing a new file and
+ * renaming it over the old one, under the lock. A "#+" record line in the file holds the timing
+ * of the command after it and is not counted as a command.
  *
  * max_history: The maximum number of command lines the history can store.
  * 
@@ -20,7 +95,11 @@ typedef struct history {
 history_t *alloc_history(int max_history);
 
 /**
- * add_line_history: adds a new command line to the history.
+ * add_line_history: adds a new command line to the history. It is appended to the history file
+ * once flush_every commands are waiting (every command by default), so a killed shell loses at
+ * most flush_every - 1 commands. The dedup mode may drop the command (ignoredups) or erase its
+ * older copy (erasedups); erased commands keep their number but are no longer printed or found.
+ * In timed mode the command is not journaled until time_line_history gives its timing.
  *
  * history: A pointer to the history structure where the command line is to be added.
  * 
@@ -28,6 +107,60 @@ history_t *alloc_history(int max_history);
  */
 void add_line_history(history_t *history, const char *cmd_line);
 
+/**
+ * time_line_history: records the timing of the command added last in timed mode, which
+ * add_line_history left waiting for it, and journals the command with its timing.
+ * Does nothing if that command was dropped as a duplicate or already timed.
+ *
+ * history: A pointer to the history structure.
+ *
+ * timing: The timing of the command.
+ */
+void time_line_history(history_t *history, const history_timing_t *timing);
+
+/**
+ * find_timing_history: retrieves the timing of a command by its number.
+ *
+ * history: A pointer to the history structure.
+ *
+ * index: The number of the command.
+ *
+ * Returns: A pointer to the timing; NULL if the command is not stored, was erased or was not timed.
+ */
+const history_timing_t *find_timing_history(history_t *history, int index);
+
+/**
+ * flush_history: appends every command still waiting to the history file in one writev call,
+ * holding an exclusive flock so shells sharing the file never interleave their lines. In merge
+ * mode the lines other shells appended are merged under the same lock.
+ *
+ * history: A pointer to the history structure.
+ */
+void flush_history(history_t *history);
+
+/**
+ * merge_history: in merge mode, adds the commands other shells appended to the history file since
+ * this shell last read or wrote it, as if they had been typed here (after applying the dedup
+ * mode). Commands still waiting are flushed first. Does nothing outside merge mode; when nothing
+ * was appended it costs one fstat, so it is meant to be called before every prompt.
+ *
+ * history: A pointer to the history structure.
+ */
+void merge_history(history_t *history);
+
+/**
+ * convert_history: rewrites the history file in another format, keeping every command and its
+ * timing. The new file is written next to the old one and renamed over it while the journal is
+ * locked; other shells sharing the file move over to it on their next write.
+ *
+ * history: A pointer to the history structure.
+ *
+ * format: HISTORY_TEXT or HISTORY_BINARY.
+ *
+ * Returns: The number of commands in the converted file; -1 if it could not be converted.
+ */
+int convert_history(history_t *history, int format);
+
 /**
  * print_history : prints the contents of the history to standard output.
  *
@@ -36,18 +169,36 @@ void add_line_history(history_t *history, const char *cmd_line);
 void print_history(history_t *history);
 
 /**
- * find_line_history: retrieves a specific command line from the history based on its index.
+ * find_line_history: retrieves a specific command line from the history based on its number.
  *
  * history: A pointer to the history structure to search within.
  * 
- * index: The 1-based index of the command line to retrieve.
+ * index: The number of the command line to retrieve, as shown by print_history. Numbers keep
+ * growing once the history is full, so the oldest commands stop being found.
  * 
  * Returns: A pointer to the command line string if found; NULL if the index is out of bounds.
  */
 char *find_line_history(history_t *history, int index);
 
 /**
- * free_history: deallocates the history structure and its contents.
+ * search_history: finds the most recent command before a given number that contains a pattern,
+ * using a trigram index over the history that is built on the first search and then kept up to
+ * date by add_line_history.
+ *
+ * history: A pointer to the history structure to search within.
+ *
+ * pattern: The text to search for.
+ *
+ * prefix: True to only match commands that start with the pattern.
+ *
+ * before: Only commands numbered below this are searched; pass count + 1 to search everything.
+ *
+ * Returns: The number of the matching command; 0 if none matches.
+ */
+int search_history(history_t *history, const char *pattern, bool prefix, int before);
+
+/**
+ * free_history: journals the commands still waiting, then deallocates the history structure and its contents.
  *
  * history: A pointer to the history structure to be deallocated.
  */
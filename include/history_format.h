@@ -0,0 +1,254 @@
+#ifndef _HISTORY_FORMAT_H_
+#define _HISTORY_FORMAT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "history.h"
+
+//The longest record prefix of either format: a "#+" timing line, or a binary record's
+//length, kind and timing fields
+#define RECORD_MAX 128
+
+//Size of the binary header: magic, version, codec, two reserved bytes, footer offset
+#define BINARY_HEADER_SIZE 16
+
+//Compression of the archive segment of a binary history file
+#define HISTORY_CODEC_NONE 0
+#define HISTORY_CODEC_ZSTD 1
+#define HISTORY_CODEC_LZ4 2
+
+//Codec used when writing an archive: the first one compiled in
+#ifndef HISTORY_CODEC
+#if defined(HISTORY_ZSTD)
+#define HISTORY_CODEC HISTORY_CODEC_ZSTD
+#elif defined(HISTORY_LZ4)
+#define HISTORY_CODEC HISTORY_CODEC_LZ4
+#else
+#define HISTORY_CODEC HISTORY_CODEC_NONE
+#endif
+#endif
+
+//A command as stored in a history file: the line (not NUL-terminated) and its timing,
+//whose start is 0 if the command was not timed
+typedef struct history_record {
+    const char *line;
+    size_t len;
+    history_timing_t timing;
+} history_record_t;
+
+//A history file opened for reading. data holds every record: it is the file itself, or a
+//copy with the archive decompressed. In the binary format the archive records are found
+//through the footer index; the records appended since follow from offset appended.
+typedef struct history_image {
+    int format;
+    const char *data;
+    size_t size;
+    char *owned;
+    const char *archive_index;
+    int archive_count;
+    size_t archive_base;
+    size_t appended;
+} history_image_t;
+
+/**
+ * format_text_record: formats the "#+START WALL USER SYS STATUS" line that precedes a timed
+ * command in the text format.
+ *
+ * out: Receives the line, with its newline; RECORD_MAX bytes are enough.
+ *
+ * timing: The timing of the command.
+ *
+ * Returns: The length of the line.
+ */
+size_t format_text_record(char *out, const history_timing_t *timing);
+
+/**
+ * parse_text_record: parses a "#+" timing line of the text format.
+ *
+ * line: The line, without its newline; it does not need to be NUL-terminated.
+ *
+ * len: The length of the line.
+ *
+ * timing: Receives the timing.
+ *
+ * Returns: True if the line is a timing line; otherwise, false.
+ */
+bool parse_text_record(const char *line, size_t len, history_timing_t *timing);
+
+/**
+ * encode_text_line: writes a command as one line of the text format. A command that contains newlines
+ * (a for loop or a here-document typed over several lines) is joined into one line: "#\\" followed by
+ * the command with its backslashes doubled and its newlines written as "\\n". A command that starts
+ * with "#+" could be read back as a timing line, so it is written with a '#' in front; so is one that
+ * starts with "##" or "#\\", which could be read back as an escaped or joined command.
+ *
+ * out: Receives the line, without its newline; NULL to only compute its length.
+ *
+ * line: The command; it does not need to be NUL-terminated.
+ *
+ * len: The length of the command.
+ *
+ * Returns: The length of the line.
+ */
+size_t encode_text_line(char *out, const char *line, size_t len);
+
+/**
+ * joined_text_line: tells whether a command line of the text format holds a command of several lines,
+ * which has to be copied out with decode_text_line.
+ *
+ * line: The line, which is not a timing line; it does not need to be NUL-terminated.
+ *
+ * len: The length of the line.
+ *
+ * Returns: True if the line holds a joined command; otherwise, false.
+ */
+bool joined_text_line(const char *line, size_t len);
+
+/**
+ * decode_text_line: reads back the command encode_text_line wrote as a command line of the text format.
+ *
+ * out: Receives the command, which is never longer than the line; it may be line itself.
+ *
+ * line: The line, which is not a timing line.
+ *
+ * len: The length of the line.
+ *
+ * Returns: The length of the command.
+ */
+size_t decode_text_line(char *out, const char *line, size_t len);
+
+/**
+ * unescape_text_line: drops the '#' encode_text_line put in front of a command line of the text format,
+ * so the command can be used where it is. A joined command is left for decode_text_line.
+ *
+ * line: The line, which is not a timing line; it is advanced past the escape.
+ *
+ * len: The length of the line; it is decremented with it.
+ */
+void unescape_text_line(const char **line, size_t *len);
+
+/**
+ * format_binary_record: formats the prefix of a binary record: the varint length of the rest of
+ * the record, its kind (timed or not) and the varint timing fields. The command follows it.
+ *
+ * out: Receives the prefix; RECORD_MAX bytes are enough.
+ *
+ * len: The length of the command.
+ *
+ * timing: The timing of the command; NULL or a start of 0 if it was not timed.
+ *
+ * Returns: The length of the prefix.
+ */
+size_t format_binary_record(char *out, size_t len, const history_timing_t *timing);
+
+/**
+ * parse_binary_record: decodes one binary record.
+ *
+ * data: The start of the record.
+ *
+ * size: The number of bytes available.
+ *
+ * record: Receives the command and its timing; the line points into data.
+ *
+ * Returns: The length of the record; 0 if it is incomplete or corrupt.
+ */
+size_t parse_binary_record(const char *data, size_t size, history_record_t *record);
+
+/**
+ * format_binary_header: formats the header of a binary history file.
+ *
+ * out: Receives the BINARY_HEADER_SIZE bytes of the header.
+ *
+ * codec: The codec of the archive.
+ *
+ * footer_offset: The offset of the footer index; 0 if the file has no archive.
+ */
+void format_binary_header(char *out, int codec, uint64_t footer_offset);
+
+/**
+ * history_file_format: tells the format of a history file from its first bytes.
+ *
+ * data: The start of the file.
+ *
+ * size: The number of bytes available; BINARY_HEADER_SIZE are enough.
+ *
+ * Returns: HISTORY_BINARY if the file starts with the binary magic; otherwise, HISTORY_TEXT.
+ */
+int history_file_format(const char *data, size_t size);
+
+/**
+ * open_history_image: detects the format of the contents of a history file and prepares them
+ * for reading. A compressed archive is decompressed; if its codec was not compiled in, only the
+ * records appended after it are read.
+ *
+ * data: The contents of the file, usually memory-mapped.
+ *
+ * size: The size of the file.
+ *
+ * image: Receives the prepared contents; release it with close_history_image.
+ *
+ * Returns: True if the file can be read; false if it is a corrupt binary file.
+ */
+bool open_history_image(const char *data, size_t size, history_image_t *image);
+
+/**
+ * archive_record_offset: finds a record of the archive through the footer index in O(1).
+ *
+ * image: The history image.
+ *
+ * i: The position of the record in the archive, from 0.
+ *
+ * Returns: The offset of the record in image->data.
+ */
+size_t archive_record_offset(const history_image_t *image, int i);
+
+/**
+ * close_history_image: releases the decompressed copy of an image, if there is one.
+ *
+ * image: The history image.
+ */
+void close_history_image(history_image_t *image);
+
+/**
+ * read_history_records: collects every record of a history image in order.
+ *
+ * image: The history image.
+ *
+ * count: Receives the number of records.
+ *
+ * Returns: An array of the records, pointing into image->data, to be freed by the caller; NULL if allocation fails.
+ */
+history_record_t *read_history_records(const history_image_t *image, int *count);
+
+/**
+ * write_history_records: writes a complete history file in the given format. A binary file
+ * holds the records in one archive, compressed with HISTORY_CODEC, followed by its footer index.
+ * Commands containing newlines cannot be kept in the text format; they become several lines.
+ *
+ * fd: The file to write, which should be empty.
+ *
+ * format: HISTORY_TEXT or HISTORY_BINARY.
+ *
+ * records: The records to write.
+ *
+ * count: The number of records.
+ *
+ * Returns: True if the whole file was written; otherwise, false.
+ */
+bool write_history_records(int fd, int format, const history_record_t *records, int count);
+
+/**
+ * convert_history_file: converts a history file, in either format, to the given format.
+ *
+ * from: The path of the file to convert.
+ *
+ * to: The path of the file to write; it is replaced if it exists.
+ *
+ * format: HISTORY_TEXT or HISTORY_BINARY.
+ *
+ * Returns: The number of commands converted; -1 if a file could not be read or written.
+ */
+int convert_history_file(const char *from, const char *to, int format);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _HISTORY_INDEX_H_
+#define _HISTORY_INDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//The command numbers of the lines containing one trigram, in increasing order. ids[start..len) are live.
+typedef struct posting {
+    uint32_t key;
+    int *ids;
+    int start;
+    int len;
+    int capacity;
+} posting_t;
+
+//Represents a trigram index over history lines: an open-addressing table of postings
+typedef struct history_index {
+    posting_t *table;
+    int capacity;
+    int count;
+} history_index_t;
+
+/**
+ * alloc_history_index: allocates an empty trigram index.
+ *
+ * Returns: A pointer to the newly allocated index; NULL if allocation fails.
+ */
+history_index_t *alloc_history_index();
+
+/**
+ * index_add_line: indexes every trigram of a line.
+ *
+ * index: A pointer to the index.
+ *
+ * id: The command number of the line. It must be greater than every number indexed before.
+ *
+ * line: The line to index; it does not need to be NUL-terminated.
+ *
+ * len: The length of the line.
+ */
+void index_add_line(history_index_t *index, int id, const char *line, size_t len);
+
+/**
+ * index_remove_line: removes a line evicted from the history. It must be the oldest line still indexed.
+ *
+ * index: A pointer to the index.
+ *
+ * id: The command number of the line.
+ *
+ * line: The line, as it was indexed.
+ *
+ * len: The length of the line.
+ */
+void index_remove_line(history_index_t *index, int id, const char *line, size_t len);
+
+/**
+ * index_lookup: finds the candidate lines for a pattern of at least three bytes: the lines
+ * containing its rarest trigram. Every line containing the pattern is a candidate.
+ *
+ * index: A pointer to the index.
+ *
+ * pattern: The pattern to look up.
+ *
+ * len: The length of the pattern; at least 3.
+ *
+ * ids: Stores a pointer to the candidates' command numbers, in increasing order, at this location.
+ *
+ * num_ids: Stores the number of candidates at this location.
+ */
+void index_lookup(history_index_t *index, const char *pattern, size_t len, const int **ids, int *num_ids);
+
+/**
+ * free_history_index: deallocates the index.
+ *
+ * index: A pointer to the index to be deallocated.
+ */
+void free_history_index(history_index_t *index);
+
+#endif
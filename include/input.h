@@ -0,0 +1,77 @@
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//A line reader on top of read(2). Unlike stdio it never hides buffered bytes from the event loop.
+//The buffer is reused for every line and grows to fit the longest one. line is where the line
+//returned last starts; it stays in the buffer so continue_line can extend it in place.
+typedef struct input {
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t line;
+    size_t start;
+    size_t end;
+    bool eof;
+} input_t;
+
+//The buffer size for batch input (scripts, msh < file): most reads then fill many lines at once
+#define INPUT_BATCH_CAPACITY (1 << 20)
+
+/**
+ * alloc_input: allocates a line reader for a descriptor.
+ *
+ * fd: The descriptor to read lines from.
+ *
+ * capacity: The initial size of the buffer, which is also the most one read(2) asks for until a
+ * longer line grows it; 0 for a size suited to interactive input.
+ *
+ * Returns: A pointer to the newly allocated reader; NULL if allocation fails.
+ */
+input_t *alloc_input(int fd, size_t capacity);
+
+/**
+ * next_line: returns the next complete line already in the buffer, without reading.
+ *
+ * in: A pointer to the reader.
+ *
+ * len: Stores the length of the line (without its newline) at this location.
+ *
+ * Returns: The line with its newline replaced by '\0', valid until the next call; NULL if no complete line is
+ * buffered. After end of file, a final line without a newline is returned too.
+ */
+char *next_line(input_t *in, size_t *len);
+
+/**
+ * continue_line: extends the line returned last with the next complete line, e.g. when it ends inside
+ * a quote or after a backslash. Nothing is copied: the newline between them is put back in place.
+ *
+ * in: A pointer to the reader.
+ *
+ * len: Stores the length of the joined line at this location.
+ *
+ * Returns: The joined line, valid until the next call; NULL if no complete line is buffered (after end
+ * of file, none will be).
+ */
+char *continue_line(input_t *in, size_t *len);
+
+/**
+ * fill_input: performs a single read(2) into the buffer, growing it if needed. The line returned last
+ * is kept, but moves: pointers into the buffer must be fetched again.
+ *
+ * in: A pointer to the reader.
+ *
+ * Returns: The number of bytes read; 0 at end of file; -1 on error (including EAGAIN and EINTR).
+ */
+long fill_input(input_t *in);
+
+/**
+ * free_input: deallocates the reader. The descriptor is not closed.
+ *
+ * in: A pointer to the reader to be deallocated.
+ */
+void free_input(input_t *in);
+
+#endif
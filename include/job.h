@@ -6,21 +6,45 @@
 
 typedef enum job_state {FOREGROUND, BACKGROUND, SUSPENDED, UNDEFINED} job_state_t;
 
+//A job is a pipeline of one or more processes sharing the process group ``pid``
 typedef struct job {
     char *cmd_line;
     job_state_t state;
     pid_t pid;
     int jid;
+    pid_t *pids;
+    int num_pids;
 } job_t;
 
+//Represents the job table: slot i holds the job with job ID i + 1
+typedef struct job_table {
+    job_t *slots;
+    int capacity;
+    int *free_slots;
+    int num_free;
+    pid_t *pid_keys;
+    int *pid_slots;
+    int pid_capacity;
+    int num_pids;
+    int state_counts[UNDEFINED];
+} job_table_t;
+
 /**
- * add_job : adds a new job to the job array
+ * alloc_jobs: allocates an empty job table. The table grows on demand, so the
+ * capacity is only a starting size.
+ *
+ * capacity: The number of job slots to allocate up front.
  *
- * jobs: A pointer to the first element of the job array.
+ * Returns: A pointer to the newly allocated job table; NULL if allocation fails.
+ */
+job_table_t *alloc_jobs(int capacity);
+
+/**
+ * add_job : adds a new job to the job table
  *
- * max_jobs: The maximum number of jobs the array can hold.
+ * jobs: A pointer to the job table.
  *
- * pid: The process ID of the new job.
+ * pid: The process ID of the new job. It is also the process group ID shared by every process in the job.
  *
  * state: The state of the new job (e.g., BACKGROUND, FOREGROUND).
  *
@@ -28,88 +52,121 @@ typedef struct job {
  *
  * Returns: True if the job was successfully added; otherwise, false.
  */
-bool add_job(job_t *jobs, int max_jobs, pid_t pid, job_state_t state, const char *cmd_line);
+bool add_job(job_table_t *jobs, pid_t pid, job_state_t state, const char *cmd_line);
+
+/**
+ * add_job_process: adds another process (e.g., the next stage of a pipeline) to an existing job.
+ *
+ * jobs: A pointer to the job table.
+ *
+ * pgid: The process ID the job was added with (its process group ID).
+ *
+ * pid: The process ID of the process joining the job.
+ *
+ * Returns: True if the process was added to the job; otherwise, false.
+ */
+bool add_job_process(job_table_t *jobs, pid_t pgid, pid_t pid);
 
 /**
- * delete_job: deletes a job from the job array based on its process ID.
+ * delete_job_process: removes a terminated process from its job and deletes the job once none of its processes remain.
  *
- * jobs: A pointer to the first element of the job array.
+ * jobs: A pointer to the job table.
  *
- * max_jobs: The maximum number of jobs the array can hold.
+ * pid: The process ID of the terminated process.
  *
- * pid: The process ID of the job to be deleted.
+ * Returns: The process group ID of the job if it was deleted; 0 if the job still has processes; -1 if no job contains the process.
+ */
+pid_t delete_job_process(job_table_t *jobs, pid_t pid);
+
+/**
+ * delete_job: deletes a job from the job table based on its process ID.
+ *
+ * jobs: A pointer to the job table.
+ *
+ * pid: The process ID of any process in the job to be deleted.
  *
  * Returns: True if the job was successfully deleted; otherwise, false.
  */
-bool delete_job(job_t *jobs, int max_jobs, pid_t pid);
+bool delete_job(job_table_t *jobs, pid_t pid);
+
+/**
+ * free_jobs: Frees the job table and every job in it.
+ *
+ * jobs: A pointer to the job table to be freed.
+ */
+void free_jobs(job_table_t *jobs);
 
 /**
- * free_jobs: Frees the resources allocated for the jobs array.
+ * jobs_full : checks if the job table has no free slot, growing the table first if it is full.
  *
- * jobs: A pointer to the first element of the job array to be freed.
+ * jobs: A pointer to the job table.
  *
- * max_jobs: The maximum number of jobs the array can hold.
+ * Returns: True if no slot is free and the table could not grow, which only happens when memory runs
+ *          out and is reported as an error; otherwise, false.
  */
-void free_jobs(job_t *jobs, int max_jobs);
+bool jobs_full(job_table_t *jobs);
 
 /**
- * jobs_full : checks if the job array is full.
+ * has_background_job: checks for the existence of any background job in the job table.
  *
- * jobs: A pointer to the first element of the job array.
- * 
- * max_jobs: The maximum number of jobs the array can hold.
- * 
- * Returns: True if the job array is full; otherwise, false.
+ * jobs: A pointer to the job table.
+ *
+ * Returns: True if there is at least one job in the table with its state set to BACKGROUND; otherwise, false.
  */
-bool jobs_full(job_t *jobs, int max_jobs);
+bool has_background_job(job_table_t *jobs);
 
 /**
- * has_background_job: checks for the existence of any background job in the job array.
+ * count_jobs: counts the jobs that are in a given state.
+ *
+ * jobs: A pointer to the job table.
  *
- * jobs: A pointer to the first element of the job array.
- * 
- * max_jobs: The maximum number of jobs the array can hold.
- * 
- * Returns: True if there is at least one job in the array with its state set to BACKGROUND; otherwise, false.
+ * state: The state to count.
+ *
+ * Returns: The number of jobs in the given state.
  */
-bool has_background_job(job_t *jobs, int max_jobs);
+int count_jobs(job_table_t *jobs, job_state_t state);
 
 /**
  * update_job_state: updates the state of a specific job identified by its PID.
  *
- * jobs: A pointer to the first element of the job array.
- * 
- * max_jobs: The maximum number of jobs the array can hold.
- * 
- * pid: The process ID of the job to update.
- * 
+ * jobs: A pointer to the job table.
+ *
+ * pid: The process ID of any process in the job to update.
+ *
  * new_state: The new state to set for the job.
  */
-void update_job_state(job_t* jobs,int max_jobs,pid_t pid,job_state_t new_state);
+void update_job_state(job_table_t* jobs,pid_t pid,job_state_t new_state);
 
 /**
  * get_job_id_by_pid: retrieves the job ID of a specific job identified by its PID.
  *
- * jobs: A pointer to the first element of the job array.
- * 
- * max_jobs: The maximum number of jobs the array can hold.
- * 
- * pid: The process ID of the job whose job ID is to be retrieved.
- * 
- * Returns: The job ID of the specified job; -1 if the job is not found.
+ * jobs: A pointer to the job table.
+ *
+ * pid: The process ID of any process in the job whose job ID is to be retrieved.
+ *
+ * Returns: The job ID of the specified job; 0 if the job is not found.
  */
-int get_job_id_by_pid(job_t* jobs,int max_jobs,pid_t pid);
+int get_job_id_by_pid(job_table_t* jobs,pid_t pid);
+
+/**
+ * get_pgid_by_pid: retrieves the process group ID of the job that contains a process.
+ *
+ * jobs: A pointer to the job table.
+ *
+ * pid: The process ID of any process in the job.
+ *
+ * Returns: The process group ID (the pid the job was added with); -1 if the job is not found.
+ */
+pid_t get_pgid_by_pid(job_table_t* jobs,pid_t pid);
 
 /**
  * get_pid_by_job_id: retrieves the process ID of a specific job identified by its job ID.
  *
- * jobs: A pointer to the first element of the job array.
- * 
- * max_jobs: The maximum number of jobs the array can hold.
- * 
+ * jobs: A pointer to the job table.
+ *
  * jid: The job ID of the job whose process ID is to be retrieved.
- * 
+ *
  * Returns: The process ID of the specified job; -1 if the job is not found.
  */
-pid_t get_pid_by_job_id(job_t* jobs,int max_jobs,int jid);
+pid_t get_pid_by_job_id(job_table_t* jobs,int jid);
 #endif
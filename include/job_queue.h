@@ -0,0 +1,103 @@
+#ifndef _JOB_QUEUE_H_
+#define _JOB_QUEUE_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+struct msh;
+struct and_or;
+struct pipeline;
+
+//A background job waiting for a free slot. Either way it runs with the variables it had when it was
+//started: a job that is one pipeline keeps a copy of it with its words already expanded, and a list that
+//runs in a copy of the shell (several pipelines, or compound commands) is forked when it is queued and
+//held until a slot frees (see fork_subshell); pid is that subshell, or 0.
+typedef struct queued_job {
+    char *cmd_line;
+    struct pipeline *pipeline;
+    pid_t pid;
+    struct queued_job *next;
+} queued_job_t;
+
+//Represents the FIFO of background jobs held back by the parallelism cap
+typedef struct job_queue {
+    queued_job_t *head;
+    queued_job_t *tail;
+    int count;
+    int max_running;
+} job_queue_t;
+
+/**
+ * alloc_job_queue: allocates an empty job queue.
+ *
+ * max_running: The number of background jobs allowed to run at once; 0 uses the number of online CPUs.
+ *
+ * Returns: A pointer to the newly allocated queue; NULL if allocation fails.
+ */
+job_queue_t *alloc_job_queue(int max_running);
+
+/**
+ * queue_job: holds back a background job if the parallelism cap is reached or other jobs are
+ * already waiting. Queued jobs start in FIFO order as running background jobs finish. The words,
+ * assignments and redirections of a job that is one pipeline are expanded now; any other list is
+ * forked now into a held subshell. Either way, variables that change before it starts (e.g. in the
+ * loop that queues it) do not change what it runs.
+ *
+ * shell: The current shell state value.
+ *
+ * job: The and-or list of the job. Its text is copied.
+ *
+ * Returns: True if the job was queued; false if the caller should launch it now.
+ */
+bool queue_job(struct msh *shell, const struct and_or *job);
+
+/**
+ * dispatch_jobs: launches queued jobs while fewer background jobs than the cap are running.
+ * Called from the reap path after children have been reaped.
+ *
+ * shell: The current shell state value.
+ */
+void dispatch_jobs(struct msh *shell);
+
+/**
+ * print_job_queue: prints the number of running and queued jobs followed by every queued job in order.
+ *
+ * shell: The current shell state value.
+ */
+void print_job_queue(struct msh *shell);
+
+/**
+ * clear_job_queue: drops every queued job without running it. Held subshells are killed.
+ *
+ * queue: A pointer to the job queue.
+ *
+ * Returns: The number of jobs dropped.
+ */
+int clear_job_queue(job_queue_t *queue);
+
+/**
+ * forget_job_queue: drops every queued job in a forked child of the shell. The held subshells are the
+ * shell's, so they are left alone.
+ *
+ * queue: A pointer to the job queue.
+ */
+void forget_job_queue(job_queue_t *queue);
+
+/**
+ * forget_queued_job: drops the queued job of a held subshell that exited before it was released.
+ * Called from the reap path for processes that are not in the job table.
+ *
+ * queue: A pointer to the job queue; NULL is ignored.
+ *
+ * pid: The process ID that was reaped.
+ */
+void forget_queued_job(job_queue_t *queue, pid_t pid);
+
+/**
+ * free_job_queue: deallocates the queue and every job still in it.
+ *
+ * queue: A pointer to the job queue to be deallocated.
+ */
+void free_job_queue(job_queue_t *queue);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef _LAUNCH_H_
+#define _LAUNCH_H_
+
+#include "redirect.h"
+#include <sys/types.h>
+#include <signal.h>
+
+struct msh;
+
+//The entry point of a builtin command; returns the command's exit status
+typedef int builtin_main_t(struct msh *shell, int argc, char **argv);
+
+/**
+ * spawn_process: launches a program without copying the shell's address space
+ * (posix_spawn, which glibc implements with clone(CLONE_VM|CLONE_VFORK)).
+ *
+ * path: The path of the executable to run.
+ *
+ * argv: A NULL-terminated argument array passed to the program.
+ *
+ * envp: The NULL-terminated environment of the program (see environment in variables.h).
+ *
+ * redirects: The redirections of the command, applied after in_fd and out_fd; NULL for none.
+ *
+ * child_mask: The signal mask the child starts with (the mask the shell had
+ * before it blocked SIGCHLD).
+ *
+ * pgid: The process group to join; 0 makes the child the leader of a new group.
+ *
+ * in_fd: The descriptor to use as the child's standard input; -1 to inherit the shell's.
+ *
+ * out_fd: The descriptor to use as the child's standard output; -1 to inherit the shell's.
+ *
+ * Returns: The process ID of the child; -1 if the program could not be launched.
+ */
+pid_t spawn_process(const char *path, char **argv, char **envp, const redirections_t *redirects, const sigset_t *child_mask, pid_t pgid, int in_fd, int out_fd);
+
+/**
+ * fork_process: launches a program using fork and execve. This is the
+ * original launch path, kept as a fallback and for benchmarking.
+ *
+ * path: The path of the executable to run.
+ *
+ * argv: A NULL-terminated argument array passed to the program.
+ *
+ * envp: The NULL-terminated environment of the program.
+ *
+ * redirects: The redirections of the command, applied after in_fd and out_fd; NULL for none.
+ *
+ * child_mask: The signal mask the child starts with.
+ *
+ * pgid: The process group to join; 0 makes the child the leader of a new group.
+ *
+ * in_fd: The descriptor to use as the child's standard input; -1 to inherit the shell's.
+ *
+ * out_fd: The descriptor to use as the child's standard output; -1 to inherit the shell's.
+ *
+ * Returns: The process ID of the child; -1 if fork failed.
+ */
+pid_t fork_process(const char *path, char **argv, char **envp, const redirections_t *redirects, const sigset_t *child_mask, pid_t pgid, int in_fd, int out_fd);
+
+/**
+ * fork_builtin: runs a builtin in a forked child of the shell, without exec.
+ * The child exits with the builtin's return value.
+ *
+ * builtin: The function implementing the builtin.
+ *
+ * shell: The shell state passed to the builtin.
+ *
+ * argc: The number of arguments in argv.
+ *
+ * argv: A NULL-terminated argument array passed to the builtin.
+ *
+ * redirects: The redirections of the command, applied after in_fd and out_fd; NULL for none. The
+ * shell's other descriptors above standard error are closed.
+ *
+ * child_mask: The signal mask the child starts with.
+ *
+ * pgid: The process group to join; 0 makes the child the leader of a new group.
+ *
+ * in_fd: The descriptor to use as the child's standard input; -1 to inherit the shell's.
+ *
+ * out_fd: The descriptor to use as the child's standard output; -1 to inherit the shell's.
+ *
+ * Returns: The process ID of the child; -1 if fork failed.
+ */
+pid_t fork_builtin(builtin_main_t *builtin, struct msh *shell, int argc, char **argv, const redirections_t *redirects, const sigset_t *child_mask, pid_t pgid, int in_fd, int out_fd);
+
+#endif
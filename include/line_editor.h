@@ -0,0 +1,59 @@
+#ifndef _LINE_EDITOR_H_
+#define _LINE_EDITOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <termios.h>
+
+struct msh;
+
+//A minimal line editor for interactive use: typing, backspace, ctrl-u and ctrl-r history search
+typedef struct line_editor {
+    int fd;
+    struct termios saved;
+    char *buffer;
+    size_t len;
+    size_t capacity;
+    char pending[256];
+    size_t pending_start;
+    size_t pending_end;
+    bool searching;
+    char *pattern;
+    size_t pattern_len;
+    size_t pattern_capacity;
+    int match;
+} line_editor_t;
+
+/**
+ * alloc_line_editor: allocates a line editor for a terminal.
+ *
+ * fd: The terminal descriptor to read keys from; output goes to standard output.
+ *
+ * Returns: A pointer to the newly allocated editor; NULL if fd is not a terminal or allocation fails.
+ */
+line_editor_t *alloc_line_editor(int fd);
+
+/**
+ * edit_line: shows the prompt and lets the user edit a line with the terminal in raw mode. Signals
+ * that arrive meanwhile are handled by the event loop. ctrl-r starts a reverse incremental search
+ * of the history: typing refines it, ctrl-r again finds an older match, enter runs the match and
+ * escape keeps it for editing. ctrl-c discards the line.
+ *
+ * editor: A pointer to the editor.
+ *
+ * shell: The current shell state value.
+ *
+ * prompt: The prompt to show.
+ *
+ * Returns: The line (owned by the editor, valid until the next call); NULL at end of input.
+ */
+char *edit_line(line_editor_t *editor, struct msh *shell, const char *prompt);
+
+/**
+ * free_line_editor: deallocates the editor.
+ *
+ * editor: A pointer to the editor to be deallocated.
+ */
+void free_line_editor(line_editor_t *editor);
+
+#endif
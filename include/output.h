@@ -0,0 +1,65 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stddef.h>
+
+#define OUTPUT_BUFFER_SIZE 8192
+
+//Where output is captured instead of written, e.g. the output of a command substitution: reserve
+//returns room for at least size more bytes after what was captured so far, and commit keeps the
+//first n of them
+typedef struct capture {
+    char *(*reserve)(void *context, size_t size);
+    void (*commit)(void *context, size_t n);
+    void *context;
+} capture_t;
+
+/**
+ * out_write: appends bytes to the builtin output buffer, writing the buffer
+ * to standard output whenever it fills up.
+ *
+ * data: The bytes to write.
+ *
+ * len: The number of bytes to write.
+ */
+void out_write(const char *data, size_t len);
+
+/**
+ * out_puts: appends a string (without a trailing newline) to the builtin output buffer.
+ *
+ * str: The NUL-terminated string to write.
+ */
+void out_puts(const char *str);
+
+/**
+ * out_putc: appends a single character to the builtin output buffer.
+ *
+ * c: The character to write.
+ */
+void out_putc(char c);
+
+/**
+ * out_printf: formats a string with printf-style arguments into the builtin output buffer.
+ *
+ * format: The printf format string.
+ */
+void out_printf(const char *format, ...);
+
+/**
+ * out_capture: sends the builtin output straight to a capture instead of standard output, until it
+ * is called again. What is buffered for standard output is written out first.
+ *
+ * capture: The capture; NULL to write to standard output again.
+ *
+ * Returns: The capture that was in place before; NULL if there was none.
+ */
+const capture_t *out_capture(const capture_t *capture);
+
+/**
+ * out_flush: writes everything in the builtin output buffer to standard output.
+ *
+ * Returns: 0 on success; -1 if the write failed.
+ */
+int out_flush();
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include "shell.h"
+
+/**
+ * builtin_parallel: the parallel builtin. Runs a command once per argument with at most N items
+ * running at a time, starting the next item whenever one finishes. Every item is a job of its own,
+ * so it shows up in jobs and can be signaled with kill. The output of each item is captured and
+ * printed as a group in argument order, and items that fail are reported on standard error.
+ *
+ * shell: The current shell state value.
+ *
+ * argc: The number of arguments in argv.
+ *
+ * argv: "parallel [-j N] COMMAND [ARG...] [::: ITEM...]". Every "{}" in the command is replaced by
+ * the item, or the item is appended if there is none. Without ":::", items are read from standard
+ * input, one per line. N defaults to the job queue's parallelism cap.
+ *
+ * Returns: The number of items that failed or never ran, at most 101; 1 on a usage error.
+ */
+int builtin_parallel(msh_t *shell, int argc, char **argv);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _PARSE_CACHE_H_
+#define _PARSE_CACHE_H_
+
+#include "parser.h"
+#include <stdint.h>
+#include <stddef.h>
+
+//The memory the shell's parse cache may hold
+#ifndef PARSE_CACHE_BYTES
+#define PARSE_CACHE_BYTES (1 << 20)
+#endif
+
+//A cached line and its parse tree, linked into a hash bucket and into the LRU list
+typedef struct parse_entry {
+    uint64_t hash;
+    char *line;
+    size_t len;
+    parse_tree_t *tree;
+    size_t bytes;
+    struct parse_entry *next;
+    struct parse_entry *newer;
+    struct parse_entry *older;
+} parse_entry_t;
+
+//Represents the state of the line -> parse tree cache
+typedef struct parse_cache {
+    parse_entry_t **buckets;
+    int num_buckets;
+    int count;
+    parse_entry_t *newest;
+    parse_entry_t *oldest;
+    size_t bytes;
+    size_t max_bytes;
+    long long hits;
+    long long misses;
+} parse_cache_t;
+
+/**
+ * alloc_parse_cache: allocates an empty parse cache.
+ *
+ * max_bytes: The most memory the cached lines and trees may hold; the least recently used are
+ * evicted to stay under it. 0 disables caching.
+ *
+ * Returns: A pointer to the newly allocated cache; NULL if allocation fails.
+ */
+parse_cache_t *alloc_parse_cache(size_t max_bytes);
+
+/**
+ * acquire_parse_tree: parses a line, or finds the tree of an identical line parsed before.
+ * The builtin of every command of the tree is resolved, and lists with compound commands are
+ * compiled (see compile.h). Lines that fail to parse are not cached.
+ *
+ * cache: A pointer to the parse cache; NULL parses without caching.
+ *
+ * line: The command line; it is not modified.
+ *
+ * tree: Receives the tree, to be given back with release_parse_tree; NULL unless PARSE_OK is returned.
+ * The tree may be shared and must not be modified.
+ *
+ * error: Receives a description of the syntax error when PARSE_ERROR is returned; may be NULL.
+ *
+ * Returns: As for parse_line.
+ */
+int acquire_parse_tree(parse_cache_t *cache, const char *line, parse_tree_t **tree, const char **error);
+
+/**
+ * release_parse_tree: gives back a tree from acquire_parse_tree. It is freed once neither the cache
+ * nor anyone else holds it, so a tree evicted while it runs stays valid.
+ *
+ * tree: The tree; NULL is ignored.
+ */
+void release_parse_tree(parse_tree_t *tree);
+
+/**
+ * print_parse_cache: prints the size of the cache and its hit and miss counts to standard output.
+ *
+ * cache: A pointer to the parse cache.
+ */
+void print_parse_cache(parse_cache_t *cache);
+
+/**
+ * clear_parse_cache: removes every entry from the cache. The counters are kept.
+ *
+ * cache: A pointer to the parse cache to clear.
+ */
+void clear_parse_cache(parse_cache_t *cache);
+
+/**
+ * free_parse_cache: deallocates the cache and releases its trees.
+ *
+ * cache: A pointer to the parse cache; NULL is ignored.
+ */
+void free_parse_cache(parse_cache_t *cache);
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef _PARSER_H_
+#define _PARSER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Results of parse_line
+#define PARSE_OK 0
+#define PARSE_ERROR 1
+//The line ends inside a quote or after an operator that needs another command
+#define PARSE_INCOMPLETE 2
+
+//Kinds of redirections: "<", ">", ">>", "<&", ">&", "<<" (and "<<-") and "<<<"
+typedef enum redirect_type {REDIRECT_IN, REDIRECT_OUT, REDIRECT_APPEND, REDIRECT_DUP_IN, REDIRECT_DUP_OUT,
+                            REDIRECT_HERE_DOC, REDIRECT_HERE_STRING} redirect_type_t;
+
+//Kinds of commands: a simple command, the compound commands and a function definition
+typedef enum command_type {COMMAND_SIMPLE, COMMAND_IF, COMMAND_WHILE, COMMAND_UNTIL, COMMAND_FOR, COMMAND_GROUP, COMMAND_FUNCTION} command_type_t;
+
+//How a pipeline of an and-or list is joined to the one before it
+typedef enum connector {CONNECT_NONE, CONNECT_AND, CONNECT_OR} connector_t;
+
+//Kinds of parameters: $NAME or ${NAME}, $0 to $9 or ${N}, $#, "$@" (each parameter a word), $* (the
+//parameters joined by spaces), $?, $! and $$; and command substitutions, $(LIST) and `LIST`, which
+//are replaced by the output of LIST
+typedef enum param_type {
+    PARAM_VARIABLE,
+    PARAM_POSITIONAL,
+    PARAM_COUNT,
+    PARAM_ALL,
+    PARAM_ALL_JOINED,
+    PARAM_STATUS,
+    PARAM_BACKGROUND_PID,
+    PARAM_PID,
+    PARAM_COMMAND
+} param_type_t;
+
+//A parameter expansion inside a word, inserted at offset in the word's text. op is what ${NAME OP WORD}
+//does: '-' expands word if the parameter is unset, '=' also assigns it, '+' expands word only if it
+//is set; with colon, an empty parameter counts as unset. '#' is ${#NAME}, the length of the value;
+//0 is a plain expansion; word_text and word are the text and expansions of WORD. quoted is set
+//inside "...", where the value is not split into fields. A command substitution has the lists it
+//runs, parsed into the tree of the line it is on.
+typedef struct expansion {
+    param_type_t type;
+    const struct symbol *symbol;
+    int index;
+    char op;
+    bool colon;
+    bool quoted;
+    size_t offset;
+    struct word *word;
+    char *word_text;
+    struct and_or *lists;
+    struct parse_tree *tree;
+    struct expansion *next;
+} expansion_t;
+
+//What a word needs at run time, beside its text (which has quotes removed and the expansions cut
+//out): its expansions in order. quoted is set if the word has quotes in it, which keep it as a
+//(possibly empty) argument when everything in it expands to nothing; assignment is set for
+//NAME=VALUE arguments of export, which are not split into fields.
+typedef struct word {
+    expansion_t *expansions;
+    bool quoted;
+    bool assignment;
+} word_t;
+
+//A NAME=VALUE word before a command's name. expand is NULL if the value has no expansions.
+typedef struct assignment {
+    const struct symbol *symbol;
+    char *value;
+    word_t *expand;
+    struct assignment *next;
+} assignment_t;
+
+//A redirection of descriptor fd to the file (or, for the dup kinds, the descriptor) named by target.
+//For a here-document, target is its body; for a here-string, the word whose value, and a newline,
+//is read. expand is NULL if the target has no expansions.
+typedef struct redirect {
+    redirect_type_t type;
+    int fd;
+    char *target;
+    word_t *expand;
+    struct redirect *next;
+} redirect_t;
+
+//The parts of a compound command, each a sequence of and-or lists. if: condition, body (then) and
+//else_body (else, or an elif as a nested if); while and until: condition and body; for: name (and
+//its symbol), words (num_words is -1 without "in"; expand as for a simple command) and body;
+//{ ... }: body; a function definition: name and body, which holds the compound command the function runs.
+typedef struct compound {
+    struct and_or *condition;
+    struct and_or *body;
+    struct and_or *else_body;
+    char *name;
+    const struct symbol *symbol;
+    int num_words;
+    char **words;
+    word_t **expand;
+} compound_t;
+
+//A command. A simple command has its assignments, its words with quoting removed, NULL-terminated,
+//and its redirections in order. expand is NULL if no word has expansions; otherwise, expand[i] is
+//what argv[i] needs expanded (NULL for a plain word). A compound command has no words (argv is
+//empty) and its parts in compound. builtin is the builtin argv[0] names, filled in by the parse
+//cache when argv[0] has no expansions; parse_line leaves it NULL.
+typedef struct command {
+    command_type_t type;
+    assignment_t *assignments;
+    int argc;
+    char **argv;
+    word_t **expand;
+    redirect_t *redirects;
+    compound_t *compound;
+    const struct builtin *builtin;
+    struct command *next;
+} command_t;
+
+//Commands connected by pipes; connector joins it to the previous pipeline of its and-or list
+typedef struct pipeline {
+    int num_commands;
+    command_t *commands;
+    connector_t connector;
+    struct pipeline *next;
+} pipeline_t;
+
+//Pipelines joined by && and ||, run as one job. text is the source of the list as typed, from
+//the end of the previous list to its own terminator, which is what history and the job table show.
+//program is the bytecode of a list that holds compound commands (see compile.h); NULL until compiled.
+typedef struct and_or {
+    int num_pipelines;
+    pipeline_t *pipelines;
+    int job_type;
+    char *text;
+    struct program *program;
+    struct and_or *next;
+} and_or_t;
+
+//A parsed line: its and-or lists in order. Every node and string lives in the tree's arena.
+//refs counts the holders of a shared tree (see parse_cache.h); parse_line sets it to 1.
+typedef struct parse_tree {
+    int num_lists;
+    and_or_t *lists;
+    struct arena_block *arena;
+    int refs;
+} parse_tree_t;
+
+//The state of one parse. Nothing is kept between calls, so parses may nest (e.g. when a
+//command run from a parsed line parses another line). special is the bitmap of the bytes of the
+//line that quotes, blanks, operators and expansions may start at (see scan.h); the runs between them
+//are copied without being looked at byte by byte. expansions collects those of the word being read,
+//and heredocs the here-documents whose bodies start after the next newline.
+typedef struct parser {
+    const char *line;
+    size_t len;
+    const uint64_t *special;
+    const char *pos;
+    parse_tree_t *tree;
+    char *word;
+    size_t word_cap;
+    const char *error;
+    expansion_t *expansions;
+    expansion_t **last_expansion;
+    struct heredoc *heredocs;
+    struct heredoc **last_heredoc;
+} parser_t;
+
+/**
+ * parse_line: parses a command line into a tree of and-or lists, pipelines and commands.
+ * Lists are separated by ';', '&' (which runs the list in the background) or newlines;
+ * pipelines by "&&" and "||"; commands by '|'. Words may be quoted with '...' (literal),
+ * "..." (where backslash escapes \, " and $) or a backslash, and a word starting with '#'
+ * starts a comment. Outside '...', $NAME, ${NAME}, ${NAME:-WORD} (and :=, :+, without the colon
+ * too), ${#NAME} and the special parameters $0-$9, $#, $@, $*, $?, $! and $$ are recorded as
+ * expansions, with NAME interned as a symbol (see variables.h), and so are command substitutions,
+ * $(LIST) and `LIST` (where a backslash escapes $, ` and itself), whose LIST is parsed with the line. Words of the form NAME=VALUE
+ * before a command's name are assignments. Redirections are "<", ">", ">>", "<&", ">&", "<<<" (a here-string)
+ * and "<<" (a here-document), optionally preceded by a descriptor number. The body of a here-document
+ * is the lines after the one it is on, up to its delimiter; "<<-" strips their leading tabs. The body
+ * is expanded like a quoted word unless the delimiter has quotes. A command may also be "if LIST; then LIST; [elif LIST; then LIST;]... [else LIST;] fi",
+ * "while LIST; do LIST; done", "until LIST; do LIST; done", "for NAME [in WORD...]; do LIST; done",
+ * "{ LIST; }" or a function definition, "NAME() COMMAND", where COMMAND is one of those. Reserved
+ * words are only recognized unquoted, at the start of a command.
+ *
+ * line: The command line; it is not modified.
+ *
+ * tree: Receives the parse tree, to be freed with free_parse_tree; NULL unless PARSE_OK is returned.
+ *
+ * error: Receives a description of the syntax error when PARSE_ERROR is returned; may be NULL.
+ *
+ * Returns: PARSE_OK, PARSE_ERROR, or PARSE_INCOMPLETE if the line ends inside a quote, inside a
+ * compound command or after "&&", "||" or '|'.
+ */
+int parse_line(const char *line, parse_tree_t **tree, const char **error);
+
+/**
+ * parse_tree_alloc: allocates memory that lives as long as a parse tree, e.g. for the code compiled from it.
+ *
+ * tree: The tree.
+ *
+ * size: The number of bytes needed.
+ *
+ * Returns: The memory, aligned for any node; it is freed with the tree.
+ */
+void *parse_tree_alloc(parse_tree_t *tree, size_t size);
+
+/**
+ * parse_tree_size: the memory a parse tree holds, for bounding caches of trees.
+ *
+ * tree: The tree.
+ *
+ * Returns: The number of bytes allocated for the tree and its arena.
+ */
+size_t parse_tree_size(const parse_tree_t *tree);
+
+/**
+ * free_parse_tree: frees a parse tree and every string in it.
+ *
+ * tree: The tree to free; NULL is ignored.
+ */
+void free_parse_tree(parse_tree_t *tree);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _PATH_CACHE_H_
+#define _PATH_CACHE_H_
+
+#include <stdbool.h>
+#include <time.h>
+
+//A resolved command: the name typed by the user and the full path it maps to
+typedef struct path_entry {
+    char *name;
+    char *path;
+    int hits;
+    struct path_entry *next;
+} path_entry_t;
+
+//Represents the state of the command name -> path hash table
+typedef struct path_cache {
+    path_entry_t **buckets;
+    int num_buckets;
+    int count;
+    char *path_env;
+    char **dirs;
+    struct timespec *dir_mtimes;
+    int num_dirs;
+    int inotify_fd;
+} path_cache_t;
+
+/**
+ * alloc_path_cache: allocates and initializes an empty command path cache.
+ *
+ * Returns: A pointer to the newly allocated cache; NULL if allocation fails.
+ */
+path_cache_t *alloc_path_cache();
+
+/**
+ * resolve_command: finds the executable that a command name refers to.
+ *
+ * cache: A pointer to the path cache used to remember earlier lookups.
+ *
+ * name: The command name. Names containing a '/' are returned as they are.
+ *
+ * Returns: The path of the executable (owned by the cache); NULL if the command cannot be found in PATH.
+ */
+const char *resolve_command(path_cache_t *cache, const char *name);
+
+/**
+ * hash_command: resolves a command and stores it in the cache without running it.
+ *
+ * cache: A pointer to the path cache.
+ *
+ * name: The command name to look up.
+ *
+ * Returns: True if the command was found; otherwise, false.
+ */
+bool hash_command(path_cache_t *cache, const char *name);
+
+/**
+ * print_path_cache: prints every cached command with its hit count to standard output.
+ *
+ * cache: A pointer to the path cache to print.
+ */
+void print_path_cache(path_cache_t *cache);
+
+/**
+ * clear_path_cache: removes every entry from the cache.
+ *
+ * cache: A pointer to the path cache to clear.
+ */
+void clear_path_cache(path_cache_t *cache);
+
+/**
+ * free_path_cache: deallocates the cache and all of its entries.
+ *
+ * cache: A pointer to the path cache to be deallocated.
+ */
+void free_path_cache(path_cache_t *cache);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "shell.h"
+#include "parser.h"
+
+/**
+ * run_pipeline: runs a parsed pipeline, e.g. "cat log | grep error | wc -l". The words of its commands
+ * are expanded first (see expand.h). A function or builtin on its own runs inside the shell, in the
+ * foreground, with any variables assigned before its name set and its redirections applied to the shell
+ * while it runs; anything else is launched as a single job, with those variables in its environment and
+ * its redirections applied in its processes. A command of assignments alone sets them. Compound
+ * commands are run by the VM (see vm.h); here, they are only rejected inside pipelines.
+ *
+ * shell: The current shell state value.
+ *
+ * pipeline: The pipeline to run, from a tree given by acquire_parse_tree (which resolves its builtins).
+ *
+ * cmd_line: The command line recorded for the job.
+ *
+ * job_type: FOREGROUND to wait for the pipeline to finish; BACKGROUND to return immediately.
+ *
+ * Returns: 0 if the pipeline ran or at least one of its stages was launched; otherwise, -1.
+ * shell->last_status is set when the pipeline could not run.
+ */
+int run_pipeline(msh_t *shell, const pipeline_t *pipeline, const char *cmd_line, int job_type);
+
+/**
+ * launch_pipeline: launches already separated commands connected by pipes as a single job.
+ * All processes share one process group, led by the first process that starts.
+ *
+ * shell: The current shell state value.
+ *
+ * stages: An array of argv arrays, one per command of the pipeline.
+ *
+ * stage_argc: The number of arguments of each command.
+ *
+ * stage_envp: The environment of each program; NULL to give every program the shell's environment.
+ *
+ * stage_redirects: The redirections of each command, opened (see redirect.h); NULL if none has any.
+ *
+ * num_stages: The number of commands in the pipeline.
+ *
+ * cmd_line: The command line recorded for the job.
+ *
+ * job_type: FOREGROUND to wait for the pipeline to finish; BACKGROUND to return immediately.
+ *
+ * Returns: 0 if at least one stage of the pipeline was launched; otherwise, -1.
+ */
+int launch_pipeline(msh_t *shell, char ***stages, int *stage_argc, char ***stage_envp, const redirections_t *stage_redirects, int num_stages, const char *cmd_line, int job_type);
+
+/**
+ * splice_cat: the builtin cat used inside pipelines. Copies the named files
+ * (or standard input) to standard output with splice(2) when either side is a
+ * pipe, so the data never passes through user space. If any option is
+ * given, the real cat runs instead.
+ *
+ * shell: The current shell state value.
+ *
+ * argc: The number of arguments in argv.
+ *
+ * argv: "cat" followed by zero or more file names ("-" is standard input).
+ *
+ * Returns: 0 on success; 1 if any file could not be copied.
+ */
+int splice_cat(msh_t *shell, int argc, char **argv);
+
+/**
+ * splice_tee: the builtin tee used inside pipelines. Duplicates standard input
+ * to standard output with tee(2) and moves it into the named file with
+ * splice(2) when the descriptors allow it. Options other than -a run the
+ * real tee instead.
+ *
+ * shell: The current shell state value.
+ *
+ * argc: The number of arguments in argv.
+ *
+ * argv: "tee", an optional "-a" to append, and zero or more file names.
+ *
+ * Returns: 0 on success; 1 if any file could not be written.
+ */
+int splice_tee(msh_t *shell, int argc, char **argv);
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _REDIRECT_H_
+#define _REDIRECT_H_
+
+#include "parser.h"
+#include <stdbool.h>
+#include <spawn.h>
+
+struct msh;
+
+//What a redirection does to a descriptor of a command: fd becomes a copy of source, or is closed if
+//source is -1. owned is set for a source the shell opened (a file or a here-document), which it
+//closes once the command has its copy.
+typedef struct fd_action {
+    int fd;
+    int source;
+    bool owned;
+} fd_action_t;
+
+//The redirections of one command, opened and ready to apply, in order
+typedef struct redirections {
+    int num_actions;
+    fd_action_t *actions;
+} redirections_t;
+
+//A descriptor the shell changed for a builtin, function or compound command running in it, and a
+//copy of what it was (-1 if it was not open)
+typedef struct saved_fd {
+    int fd;
+    int copy;
+} saved_fd_t;
+
+//The descriptors changed in the shell, innermost last, to be put back when what changed them is done
+typedef struct fd_stack {
+    saved_fd_t *saved;
+    int count;
+    int capacity;
+} fd_stack_t;
+
+/**
+ * open_redirections: opens what the redirections of a command read and write, in the shell: files with
+ * O_CLOEXEC, so only the command gets them, and here-documents and here-strings as anonymous memory
+ * files (memfd_create) that never touch the filesystem. Targets are expanded first (see expand.h).
+ *
+ * shell: The current shell state value.
+ *
+ * redirects: The redirections of the command, in order.
+ *
+ * out: Receives the actions, on the expansion stack. With no redirections, it is empty.
+ *
+ * Returns: 0 on success; -1 if a file could not be opened or a target is not valid. The error is
+ * printed and nothing is left open.
+ */
+int open_redirections(struct msh *shell, const redirect_t *redirects, redirections_t *out);
+
+/**
+ * close_redirections: closes the descriptors open_redirections opened, once the command has its copies.
+ *
+ * redirections: The redirections.
+ */
+void close_redirections(const redirections_t *redirections);
+
+/**
+ * apply_redirections: applies redirections in a child process, with dup2, before it runs the command.
+ * The owned sources are closed after. Exits the child if a descriptor cannot be duplicated.
+ *
+ * redirections: The redirections; NULL or empty for none.
+ */
+void apply_redirections(const redirections_t *redirections);
+
+/**
+ * add_spawn_redirections: adds redirections to the file actions of posix_spawn, after those that set
+ * up the pipes of the command.
+ *
+ * actions: The file actions.
+ *
+ * redirections: The redirections; NULL or empty for none.
+ */
+void add_spawn_redirections(posix_spawn_file_actions_t *actions, const redirections_t *redirections);
+
+/**
+ * push_redirections: applies redirections to the shell itself, for a command that runs in it. Each
+ * descriptor changed is saved on the shell's descriptor stack first. Buffered output is written out
+ * before standard output or error changes.
+ *
+ * shell: The current shell state value.
+ *
+ * redirections: The redirections. Their owned sources are closed; the shell has its copies.
+ *
+ * Returns: The depth of the descriptor stack before, for pop_redirections; -1 if a descriptor could
+ * not be changed, in which case the error is printed and nothing is changed.
+ */
+int push_redirections(struct msh *shell, const redirections_t *redirections);
+
+/**
+ * pop_redirections: puts back the descriptors saved on the shell's descriptor stack above a depth,
+ * after writing out buffered output.
+ *
+ * shell: The current shell state value.
+ *
+ * depth: The depth, from push_redirections.
+ */
+void pop_redirections(struct msh *shell, int depth);
+
+/**
+ * free_fd_stack: frees the descriptor stack. Nothing may be saved on it.
+ *
+ * stack: The stack.
+ */
+void free_fd_stack(fd_stack_t *stack);
+
+#endif
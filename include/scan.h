@@ -0,0 +1,64 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Builds the bitmap of the special bytes of a line
+typedef void classify_fn_t(const char *line, size_t len, uint64_t *bitmap);
+
+//An implementation of the classifier: "avx2", "sse2" or "scalar"
+typedef struct scan_impl {
+    const char *name;
+    classify_fn_t *classify;
+} scan_impl_t;
+
+/**
+ * classify_line: builds a bitmap of the special bytes of a line in one pass, with the fastest
+ * implementation the CPU supports (chosen on the first call). The special bytes are the ones a
+ * tokenizer must look at: blanks and control characters (every byte up to ' '), quotes,
+ * backquote and backslash, $ (which, like the backquote, starts an expansion) and the operator characters ; & | < and >. Every other byte is part of a plain word.
+ *
+ * line: The line.
+ *
+ * len: The number of bytes to classify.
+ *
+ * bitmap: Receives (len + 63) / 64 words. Bit i % 64 of word i / 64 is set if line[i] is special;
+ * the bits past len are clear.
+ */
+void classify_line(const char *line, size_t len, uint64_t *bitmap);
+
+/**
+ * scan_implementations: lists the classifiers this CPU can run, fastest first. Building with
+ * -DSCAN_SCALAR leaves only the scalar one.
+ *
+ * impls: Receives the list.
+ *
+ * Returns: The number of implementations.
+ */
+int scan_implementations(const scan_impl_t **impls);
+
+/**
+ * select_scan_implementation: makes classify_line use a given implementation, e.g. to compare them.
+ *
+ * name: The name of the implementation.
+ *
+ * Returns: True if this CPU supports it; otherwise, false and the current choice is kept.
+ */
+bool select_scan_implementation(const char *name);
+
+/**
+ * next_special: finds the first set bit of a bitmap at or after a position.
+ *
+ * bitmap: A bitmap from classify_line.
+ *
+ * len: The length of the line it was built for.
+ *
+ * pos: The position to start at.
+ *
+ * Returns: The position of the next special byte; len if there is none.
+ */
+size_t next_special(const uint64_t *bitmap, size_t len, size_t pos);
+
+#endif
@@ -1,27 +1,70 @@
 #ifndef _SHELL_H_
 #define _SHELL_H_
 #include <stdbool.h>
+#include <sys/time.h>
 #include "job.h"
 #include "history.h"
+#include "path_cache.h"
+#include "job_queue.h"
 #include "signal_handlers.h"
+#include "parser.h"
+#include "parse_cache.h"
+#include "variables.h"
+#include "redirect.h"
+#include "expand.h"
 typedef struct msh{
-    int max_jobs;
     int max_line;
     int max_history;
-    job_t *jobs;
+    job_table_t *jobs;
+    job_queue_t *queue;
     history_t* history;
+    //False when commands are not added to the history (in scripts, unless -H is given)
+    bool record_history;
+    path_cache_t* path_cache;
+    parse_cache_t* parse_cache;
+    variable_table_t* variables;
+    //The words of the commands running, once expanded
+    expand_stack_t expand_stack;
+    //The descriptors redirected for the builtins, functions and compound commands running in the shell
+    fd_stack_t fd_stack;
+    struct function_table* functions;
+    //The positional parameters, starting with $0: the arguments of the function being run, starting
+    //with its name, or those of the script; none otherwise
+    int num_params;
+    char **params;
+    //Set once exit has run inside a compound command or function, to unwind everything running
+    bool exiting;
     pid_t curr_foreground_pid;
+    pid_t status_pid;
+    int last_status;
+    //Command substitutions run so far: a command with no name has the status of the last one it ran
+    unsigned int num_substitutions;
+    //$$, the process ID of the shell (kept by its subshells), and $!, the last job started in the background
+    pid_t pid;
+    pid_t last_background_pid;
+    //CPU time of the foreground processes reaped since the current command started
+    struct timeval fg_user_time;
+    struct timeval fg_sys_time;
+    int signal_fd;
+    int epoll_fd;
+    int input_fd;
+    sigset_t child_mask;
+    void (*child_hook)(struct msh *shell, pid_t pid, int status);
+    void *child_hook_data;
 }msh_t;
 
 extern msh_t* shell;
+
+//evaluate_partial: the line needs another line of input
+#define EVALUATE_INCOMPLETE 1
 #endif
 
  /*
 * alloc_shell: allocates and initializes the state of the shell
 *
-* max_jobs: The maximum number of jobs that can be in existence at any point in time.
+* max_jobs: The number of job slots allocated up front. The job table grows beyond it on demand.
 *
-* max_line: The maximum number of characters that can be entered for any specific command line.
+* max_line: The maximum number of characters that can be entered for any specific command line; 0 for no limit.
 *
 * max_history: The maximum number of saved history commands for the shell.
 *
@@ -38,10 +81,24 @@ msh_t *alloc_shell(int max_jobs, int max_line, int max_history);
 *
 * Returns: NULL no other commands can be parsed; otherwise, it returns a parsed command from the command line.
 *
-* Please note this function does modify the ``line`` parameter.
+* Please note this function does modify the ``line`` parameter. It keeps its position in a static
+* variable; parse_tok_r keeps it in the caller's instead. The shell itself parses lines with parse_line (parser.h).
 */
 char *parse_tok(char *line, int *job_type);
 
+/**
+* parse_tok_r: the reentrant form of parse_tok.
+*
+* line: the command line to parse; NULL to continue parsing the line whose position is in saveptr.
+*
+* job_type: as for parse_tok.
+*
+* saveptr: keeps the position in the line between calls.
+*
+* Returns: as for parse_tok.
+*/
+char *parse_tok_r(char *line, int *job_type, char **saveptr);
+
 /**
 * separate_args: Separates the arguments of command and places them in an allocated array returned by this function
 *
@@ -52,21 +109,88 @@ char *parse_tok(char *line, int *job_type);
 * is_builtin: true if the command is a built-in command; otherwise false.
 *
 * Returns: NULL is line contains no arguments; otherwise, a newly allocated array of strings that represents the arguments of the command (similar to argv). Make sure the array includes a NULL value in its last location.
-* Note: The user is responsible for freeing the memory return by this function!
+* Note: The user is responsible for freeing the memory return by this function! The strings live in the same allocation as the array, so a single free() of the array releases them; line is not modified.
 */
 char **separate_args(char *line, int *argc,bool* is_builtin);
 
 /*
-* evaluate - executes the provided command line string
+* waitfg - blocks until the current foreground job finishes or is stopped, handling signals from the event loop meanwhile
 *
 * shell - the current shell state value
+*/
+void waitfg(msh_t *shell);
+
+/*
+* evaluate - parses the provided command line string and executes its and-or lists in order.
+*     A line with a syntax error is reported and not run at all (the exit status becomes 2).
 *
-* line - the command line string to evaluate
+* shell - the current shell state value
+*
+* line - the command line string to evaluate; it is not modified
 *
 * Returns: non-zero if the command executed wants the shell program to close. Otherwise, a 0 is returned.
 */
 int evaluate(msh_t *shell, char *line);
 
+/*
+* evaluate_partial - evaluates a line that the next line of input may still complete. A line that ends inside a
+*     quote, after a backslash or after "&&", "||" or '|' is neither run nor reported.
+*
+* shell - the current shell state value
+*
+* line - the command line string to evaluate; it is not modified
+*
+* Returns: EVALUATE_INCOMPLETE if the line needs another line; otherwise, as evaluate.
+*/
+int evaluate_partial(msh_t *shell, char *line);
+
+/*
+* launch_background - starts an and-or list as a background job. A single pipeline is launched
+*     directly; a list of several pipelines runs in a forked copy of the shell, which is the job.
+*
+* shell - the current shell state value
+*
+* list - the and-or list to start
+*/
+void launch_background(msh_t *shell, const and_or_t *list);
+
+/*
+* fork_subshell - forks the copy of the shell that runs an and-or list in the background, in a process group
+*     of its own. It is not added to the job table. A held subshell waits for release_subshell before it runs
+*     the list, but it is a copy of the shell as it is now, so the list sees the variables as they were when it
+*     was forked (this is how the job queue holds back lists that cannot be expanded ahead of time).
+*
+* shell - the current shell state value
+*
+* list - the and-or list to run
+*
+* held - true to have the subshell wait for release_subshell
+*
+* Returns: The process ID of the subshell; -1 if fork failed.
+*/
+pid_t fork_subshell(msh_t *shell, const and_or_t *list, bool held);
+
+/*
+* release_subshell - lets a subshell forked held by fork_subshell run its list.
+*
+* pid - the process ID of the subshell
+*
+* Returns: True if the subshell was released; false if it no longer exists.
+*/
+bool release_subshell(pid_t pid);
+
+/*
+* run_lists - runs and-or lists in order inside the shell, like a line, but without recording or timing them:
+*     the list of a command substitution. A list ending in '&' starts as a background job.
+*
+* shell - the current shell state value; shell->last_status receives the exit status of the last list
+*
+* lists - the and-or lists; lists that hold compound commands must be compiled
+*
+* Returns: -1 if a list ran exit; otherwise, 0.
+*/
+int run_lists(msh_t *shell, const and_or_t *lists);
+
 /*
 * exit_shell - Closes down the shell by deallocating the shell state.
 *
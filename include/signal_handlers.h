@@ -1,6 +1,29 @@
 #ifndef _SIGNAL_HANDLERS_H_
 #define _SIGNAL_HANDLERS_H_
 
-void initialize_signal_handlers();
+#include <signal.h>
+
+struct msh;
+
+/**
+ * initialize_signal_handlers: blocks SIGCHLD, SIGINT and SIGTSTP and routes
+ * them to a signalfd, so they are handled by the shell's event loop in normal
+ * context instead of in asynchronous handlers.
+ *
+ * child_mask: Receives the signal mask the shell had before, which launched children start with.
+ *
+ * Returns: The signalfd descriptor; -1 if it could not be created.
+ */
+int initialize_signal_handlers(sigset_t *child_mask);
+
+/**
+ * handle_signals: reads every pending signal from the shell's signalfd,
+ * forwards ctrl-c and ctrl-z to the foreground job, reaps every child
+ * that has exited, stopped or continued, and starts queued jobs in the
+ * slots that freed up.
+ *
+ * shell: The current shell state value.
+ */
+void handle_signals(struct msh *shell);
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef _SUBSTITUTE_H_
+#define _SUBSTITUTE_H_
+
+#include "shell.h"
+#include "output.h"
+
+/**
+ * substitute: runs the list of a command substitution and captures its output. A list of builtins
+ * that only write output (echo, printf, test, ...) runs in the shell, and what they write goes straight
+ * into the capture (see out_capture in output.h). Anything else runs in a forked copy of the shell, as a
+ * foreground job whose standard output is a pipe; the pipe is read into the capture as the output comes,
+ * with no temporary file, and the child is reaped like any other job.
+ *
+ * shell: The current shell state value; shell->last_status receives the exit status of the list.
+ *
+ * expansion: The command substitution (PARAM_COMMAND).
+ *
+ * capture: Where the output goes.
+ */
+void substitute(msh_t *shell, const expansion_t *expansion, const capture_t *capture);
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef _VARIABLES_H_
+#define _VARIABLES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//An interned name. Every use of a name gets the same symbol, so the parser resolves a variable's
+//name once and lookups index the variable table with id, without hashing or comparing the name.
+//Symbols live as long as the process and are shared by every variable table.
+typedef struct symbol {
+    const char *name;
+    size_t len;
+    uint32_t hash;
+    int id;
+    struct symbol *next;
+} symbol_t;
+
+//The variable is passed to the programs the shell runs
+#define VARIABLE_EXPORTED 0x1
+
+//A shell variable. value is NULL while it is not set; its buffer holds capacity bytes and is
+//reused by shorter values, so a loop setting it does not allocate.
+typedef struct variable {
+    char *value;
+    size_t len;
+    size_t capacity;
+    int flags;
+} variable_t;
+
+//Represents the state of the shell's variables: one variable for every symbol, indexed by its id,
+//and the environment built from the exported ones. envp is kept until an exported variable changes.
+typedef struct variable_table {
+    variable_t *variables;
+    int num_variables;
+    int num_exported;
+    char **envp;
+} variable_table_t;
+
+/**
+ * intern_symbol: finds the symbol of a name, creating it the first time the name is seen.
+ *
+ * name: The name; it need not be NUL-terminated.
+ *
+ * len: The length of the name.
+ *
+ * Returns: The symbol. Exits the shell if memory cannot be allocated.
+ */
+const symbol_t *intern_symbol(const char *name, size_t len);
+
+/**
+ * is_variable_name: checks whether a string is a valid variable name: a letter or underscore
+ * followed by letters, digits and underscores.
+ *
+ * name: The string.
+ *
+ * len: Its length.
+ *
+ * Returns: True if it is a valid name.
+ */
+bool is_variable_name(const char *name, size_t len);
+
+/**
+ * alloc_variables: allocates an empty variable table.
+ *
+ * Returns: A pointer to the newly allocated table; NULL if allocation fails.
+ */
+variable_table_t *alloc_variables();
+
+/**
+ * import_environment: sets and exports a variable for every NAME=VALUE entry of an environment.
+ * Entries that are not valid assignments are skipped.
+ *
+ * table: A pointer to the variable table.
+ *
+ * envp: The environment, NULL-terminated (e.g. environ).
+ */
+void import_environment(variable_table_t *table, char **envp);
+
+/**
+ * symbol_value: looks up the value of a variable.
+ *
+ * table: A pointer to the variable table.
+ *
+ * symbol: The name of the variable.
+ *
+ * Returns: The value, owned by the table and valid until the variable changes; NULL if it is not set.
+ */
+const char *symbol_value(const variable_table_t *table, const symbol_t *symbol);
+
+/**
+ * assign_symbol: gives a variable a value, keeping its flags. Setting an exported variable drops
+ * the cached environment; setting PATH also updates the process environment, where the path cache
+ * (path_cache.h) reads it.
+ *
+ * table: A pointer to the variable table.
+ *
+ * symbol: The name of the variable.
+ *
+ * value: The value; it is copied.
+ *
+ * len: The length of the value.
+ *
+ * Returns: True if the variable was set; false if allocation failed.
+ */
+bool assign_symbol(variable_table_t *table, const symbol_t *symbol, const char *value, size_t len);
+
+/**
+ * export_symbol: marks a variable as exported, so it is in the environment of the programs the
+ * shell runs from then on. A variable that is not set is exported once it is.
+ *
+ * table: A pointer to the variable table.
+ *
+ * symbol: The name of the variable.
+ *
+ * Returns: True on success; false if allocation failed.
+ */
+bool export_symbol(variable_table_t *table, const symbol_t *symbol);
+
+/**
+ * unset_symbol: removes a variable, and its export mark.
+ *
+ * table: A pointer to the variable table.
+ *
+ * symbol: The name of the variable.
+ */
+void unset_symbol(variable_table_t *table, const symbol_t *symbol);
+
+/**
+ * variable_flags: the flags of a variable.
+ *
+ * table: A pointer to the variable table.
+ *
+ * symbol: The name of the variable.
+ *
+ * Returns: VARIABLE_EXPORTED if it is exported; otherwise, 0.
+ */
+int variable_flags(const variable_table_t *table, const symbol_t *symbol);
+
+/**
+ * environment: the environment of the programs the shell runs: NAME=VALUE for every exported
+ * variable that is set. It is built again only after an exported variable changed.
+ *
+ * table: A pointer to the variable table.
+ *
+ * Returns: The NULL-terminated environment, owned by the table and valid until an exported variable changes.
+ */
+char **environment(variable_table_t *table);
+
+/**
+ * set_variable: gives a variable a value, by name.
+ *
+ * table: A pointer to the variable table.
+ *
+ * name: The name of the variable.
+ *
+ * value: The value; it is copied.
+ *
+ * Returns: True if the variable was set; false if allocation failed.
+ */
+bool set_variable(variable_table_t *table, const char *name, const char *value);
+
+/**
+ * get_variable: looks up the value of a variable, by name.
+ *
+ * table: A pointer to the variable table.
+ *
+ * name: The name of the variable.
+ *
+ * Returns: The value, owned by the table and valid until the variable changes; NULL if it is not set.
+ */
+const char *get_variable(variable_table_t *table, const char *name);
+
+/**
+ * free_variables: deallocates the table and every variable in it. Symbols are kept.
+ *
+ * table: A pointer to the variable table to be deallocated; NULL is ignored.
+ */
+void free_variables(variable_table_t *table);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef _VM_H_
+#define _VM_H_
+
+#include "shell.h"
+#include "compile.h"
+
+//Functions may call each other (or themselves) this deep
+#define MAX_CALL_DEPTH 1000
+
+//A shell function: the bytecode of its body, which starts at entry in the program of the list that
+//defined it. The function holds a reference to the tree the program lives in.
+typedef struct function {
+    char *name;
+    const program_t *program;
+    int entry;
+    struct function *next;
+} function_t;
+
+//Represents the state of the shell's functions: a hash table from names to bodies
+typedef struct function_table {
+    function_t **buckets;
+    int num_buckets;
+    int count;
+    int depth;
+} function_table_t;
+
+/**
+ * run_program: runs bytecode from compile_list. Pipelines run with run_pipeline, in the foreground,
+ * and a loop stops when one of them is interrupted with ctrl-c. Descriptors redirected for a compound
+ * command are put back after it, and when the program is left from inside it.
+ *
+ * shell: The current shell state value; the exit status of the program is left in shell->last_status.
+ *
+ * program: The program.
+ *
+ * entry: The instruction to start at: 0 for the list, or the body of a function.
+ *
+ * Returns: -1 if the program (or a function it called) ran exit; otherwise, 0.
+ */
+int run_program(msh_t *shell, const program_t *program, int entry);
+
+/**
+ * argument_status: finds the exit status a return or exit command gives: its argument, expanded,
+ * modulo 256, or the last exit status without one. An argument that is not a number is reported and
+ * gives 2.
+ *
+ * shell: The current shell state value.
+ *
+ * command: The return or exit command.
+ *
+ * Returns: The exit status.
+ */
+int argument_status(msh_t *shell, const command_t *command);
+
+/**
+ * alloc_functions: allocates an empty function table.
+ *
+ * Returns: A pointer to the newly allocated table; NULL if allocation fails.
+ */
+function_table_t *alloc_functions();
+
+/**
+ * define_function: defines a function, replacing any function of the same name.
+ *
+ * table: A pointer to the function table.
+ *
+ * name: The name of the function.
+ *
+ * program: The program the body of the function is in; a reference to its tree is taken.
+ *
+ * entry: The first instruction of the body.
+ */
+void define_function(function_table_t *table, const char *name, const program_t *program, int entry);
+
+/**
+ * find_function: looks up a function.
+ *
+ * table: A pointer to the function table.
+ *
+ * name: The name of the function.
+ *
+ * Returns: The function; NULL if no function has that name.
+ */
+const function_t *find_function(function_table_t *table, const char *name);
+
+/**
+ * call_function: runs a function in the shell, with the arguments of the command as its positional parameters.
+ *
+ * shell: The current shell state value; shell->last_status receives the exit status of the function.
+ *
+ * function: The function.
+ *
+ * argc: The number of arguments in argv.
+ *
+ * argv: The arguments, starting with the name of the function.
+ *
+ * Returns: -1 if the function ran exit; otherwise, 0.
+ */
+int call_function(msh_t *shell, const function_t *function, int argc, char **argv);
+
+/**
+ * free_functions: deallocates the table and every function in it.
+ *
+ * table: A pointer to the function table to be deallocated; NULL is ignored.
+ */
+void free_functions(function_table_t *table);
+
+#endif
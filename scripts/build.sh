@@ -1,4 +1,4 @@
 #!/bin/bash
 
 cd ..
-gcc -I./include/ -o ./bin/msh ./src/*.c
\ No newline at end of file
+gcc -I./include/ -o ./bin/msh $CFLAGS ./src/*.c $LIBS
\ No newline at end of file
@@ -0,0 +1,922 @@
+#include "../include/builtins.h"
+#include "../include/pipeline.h"
+#include "../include/parallel.h"
+#include "../include/output.h"
+#include "../include/event_loop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//State of the recursive descent parser used by test and [
+typedef struct test_parser {
+    char **argv;
+    int argc;
+    int pos;
+    bool error;
+} test_parser_t;
+
+/**
+ * Writes the character for the backslash escape at p to the output buffer.
+ *
+ * @param p Points at the backslash that starts the escape.
+ * @param stop Set to true when the escape is \c (stop producing output); may be NULL.
+ * @return A pointer to the last character that belongs to the escape.
+ */
+static const char *put_escape(const char *p, bool *stop){
+    char c=p[1];
+    int value=0;
+    int digits=0;
+    switch(c){
+        case 'a': out_putc('\a'); return p+1;
+        case 'b': out_putc('\b'); return p+1;
+        case 'e': out_putc('\033'); return p+1;
+        case 'f': out_putc('\f'); return p+1;
+        case 'n': out_putc('\n'); return p+1;
+        case 'r': out_putc('\r'); return p+1;
+        case 't': out_putc('\t'); return p+1;
+        case 'v': out_putc('\v'); return p+1;
+        case '\\': out_putc('\\'); return p+1;
+        case 'c':
+            if(stop!=NULL){
+                *stop=true;
+            }
+            return p+1;
+        case '0':
+            p++;
+            while(digits<3&&p[1]>='0'&&p[1]<='7'){
+                value=value*8+(*++p-'0');
+                digits++;
+            }
+            out_putc((char)value);
+            return p;
+        case 'x':
+            p++;
+            while(digits<2&&isxdigit((unsigned char)p[1])){
+                char h=*++p;
+                value=value*16+(isdigit((unsigned char)h)?h-'0':tolower((unsigned char)h)-'a'+10);
+                digits++;
+            }
+            if(digits==0){
+                out_puts("\\x");
+            }
+            else{
+                out_putc((char)value);
+            }
+            return p;
+        case '\0':
+            out_putc('\\');
+            return p;
+        default:
+            out_putc('\\');
+            out_putc(c);
+            return p+1;
+    }
+}
+
+/**
+ * Writes a string to the output buffer, interpreting backslash escapes.
+ *
+ * @param str The string to write.
+ * @param stop Set to true if the string contained \c; may be NULL.
+ */
+static void put_escaped(const char *str, bool *stop){
+    for(const char *p=str;*p!='\0';p++){
+        if(*p=='\\'){
+            p=put_escape(p,stop);
+            if(stop!=NULL&&*stop){
+                return;
+            }
+        }
+        else{
+            out_putc(*p);
+        }
+    }
+}
+
+/**
+ * Lists the active jobs and their states.
+ */
+static int builtin_jobs(msh_t *shell, int argc, char **argv){
+    for(int i=0;i<shell->jobs->capacity;i++){
+        job_t* j=&(shell->jobs->slots[i]);
+        if(j->cmd_line!=NULL&&j->pid!=0){
+            printf("[%d] %d %s %s\n",j->jid,j->pid,j->state==SUSPENDED?"Stopped":"RUNNING",j->cmd_line);
+        }
+    }
+    return 0;
+}
+
+//A timed history entry, for sorting by cost
+typedef struct timed_entry {
+    int number;
+    long long wall_us;
+} timed_entry_t;
+
+/**
+ * Orders timed entries from the longest running to the shortest, oldest first among equals.
+ */
+static int compare_slowest(const void *a, const void *b){
+    const timed_entry_t *x=a;
+    const timed_entry_t *y=b;
+    if(x->wall_us!=y->wall_us){
+        return x->wall_us<y->wall_us?1:-1;
+    }
+    return x->number-y->number;
+}
+
+/**
+ * Prints a history entry with its start time, wall clock, user and system
+ * CPU seconds and exit status. Background jobs only have a start time;
+ * entries that were not timed show dashes.
+ *
+ * @param shell The current shell state.
+ * @param number The number of the entry; erased entries are skipped.
+ */
+static void print_timed_entry(msh_t *shell, int number){
+    char *line=find_line_history(shell->history,number);
+    if(line==NULL){
+        return;
+    }
+    const history_timing_t *timing=find_timing_history(shell->history,number);
+    if(timing==NULL){
+        out_printf("%5d  %-19s  %9s %9s %9s %6s  %s\n",number,"-","-","-","-","-",line);
+        return;
+    }
+    char started[32];
+    time_t seconds=timing->start_us/1000000;
+    struct tm tm;
+    strftime(started,sizeof(started),"%Y-%m-%d %H:%M:%S",localtime_r(&seconds,&tm));
+    if(timing->wall_us<0){
+        out_printf("%5d  %s  %9s %9s %9s %6s  %s\n",number,started,"bg","-","-","-",line);
+        return;
+    }
+    out_printf("%5d  %s  %9.3f %9.3f %9.3f %6d  %s\n",number,started,timing->wall_us/1e6,
+               timing->user_us/1e6,timing->sys_us/1e6,timing->status,line);
+}
+
+/**
+ * Prints the history with the timing of every command (-t), or only the N
+ * commands that ran longest, slowest first (--slowest N).
+ *
+ * @param shell The current shell state.
+ * @param slowest The number of commands to print; 0 prints every command in order.
+ * @return The exit status: 0, or 1 if memory for sorting them cannot be allocated.
+ */
+static int print_history_timing(msh_t *shell, int slowest){
+    history_t *history=shell->history;
+    int first=history->count-history->size+1;
+    out_printf("%5s  %-19s  %9s %9s %9s %6s  %s\n","num","started","wall(s)","user(s)","sys(s)","status","command");
+    if(slowest==0){
+        for(int number=first;number<=history->count;number++){
+            print_timed_entry(shell,number);
+        }
+        return 0;
+    }
+    timed_entry_t *entries=malloc(sizeof(timed_entry_t)*(history->size+1));
+    if(entries==NULL){
+        perror("Failed to allocate memory for the history timings");
+        return 1;
+    }
+    int num_entries=0;
+    for(int number=first;number<=history->count;number++){
+        const history_timing_t *timing=find_timing_history(history,number);
+        if(timing!=NULL&&timing->wall_us>=0){
+            entries[num_entries].number=number;
+            entries[num_entries++].wall_us=timing->wall_us;
+        }
+    }
+    qsort(entries,num_entries,sizeof(timed_entry_t),compare_slowest);
+    for(int i=0;i<num_entries&&i<slowest;i++){
+        print_timed_entry(shell,entries[i].number);
+    }
+    free(entries);
+    return 0;
+}
+
+/**
+ * Prints the command history; with -s PATTERN only the commands that
+ * contain PATTERN ("^PATTERN" for commands that start with it), with -t the
+ * timing of every command and with --slowest N the N slowest commands.
+ * --convert text|binary rewrites the history file in that format.
+ */
+static int builtin_history(msh_t *shell, int argc, char **argv){
+    if(argc==1){
+        print_history(shell->history);
+        return 0;
+    }
+    if(argc==2&&strcmp(argv[1],"-t")==0){
+        return print_history_timing(shell,0);
+    }
+    if(argc==3&&strcmp(argv[1],"--slowest")==0){
+        char *end;
+        long slowest=strtol(argv[2],&end,10);
+        if(*end=='\0'&&slowest>0&&slowest<=INT_MAX){
+            return print_history_timing(shell,(int)slowest);
+        }
+    }
+    if(argc==3&&strcmp(argv[1],"--convert")==0){
+        int format=strcmp(argv[2],"text")==0?HISTORY_TEXT:strcmp(argv[2],"binary")==0?HISTORY_BINARY:-1;
+        if(format!=-1){
+            if(convert_history(shell->history,format)==-1){
+                printf("error: history: cannot convert the history file\n");
+                return 1;
+            }
+            return 0;
+        }
+    }
+    if(argc!=3||strcmp(argv[1],"-s")!=0){
+        printf("error: usage: history [-s PATTERN | -t | --slowest N | --convert text|binary]\n");
+        return 1;
+    }
+    bool prefix=argv[2][0]=='^';
+    const char *pattern=prefix?argv[2]+1:argv[2];
+    int capacity=16;
+    int num_matches=0;
+    int *matches=malloc(sizeof(int)*capacity);
+    if(matches==NULL){
+        perror("Failed to allocate memory for the history matches");
+        return 1;
+    }
+    // Matches come newest first; collect them to print in history order
+    for(int number=search_history(shell->history,pattern,prefix,INT_MAX);number!=0;
+        number=search_history(shell->history,pattern,prefix,number)){
+        if(num_matches==capacity){
+            int *grown=realloc(matches,sizeof(int)*capacity*2);
+            if(grown==NULL){
+                perror("Failed to allocate memory for the history matches");
+                free(matches);
+                return 1;
+            }
+            matches=grown;
+            capacity*=2;
+        }
+        matches[num_matches++]=number;
+    }
+    for(int i=num_matches-1;i>=0;i--){
+        out_printf("%5d\t%s\n",matches[i],find_line_history(shell->history,matches[i]));
+    }
+    free(matches);
+    return num_matches>0?0:1;
+}
+
+/**
+ * Re-executes the history entry named by "!N".
+ */
+static int builtin_history_event(msh_t *shell, int argc, char **argv){
+    int index=atoi(&argv[0][1]);
+    char *line=find_line_history(shell->history,index);
+    if(argc!=1||line==NULL){
+        printf("error: %s: event not found\n",argv[0]);
+        return 1;
+    }
+    printf("%s\n",line);
+    // Running the line adds to the history, which may evict the line while it runs: run a copy
+    char *copy=strdup(line);
+    evaluate(shell,copy);
+    free(copy);
+    return shell->last_status;
+}
+
+/**
+ * Resumes a job in the background (bg) or the foreground (fg). The job is
+ * named by "%JID" or by a process ID.
+ */
+static int builtin_bg_fg(msh_t *shell, int argc, char **argv){
+    pid_t pid_to_update=-1;
+    if(argc==2){
+        if(argv[1][0]=='%'){
+            pid_to_update=get_pid_by_job_id(shell->jobs,atoi(argv[1]+1));
+        }
+        else if(get_job_id_by_pid(shell->jobs,atoi(argv[1]))!=0){
+            pid_to_update=atoi(argv[1]);
+        }
+    }
+    if(pid_to_update==-1){
+        printf("error: %s: no such job\n",argc==2?argv[1]:argv[0]);
+        return 1;
+    }
+    if(strcmp(argv[0],"bg")==0){
+        update_job_state(shell->jobs,pid_to_update,BACKGROUND);
+    }
+    else{
+        update_job_state(shell->jobs,pid_to_update,FOREGROUND);
+    }
+    kill(-pid_to_update,SIGCONT);
+    return 0;
+}
+
+/**
+ * Lists the job queue (no arguments), drops every queued job (-c), sets the
+ * parallelism cap (-p NUMBER) or waits until the queue has drained and every
+ * background job has finished (-w).
+ */
+static int builtin_queue(msh_t *shell, int argc, char **argv){
+    if(argc==1){
+        print_job_queue(shell);
+        return 0;
+    }
+    if(argc==2&&strcmp(argv[1],"-c")==0){
+        printf("queue: dropped %d jobs\n",clear_job_queue(shell->queue));
+        return 0;
+    }
+    if(argc==2&&strcmp(argv[1],"-w")==0){
+        while(shell->queue->count>0||has_background_job(shell->jobs)){
+            wait_for_signals(shell);
+        }
+        return 0;
+    }
+    if(argc==3&&strcmp(argv[1],"-p")==0){
+        char *end;
+        long value=strtol(argv[2],&end,10);
+        if(*end!='\0'||value<=0||value>INT_MAX){
+            printf("error: queue: %s: invalid number\n",argv[2]);
+            return 1;
+        }
+        shell->queue->max_running=(int)value;
+        dispatch_jobs(shell);
+        return 0;
+    }
+    printf("error: usage: queue [-c | -w | -p NUMBER]\n");
+    return 1;
+}
+
+/**
+ * Sends SIGINT (2), SIGKILL (9), SIGCONT (18) or SIGSTOP (19) to a process group.
+ */
+static int builtin_kill(msh_t *shell, int argc, char **argv){
+    if(argc!=3){
+        printf("error: usage: kill SIG_NUM PID\n");
+        return 1;
+    }
+    int sig_num=atoi(argv[1]);
+    pid_t pid_to_kill=atoi(argv[2]);
+    if(sig_num==2){
+        kill(-pid_to_kill,SIGINT);
+    }
+    else if(sig_num==9){
+        kill(-pid_to_kill,SIGKILL);
+    }
+    else if(sig_num==18){
+        kill(-pid_to_kill,SIGCONT);
+    }
+    else if(sig_num==19){
+        kill(-pid_to_kill,SIGSTOP);
+    }
+    else{
+        printf("error: invalid signal number\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Lists (no arguments), pre-resolves (NAME...) or clears (-r) the command path cache,
+ * or shows the parse cache and its hit rate (-p).
+ */
+static int builtin_hash(msh_t *shell, int argc, char **argv){
+    int status=0;
+    if(argc==1){
+        print_path_cache(shell->path_cache);
+    }
+    else if(argc==2&&strcmp(argv[1],"-r")==0){
+        clear_path_cache(shell->path_cache);
+    }
+    else if(argc==2&&strcmp(argv[1],"-p")==0){
+        print_parse_cache(shell->parse_cache);
+    }
+    else{
+        for(int i=1;i<argc;i++){
+            if(!hash_command(shell->path_cache,argv[i])){
+                printf("error: hash: %s: not found\n",argv[i]);
+                status=1;
+            }
+        }
+    }
+    return status;
+}
+
+/**
+ * Writes its arguments separated by spaces. -n suppresses the newline, -e
+ * enables backslash escapes and -E disables them.
+ */
+static int builtin_echo(msh_t *shell, int argc, char **argv){
+    bool newline=true;
+    bool escapes=false;
+    int i=1;
+    while(i<argc&&argv[i][0]=='-'&&argv[i][1]!='\0'&&strspn(argv[i]+1,"neE")==strlen(argv[i]+1)){
+        for(const char *flag=argv[i]+1;*flag!='\0';flag++){
+            if(*flag=='n'){
+                newline=false;
+            }
+            else{
+                escapes=*flag=='e';
+            }
+        }
+        i++;
+    }
+    bool stop=false;
+    for(int first=i;i<argc;i++){
+        if(i>first){
+            out_putc(' ');
+        }
+        if(escapes){
+            put_escaped(argv[i],&stop);
+            if(stop){
+                return 0;
+            }
+        }
+        else{
+            out_puts(argv[i]);
+        }
+    }
+    if(newline){
+        out_putc('\n');
+    }
+    return 0;
+}
+
+/**
+ * Converts a printf argument to a number, reporting arguments that are not numbers.
+ *
+ * @param value The argument; NULL or empty is 0, and 'c gives the code of c.
+ * @param status Set to 1 if the argument is not a valid number.
+ * @return The converted value.
+ */
+static long long printf_number(const char *value, int *status){
+    if(value==NULL||*value=='\0'){
+        return 0;
+    }
+    if(value[0]=='\''||value[0]=='"'){
+        return (unsigned char)value[1];
+    }
+    char *end;
+    errno=0;
+    long long number=strtoll(value,&end,0);
+    if(*end!='\0'||errno!=0){
+        fprintf(stderr,"printf: %s: invalid number\n",value);
+        *status=1;
+    }
+    return number;
+}
+
+/**
+ * Formats its arguments under the control of FORMAT, reusing the format
+ * until every argument has been consumed.
+ */
+static int builtin_printf(msh_t *shell, int argc, char **argv){
+    if(argc<2){
+        fprintf(stderr,"printf: usage: printf FORMAT [ARGUMENTS...]\n");
+        return 2;
+    }
+    const char *format=argv[1];
+    int arg=2;
+    int status=0;
+    bool stop=false;
+    do{
+        int first_arg=arg;
+        for(const char *p=format;*p!='\0'&&!stop;p++){
+            if(*p=='\\'){
+                p=put_escape(p,&stop);
+                continue;
+            }
+            if(*p!='%'){
+                out_putc(*p);
+                continue;
+            }
+            if(p[1]=='%'){
+                out_putc('%');
+                p++;
+                continue;
+            }
+            // Copy flags, width and precision into a format for a single value
+            char spec[40];
+            size_t len=0;
+            spec[len++]=*p++;
+            while(*p!='\0'&&strchr("-+ #0",*p)!=NULL&&len<10){
+                spec[len++]=*p++;
+            }
+            while(isdigit((unsigned char)*p)&&len<20){
+                spec[len++]=*p++;
+            }
+            if(*p=='.'){
+                spec[len++]=*p++;
+                while(isdigit((unsigned char)*p)&&len<30){
+                    spec[len++]=*p++;
+                }
+            }
+            if(*p=='\0'){
+                fprintf(stderr,"printf: %s: missing format character\n",format);
+                return 1;
+            }
+            const char *value=arg<argc?argv[arg++]:NULL;
+            switch(*p){
+                case 'd':
+                case 'i':
+                    spec[len++]='l';
+                    spec[len++]='l';
+                    spec[len++]=*p;
+                    spec[len]='\0';
+                    out_printf(spec,printf_number(value,&status));
+                    break;
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X':
+                    spec[len++]='l';
+                    spec[len++]='l';
+                    spec[len++]=*p;
+                    spec[len]='\0';
+                    out_printf(spec,(unsigned long long)printf_number(value,&status));
+                    break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                    spec[len++]=*p;
+                    spec[len]='\0';
+                    out_printf(spec,value==NULL?0.0:strtod(value,NULL));
+                    break;
+                case 'c':
+                    if(value!=NULL&&value[0]!='\0'){
+                        spec[len++]='c';
+                        spec[len]='\0';
+                        out_printf(spec,value[0]);
+                    }
+                    break;
+                case 's':
+                    spec[len++]='s';
+                    spec[len]='\0';
+                    out_printf(spec,value==NULL?"":value);
+                    break;
+                case 'b':
+                    put_escaped(value==NULL?"":value,&stop);
+                    break;
+                default:
+                    fprintf(stderr,"printf: %%%c: invalid format character\n",*p);
+                    return 1;
+            }
+        }
+        // A format without conversions would otherwise loop forever
+        if(arg==first_arg){
+            break;
+        }
+    }while(arg<argc&&!stop);
+    return status;
+}
+
+/**
+ * Always succeeds.
+ */
+static int builtin_true(msh_t *shell, int argc, char **argv){
+    return 0;
+}
+
+/**
+ * Always fails.
+ */
+static int builtin_false(msh_t *shell, int argc, char **argv){
+    return 1;
+}
+
+/**
+ * Prints the current working directory.
+ */
+static int builtin_pwd(msh_t *shell, int argc, char **argv){
+    char *cwd=getcwd(NULL,0);
+    if(cwd==NULL){
+        fprintf(stderr,"pwd: %s\n",strerror(errno));
+        return 1;
+    }
+    out_puts(cwd);
+    out_putc('\n');
+    free(cwd);
+    return 0;
+}
+
+/**
+ * Lists the exported variables (no arguments) or exports each NAME, setting
+ * it first if given as NAME=VALUE.
+ */
+static int builtin_export(msh_t *shell, int argc, char **argv){
+    if(argc==1){
+        for(char **entry=environment(shell->variables);*entry!=NULL;entry++){
+            const char *equals=strchr(*entry,'=');
+            out_puts("export ");
+            out_write(*entry,equals-*entry+1);
+            // Quoted so the line can be read back in
+            out_putc('\'');
+            for(const char *c=equals+1;*c!='\0';c++){
+                if(*c=='\''){
+                    out_puts("'\\''");
+                }
+                else{
+                    out_putc(*c);
+                }
+            }
+            out_puts("'\n");
+        }
+        return 0;
+    }
+    int status=0;
+    for(int i=1;i<argc;i++){
+        const char *equals=strchr(argv[i],'=');
+        size_t len=equals!=NULL?(size_t)(equals-argv[i]):strlen(argv[i]);
+        if(!is_variable_name(argv[i],len)){
+            printf("error: export: %s: not a valid identifier\n",argv[i]);
+            status=1;
+            continue;
+        }
+        const symbol_t *symbol=intern_symbol(argv[i],len);
+        if((equals!=NULL&&!assign_symbol(shell->variables,symbol,equals+1,strlen(equals+1)))||
+           !export_symbol(shell->variables,symbol)){
+            printf("error: export: %s: out of memory\n",argv[i]);
+            status=1;
+        }
+    }
+    return status;
+}
+
+/**
+ * Removes each named variable.
+ */
+static int builtin_unset(msh_t *shell, int argc, char **argv){
+    int status=0;
+    for(int i=1;i<argc;i++){
+        if(!is_variable_name(argv[i],strlen(argv[i]))){
+            printf("error: unset: %s: not a valid identifier\n",argv[i]);
+            status=1;
+            continue;
+        }
+        unset_symbol(shell->variables,intern_symbol(argv[i],strlen(argv[i])));
+    }
+    return status;
+}
+
+/**
+ * Parses an integer operand of test, flagging operands that are not integers.
+ *
+ * @param parser The test parser state.
+ * @param value The operand to convert.
+ * @return The converted value.
+ */
+static long long test_integer(test_parser_t *parser, const char *value){
+    char *end;
+    errno=0;
+    long long number=strtoll(value,&end,10);
+    while(isspace((unsigned char)*end)){
+        end++;
+    }
+    if(*value=='\0'||*end!='\0'||errno!=0){
+        fprintf(stderr,"test: %s: integer expression expected\n",value);
+        parser->error=true;
+    }
+    return number;
+}
+
+/**
+ * Checks whether a word is one of the binary operators of test.
+ *
+ * @param op The word to check.
+ * @return True if op is a binary operator; otherwise, false.
+ */
+static bool test_is_binary(const char *op){
+    static const char *BINARY_OPS[]={"=","==","!=","<",">","-eq","-ne","-lt","-le","-gt","-ge",NULL};
+    for(int i=0;BINARY_OPS[i]!=NULL;i++){
+        if(strcmp(op,BINARY_OPS[i])==0){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Evaluates a binary test such as "a = b" or "1 -lt 2".
+ */
+static bool test_binary(test_parser_t *parser, const char *left, const char *op, const char *right){
+    if(strcmp(op,"=")==0||strcmp(op,"==")==0){
+        return strcmp(left,right)==0;
+    }
+    if(strcmp(op,"!=")==0){
+        return strcmp(left,right)!=0;
+    }
+    if(strcmp(op,"<")==0){
+        return strcmp(left,right)<0;
+    }
+    if(strcmp(op,">")==0){
+        return strcmp(left,right)>0;
+    }
+    long long a=test_integer(parser,left);
+    long long b=test_integer(parser,right);
+    if(strcmp(op,"-eq")==0){
+        return a==b;
+    }
+    if(strcmp(op,"-ne")==0){
+        return a!=b;
+    }
+    if(strcmp(op,"-lt")==0){
+        return a<b;
+    }
+    if(strcmp(op,"-le")==0){
+        return a<=b;
+    }
+    if(strcmp(op,"-gt")==0){
+        return a>b;
+    }
+    return a>=b;
+}
+
+/**
+ * Evaluates a unary test such as "-n STRING" or "-f FILE".
+ *
+ * @return The result of the test; parser->error is set for unknown operators.
+ */
+static bool test_unary(test_parser_t *parser, const char *op, const char *operand){
+    struct stat st;
+    switch(op[1]){
+        case 'n': return operand[0]!='\0';
+        case 'z': return operand[0]=='\0';
+        case 'e': return stat(operand,&st)==0;
+        case 'f': return stat(operand,&st)==0&&S_ISREG(st.st_mode);
+        case 'd': return stat(operand,&st)==0&&S_ISDIR(st.st_mode);
+        case 'p': return stat(operand,&st)==0&&S_ISFIFO(st.st_mode);
+        case 'b': return stat(operand,&st)==0&&S_ISBLK(st.st_mode);
+        case 'c': return stat(operand,&st)==0&&S_ISCHR(st.st_mode);
+        case 'S': return stat(operand,&st)==0&&S_ISSOCK(st.st_mode);
+        case 's': return stat(operand,&st)==0&&st.st_size>0;
+        case 'h':
+        case 'L': return lstat(operand,&st)==0&&S_ISLNK(st.st_mode);
+        case 'r': return access(operand,R_OK)==0;
+        case 'w': return access(operand,W_OK)==0;
+        case 'x': return access(operand,X_OK)==0;
+        case 't': return isatty((int)test_integer(parser,operand));
+    }
+    fprintf(stderr,"test: %s: unary operator expected\n",op);
+    parser->error=true;
+    return false;
+}
+
+static bool test_or(test_parser_t *parser);
+
+/**
+ * primary := '(' expr ')' | UNARY-OP operand | operand BINARY-OP operand | operand
+ */
+static bool test_primary(test_parser_t *parser){
+    int remaining=parser->argc-parser->pos;
+    if(remaining<=0){
+        fprintf(stderr,"test: argument expected\n");
+        parser->error=true;
+        return false;
+    }
+    char **args=parser->argv+parser->pos;
+    if(remaining>=3&&test_is_binary(args[1])){
+        parser->pos+=3;
+        return test_binary(parser,args[0],args[1],args[2]);
+    }
+    if(strcmp(args[0],"(")==0&&remaining>=2){
+        parser->pos++;
+        bool result=test_or(parser);
+        if(parser->pos>=parser->argc||strcmp(parser->argv[parser->pos],")")!=0){
+            fprintf(stderr,"test: ')' expected\n");
+            parser->error=true;
+            return false;
+        }
+        parser->pos++;
+        return result;
+    }
+    if(remaining>=2&&args[0][0]=='-'&&args[0][1]!='\0'&&args[0][2]=='\0'){
+        parser->pos+=2;
+        return test_unary(parser,args[0],args[1]);
+    }
+    parser->pos++;
+    return args[0][0]!='\0';
+}
+
+/**
+ * not := '!' not | primary
+ */
+static bool test_not(test_parser_t *parser){
+    if(parser->pos<parser->argc-1&&strcmp(parser->argv[parser->pos],"!")==0){
+        parser->pos++;
+        return !test_not(parser);
+    }
+    return test_primary(parser);
+}
+
+/**
+ * and := not ('-a' not)*
+ */
+static bool test_and(test_parser_t *parser){
+    bool result=test_not(parser);
+    while(parser->pos<parser->argc&&strcmp(parser->argv[parser->pos],"-a")==0){
+        parser->pos++;
+        result=test_not(parser)&&result;
+    }
+    return result;
+}
+
+/**
+ * or := and ('-o' and)*
+ */
+static bool test_or(test_parser_t *parser){
+    bool result=test_and(parser);
+    while(parser->pos<parser->argc&&strcmp(parser->argv[parser->pos],"-o")==0){
+        parser->pos++;
+        result=test_and(parser)||result;
+    }
+    return result;
+}
+
+/**
+ * Evaluates a conditional expression. Returns 0 if it is true, 1 if it is
+ * false and 2 on a syntax error. As "[", the last argument must be "]".
+ */
+static int builtin_test(msh_t *shell, int argc, char **argv){
+    if(strcmp(argv[0],"[")==0){
+        if(strcmp(argv[argc-1],"]")!=0){
+            fprintf(stderr,"[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+    if(argc==1){
+        return 1;
+    }
+    test_parser_t parser={argv+1,argc-1,0,false};
+    bool result=test_or(&parser);
+    if(!parser.error&&parser.pos<parser.argc){
+        fprintf(stderr,"test: %s: unexpected argument\n",parser.argv[parser.pos]);
+        parser.error=true;
+    }
+    if(parser.error){
+        return 2;
+    }
+    return result?0:1;
+}
+
+static const builtin_t BUILTINS[] = {
+    {"jobs", builtin_jobs, 0},
+    {"history", builtin_history, 0},
+    {"!", builtin_history_event, 0},
+    {"bg", builtin_bg_fg, 0},
+    {"fg", builtin_bg_fg, 0},
+    {"kill", builtin_kill, 0},
+    {"queue", builtin_queue, 0},
+    {"parallel", builtin_parallel, 0},
+    {"hash", builtin_hash, 0},
+    {"echo", builtin_echo, BUILTIN_OUTPUT_ONLY},
+    {"printf", builtin_printf, BUILTIN_OUTPUT_ONLY},
+    {"true", builtin_true, BUILTIN_OUTPUT_ONLY},
+    {"false", builtin_false, BUILTIN_OUTPUT_ONLY},
+    {"test", builtin_test, BUILTIN_OUTPUT_ONLY},
+    {"[", builtin_test, BUILTIN_OUTPUT_ONLY},
+    {"pwd", builtin_pwd, BUILTIN_OUTPUT_ONLY},
+    {"export", builtin_export, 0},
+    {"unset", builtin_unset, 0},
+    {"cat", splice_cat, BUILTIN_STAGE_ONLY},
+    {"tee", splice_tee, BUILTIN_STAGE_ONLY},
+};
+
+/**
+ * Looks up a command name in the builtin registry.
+ *
+ * @param name The command name; "!N" finds the history re-execution builtin.
+ * @return The registry entry; NULL if the name is not a builtin.
+ */
+const builtin_t *find_builtin(const char *name){
+    if(name[0]=='!'&&name[1]!='\0'){
+        name="!";
+    }
+    for(size_t i=0;i<sizeof(BUILTINS)/sizeof(BUILTINS[0]);i++){
+        if(strcmp(name,BUILTINS[i].name)==0){
+            return &BUILTINS[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Runs a builtin inside the shell process. Output the shell already printed
+ * is flushed first so it stays ahead of the builtin's buffered output.
+ *
+ * @param shell The current shell state.
+ * @param builtin The registry entry of the builtin to run.
+ * @param argc The number of arguments in argv.
+ * @param argv The arguments of the command, starting with its name.
+ * @return The exit status of the builtin.
+ */
+int run_builtin(msh_t *shell, const builtin_t *builtin, int argc, char **argv){
+    fflush(stdout);
+    int status=builtin->run(shell,argc,argv);
+    out_flush();
+    fflush(stdout);
+    return status;
+}
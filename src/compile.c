@@ -0,0 +1,495 @@
+#include "../include/compile.h"
+#include "../include/job.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CODE_CAPACITY 32
+
+//No jump is waiting to be patched
+#define NO_PATCH -1
+
+//A compound command being compiled whose redirections are applied to the shell; slot keeps what to
+//put back once it is done
+typedef struct scope {
+    int slot;
+    struct scope *outer;
+} scope_t;
+
+//A loop being compiled. break and continue jump out of it before its end is known; their jumps
+//are chained through their targets and patched once it is. scope is the innermost redirected
+//command around it, which jumps out of the loop stay in.
+typedef struct loop {
+    int breaks;
+    int continues;
+    scope_t *scope;
+    struct loop *outer;
+} loop_t;
+
+//The state of one compilation
+typedef struct compiler {
+    instruction_t *code;
+    int count;
+    int capacity;
+    int num_slots;
+    loop_t *loop;
+    scope_t *scope;
+    bool in_function;
+    parse_tree_t *tree;
+} compiler_t;
+
+static void compile_and_or(compiler_t *compiler, and_or_t *list, bool foreground);
+
+/**
+ * Appends an instruction.
+ *
+ * @param compiler The compiler.
+ * @param op The opcode; every operand starts out empty.
+ * @return The index of the instruction.
+ */
+static int emit(compiler_t *compiler, opcode_t op){
+    if(compiler->count==compiler->capacity){
+        compiler->capacity=compiler->capacity==0?INITIAL_CODE_CAPACITY:compiler->capacity*2;
+        compiler->code=realloc(compiler->code,sizeof(instruction_t)*compiler->capacity);
+        if(compiler->code==NULL){
+            perror("Failed to allocate memory for bytecode");
+            exit(EXIT_FAILURE);
+        }
+    }
+    instruction_t *instruction=&compiler->code[compiler->count];
+    memset(instruction,0,sizeof(instruction_t));
+    instruction->op=op;
+    instruction->target=NO_PATCH;
+    return compiler->count++;
+}
+
+/**
+ * Appends an instruction with a value.
+ *
+ * @param compiler The compiler.
+ * @param op The opcode.
+ * @param value The value (e.g. an exit status).
+ */
+static void emit_value(compiler_t *compiler, opcode_t op, int value){
+    int index=emit(compiler,op);
+    compiler->code[index].value=value;
+}
+
+/**
+ * Appends an instruction on a slot.
+ *
+ * @param compiler The compiler.
+ * @param op The opcode.
+ * @param slot The slot.
+ */
+static void emit_slot(compiler_t *compiler, opcode_t op, int slot){
+    int index=emit(compiler,op);
+    compiler->code[index].slot=slot;
+}
+
+/**
+ * Appends a jump whose target is known.
+ *
+ * @param compiler The compiler.
+ * @param op The opcode.
+ * @param target The index of the instruction to jump to.
+ */
+static void emit_jump(compiler_t *compiler, opcode_t op, int target){
+    int index=emit(compiler,op);
+    compiler->code[index].target=target;
+}
+
+/**
+ * Appends an instruction that sets the exit status.
+ *
+ * @param compiler The compiler.
+ * @param status The exit status.
+ */
+static void emit_status(compiler_t *compiler, int status){
+    emit_value(compiler,OP_STATUS,status);
+}
+
+/**
+ * Points a chain of jumps at a target.
+ *
+ * @param compiler The compiler.
+ * @param chain The index of the last jump of the chain; NO_PATCH if it is empty.
+ * @param target The index of the instruction to jump to.
+ */
+static void patch(compiler_t *compiler, int chain, int target){
+    while(chain!=NO_PATCH){
+        int next=compiler->code[chain].target;
+        compiler->code[chain].target=target;
+        chain=next;
+    }
+}
+
+/**
+ * Allocates a slot for a loop.
+ *
+ * @param compiler The compiler.
+ * @return The slot.
+ */
+static int new_slot(compiler_t *compiler){
+    return compiler->num_slots++;
+}
+
+/**
+ * Compiles a sequence of lists, run one after the other.
+ *
+ * @param compiler The compiler.
+ * @param lists The first list.
+ */
+static void compile_sequence(compiler_t *compiler, and_or_t *lists){
+    for(and_or_t *list=lists;list!=NULL;list=list->next){
+        compile_and_or(compiler,list,list->job_type!=BACKGROUND);
+    }
+}
+
+/**
+ * Reads the loop count break and continue take.
+ *
+ * @param command The break or continue command.
+ * @return The number of loops to leave; 0 if the argument is not a positive number.
+ */
+static int loop_count(const command_t *command){
+    if(command->argc==1){
+        return 1;
+    }
+    char *end;
+    long count=strtol(command->argv[1],&end,10);
+    return command->argc==2&&*end=='\0'&&count>0&&count<=1000?(int)count:0;
+}
+
+/**
+ * Compiles break or continue as a jump out of the loop it names. The exit
+ * status becomes 0. break N and continue N past the outermost loop act on
+ * the outermost loop.
+ *
+ * @param compiler The compiler.
+ * @param command The command.
+ * @param is_break True for break; false for continue.
+ * @return False if the command cannot be resolved (it is not in a loop or its argument is not a
+ *         number) and is run as a command instead.
+ */
+static bool compile_loop_jump(compiler_t *compiler, const command_t *command, bool is_break){
+    int count=loop_count(command);
+    loop_t *loop=compiler->loop;
+    if(loop==NULL||count==0){
+        return false;
+    }
+    while(--count>0&&loop->outer!=NULL){
+        loop=loop->outer;
+    }
+    // Redirections of compound commands inside the loop that the jump leaves are put back
+    if(compiler->scope!=loop->scope){
+        scope_t *scope=compiler->scope;
+        while(scope->outer!=loop->scope){
+            scope=scope->outer;
+        }
+        emit_slot(compiler,OP_RESTORE,scope->slot);
+    }
+    emit_status(compiler,0);
+    int jump=emit(compiler,OP_JUMP);
+    int *chain=is_break?&loop->breaks:&loop->continues;
+    compiler->code[jump].target=*chain;
+    *chain=jump;
+    return true;
+}
+
+/**
+ * Compiles return in a function body.
+ *
+ * @param compiler The compiler.
+ * @param command The command.
+ * @return False if the command is not in a function or its argument is not a number.
+ */
+static bool compile_return(compiler_t *compiler, const command_t *command){
+    if(!compiler->in_function||command->argc>2){
+        return false;
+    }
+    if(command->expand!=NULL){
+        // The status is only known once the argument is expanded
+        int index=emit(compiler,OP_RETURN);
+        compiler->code[index].value=-1;
+        compiler->code[index].command=command;
+        return true;
+    }
+    int status=-1;
+    if(command->argc==2){
+        char *end;
+        long value=strtol(command->argv[1],&end,10);
+        if(*end!='\0'||end==command->argv[1]){
+            return false;
+        }
+        status=(int)(value&0xff);
+    }
+    emit_value(compiler,OP_RETURN,status);
+    return true;
+}
+
+/**
+ * Compiles an if command: the condition, then a jump over the body to the
+ * else part if it failed. Without an else part, the exit status is then 0.
+ *
+ * @param compiler The compiler.
+ * @param compound The parts of the command.
+ */
+static void compile_if(compiler_t *compiler, const compound_t *compound){
+    compile_sequence(compiler,compound->condition);
+    int to_else=emit(compiler,OP_JUMP_FALSE);
+    compile_sequence(compiler,compound->body);
+    int to_end=emit(compiler,OP_JUMP);
+    compiler->code[to_else].target=compiler->count;
+    if(compound->else_body!=NULL){
+        compile_sequence(compiler,compound->else_body);
+    }
+    else{
+        emit_status(compiler,0);
+    }
+    compiler->code[to_end].target=compiler->count;
+}
+
+/**
+ * Compiles a while or until loop. Its exit status is that of the last run
+ * of its body, kept in a slot while the condition runs; 0 if the body never
+ * ran.
+ *
+ * @param compiler The compiler.
+ * @param compound The parts of the loop.
+ * @param until True for until, which runs while the condition fails.
+ */
+static void compile_while(compiler_t *compiler, const compound_t *compound, bool until){
+    int slot=new_slot(compiler);
+    loop_t loop={NO_PATCH,NO_PATCH,compiler->scope,compiler->loop};
+    emit_status(compiler,0);
+    emit_slot(compiler,OP_SAVE,slot);
+    int top=compiler->count;
+    compile_sequence(compiler,compound->condition);
+    int to_exit=emit(compiler,until?OP_JUMP_TRUE:OP_JUMP_FALSE);
+    compiler->loop=&loop;
+    compile_sequence(compiler,compound->body);
+    compiler->loop=loop.outer;
+    patch(compiler,loop.continues,compiler->count);
+    emit_slot(compiler,OP_SAVE,slot);
+    emit_jump(compiler,OP_JUMP,top);
+    compiler->code[to_exit].target=compiler->count;
+    emit_slot(compiler,OP_LOAD,slot);
+    patch(compiler,loop.breaks,compiler->count);
+}
+
+/**
+ * Compiles a for loop. Its word counter lives in a slot, so loops nest and
+ * functions recurse without sharing it.
+ *
+ * @param compiler The compiler.
+ * @param command The for command.
+ */
+static void compile_for(compiler_t *compiler, const command_t *command){
+    int slot=new_slot(compiler);
+    loop_t loop={NO_PATCH,NO_PATCH,compiler->scope,compiler->loop};
+    int init=emit(compiler,OP_FOR_INIT);
+    compiler->code[init].slot=slot;
+    compiler->code[init].command=command;
+    int next=emit(compiler,OP_FOR_NEXT);
+    compiler->code[next].slot=slot;
+    compiler->code[next].command=command;
+    compiler->loop=&loop;
+    compile_sequence(compiler,command->compound->body);
+    compiler->loop=loop.outer;
+    patch(compiler,loop.continues,next);
+    emit_jump(compiler,OP_JUMP,next);
+    compiler->code[next].target=compiler->count;
+    patch(compiler,loop.breaks,compiler->count);
+    emit_slot(compiler,OP_FOR_DONE,slot);
+}
+
+/**
+ * Compiles a function definition. The body is compiled in place, after an
+ * instruction that defines the function and jumps over it; loops around the
+ * definition are not visible to break and continue inside it.
+ *
+ * @param compiler The compiler.
+ * @param command The function definition.
+ */
+static void compile_function(compiler_t *compiler, const command_t *command){
+    int define=emit(compiler,OP_FUNCTION);
+    compiler->code[define].command=command;
+    loop_t *loop=compiler->loop;
+    scope_t *scope=compiler->scope;
+    bool in_function=compiler->in_function;
+    compiler->loop=NULL;
+    compiler->scope=NULL;
+    compiler->in_function=true;
+    compile_sequence(compiler,command->compound->body);
+    emit_value(compiler,OP_RETURN,-1);
+    compiler->loop=loop;
+    compiler->scope=scope;
+    compiler->in_function=in_function;
+    compiler->code[define].target=compiler->count;
+}
+
+/**
+ * Compiles a compound command inline.
+ *
+ * @param compiler The compiler.
+ * @param command The command.
+ */
+static void compile_compound(compiler_t *compiler, const command_t *command){
+    switch(command->type){
+        case COMMAND_IF:
+            compile_if(compiler,command->compound);
+            break;
+        case COMMAND_WHILE:
+        case COMMAND_UNTIL:
+            compile_while(compiler,command->compound,command->type==COMMAND_UNTIL);
+            break;
+        case COMMAND_FOR:
+            compile_for(compiler,command);
+            break;
+        case COMMAND_GROUP:
+            compile_sequence(compiler,command->compound->body);
+            break;
+        case COMMAND_FUNCTION:
+            compile_function(compiler,command);
+            break;
+        case COMMAND_SIMPLE:
+            break;
+    }
+}
+
+/**
+ * Compiles a compound command with redirections: they are applied to the
+ * shell around the command, and put back after it.
+ *
+ * @param compiler The compiler.
+ * @param command The command.
+ */
+static void compile_redirected(compiler_t *compiler, const command_t *command){
+    scope_t scope={new_slot(compiler),compiler->scope};
+    int open=emit(compiler,OP_REDIRECT);
+    compiler->code[open].slot=scope.slot;
+    compiler->code[open].command=command;
+    compiler->scope=&scope;
+    compile_compound(compiler,command);
+    compiler->scope=scope.outer;
+    emit_slot(compiler,OP_RESTORE,scope.slot);
+    compiler->code[open].target=compiler->count;
+}
+
+/**
+ * Compiles a pipeline. A compound command on its own is compiled inline;
+ * exit, and break, continue and return where they can be resolved, become
+ * instructions. Anything else is run by the VM.
+ *
+ * @param compiler The compiler.
+ * @param pipeline The pipeline.
+ */
+static void compile_pipeline(compiler_t *compiler, const pipeline_t *pipeline, const char *text){
+    const command_t *command=pipeline->commands;
+    if(pipeline->num_commands==1&&command->type!=COMMAND_SIMPLE){
+        if(command->redirects!=NULL&&command->type!=COMMAND_FUNCTION){
+            compile_redirected(compiler,command);
+        }
+        else{
+            compile_compound(compiler,command);
+        }
+        return;
+    }
+    if(pipeline->num_commands==1&&command->redirects==NULL){
+        const char *name=command->argv[0];
+        if(name!=NULL&&strcmp(name,"exit")==0){
+            int index=emit(compiler,OP_EXIT);
+            compiler->code[index].command=command;
+            return;
+        }
+        if(name!=NULL&&((strcmp(name,"break")==0&&compile_loop_jump(compiler,command,true))||
+                        (strcmp(name,"continue")==0&&compile_loop_jump(compiler,command,false))||
+                        (strcmp(name,"return")==0&&compile_return(compiler,command)))){
+            return;
+        }
+    }
+    int run=emit(compiler,OP_PIPELINE);
+    compiler->code[run].pipeline=pipeline;
+    compiler->code[run].text=text;
+}
+
+/**
+ * Compiles an and-or list. A pipeline after && is jumped over if the exit
+ * status so far is not 0, and one after || if it is.
+ *
+ * @param compiler The compiler.
+ * @param list The and-or list.
+ * @param foreground False to start the list in the background instead.
+ */
+static void compile_and_or(compiler_t *compiler, and_or_t *list, bool foreground){
+    if(!foreground){
+        // The subshell a compound list runs in needs code of its own
+        if(needs_program(list)){
+            compile_list(compiler->tree,list);
+        }
+        int start=emit(compiler,OP_BACKGROUND);
+        compiler->code[start].list=list;
+        return;
+    }
+    for(const pipeline_t *pipeline=list->pipelines;pipeline!=NULL;pipeline=pipeline->next){
+        int skip=-1;
+        if(pipeline->connector!=CONNECT_NONE){
+            skip=emit(compiler,pipeline->connector==CONNECT_AND?OP_JUMP_FALSE:OP_JUMP_TRUE);
+        }
+        compile_pipeline(compiler,pipeline,list->text);
+        if(skip!=-1){
+            compiler->code[skip].target=compiler->count;
+        }
+    }
+}
+
+/**
+ * Checks whether an and-or list holds a compound command or a function definition.
+ *
+ * @param list The and-or list.
+ * @return True if it has to be compiled.
+ */
+bool needs_program(const and_or_t *list){
+    for(const pipeline_t *pipeline=list->pipelines;pipeline!=NULL;pipeline=pipeline->next){
+        if(pipeline->num_commands==1&&pipeline->commands->type!=COMMAND_SIMPLE){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Compiles an and-or list to bytecode in the arena of its tree.
+ *
+ * @param tree The tree the list is in.
+ * @param list The and-or list; its program is set.
+ * @return The program.
+ */
+program_t *compile_list(parse_tree_t *tree, and_or_t *list){
+    compiler_t compiler={NULL,0,0,0,NULL,NULL,false,tree};
+    compile_and_or(&compiler,list,true);
+    emit_value(&compiler,OP_RETURN,-1);
+    program_t *program=parse_tree_alloc(tree,sizeof(program_t));
+    program->num_instructions=compiler.count;
+    program->num_slots=compiler.num_slots;
+    program->code=parse_tree_alloc(tree,sizeof(instruction_t)*compiler.count);
+    program->tree=tree;
+    memcpy(program->code,compiler.code,sizeof(instruction_t)*compiler.count);
+    free(compiler.code);
+    list->program=program;
+    return program;
+}
+
+/**
+ * Compiles the lists of a tree that hold compound commands.
+ *
+ * @param tree The parse tree.
+ */
+void compile_tree(parse_tree_t *tree){
+    for(and_or_t *list=tree->lists;list!=NULL;list=list->next){
+        if(needs_program(list)){
+            compile_list(tree,list);
+        }
+    }
+}
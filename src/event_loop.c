@@ -0,0 +1,123 @@
+#include "../include/event_loop.h"
+#include "../include/shell.h"
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+#define MAX_EVENTS 4
+
+/**
+ * Creates the epoll instance the shell waits on for input and signals.
+ *
+ * @param shell A pointer to the shell instance.
+ * @return The epoll descriptor; -1 on error.
+ */
+int alloc_event_loop(msh_t *shell){
+    int epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd<0){
+        perror("epoll_create1");
+        return -1;
+    }
+    struct epoll_event event={.events=EPOLLIN,.data.fd=shell->signal_fd};
+    if(epoll_ctl(epoll_fd,EPOLL_CTL_ADD,shell->signal_fd,&event)<0){
+        perror("epoll_ctl");
+        close(epoll_fd);
+        return -1;
+    }
+    return epoll_fd;
+}
+
+/**
+ * Registers the descriptor commands are read from with the event loop.
+ * epoll refuses regular files, which are always readable anyway.
+ *
+ * @param shell A pointer to the shell instance.
+ * @param fd The input descriptor.
+ * @return True if the descriptor is watched; otherwise, false.
+ */
+bool watch_input(msh_t *shell, int fd){
+    struct epoll_event event={.events=EPOLLIN,.data.fd=fd};
+    shell->input_fd=-1;
+    if(epoll_ctl(shell->epoll_fd,EPOLL_CTL_ADD,fd,&event)<0){
+        return false;
+    }
+    shell->input_fd=fd;
+    return true;
+}
+
+/**
+ * Blocks until input is ready. Children that exit while the shell sits at the
+ * prompt are reaped as soon as their SIGCHLD arrives instead of at the next
+ * command.
+ *
+ * @param shell A pointer to the shell instance.
+ */
+void wait_for_input(msh_t *shell){
+    struct epoll_event events[MAX_EVENTS];
+    if(shell->input_fd==-1){
+        handle_signals(shell);
+        return;
+    }
+    while(true){
+        int n=epoll_wait(shell->epoll_fd,events,MAX_EVENTS,-1);
+        if(n<0){
+            if(errno==EINTR){
+                continue;
+            }
+            perror("epoll_wait");
+            return;
+        }
+        bool readable=false;
+        for(int i=0;i<n;i++){
+            if(events[i].data.fd==shell->signal_fd){
+                handle_signals(shell);
+            }
+            else if(events[i].data.fd==shell->input_fd){
+                readable=true;
+            }
+        }
+        if(readable){
+            return;
+        }
+    }
+}
+
+/**
+ * Blocks on the signalfd alone, then handles whatever arrived. A forked
+ * copy of the shell (a builtin in a pipeline) waits for its children directly.
+ *
+ * @param shell A pointer to the shell instance.
+ */
+void wait_for_signals(msh_t *shell){
+    if(shell->signal_fd==-1){
+        // A forked copy of the shell has no signalfd: wait for a child without reaping it
+        siginfo_t info;
+        while(waitid(P_ALL,0,&info,WEXITED|WSTOPPED|WCONTINUED|WNOWAIT)<0&&errno==EINTR){
+        }
+        handle_signals(shell);
+        return;
+    }
+    struct pollfd pfd={.fd=shell->signal_fd,.events=POLLIN};
+    while(poll(&pfd,1,-1)<0&&errno==EINTR){
+    }
+    handle_signals(shell);
+}
+
+/**
+ * Closes the descriptors owned by the event loop.
+ *
+ * @param shell A pointer to the shell instance.
+ */
+void free_event_loop(msh_t *shell){
+    if(shell->epoll_fd!=-1){
+        close(shell->epoll_fd);
+        shell->epoll_fd=-1;
+    }
+    if(shell->signal_fd!=-1){
+        close(shell->signal_fd);
+        shell->signal_fd=-1;
+    }
+}
@@ -0,0 +1,773 @@
+#include "../include/expand.h"
+#include "../include/shell.h"
+#include "../include/substitute.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+//Blocks of the expansion stack hold at least this many bytes
+#define EXPAND_BLOCK_SIZE 4096
+
+//Fields are built in buffers of these sizes on the C stack before they move to the heap
+#define SMALL_TEXT 1024
+#define SMALL_FIELDS 32
+
+//Where IFS is not set, fields are split at blanks, tabs and newlines
+#define DEFAULT_IFS " \t\n"
+
+//A field being built: a word without expansions (literal, which is used as it is), or a string
+//in the builder's text, starting at offset
+typedef struct field {
+    const char *literal;
+    size_t offset;
+} field_t;
+
+//The state of expanding the words of one command
+typedef struct builder {
+    msh_t *shell;
+    char *text;
+    size_t len;
+    size_t capacity;
+    field_t *fields;
+    int num_fields;
+    int field_capacity;
+    //Where the current field starts; in_field is set once something (even an empty quoted value) is in it
+    size_t start;
+    bool in_field;
+    const char *ifs;
+    //The bytes of ifs, as a bitmap built the first time a value is split
+    uint64_t ifs_set[4];
+    bool has_ifs_set;
+    char small_text[SMALL_TEXT];
+    field_t small_fields[SMALL_FIELDS];
+} builder_t;
+
+static void append_word(builder_t *builder, const char *text, const word_t *word, bool quoted, bool split, bool split_text);
+
+/**
+ * Sets up a builder with its buffers on the C stack.
+ *
+ * @param builder The builder.
+ * @param shell The current shell state.
+ */
+static void init_builder(builder_t *builder, msh_t *shell){
+    builder->shell=shell;
+    builder->text=builder->small_text;
+    builder->len=0;
+    builder->capacity=SMALL_TEXT;
+    builder->fields=builder->small_fields;
+    builder->num_fields=0;
+    builder->field_capacity=SMALL_FIELDS;
+    builder->start=0;
+    builder->in_field=false;
+    static const symbol_t *ifs_symbol;
+    if(ifs_symbol==NULL){
+        ifs_symbol=intern_symbol("IFS",3);
+    }
+    const char *ifs=symbol_value(shell->variables,ifs_symbol);
+    builder->ifs=ifs!=NULL?ifs:DEFAULT_IFS;
+    builder->has_ifs_set=false;
+}
+
+/**
+ * Checks whether a byte is one of the characters of IFS.
+ *
+ * @param builder The builder.
+ * @param c The byte.
+ * @return True if c separates fields.
+ */
+static bool is_ifs(builder_t *builder, unsigned char c){
+    if(!builder->has_ifs_set){
+        memset(builder->ifs_set,0,sizeof(builder->ifs_set));
+        for(const unsigned char *i=(const unsigned char *)builder->ifs;*i!='\0';i++){
+            builder->ifs_set[*i>>6]|=(uint64_t)1<<(*i&63);
+        }
+        builder->has_ifs_set=true;
+    }
+    return (builder->ifs_set[c>>6]>>(c&63))&1;
+}
+
+/**
+ * Frees the buffers a builder moved to the heap.
+ *
+ * @param builder The builder.
+ */
+static void free_builder(builder_t *builder){
+    if(builder->text!=builder->small_text){
+        free(builder->text);
+    }
+    if(builder->fields!=builder->small_fields){
+        free(builder->fields);
+    }
+}
+
+/**
+ * Makes room for bytes after the text of a builder, and a NUL after them.
+ *
+ * @param builder The builder.
+ * @param n The number of bytes.
+ * @return Where they go.
+ */
+static char *reserve(builder_t *builder, size_t n){
+    if(builder->len+n+1>builder->capacity){
+        size_t capacity=builder->capacity*2;
+        while(builder->len+n+1>capacity){
+            capacity*=2;
+        }
+        char *text=builder->text==builder->small_text?malloc(capacity):realloc(builder->text,capacity);
+        if(text==NULL){
+            perror("Failed to allocate memory for an expansion");
+            exit(EXIT_FAILURE);
+        }
+        if(builder->text==builder->small_text){
+            memcpy(text,builder->small_text,builder->len);
+        }
+        builder->text=text;
+        builder->capacity=capacity;
+    }
+    return builder->text+builder->len;
+}
+
+/**
+ * Appends bytes to the text of a builder.
+ *
+ * @param builder The builder.
+ * @param s The bytes.
+ * @param n The number of bytes.
+ */
+static void append(builder_t *builder, const char *s, size_t n){
+    memcpy(reserve(builder,n),s,n);
+    builder->len+=n;
+}
+
+/**
+ * Adds a field to a builder.
+ *
+ * @param builder The builder.
+ * @param literal The text of a word used as it is; NULL for a string in the builder's text.
+ * @param offset Where the string starts in the builder's text.
+ */
+static void add_field(builder_t *builder, const char *literal, size_t offset){
+    if(builder->num_fields==builder->field_capacity){
+        int capacity=builder->field_capacity*2;
+        field_t *fields=builder->fields==builder->small_fields?malloc(sizeof(field_t)*capacity):
+                        realloc(builder->fields,sizeof(field_t)*capacity);
+        if(fields==NULL){
+            perror("Failed to allocate memory for an expansion");
+            exit(EXIT_FAILURE);
+        }
+        if(builder->fields==builder->small_fields){
+            memcpy(fields,builder->small_fields,sizeof(field_t)*builder->num_fields);
+        }
+        builder->fields=fields;
+        builder->field_capacity=capacity;
+    }
+    builder->fields[builder->num_fields].literal=literal;
+    builder->fields[builder->num_fields++].offset=offset;
+}
+
+/**
+ * Ends the current field, if anything is in it, and starts the next one.
+ *
+ * @param builder The builder.
+ */
+static void end_field(builder_t *builder){
+    if(!builder->in_field){
+        return;
+    }
+    append(builder,"",1);
+    add_field(builder,NULL,builder->start);
+    builder->start=builder->len;
+    builder->in_field=false;
+}
+
+/**
+ * Appends text to the current field.
+ *
+ * @param builder The builder.
+ * @param s The text.
+ * @param n Its length.
+ */
+static void append_text(builder_t *builder, const char *s, size_t n){
+    if(n>0){
+        append(builder,s,n);
+        builder->in_field=true;
+    }
+}
+
+/**
+ * Appends a value to the current field, splitting it into fields at the
+ * characters of IFS. Runs of them are one separator.
+ *
+ * @param builder The builder.
+ * @param value The value.
+ * @param n Its length.
+ */
+static void append_split(builder_t *builder, const char *value, size_t n){
+    const char *end=value+n;
+    while(value<end){
+        const char *run=value;
+        while(run<end&&!is_ifs(builder,*run)){
+            run++;
+        }
+        append_text(builder,value,run-value);
+        value=run;
+        if(value<end){
+            end_field(builder);
+            while(value<end&&is_ifs(builder,*value)){
+                value++;
+            }
+        }
+    }
+}
+
+/**
+ * Appends a value to the current field, split unless it is quoted.
+ *
+ * @param builder The builder.
+ * @param value The value.
+ * @param n Its length.
+ * @param split True to split it into fields.
+ */
+static void append_value(builder_t *builder, const char *value, size_t n, bool split){
+    if(split){
+        append_split(builder,value,n);
+    }
+    else{
+        append_text(builder,value,n);
+        builder->in_field=true;
+    }
+}
+
+/**
+ * Makes room for the output of a command substitution, for capture_t.
+ *
+ * @param context The builder.
+ * @param size The number of bytes.
+ * @return Where they go.
+ */
+static char *reserve_output(void *context, size_t size){
+    return reserve(context,size);
+}
+
+/**
+ * Adds output written after the text of a builder to it, for capture_t.
+ *
+ * @param context The builder.
+ * @param n The number of bytes.
+ */
+static void commit_output(void *context, size_t n){
+    ((builder_t *)context)->len+=n;
+}
+
+/**
+ * Appends the output of a command substitution, without its trailing
+ * newlines. The output is captured straight into the text of the builder, and
+ * unquoted, it is split into fields where it is, since fields are never longer
+ * than the text they come from.
+ *
+ * @param builder The builder.
+ * @param expansion The command substitution.
+ * @param split True to split the output into fields.
+ */
+static void append_command(builder_t *builder, const expansion_t *expansion, bool split){
+    size_t start=builder->len;
+    capture_t capture={reserve_output,commit_output,builder};
+    substitute(builder->shell,expansion,&capture);
+    size_t end=builder->len;
+    while(end>start&&builder->text[end-1]=='\n'){
+        end--;
+    }
+    if(!split){
+        builder->len=end;
+        builder->in_field=true;
+        return;
+    }
+    builder->len=start;
+    size_t pos=start;
+    while(pos<end){
+        size_t run=pos;
+        while(run<end&&!is_ifs(builder,builder->text[run])){
+            run++;
+        }
+        if(run>pos){
+            memmove(builder->text+builder->len,builder->text+pos,run-pos);
+            builder->len+=run-pos;
+            builder->in_field=true;
+        }
+        pos=run;
+        if(pos<end){
+            // The NUL that ends the field goes where the separators were, before what is still to be moved
+            while(pos<end&&is_ifs(builder,builder->text[pos])){
+                pos++;
+            }
+            end_field(builder);
+        }
+    }
+}
+
+/**
+ * Looks up the value of a parameter.
+ *
+ * @param shell The current shell state.
+ * @param expansion The expansion naming it.
+ * @param number A buffer for a value that is a number.
+ * @return The value; NULL if the parameter is not set.
+ */
+static const char *param_value(msh_t *shell, const expansion_t *expansion, char number[24]){
+    switch(expansion->type){
+        case PARAM_VARIABLE:
+            return symbol_value(shell->variables,expansion->symbol);
+        case PARAM_POSITIONAL:
+            if(expansion->index==0){
+                return shell->num_params>0?shell->params[0]:"msh";
+            }
+            return expansion->index<shell->num_params?shell->params[expansion->index]:NULL;
+        case PARAM_COUNT:
+            snprintf(number,24,"%d",shell->num_params>0?shell->num_params-1:0);
+            return number;
+        case PARAM_STATUS:
+            snprintf(number,24,"%d",shell->last_status);
+            return number;
+        case PARAM_BACKGROUND_PID:
+            if(shell->last_background_pid==0){
+                return NULL;
+            }
+            snprintf(number,24,"%d",(int)shell->last_background_pid);
+            return number;
+        case PARAM_PID:
+            snprintf(number,24,"%d",(int)shell->pid);
+            return number;
+        default:
+            // $@ and $* are set if there is at least one parameter
+            return shell->num_params>1?"":NULL;
+    }
+}
+
+/**
+ * Appends the positional parameters: as separate fields for "$@", and joined
+ * by the first character of IFS for "$*". Unquoted, both are split.
+ *
+ * @param builder The builder.
+ * @param expansion The expansion of $@ or $*.
+ * @param quoted True if the expansion is quoted.
+ */
+static void append_params(builder_t *builder, const expansion_t *expansion, bool quoted){
+    msh_t *shell=builder->shell;
+    for(int i=1;i<shell->num_params;i++){
+        if(i>1){
+            if(!quoted){
+                end_field(builder);
+            }
+            else if(expansion->type==PARAM_ALL){
+                builder->in_field=true;
+                end_field(builder);
+            }
+            else if(builder->ifs[0]!='\0'){
+                append_text(builder,builder->ifs,1);
+            }
+        }
+        append_value(builder,shell->params[i],strlen(shell->params[i]),!quoted);
+    }
+}
+
+/**
+ * Appends the value of a parameter expansion, applying its operator.
+ *
+ * @param builder The builder.
+ * @param expansion The expansion.
+ * @param quoted True if the expansion, or the word it is part of, is quoted.
+ * @param split True to split the value into fields.
+ */
+static void append_expansion(builder_t *builder, const expansion_t *expansion, bool quoted, bool split){
+    msh_t *shell=builder->shell;
+    if(expansion->type==PARAM_COMMAND){
+        append_command(builder,expansion,split);
+        return;
+    }
+    char number[24];
+    const char *value=param_value(shell,expansion,number);
+    bool unset=value==NULL||(expansion->colon&&*value=='\0'&&expansion->type!=PARAM_ALL&&expansion->type!=PARAM_ALL_JOINED);
+    switch(expansion->op){
+        case '#':
+            snprintf(number,sizeof(number),"%zu",value!=NULL?strlen(value):0);
+            append_value(builder,number,strlen(number),false);
+            return;
+        case '-':
+            if(unset){
+                append_word(builder,expansion->word_text,expansion->word,quoted,split,split&&!expansion->word->quoted);
+                return;
+            }
+            break;
+        case '+':
+            if(!unset){
+                append_word(builder,expansion->word_text,expansion->word,quoted,split,split&&!expansion->word->quoted);
+            }
+            else if(quoted){
+                builder->in_field=true;
+            }
+            return;
+        case '=':
+            if(unset){
+                // The word is expanded in place, then becomes the value
+                size_t start=builder->len;
+                bool in_field=builder->in_field;
+                append_word(builder,expansion->word_text,expansion->word,true,false,false);
+                assign_symbol(shell->variables,expansion->symbol,builder->text+start,builder->len-start);
+                builder->in_field=in_field||quoted||builder->len>start;
+                return;
+            }
+            break;
+    }
+    if(expansion->type==PARAM_ALL||expansion->type==PARAM_ALL_JOINED){
+        append_params(builder,expansion,quoted);
+        return;
+    }
+    if(value!=NULL){
+        append_value(builder,value,strlen(value),split);
+    }
+    else if(quoted){
+        builder->in_field=true;
+    }
+}
+
+/**
+ * Appends text of a word to the current field.
+ *
+ * @param builder The builder.
+ * @param s The text.
+ * @param n Its length.
+ * @param split True to split it into fields.
+ */
+static void append_literal(builder_t *builder, const char *s, size_t n, bool split){
+    if(split){
+        append_split(builder,s,n);
+    }
+    else{
+        append_text(builder,s,n);
+    }
+}
+
+/**
+ * Appends a word to the current field: its text, with the values of its
+ * expansions inserted.
+ *
+ * @param builder The builder.
+ * @param text The text of the word.
+ * @param word Its expansions.
+ * @param quoted True if the word is inside quotes (e.g. the word of "${NAME-WORD}").
+ * @param split True to split the values of unquoted expansions.
+ * @param split_text True to split the text too, as for the unquoted word of ${NAME-WORD}.
+ */
+static void append_word(builder_t *builder, const char *text, const word_t *word, bool quoted, bool split, bool split_text){
+    size_t pos=0;
+    // Quotes that are not around an expansion keep the word, even if it comes out empty
+    bool quotes_kept=word->quoted;
+    for(const expansion_t *expansion=word->expansions;expansion!=NULL;expansion=expansion->next){
+        quotes_kept&=!expansion->quoted;
+        append_literal(builder,text+pos,expansion->offset-pos,split_text);
+        pos=expansion->offset;
+        bool inner_quoted=quoted||expansion->quoted;
+        append_expansion(builder,expansion,inner_quoted,split&&!inner_quoted);
+    }
+    append_literal(builder,text+pos,strlen(text+pos),split_text);
+    if(quotes_kept){
+        builder->in_field=true;
+    }
+}
+
+/**
+ * Allocates memory on the expansion stack.
+ *
+ * @param shell The current shell state.
+ * @param size The number of bytes.
+ * @return The memory, aligned for pointers.
+ */
+void *expand_alloc(msh_t *shell, size_t size){
+    expand_stack_t *stack=&shell->expand_stack;
+    size=(size+sizeof(void*)-1)&~(sizeof(void*)-1);
+    expand_block_t *block=stack->top;
+    if(block==NULL||block->size-block->used<size){
+        block=stack->spare;
+        if(block!=NULL&&block->size>=size){
+            stack->spare=NULL;
+        }
+        else{
+            size_t block_size=size>EXPAND_BLOCK_SIZE?size:EXPAND_BLOCK_SIZE;
+            block=malloc(sizeof(expand_block_t));
+            char *data=malloc(block_size);
+            if(block==NULL||data==NULL){
+                perror("Failed to allocate memory for an expansion");
+                exit(EXIT_FAILURE);
+            }
+            block->data=data;
+            block->size=block_size;
+        }
+        block->used=0;
+        block->prev=stack->top;
+        stack->top=block;
+    }
+    void *p=block->data+block->used;
+    block->used+=size;
+    return p;
+}
+
+/**
+ * Takes the current position of the expansion stack.
+ *
+ * @param shell The current shell state.
+ * @return The position.
+ */
+expand_mark_t expand_mark(msh_t *shell){
+    expand_block_t *top=shell->expand_stack.top;
+    expand_mark_t mark={top,top!=NULL?top->used:0};
+    return mark;
+}
+
+/**
+ * Frees a block of the expansion stack.
+ *
+ * @param block The block; NULL is ignored.
+ */
+static void free_block(expand_block_t *block){
+    if(block!=NULL){
+        free(block->data);
+        free(block);
+    }
+}
+
+/**
+ * Pops everything pushed on the expansion stack after a position. The last
+ * block popped is kept for reuse.
+ *
+ * @param shell The current shell state.
+ * @param mark The position.
+ */
+void expand_release(msh_t *shell, expand_mark_t mark){
+    expand_stack_t *stack=&shell->expand_stack;
+    while(stack->top!=mark.block){
+        expand_block_t *block=stack->top;
+        stack->top=block->prev;
+        if(stack->spare==NULL||stack->spare->size<block->size){
+            free_block(stack->spare);
+            stack->spare=block;
+        }
+        else{
+            free_block(block);
+        }
+    }
+    if(mark.block!=NULL){
+        mark.block->used=mark.used;
+    }
+}
+
+/**
+ * Moves the fields of a builder onto the expansion stack.
+ *
+ * @param builder The builder.
+ * @return The NULL-terminated fields.
+ */
+static char **push_fields(builder_t *builder){
+    char **argv=expand_alloc(builder->shell,sizeof(char*)*(builder->num_fields+1)+builder->len);
+    char *text=(char *)(argv+builder->num_fields+1);
+    memcpy(text,builder->text,builder->len);
+    for(int i=0;i<builder->num_fields;i++){
+        const field_t *field=&builder->fields[i];
+        argv[i]=field->literal!=NULL?(char *)field->literal:text+field->offset;
+    }
+    argv[builder->num_fields]=NULL;
+    return argv;
+}
+
+/**
+ * Expands the words of a command into fields.
+ *
+ * @param shell The current shell state.
+ * @param num_words The number of words.
+ * @param words The text of the words.
+ * @param expand What each word needs expanded; NULL if no word has expansions.
+ * @param argc Receives the number of fields.
+ * @return The NULL-terminated fields; words itself if expand is NULL.
+ */
+char **expand_words(msh_t *shell, int num_words, char **words, word_t **expand, int *argc){
+    if(expand==NULL){
+        *argc=num_words;
+        return words;
+    }
+    builder_t builder;
+    init_builder(&builder,shell);
+    for(int i=0;i<num_words;i++){
+        if(expand[i]==NULL){
+            add_field(&builder,words[i],0);
+            continue;
+        }
+        append_word(&builder,words[i],expand[i],false,!expand[i]->assignment,false);
+        end_field(&builder);
+    }
+    char **argv=push_fields(&builder);
+    *argc=builder.num_fields;
+    free_builder(&builder);
+    return argv;
+}
+
+/**
+ * Expands a word into a single field, without splitting it.
+ *
+ * @param shell The current shell state.
+ * @param text The text of the word.
+ * @param expand What the word needs expanded; NULL for a plain word.
+ * @return The expanded word; text itself if expand is NULL.
+ */
+char *expand_word(msh_t *shell, char *text, const word_t *expand){
+    if(expand==NULL){
+        return text;
+    }
+    builder_t builder;
+    init_builder(&builder,shell);
+    append_word(&builder,text,expand,false,false,false);
+    append(&builder,"",1);
+    char *word=expand_alloc(shell,builder.len);
+    memcpy(word,builder.text,builder.len);
+    free_builder(&builder);
+    return word;
+}
+
+/**
+ * Sets the variables assigned by a command that has no name.
+ *
+ * @param shell The current shell state.
+ * @param assignments The assignments.
+ */
+void assign_variables(msh_t *shell, const assignment_t *assignments){
+    for(const assignment_t *assignment=assignments;assignment!=NULL;assignment=assignment->next){
+        expand_mark_t mark=expand_mark(shell);
+        const char *value=expand_word(shell,assignment->value,assignment->expand);
+        assign_symbol(shell->variables,assignment->symbol,value,strlen(value));
+        expand_release(shell,mark);
+    }
+}
+
+/**
+ * Builds the environment of a program run with assignments before its name.
+ *
+ * @param shell The current shell state.
+ * @param assignments The assignments; NULL for the shell's environment.
+ * @return The NULL-terminated environment.
+ */
+char **command_environment(msh_t *shell, const assignment_t *assignments){
+    char **envp=environment(shell->variables);
+    if(assignments==NULL){
+        return envp;
+    }
+    int num_assignments=0;
+    for(const assignment_t *assignment=assignments;assignment!=NULL;assignment=assignment->next){
+        num_assignments++;
+    }
+    int num_entries=0;
+    while(envp[num_entries]!=NULL){
+        num_entries++;
+    }
+    char **entries=expand_alloc(shell,sizeof(char*)*(num_entries+num_assignments+1));
+    int count=0;
+    // Entries the assignments replace are left out
+    for(int i=0;i<num_entries;i++){
+        bool replaced=false;
+        for(const assignment_t *assignment=assignments;assignment!=NULL&&!replaced;assignment=assignment->next){
+            const symbol_t *symbol=assignment->symbol;
+            replaced=strncmp(envp[i],symbol->name,symbol->len)==0&&envp[i][symbol->len]=='=';
+        }
+        if(!replaced){
+            entries[count++]=envp[i];
+        }
+    }
+    for(const assignment_t *assignment=assignments;assignment!=NULL;assignment=assignment->next){
+        const symbol_t *symbol=assignment->symbol;
+        const char *value=expand_word(shell,assignment->value,assignment->expand);
+        size_t len=strlen(value);
+        char *entry=expand_alloc(shell,symbol->len+len+2);
+        memcpy(entry,symbol->name,symbol->len);
+        entry[symbol->len]='=';
+        memcpy(entry+symbol->len+1,value,len+1);
+        // A later assignment to the same name wins
+        for(int i=count;i>0;i--){
+            if(strncmp(entries[i-1],symbol->name,symbol->len)==0&&entries[i-1][symbol->len]=='='){
+                entries[i-1]=entry;
+                entry=NULL;
+                break;
+            }
+        }
+        if(entry!=NULL){
+            entries[count++]=entry;
+        }
+    }
+    entries[count]=NULL;
+    return entries;
+}
+
+/**
+ * Gives variables the values assigned before the name of a builtin or function.
+ *
+ * @param shell The current shell state.
+ * @param assignments The assignments.
+ * @param count Receives the number of variables set.
+ * @return The values the variables had.
+ */
+saved_variable_t *push_assignments(msh_t *shell, const assignment_t *assignments, int *count){
+    int num_assignments=0;
+    for(const assignment_t *assignment=assignments;assignment!=NULL;assignment=assignment->next){
+        num_assignments++;
+    }
+    saved_variable_t *saved=expand_alloc(shell,sizeof(saved_variable_t)*num_assignments);
+    int i=0;
+    for(const assignment_t *assignment=assignments;assignment!=NULL;assignment=assignment->next){
+        const char *old=symbol_value(shell->variables,assignment->symbol);
+        saved[i].symbol=assignment->symbol;
+        saved[i].value=NULL;
+        if(old!=NULL){
+            size_t len=strlen(old);
+            char *copy=expand_alloc(shell,len+1);
+            memcpy(copy,old,len+1);
+            saved[i].value=copy;
+        }
+        i++;
+        const char *value=expand_word(shell,assignment->value,assignment->expand);
+        assign_symbol(shell->variables,assignment->symbol,value,strlen(value));
+    }
+    *count=num_assignments;
+    return saved;
+}
+
+/**
+ * Gives variables back the values they had before push_assignments.
+ *
+ * @param shell The current shell state.
+ * @param saved The values.
+ * @param count The number of variables.
+ */
+void pop_assignments(msh_t *shell, const saved_variable_t *saved, int count){
+    // In reverse, so a name assigned twice gets its first value back
+    for(int i=count-1;i>=0;i--){
+        if(saved[i].value!=NULL){
+            assign_symbol(shell->variables,saved[i].symbol,saved[i].value,strlen(saved[i].value));
+        }
+        else{
+            unset_symbol(shell->variables,saved[i].symbol);
+        }
+    }
+}
+
+/**
+ * Frees the blocks of an expansion stack.
+ *
+ * @param stack The stack.
+ */
+void free_expand_stack(expand_stack_t *stack){
+    while(stack->top!=NULL){
+        expand_block_t *block=stack->top;
+        stack->top=block->prev;
+        free_block(block);
+    }
+    free_block(stack->spare);
+    stack->spare=NULL;
+}
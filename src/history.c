@@ -1,12 +1,729 @@
+#define _GNU_SOURCE
 #include "history.h"
+#include "history_index.h"
+#include "history_format.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
 
 const char *HISTORY_FILE_PATH = "../data/.msh_history";
 
+//writev accepts at most IOV_MAX (1024) buffers: a timing record, a line and its newline per command
+#define LINES_PER_WRITE 256
+
+//Maps the hash of a line to the number of its newest copy; number 0 marks an empty slot
+typedef struct dedup_entry {
+    uint64_t hash;
+    int number;
+} dedup_entry_t;
+
+/**
+ * Builds the path of the file a new history file is written to before it is
+ * renamed over the old one.
+ *
+ * @return The path, to be freed by the caller.
+ */
+static char *temp_path(){
+    size_t path_len=strlen(HISTORY_FILE_PATH);
+    char *tmp_path=malloc(path_len+5);
+    memcpy(tmp_path,HISTORY_FILE_PATH,path_len);
+    memcpy(tmp_path+path_len,".tmp",5);
+    return tmp_path;
+}
+
+/**
+ * Maps the lines of a text history file and indexes the starts of the last
+ * max_history, scanning backwards from the end with memrchr. Only the
+ * indexed tail is read, so startup does not depend on the length of the
+ * journal. Timing records are parsed into the timings of the lines they
+ * precede.
+ *
+ * @param history A pointer to a history structure with an empty ring.
+ * @param missing_newline Set to true if the file does not end with a newline.
+ * @return The number of lines in the file, counted up to 2 * max_history + 1; 0, with nothing
+ *         loaded, if memory runs out.
+ */
+static int load_text(history_t *history, bool *missing_newline){
+    const char *map=history->map;
+    size_t size=history->map_size;
+    *missing_newline=map[size-1]!='\n';
+    // Every line, the last one included, is treated as ending just before its terminator
+    size_t end=*missing_newline?size:size-1;
+    int max_history=history->max_history;
+    int limit=2*max_history+1;
+    size_t *starts=malloc(sizeof(size_t)*(max_history+1));
+    if(starts==NULL){
+        return 0;
+    }
+    history_timing_t *timings=NULL;
+    int lines=0;
+    size_t search_end=end;
+    while(lines<limit){
+        const char *newline=search_end>0?memrchr(map,'\n',search_end):NULL;
+        size_t start=newline==NULL?0:(size_t)(newline-map)+1;
+        history_timing_t timing;
+        if(!parse_text_record(map+start,search_end-start,&timing)){
+            if(lines<max_history){
+                starts[max_history-1-lines]=start;
+            }
+            lines++;
+        }
+        else if(lines>0&&lines<=max_history){
+            // A record belongs to the line after it, which was found just before
+            if(timings==NULL){
+                timings=calloc(max_history,sizeof(history_timing_t));
+            }
+            if(timings!=NULL){
+                timings[max_history-lines]=timing;
+            }
+        }
+        if(newline==NULL){
+            break;
+        }
+        search_end=newline-map;
+    }
+
+    int loaded=lines<max_history?lines:max_history;
+    history->map_offsets=malloc(sizeof(size_t)*(loaded>0?loaded:1));
+    if(history->map_offsets==NULL){
+        // The history starts empty rather than half-loaded
+        free(starts);
+        free(timings);
+        return 0;
+    }
+    memcpy(history->map_offsets,starts+max_history-loaded,sizeof(size_t)*loaded);
+    if(timings!=NULL){
+        memmove(timings,timings+max_history-loaded,sizeof(history_timing_t)*loaded);
+        memset(timings+loaded,0,sizeof(history_timing_t)*(max_history-loaded));
+        history->timings=timings;
+    }
+    history->num_mapped=loaded;
+    free(starts);
+    return lines;
+}
+
+/**
+ * Indexes the last max_history records of a binary history file. Records
+ * appended since the archive was written are scanned forward; the rest are
+ * taken from the end of the archive through its footer index without reading
+ * the ones before them.
+ *
+ * @param history A pointer to a history structure with an empty ring.
+ * @param image The opened history file.
+ * @return The number of records in the file; 0, with nothing loaded, if memory runs out.
+ */
+static int load_binary(history_t *history, const history_image_t *image){
+    int max_history=history->max_history;
+    // The offsets of the last max_history appended records, in a ring
+    size_t *recent=malloc(sizeof(size_t)*max_history);
+    if(recent==NULL){
+        return 0;
+    }
+    int appended=0;
+    size_t offset=image->appended;
+    history_record_t record;
+    size_t n;
+    while(offset<image->size&&(n=parse_binary_record(image->data+offset,image->size-offset,&record))>0){
+        recent[appended%max_history]=offset;
+        appended++;
+        offset+=n;
+    }
+    int from_appended=appended<max_history?appended:max_history;
+    int from_archive=max_history-from_appended;
+    if(from_archive>image->archive_count){
+        from_archive=image->archive_count;
+    }
+    int loaded=from_archive+from_appended;
+    history->map_offsets=malloc(sizeof(size_t)*(loaded>0?loaded:1));
+    if(history->map_offsets==NULL){
+        free(recent);
+        return 0;
+    }
+    for(int i=0;i<from_archive;i++){
+        history->map_offsets[i]=archive_record_offset(image,image->archive_count-from_archive+i);
+    }
+    for(int i=0;i<from_appended;i++){
+        history->map_offsets[from_archive+i]=recent[(appended-from_appended+i)%max_history];
+    }
+    free(recent);
+
+    for(int i=0;i<loaded;i++){
+        size_t start=history->map_offsets[i];
+        if(start<image->size&&parse_binary_record(image->data+start,image->size-start,&record)>0&&
+           record.timing.start_us!=0){
+            if(history->timings==NULL){
+                history->timings=calloc(max_history,sizeof(history_timing_t));
+                if(history->timings==NULL){
+                    break;
+                }
+            }
+            history->timings[i]=record.timing;
+        }
+    }
+    history->num_mapped=loaded;
+    return image->archive_count+appended;
+}
+
+/**
+ * Maps the history file, detects its format and indexes its most recent
+ * commands. The commands are copied out of the mapping only when they are
+ * used. A compressed archive is decompressed into memory instead.
+ *
+ * @param history A pointer to a history structure with an empty ring.
+ * @param fd The open history file.
+ * @param missing_newline Set to true if a text file does not end with a newline.
+ * @return The number of commands in the file (for text files, counted up to 2 * max_history + 1).
+ */
+static int load_history(history_t *history, int fd, bool *missing_newline){
+    *missing_newline=false;
+    history->format=HISTORY_FORMAT;
+    history->map_format=HISTORY_FORMAT;
+    struct stat st;
+    if(fd==-1||fstat(fd,&st)==-1||st.st_size==0){
+        return 0;
+    }
+    char *map=mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    if(map==MAP_FAILED){
+        return 0;
+    }
+    history_image_t image;
+    bool readable=open_history_image(map,st.st_size,&image);
+    history->format=image.format;
+    history->map_format=image.format;
+    if(!readable){
+        munmap(map,st.st_size);
+        return 0;
+    }
+    int lines;
+    if(image.format==HISTORY_TEXT){
+        history->map=map;
+        history->map_size=st.st_size;
+        lines=load_text(history,missing_newline);
+    }
+    else{
+        lines=load_binary(history,&image);
+        if(image.owned!=NULL){
+            // Records are read from the decompressed copy from now on
+            munmap(map,st.st_size);
+            history->map=image.owned;
+            history->map_owned=true;
+        }
+        else{
+            history->map=map;
+        }
+        history->map_size=image.size;
+    }
+    history->size=history->num_mapped;
+    history->count=history->num_mapped;
+    return lines;
+}
+
+/**
+ * Finds the stored line in a ring slot without copying lines that are still
+ * only in the mapped file.
+ *
+ * @param history A pointer to the history structure.
+ * @param slot The ring slot of the line.
+ * @param len Receives the length of the line.
+ * @return The start of the line, which is not NUL-terminated if it is mapped.
+ */
+static const char *line_at(history_t *history, int slot, size_t *len){
+    if(history->lines[slot]!=NULL){
+        *len=strlen(history->lines[slot]);
+        return history->lines[slot];
+    }
+    // Slots are only ever filled, so an empty one still holds the line loaded into it
+    size_t start=history->map_offsets[slot];
+    const char *line=history->map+start;
+    if(history->map_format==HISTORY_BINARY){
+        history_record_t record;
+        if(start>=history->map_size||parse_binary_record(line,history->map_size-start,&record)==0){
+            *len=0;
+            return "";
+        }
+        *len=record.len;
+        return record.line;
+    }
+    const char *end=memchr(line,'\n',history->map+history->map_size-line);
+    *len=(end==NULL?history->map+history->map_size:end)-line;
+    if(joined_text_line(line,*len)){
+        // A command of several lines is copied out decoded, as find_line_history would
+        char *command=malloc(*len+1);
+        if(command==NULL){
+            *len=0;
+            return "";
+        }
+        *len=decode_text_line(command,line,*len);
+        command[*len]='\0';
+        history->lines[slot]=command;
+        return command;
+    }
+    unescape_text_line(&line,len);
+    return line;
+}
+
+/**
+ * Replaces the history file with the stored lines and their timings, in the
+ * format of the journal. The new file is written next to the old one, synced
+ * and renamed over it, so a crash leaves either the old journal or the
+ * complete new one.
+ *
+ * @param history A pointer to the history structure.
+ */
+static void compact_history(history_t *history){
+    history_record_t *records=malloc(sizeof(history_record_t)*(history->size+1));
+    if(records==NULL){
+        return;
+    }
+    for(int i=0;i<history->size;i++){
+        int slot=(history->head+i)%history->max_history;
+        records[i].line=line_at(history,slot,&records[i].len);
+        if(history->timings!=NULL){
+            records[i].timing=history->timings[slot];
+        }
+        else{
+            memset(&records[i].timing,0,sizeof(records[i].timing));
+        }
+    }
+    char *tmp_path=temp_path();
+    int fd=open(tmp_path,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+    if(fd!=-1){
+        bool ok=write_history_records(fd,history->format,records,history->size)&&fsync(fd)==0;
+        if(close(fd)==0&&ok){
+            rename(tmp_path,HISTORY_FILE_PATH);
+        }
+        else{
+            unlink(tmp_path);
+        }
+    }
+    free(tmp_path);
+    free(records);
+}
+
+/**
+ * Finds the ring slot of a stored line.
+ *
+ * @param history A pointer to the history structure.
+ * @param number The number of the line, which must still be stored.
+ * @return The slot holding the line.
+ */
+static int slot_of(history_t *history, int number){
+    int first=history->count-history->size+1;
+    return (history->head+number-first)%history->max_history;
+}
+
+/**
+ * Tells whether the line in a ring slot was erased as an older duplicate.
+ *
+ * @param history A pointer to the history structure.
+ * @param slot The ring slot of the line.
+ * @return True if the line was erased; otherwise, false.
+ */
+static bool is_erased(history_t *history, int slot){
+    return history->erased!=NULL&&history->erased[slot];
+}
+
+/**
+ * Computes the FNV-1a hash of a line.
+ *
+ * @param line The line to hash.
+ * @param len The length of the line.
+ * @return The 64-bit hash value.
+ */
+static uint64_t hash_line(const char *line, size_t len){
+    uint64_t hash=14695981039346656037ull;
+    for(size_t i=0;i<len;i++){
+        hash^=(unsigned char)line[i];
+        hash*=1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Finds the newest stored copy of a line that has not been erased.
+ *
+ * @param history A pointer to the history structure with a dedup table.
+ * @param line The line to look for.
+ * @param len The length of the line.
+ * @param hash The hash of the line.
+ * @return The number of the copy; 0 if the line is not stored.
+ */
+static int find_duplicate(history_t *history, const char *line, size_t len, uint64_t hash){
+    int mask=history->dedup_capacity-1;
+    int first=history->count-history->size+1;
+    for(int i=hash&mask;history->dedup_table[i].number!=0;i=(i+1)&mask){
+        dedup_entry_t *entry=&history->dedup_table[i];
+        if(entry->hash!=hash){
+            continue;
+        }
+        // Entries are never removed, so the copy may have left the ring since
+        if(entry->number<first){
+            return 0;
+        }
+        int slot=slot_of(history,entry->number);
+        size_t stored_len;
+        const char *stored=line_at(history,slot,&stored_len);
+        if(!is_erased(history,slot)&&stored_len==len&&memcmp(stored,line,len)==0){
+            return entry->number;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+/**
+ * Records a line as the newest copy of its hash in the dedup table.
+ *
+ * @param history A pointer to the history structure with a dedup table.
+ * @param hash The hash of the line.
+ * @param number The number of the line.
+ */
+static void insert_duplicate(history_t *history, uint64_t hash, int number){
+    int mask=history->dedup_capacity-1;
+    int i=hash&mask;
+    while(history->dedup_table[i].number!=0&&history->dedup_table[i].hash!=hash){
+        i=(i+1)&mask;
+    }
+    if(history->dedup_table[i].number==0){
+        history->dedup_used++;
+    }
+    history->dedup_table[i].hash=hash;
+    history->dedup_table[i].number=number;
+}
+
+/**
+ * Rebuilds the dedup table from the lines in the ring, erasing every copy of
+ * a line but the newest. The table is sized to four times the ring, so the
+ * entries left behind by lines that leave the ring only force a rebuild
+ * after as many new lines as the ring holds.
+ *
+ * @param history A pointer to the history structure with an erased array.
+ * @return True if the table was built; otherwise, false.
+ */
+static bool build_dedup(history_t *history){
+    int capacity=64;
+    while(capacity<4*history->size){
+        capacity*=2;
+    }
+    dedup_entry_t *table=calloc(capacity,sizeof(dedup_entry_t));
+    if(table==NULL){
+        return false;
+    }
+    free(history->dedup_table);
+    history->dedup_table=table;
+    history->dedup_capacity=capacity;
+    history->dedup_used=0;
+    int first=history->count-history->size+1;
+    for(int i=0;i<history->size;i++){
+        int slot=(history->head+i)%history->max_history;
+        if(history->erased[slot]){
+            continue;
+        }
+        size_t len;
+        const char *line=line_at(history,slot,&len);
+        uint64_t hash=hash_line(line,len);
+        int older=find_duplicate(history,line,len,hash);
+        if(older!=0){
+            history->erased[slot_of(history,older)]=1;
+        }
+        insert_duplicate(history,hash,first+i);
+    }
+    return true;
+}
+
+/**
+ * Builds the dedup table the first time erasedups needs it, so shells that do
+ * not erase duplicates never hash the lines (or touch the mapped file).
+ *
+ * @param history A pointer to the history structure.
+ * @return True if the table exists; otherwise, false.
+ */
+static bool ensure_dedup(history_t *history){
+    if(history->dedup_table!=NULL){
+        return true;
+    }
+    if(history->erased==NULL){
+        history->erased=calloc(history->max_history,1);
+        if(history->erased==NULL){
+            return false;
+        }
+    }
+    return build_dedup(history);
+}
+
+/**
+ * Applies the dedup mode to a line about to be stored: a repeat of the
+ * newest line is dropped under ignoredups, and under erasedups the older
+ * copy of the line is erased.
+ *
+ * @param history A pointer to the history structure.
+ * @param cmd_line The line about to be stored.
+ * @return True if the line should be stored; false if it is dropped.
+ */
+static bool keep_line(history_t *history, const char *cmd_line){
+    size_t len=strlen(cmd_line);
+    if((history->dedup&HISTORY_IGNOREDUPS)&&history->size>0){
+        size_t last_len;
+        const char *last=line_at(history,slot_of(history,history->count),&last_len);
+        if(last_len==len&&memcmp(last,cmd_line,len)==0){
+            return false;
+        }
+    }
+    if((history->dedup&HISTORY_ERASEDUPS)&&ensure_dedup(history)){
+        int older=find_duplicate(history,cmd_line,len,hash_line(cmd_line,len));
+        if(older!=0){
+            history->erased[slot_of(history,older)]=1;
+        }
+    }
+    return true;
+}
+
+/**
+ * Stores a command line in the ring without journaling it, keeping the
+ * search index and the dedup table (once they exist) in step with the ring.
+ *
+ * @param history A pointer to the history structure.
+ * @param cmd_line The command line to store.
+ */
+static void store_line(history_t *history, const char *cmd_line){
+    int slot;
+    if(history->size==history->max_history){
+        slot=history->head;
+        if(history->index!=NULL){
+            size_t len;
+            const char *line=line_at(history,slot,&len);
+            index_remove_line(history->index,history->count-history->size+1,line,len);
+        }
+        free(history->lines[slot]);
+        if(history->erased!=NULL){
+            history->erased[slot]=0;
+        }
+        history->head=(history->head+1)%history->max_history;
+    }
+    else{
+        slot=(history->head+history->size)%history->max_history;
+        history->size++;
+    }
+    history->lines[slot]=strdup(cmd_line);
+    if(history->timings!=NULL){
+        history->timings[slot].start_us=0;
+    }
+    history->count++;
+    size_t len=strlen(cmd_line);
+    if(history->index!=NULL){
+        index_add_line(history->index,history->count,cmd_line,len);
+    }
+    if(history->dedup_table!=NULL){
+        insert_duplicate(history,hash_line(cmd_line,len),history->count);
+        if(2*history->dedup_used>history->dedup_capacity){
+            build_dedup(history);
+        }
+    }
+}
+
+/**
+ * Sets the timing of a stored line, allocating the timings the first time.
+ *
+ * @param history A pointer to the history structure.
+ * @param number The number of the line, which must still be stored.
+ * @param timing The timing of the line.
+ */
+static void set_timing(history_t *history, int number, const history_timing_t *timing){
+    if(history->timings==NULL){
+        history->timings=calloc(history->max_history,sizeof(history_timing_t));
+        if(history->timings==NULL){
+            return;
+        }
+    }
+    history->timings[slot_of(history,number)]=*timing;
+}
+
+/**
+ * Reads the format of the open journal from its first bytes. An empty
+ * journal keeps the format it had.
+ *
+ * @param history A pointer to the history structure.
+ */
+static void detect_format(history_t *history){
+    char header[BINARY_HEADER_SIZE];
+    ssize_t n=pread(history->journal_fd,header,sizeof(header),0);
+    if(n>0){
+        history->format=history_file_format(header,n);
+    }
+}
+
+/**
+ * Writes the header of a binary journal to the locked journal if it is still
+ * empty.
+ *
+ * @param history A pointer to the history structure.
+ */
+static void start_journal(history_t *history){
+    struct stat st;
+    if(history->format==HISTORY_BINARY&&fstat(history->journal_fd,&st)==0&&st.st_size==0){
+        char header[BINARY_HEADER_SIZE];
+        format_binary_header(header,HISTORY_CODEC_NONE,0);
+        write(history->journal_fd,header,sizeof(header));
+    }
+}
+
+/**
+ * Locks the journal. If another shell compacted the history file (renamed a
+ * new file over it) since the journal was opened, the new file is opened and
+ * locked instead, since lines appended to the replaced one would be lost.
+ * The new file only holds lines that were already read from the old one, so
+ * reading resumes at its end. It may also have been converted to the other
+ * format, which is detected again.
+ *
+ * @param history A pointer to the history structure.
+ * @param operation LOCK_SH to read the journal; LOCK_EX to append to it.
+ * @return True if the journal is locked; false if it could not be opened.
+ */
+static bool lock_journal(history_t *history, int operation){
+    bool reopened=false;
+    while(history->journal_fd!=-1){
+        while(flock(history->journal_fd,operation)==-1&&errno==EINTR){
+        }
+        struct stat open_st;
+        struct stat path_st;
+        if(fstat(history->journal_fd,&open_st)==0&&stat(HISTORY_FILE_PATH,&path_st)==0&&
+           open_st.st_dev==path_st.st_dev&&open_st.st_ino==path_st.st_ino){
+            if(reopened){
+                history->journal_size=open_st.st_size;
+                detect_format(history);
+            }
+            return true;
+        }
+        // The lines mapped from the file keep it open, and the lock with it, past close
+        flock(history->journal_fd,LOCK_UN);
+        close(history->journal_fd);
+        history->journal_fd=open(HISTORY_FILE_PATH,O_RDWR|O_APPEND|O_CREAT|O_CLOEXEC,0644);
+        reopened=true;
+    }
+    return false;
+}
+
+/**
+ * Reads what other shells appended to the locked journal since it was last
+ * read or written.
+ *
+ * @param history A pointer to the history structure.
+ * @param len Receives the number of bytes read.
+ * @return The NUL-terminated bytes, to be freed by the caller; NULL if there are none.
+ */
+static char *read_journal(history_t *history, size_t *len){
+    *len=0;
+    struct stat st;
+    if(fstat(history->journal_fd,&st)==-1){
+        return NULL;
+    }
+    if((size_t)st.st_size<=history->journal_size){
+        // Only a truncated file shrinks; start over at its end
+        history->journal_size=st.st_size;
+        return NULL;
+    }
+    size_t size=st.st_size-history->journal_size;
+    char *data=malloc(size+1);
+    ssize_t n=data==NULL?-1:pread(history->journal_fd,data,size,history->journal_size);
+    if(n<=0){
+        free(data);
+        return NULL;
+    }
+    data[n]='\0';
+    history->journal_size+=n;
+    *len=n;
+    return data;
+}
+
+/**
+ * Stores the binary records other shells wrote, as merge_lines does for the
+ * text format. Records have no terminator (the byte after a command is the
+ * length of the next record), so each command is copied out to end it.
+ *
+ * @param history A pointer to the history structure with no pending lines.
+ * @param data The bytes read from the journal.
+ * @param len The number of bytes in data.
+ */
+static void merge_records(history_t *history, const char *data, size_t len){
+    size_t offset=0;
+    history_record_t record;
+    size_t n;
+    while(offset<len&&(n=parse_binary_record(data+offset,len-offset,&record))>0){
+        offset+=n;
+        if(record.len==0){
+            continue;
+        }
+        char *line=strndup(record.line,record.len);
+        if(line==NULL){
+            return;
+        }
+        if(keep_line(history,line)){
+            store_line(history,line);
+            if(record.timing.start_us!=0){
+                set_timing(history,history->count,&record.timing);
+            }
+        }
+        free(line);
+    }
+}
+
+/**
+ * Stores the lines other shells wrote, with the timings from their records,
+ * applying the dedup mode to them as if they had been typed here. They are already in the journal, so they are not
+ * written again.
+ *
+ * @param history A pointer to the history structure with no pending lines.
+ * @param data The NUL-terminated bytes read from the journal; modified in place.
+ * @param len The number of bytes in data.
+ */
+static void merge_lines(history_t *history, char *data, size_t len){
+    if(history->format==HISTORY_BINARY){
+        merge_records(history,data,len);
+        return;
+    }
+    char *line=data;
+    history_timing_t timing={0};
+    while(line<data+len){
+        char *newline=memchr(line,'\n',data+len-line);
+        if(newline!=NULL){
+            *newline='\0';
+        }
+        history_timing_t record;
+        if(parse_text_record(line,strlen(line),&record)){
+            timing=record;
+        }
+        else if(*line!='\0'){
+            // A command is never longer than its line, so it is decoded in place
+            char *command=line;
+            command[decode_text_line(command,line,strlen(line))]='\0';
+            if(keep_line(history,command)){
+                store_line(history,command);
+                if(timing.start_us!=0){
+                    set_timing(history,history->count,&timing);
+                }
+            }
+            timing.start_us=0;
+        }
+        if(newline==NULL){
+            break;
+        }
+        line=newline+1;
+    }
+}
+
 /**
  * Allocates and initializes a history structure for storing command lines.
+ * The history file is opened as an append-only journal and locked, then its
+ * format is detected and its most recent lines are loaded. A journal longer than twice the history size
+ * is compacted first, while the lock keeps other shells from appending to it.
  *
  * @param max_history The maximum number of command lines the history can store.
  * @return A pointer to the newly allocated history structure; NULL if allocation fails.
@@ -18,27 +735,226 @@ history_t *alloc_history(int max_history){
     for(int i=0;i<max_history;i++){
         history->lines[i]=NULL;
     }
-    history->next=0;
-    FILE* fin=fopen(HISTORY_FILE_PATH,"r");
-    if(fin!=NULL){
-        char *line = NULL;
-        size_t len = 0;
-        ssize_t nRead;
-        while((nRead=getline(&line,&len,fin))!=-1&&history->next<history->max_history){
-            if(nRead>=1&&line[nRead-1]=='\n'){
-                line[nRead-1]='\0';
-            }
-            add_line_history(history,line);
-            free(line);
-            line=NULL;
+    history->head=0;
+    history->size=0;
+    history->count=0;
+    history->pending=0;
+    history->flush_every=HISTORY_FLUSH_EVERY;
+    history->merge=false;
+    history->dedup=0;
+    history->timed=false;
+    history->awaiting_timing=0;
+    history->timings=NULL;
+    history->journal_size=0;
+    history->format=HISTORY_FORMAT;
+    history->map_format=HISTORY_FORMAT;
+    history->map=NULL;
+    history->map_size=0;
+    history->map_owned=false;
+    history->map_offsets=NULL;
+    history->num_mapped=0;
+    history->index=NULL;
+    history->erased=NULL;
+    history->dedup_table=NULL;
+    history->dedup_capacity=0;
+    history->dedup_used=0;
+    bool missing_newline;
+    history->journal_fd=open(HISTORY_FILE_PATH,O_RDWR|O_APPEND|O_CREAT|O_CLOEXEC,0644);
+    if(!lock_journal(history,LOCK_EX)){
+        // The history can still be read without write access, just not journaled
+        int fd=open(HISTORY_FILE_PATH,O_RDONLY|O_CLOEXEC);
+        load_history(history,fd,&missing_newline);
+        if(fd!=-1){
+            close(fd);
+        }
+        return history;
+    }
+    int journal_lines=load_history(history,history->journal_fd,&missing_newline);
+    if(journal_lines>2*max_history){
+        compact_history(history);
+        missing_newline=false;
+        // Moves over to the new file; shells waiting for the lock do the same
+        lock_journal(history,LOCK_EX);
+    }
+    if(history->journal_fd!=-1){
+        if(missing_newline){
+            // Files written before the journal end without a newline
+            write(history->journal_fd,"\n",1);
+        }
+        start_journal(history);
+        struct stat st;
+        if(fstat(history->journal_fd,&st)==0){
+            history->journal_size=st.st_size;
         }
-        fclose(fin);
+        flock(history->journal_fd,LOCK_UN);
     }
     return history;
 }
 
 /**
- * Adds a new command line to the command history.
+ * Appends the commands not yet journaled to the history file with writev,
+ * straight from the ring, each after its timing record if it has one, or as
+ * a binary record in the binary format. The journal is locked while they are written, so
+ * lines from shells sharing the file are never interleaved. In merge mode the
+ * lines other shells appended since the last read are picked up under the
+ * same lock and stored after the new ones.
+ *
+ * @param history A pointer to the history structure.
+ */
+void flush_history(history_t *history){
+    if(history==NULL||history->pending==0){
+        return;
+    }
+    if(!lock_journal(history,LOCK_EX)){
+        history->pending=0;
+        return;
+    }
+    size_t merged_len=0;
+    char *merged=history->merge?read_journal(history,&merged_len):NULL;
+    start_journal(history);
+    bool binary=history->format==HISTORY_BINARY;
+    struct iovec iov[3*LINES_PER_WRITE];
+    char records[LINES_PER_WRITE][RECORD_MAX];
+    char *encoded[LINES_PER_WRITE];
+    int first=history->size-history->pending;
+    while(first<history->size){
+        int n=0;
+        int num_records=0;
+        int num_encoded=0;
+        size_t total=0;
+        for(;first<history->size&&n<3*LINES_PER_WRITE-2;first++){
+            int slot=(history->head+first)%history->max_history;
+            char *line=history->lines[slot];
+            size_t len=strlen(line);
+            size_t text_len=binary?len:encode_text_line(NULL,line,len);
+            if(text_len!=len){
+                // The text format changes the command (escapes or joins it), so a copy is written
+                char *text=malloc(text_len);
+                if(text==NULL){
+                    // Left out of the journal, like the rest of a batch that cannot be written
+                    continue;
+                }
+                encode_text_line(text,line,len);
+                encoded[num_encoded++]=text;
+                line=text;
+                len=text_len;
+            }
+            history_timing_t *timing=NULL;
+            if(history->timings!=NULL&&history->timings[slot].start_us!=0){
+                timing=&history->timings[slot];
+            }
+            // A binary record's prefix, or the timing line of a text record if it has one
+            char *record=records[num_records++];
+            iov[n].iov_base=record;
+            if(binary){
+                iov[n++].iov_len=format_binary_record(record,len,timing);
+            }
+            else{
+                iov[n++].iov_len=timing!=NULL?format_text_record(record,timing):0;
+            }
+            iov[n].iov_base=line;
+            iov[n++].iov_len=len;
+            iov[n].iov_base="\n";
+            iov[n++].iov_len=binary?0:1;
+            total+=iov[n-3].iov_len+iov[n-2].iov_len+iov[n-1].iov_len;
+        }
+        // A short write only happens when the disk is full; the rest of the batch is dropped then
+        ssize_t written;
+        while((written=writev(history->journal_fd,iov,n))<0&&errno==EINTR){
+        }
+        for(int i=0;i<num_encoded;i++){
+            free(encoded[i]);
+        }
+        if(written<0||(size_t)written<total){
+            break;
+        }
+    }
+    struct stat st;
+    if(fstat(history->journal_fd,&st)==0){
+        history->journal_size=st.st_size;
+    }
+    flock(history->journal_fd,LOCK_UN);
+    history->pending=0;
+    if(merged!=NULL){
+        merge_lines(history,merged,merged_len);
+        free(merged);
+    }
+}
+
+/**
+ * Picks up the lines other shells appended to the history file since it was
+ * last read or written, if the history is in merge mode. An unchanged journal
+ * costs a single fstat, so this can run before every prompt.
+ *
+ * @param history A pointer to the history structure.
+ */
+void merge_history(history_t *history){
+    if(history==NULL||!history->merge||history->journal_fd==-1){
+        return;
+    }
+    if(history->pending>0){
+        flush_history(history);
+        return;
+    }
+    struct stat st;
+    // A compacted file has been renamed over (nlink 0) and is checked for by lock_journal
+    if(fstat(history->journal_fd,&st)==0&&(size_t)st.st_size==history->journal_size&&st.st_nlink>0){
+        return;
+    }
+    if(!lock_journal(history,LOCK_SH)){
+        return;
+    }
+    size_t len;
+    char *data=read_journal(history,&len);
+    flock(history->journal_fd,LOCK_UN);
+    if(data!=NULL){
+        merge_lines(history,data,len);
+        free(data);
+    }
+}
+
+/**
+ * Rewrites the history file in another format. Pending lines are flushed
+ * first, and the journal stays locked while the new file is written and
+ * renamed over it, so no shell appends to the old file in between.
+ *
+ * @param history A pointer to the history structure.
+ * @param format HISTORY_TEXT or HISTORY_BINARY.
+ * @return The number of commands in the converted file; -1 if it could not be converted.
+ */
+int convert_history(history_t *history, int format){
+    if(history==NULL){
+        return -1;
+    }
+    flush_history(history);
+    merge_history(history);
+    if(!lock_journal(history,LOCK_EX)){
+        return -1;
+    }
+    char *tmp_path=temp_path();
+    int count=convert_history_file(HISTORY_FILE_PATH,tmp_path,format);
+    if(count==-1||rename(tmp_path,HISTORY_FILE_PATH)==-1){
+        unlink(tmp_path);
+        count=-1;
+    }
+    free(tmp_path);
+    if(count!=-1){
+        // An empty text file does not tell its format
+        history->format=format;
+    }
+    // Moves over to the new file and picks up its format
+    if(lock_journal(history,LOCK_EX)){
+        flock(history->journal_fd,LOCK_UN);
+    }
+    return count;
+}
+
+/**
+ * Adds a new command line to the command history. Once the history is full
+ * the oldest line is overwritten in place, so adding is O(1). The line is
+ * appended to the journal once flush_every lines are waiting. The dedup mode
+ * may drop the line or erase its older copy, found by hash. In timed mode
+ * the line waits for its timing instead.
  *
  * @param history A pointer to the history structure where the command line will be added.
  * @param cmd_line The command line string to add. It must not be NULL.
@@ -47,58 +963,233 @@ void add_line_history(history_t *history, const char *cmd_line){
     if(cmd_line==NULL||history==NULL){
         return;
     }
-    if(history->next==history->max_history){
-        free(history->lines[0]);
-        for(int i=0;i<history->next-1;i++){
-            history->lines[i]=history->lines[i+1];
-        }
-        history->next=history->max_history-1;
+    history->awaiting_timing=0;
+    if(!keep_line(history,cmd_line)){
+        return;
+    }
+    // A pending line is about to be overwritten: write the batch out first
+    if(history->pending==history->max_history){
+        flush_history(history);
+    }
+    store_line(history,cmd_line);
+    history->pending++;
+    if(history->timed){
+        // Journaled by time_line_history, together with its timing
+        history->awaiting_timing=history->count;
+    }
+    else if(history->pending>=history->flush_every){
+        flush_history(history);
+    }
+}
+
+/**
+ * Records the timing of the line added last and journals it once
+ * flush_every lines are waiting.
+ *
+ * @param history A pointer to the history structure.
+ * @param timing The timing of the line.
+ */
+void time_line_history(history_t *history, const history_timing_t *timing){
+    int number=history->awaiting_timing;
+    // The line may have left the ring since it was added
+    if(number==0||number<=history->count-history->size){
+        return;
+    }
+    history->awaiting_timing=0;
+    set_timing(history,number,timing);
+    if(history->pending>=history->flush_every){
+        flush_history(history);
+    }
+}
+
+/**
+ * Retrieves the timing of a stored line by its number.
+ *
+ * @param history A pointer to the history structure.
+ * @param index The number of the line.
+ * @return A pointer to the timing; NULL if the line is not stored, was erased or was not timed.
+ */
+const history_timing_t *find_timing_history(history_t *history, int index){
+    int first=history->count-history->size+1;
+    if(history->timings==NULL||index<first||index>history->count){
+        return NULL;
+    }
+    int slot=slot_of(history,index);
+    if(is_erased(history,slot)||history->timings[slot].start_us==0){
+        return NULL;
     }
-    history->lines[history->next]=strdup(cmd_line);
-    history->next++;
+    return &history->timings[slot];
 }
 
 /**
- * Prints the entire command history to standard output.
+ * Prints the entire command history to standard output, skipping lines
+ * erased as duplicates.
  *
  * @param history A pointer to the history structure whose contents are to be printed.
  */
 void print_history(history_t *history){
-    for(int i=1;i<=history->next;i++){
-        printf("%5d\t%s\n",i,history->lines[i-1]);
+    int first=history->count-history->size+1;
+    for(int i=0;i<history->size;i++){
+        int slot=(history->head+i)%history->max_history;
+        if(is_erased(history,slot)){
+            continue;
+        }
+        size_t len;
+        const char *line=line_at(history,slot,&len);
+        printf("%5d\t%.*s\n",first+i,(int)len,line);
     }
 }
 
 /**
- * Retrieves a command line from history by its index.
+ * Retrieves a command line from history by its number. A line loaded from
+ * the history file is copied out of the mapping the first time it is used.
  *
  * @param history A pointer to the history structure to search within.
- * @param index The 1-based index of the command line to retrieve.
- * @return A pointer to the command line string if found; NULL if the index is out of bounds.
+ * @param index The number of the command line to retrieve.
+ * @return A pointer to the command line string if found; NULL if the index is out of bounds or the line was erased.
  */
 char *find_line_history(history_t *history, int index){
-    if(index<1||index>history->max_history){
+    int first=history->count-history->size+1;
+    if(index<first||index>history->count){
+        return NULL;
+    }
+    int slot=slot_of(history,index);
+    if(is_erased(history,slot)){
         return NULL;
     }
-    return history->lines[index-1];
+    if(history->lines[slot]==NULL){
+        size_t len;
+        const char *line=line_at(history,slot,&len);
+        // A joined command has already been copied out by line_at
+        if(history->lines[slot]==NULL){
+            history->lines[slot]=strndup(line,len);
+        }
+    }
+    return history->lines[slot];
+}
+
+/**
+ * Builds the search index over the stored lines. It is only built for the
+ * first search, so shells that never search do not pay for it (or touch the
+ * lines still in the mapped file); from then on store_line keeps it current.
+ *
+ * @param history A pointer to the history structure.
+ * @return True if the index exists; otherwise, false.
+ */
+static bool ensure_index(history_t *history){
+    if(history->index!=NULL){
+        return true;
+    }
+    history->index=alloc_history_index();
+    if(history->index==NULL){
+        return false;
+    }
+    int first=history->count-history->size+1;
+    for(int i=0;i<history->size;i++){
+        size_t len;
+        const char *line=line_at(history,(history->head+i)%history->max_history,&len);
+        index_add_line(history->index,first+i,line,len);
+    }
+    return true;
 }
 
 /**
- * Deallocates the history structure and its stored command lines.
+ * Tells whether a stored line matches a search pattern.
+ *
+ * @param history A pointer to the history structure.
+ * @param number The number of the line.
+ * @param pattern The pattern.
+ * @param len The length of the pattern.
+ * @param prefix True to match only at the start of the line.
+ * @return True if the line matches; otherwise, false.
+ */
+static bool line_matches(history_t *history, int number, const char *pattern, size_t len, bool prefix){
+    int slot=slot_of(history,number);
+    if(is_erased(history,slot)){
+        return false;
+    }
+    size_t line_len;
+    const char *line=line_at(history,slot,&line_len);
+    if(prefix){
+        return line_len>=len&&memcmp(line,pattern,len)==0;
+    }
+    return memmem(line,line_len,pattern,len)!=NULL;
+}
+
+/**
+ * Finds the most recent line before a given number that contains a pattern.
+ * Patterns of three bytes or more are looked up in the trigram index and only
+ * the lines holding their rarest trigram are checked; shorter ones are
+ * matched against every line.
+ *
+ * @param history A pointer to the history structure.
+ * @param pattern The text to search for.
+ * @param prefix True to only match lines that start with the pattern.
+ * @param before Only lines numbered below this are searched.
+ * @return The number of the matching line; 0 if no line matches.
+ */
+int search_history(history_t *history, const char *pattern, bool prefix, int before){
+    int first=history->count-history->size+1;
+    if(before>history->count+1){
+        before=history->count+1;
+    }
+    size_t len=strlen(pattern);
+    if(len<3||!ensure_index(history)){
+        for(int number=before-1;number>=first;number--){
+            if(line_matches(history,number,pattern,len,prefix)){
+                return number;
+            }
+        }
+        return 0;
+    }
+    const int *ids;
+    int num_ids;
+    index_lookup(history->index,pattern,len,&ids,&num_ids);
+    // Binary search for the first candidate at or after before
+    int low=0;
+    int high=num_ids;
+    while(low<high){
+        int mid=(low+high)/2;
+        if(ids[mid]<before){
+            low=mid+1;
+        }
+        else{
+            high=mid;
+        }
+    }
+    for(int i=low-1;i>=0&&ids[i]>=first;i--){
+        if(line_matches(history,ids[i],pattern,len,prefix)){
+            return ids[i];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Deallocates the history structure and its stored command lines, journaling
+ * any commands still waiting first.
  *
  * @param history A pointer to the history structure to be deallocated.
  */
 void free_history(history_t *history){
-    FILE* fout=fopen(HISTORY_FILE_PATH,"w");
-    for(int i=0;i<history->next-1;i++){
-        fprintf(fout,"%s\n",history->lines[i]);
-        free(history->lines[i]);
+    flush_history(history);
+    if(history->journal_fd!=-1){
+        close(history->journal_fd);
+    }
+    for(int i=0;i<history->size;i++){
+        free(history->lines[(history->head+i)%history->max_history]);
+    }
+    if(history->map_owned){
+        free((void*)history->map);
     }
-    if(history->next-1>=0){
-        fprintf(fout,"%s",history->lines[history->next-1]);
-        free(history->lines[history->next-1]);
+    else if(history->map!=NULL){
+        munmap((void*)history->map,history->map_size);
     }
-    fclose(fout);
+    free(history->map_offsets);
+    free_history_index(history->index);
+    free(history->erased);
+    free(history->dedup_table);
+    free(history->timings);
     free(history->lines);
     free(history);
 }
@@ -0,0 +1,767 @@
+#define _GNU_SOURCE
+#include "../include/history_format.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HISTORY_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HISTORY_LZ4
+#include <lz4.h>
+#endif
+
+//A binary file starts with this magic; 0x89 cannot start a line of the text format written by msh
+static const char BINARY_MAGIC[4]={'\x89','M','S','H'};
+static const char FOOTER_MAGIC[4]={'M','S','H','F'};
+#define BINARY_VERSION 1
+
+//Size of the footer before its index: magic, record count (u32), uncompressed archive size (u64)
+#define FOOTER_SIZE 16
+
+//Kinds of binary records
+#define KIND_PLAIN 1
+#define KIND_TIMED 2
+
+/**
+ * Writes an unsigned LEB128 varint.
+ *
+ * @param out Receives at most 10 bytes.
+ * @param value The value to write.
+ * @return The number of bytes written.
+ */
+static size_t put_varint(char *out, uint64_t value){
+    size_t n=0;
+    while(value>=0x80){
+        out[n++]=(char)(value|0x80);
+        value>>=7;
+    }
+    out[n++]=(char)value;
+    return n;
+}
+
+/**
+ * Reads an unsigned LEB128 varint.
+ *
+ * @param p The start of the varint.
+ * @param size The number of bytes available.
+ * @param value Receives the value.
+ * @return The number of bytes read; 0 if the varint is incomplete or too long.
+ */
+static size_t get_varint(const char *p, size_t size, uint64_t *value){
+    uint64_t result=0;
+    for(size_t i=0;i<size&&i<10;i++){
+        unsigned char byte=p[i];
+        result|=(uint64_t)(byte&0x7f)<<(7*i);
+        if(!(byte&0x80)){
+            *value=result;
+            return i+1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Maps a signed value to an unsigned one so that small magnitudes stay small (zigzag encoding).
+ */
+static uint64_t zigzag(long long value){
+    return ((uint64_t)value<<1)^(uint64_t)(value>>63);
+}
+
+/**
+ * Reverses zigzag.
+ */
+static long long unzigzag(uint64_t value){
+    return (long long)(value>>1)^-(long long)(value&1);
+}
+
+static void put_u32(char *out, uint32_t value){
+    for(int i=0;i<4;i++){
+        out[i]=(char)(value>>(8*i));
+    }
+}
+
+static void put_u64(char *out, uint64_t value){
+    for(int i=0;i<8;i++){
+        out[i]=(char)(value>>(8*i));
+    }
+}
+
+static uint32_t get_u32(const char *p){
+    uint32_t value=0;
+    for(int i=0;i<4;i++){
+        value|=(uint32_t)(unsigned char)p[i]<<(8*i);
+    }
+    return value;
+}
+
+static uint64_t get_u64(const char *p){
+    uint64_t value=0;
+    for(int i=0;i<8;i++){
+        value|=(uint64_t)(unsigned char)p[i]<<(8*i);
+    }
+    return value;
+}
+
+/**
+ * Formats the timing line of a timed command in the text format.
+ *
+ * @param out Receives the line; RECORD_MAX bytes are enough.
+ * @param timing The timing of the command.
+ * @return The length of the line.
+ */
+size_t format_text_record(char *out, const history_timing_t *timing){
+    return snprintf(out,RECORD_MAX,"#+%lld %lld %lld %lld %d\n",timing->start_us,timing->wall_us,
+                    timing->user_us,timing->sys_us,timing->status);
+}
+
+/**
+ * Parses a "#+" timing line: "#+START WALL USER SYS STATUS".
+ *
+ * @param line The line, which need not be NUL-terminated.
+ * @param len The length of the line.
+ * @param timing Receives the timing.
+ * @return True if the line is a timing line; otherwise, false.
+ */
+bool parse_text_record(const char *line, size_t len, history_timing_t *timing){
+    char record[RECORD_MAX];
+    if(len<2||len>=RECORD_MAX||line[0]!='#'||line[1]!='+'){
+        return false;
+    }
+    memcpy(record,line,len);
+    record[len]='\0';
+    int parsed=0;
+    return sscanf(record,"#+%lld %lld %lld %lld %d%n",&timing->start_us,&timing->wall_us,
+                  &timing->user_us,&timing->sys_us,&timing->status,&parsed)==5&&(size_t)parsed==len&&
+           timing->start_us!=0;
+}
+
+/**
+ * Writes a command as one line of the text format. A command of several
+ * lines is joined into one after "#\\", with its backslashes doubled and its
+ * newlines written as "\\n". A command that starts like a timing line or an
+ * escaped one gets a '#' in front.
+ *
+ * @param out Receives the line, without its newline; NULL to only measure it.
+ * @param line The command, which need not be NUL-terminated.
+ * @param len The length of the command.
+ * @return The length of the line.
+ */
+size_t encode_text_line(char *out, const char *line, size_t len){
+    if(memchr(line,'\n',len)==NULL){
+        bool escaped=len>=2&&line[0]=='#'&&(line[1]=='+'||line[1]=='#'||line[1]=='\\');
+        if(out!=NULL){
+            if(escaped){
+                out[0]='#';
+            }
+            memcpy(out+escaped,line,len);
+        }
+        return len+escaped;
+    }
+    size_t n=2;
+    for(size_t i=0;i<len;i++){
+        n+=line[i]=='\n'||line[i]=='\\'?2:1;
+    }
+    if(out==NULL){
+        return n;
+    }
+    char *dst=out;
+    *dst++='#';
+    *dst++='\\';
+    for(size_t i=0;i<len;i++){
+        if(line[i]=='\n'||line[i]=='\\'){
+            *dst++='\\';
+            *dst++=line[i]=='\n'?'n':'\\';
+        }
+        else{
+            *dst++=line[i];
+        }
+    }
+    return n;
+}
+
+/**
+ * Tells whether a command line of the text format holds a command of several
+ * lines, which only decode_text_line can read back.
+ *
+ * @param line The line, which need not be NUL-terminated.
+ * @param len The length of the line.
+ * @return True if the command was joined into the line.
+ */
+bool joined_text_line(const char *line, size_t len){
+    return len>=2&&line[0]=='#'&&line[1]=='\\';
+}
+
+/**
+ * Reads a command back from a command line of the text format.
+ *
+ * @param out Receives the command; it has room for len bytes and may be line itself.
+ * @param line The line, which is not a timing line.
+ * @param len The length of the line.
+ * @return The length of the command.
+ */
+size_t decode_text_line(char *out, const char *line, size_t len){
+    if(!joined_text_line(line,len)){
+        unescape_text_line(&line,&len);
+        memmove(out,line,len);
+        return len;
+    }
+    size_t n=0;
+    for(size_t i=2;i<len;i++){
+        if(line[i]=='\\'&&i+1<len&&(line[i+1]=='n'||line[i+1]=='\\')){
+            out[n++]=line[++i]=='n'?'\n':'\\';
+        }
+        else{
+            out[n++]=line[i];
+        }
+    }
+    return n;
+}
+
+/**
+ * Drops the escaping '#' of a command line of the text format. A joined
+ * command is left as it is, for decode_text_line.
+ *
+ * @param line The line, which is not a timing line; advanced past the escape.
+ * @param len The length of the line; decremented with it.
+ */
+void unescape_text_line(const char **line, size_t *len){
+    if(*len>=2&&(*line)[0]=='#'&&(*line)[1]=='#'){
+        (*line)++;
+        (*len)--;
+    }
+}
+
+/**
+ * Formats the prefix of a binary record; the command follows it.
+ *
+ * @param out Receives the prefix; RECORD_MAX bytes are enough.
+ * @param len The length of the command.
+ * @param timing The timing of the command; NULL or a start of 0 if it was not timed.
+ * @return The length of the prefix.
+ */
+size_t format_binary_record(char *out, size_t len, const history_timing_t *timing){
+    char fields[RECORD_MAX];
+    size_t n=0;
+    bool timed=timing!=NULL&&timing->start_us!=0;
+    fields[n++]=timed?KIND_TIMED:KIND_PLAIN;
+    if(timed){
+        n+=put_varint(fields+n,(uint64_t)timing->start_us);
+        n+=put_varint(fields+n,zigzag(timing->wall_us));
+        n+=put_varint(fields+n,(uint64_t)timing->user_us);
+        n+=put_varint(fields+n,(uint64_t)timing->sys_us);
+        n+=put_varint(fields+n,zigzag(timing->status));
+    }
+    size_t prefix=put_varint(out,n+len);
+    memcpy(out+prefix,fields,n);
+    return prefix+n;
+}
+
+/**
+ * Decodes one binary record.
+ *
+ * @param data The start of the record.
+ * @param size The number of bytes available.
+ * @param record Receives the command, pointing into data, and its timing.
+ * @return The length of the record; 0 if it is incomplete or corrupt.
+ */
+size_t parse_binary_record(const char *data, size_t size, history_record_t *record){
+    uint64_t payload;
+    size_t n=get_varint(data,size,&payload);
+    if(n==0||payload==0||payload>size-n){
+        return 0;
+    }
+    const char *p=data+n;
+    const char *end=p+payload;
+    memset(&record->timing,0,sizeof(record->timing));
+    char kind=*p++;
+    if(kind==KIND_TIMED){
+        uint64_t fields[5];
+        for(int i=0;i<5;i++){
+            size_t m=get_varint(p,end-p,&fields[i]);
+            if(m==0){
+                return 0;
+            }
+            p+=m;
+        }
+        record->timing.start_us=(long long)fields[0];
+        record->timing.wall_us=unzigzag(fields[1]);
+        record->timing.user_us=(long long)fields[2];
+        record->timing.sys_us=(long long)fields[3];
+        record->timing.status=(int)unzigzag(fields[4]);
+    }
+    else if(kind!=KIND_PLAIN){
+        return 0;
+    }
+    record->line=p;
+    record->len=end-p;
+    return n+payload;
+}
+
+/**
+ * Formats the header of a binary history file.
+ *
+ * @param out Receives BINARY_HEADER_SIZE bytes.
+ * @param codec The codec of the archive.
+ * @param footer_offset The offset of the footer; 0 if there is no archive.
+ */
+void format_binary_header(char *out, int codec, uint64_t footer_offset){
+    memcpy(out,BINARY_MAGIC,sizeof(BINARY_MAGIC));
+    out[4]=BINARY_VERSION;
+    out[5]=(char)codec;
+    out[6]=0;
+    out[7]=0;
+    put_u64(out+8,footer_offset);
+}
+
+/**
+ * Compresses an archive with a codec that was compiled in.
+ *
+ * @param codec The codec to use.
+ * @param data The archive.
+ * @param size The size of the archive.
+ * @param compressed_size Receives the size of the compressed archive.
+ * @return The compressed archive, to be freed by the caller; NULL if the codec is not available or fails.
+ */
+static char *compress_archive(int codec, const char *data, size_t size, size_t *compressed_size){
+    char *out=NULL;
+    switch(codec){
+#ifdef HISTORY_ZSTD
+        case HISTORY_CODEC_ZSTD:{
+            size_t bound=ZSTD_compressBound(size);
+            out=malloc(bound);
+            size_t n=out==NULL?0:ZSTD_compress(out,bound,data,size,3);
+            if(out==NULL||ZSTD_isError(n)){
+                free(out);
+                return NULL;
+            }
+            *compressed_size=n;
+            return out;
+        }
+#endif
+#ifdef HISTORY_LZ4
+        case HISTORY_CODEC_LZ4:{
+            if(size>LZ4_MAX_INPUT_SIZE){
+                return NULL;
+            }
+            int bound=LZ4_compressBound((int)size);
+            out=malloc(bound);
+            int n=out==NULL?0:LZ4_compress_default(data,out,(int)size,bound);
+            if(n<=0){
+                free(out);
+                return NULL;
+            }
+            *compressed_size=n;
+            return out;
+        }
+#endif
+        default:
+            (void)data;
+            (void)size;
+            (void)compressed_size;
+            return out;
+    }
+}
+
+/**
+ * Decompresses an archive with a codec that was compiled in.
+ *
+ * @param codec The codec of the archive.
+ * @param data The compressed archive.
+ * @param size The size of the compressed archive.
+ * @param out Receives the archive.
+ * @param out_size The size of the archive, as recorded in the footer.
+ * @return True if the archive was decompressed to exactly out_size bytes; otherwise, false.
+ */
+static bool decompress_archive(int codec, const char *data, size_t size, char *out, size_t out_size){
+    switch(codec){
+#ifdef HISTORY_ZSTD
+        case HISTORY_CODEC_ZSTD:{
+            size_t n=ZSTD_decompress(out,out_size,data,size);
+            return !ZSTD_isError(n)&&n==out_size;
+        }
+#endif
+#ifdef HISTORY_LZ4
+        case HISTORY_CODEC_LZ4:
+            return size<=INT_MAX&&out_size<=INT_MAX&&
+                   LZ4_decompress_safe(data,out,(int)size,(int)out_size)==(int)out_size;
+#endif
+        default:
+            (void)data;
+            (void)size;
+            (void)out;
+            (void)out_size;
+            return false;
+    }
+}
+
+/**
+ * Tells the format of a history file from its first bytes.
+ *
+ * @param data The start of the file.
+ * @param size The number of bytes available.
+ * @return HISTORY_BINARY if the file starts with the binary magic; otherwise, HISTORY_TEXT.
+ */
+int history_file_format(const char *data, size_t size){
+    if(size>=sizeof(BINARY_MAGIC)&&memcmp(data,BINARY_MAGIC,sizeof(BINARY_MAGIC))==0){
+        return HISTORY_BINARY;
+    }
+    return HISTORY_TEXT;
+}
+
+/**
+ * Detects the format of a history file and prepares its records for reading.
+ *
+ * @param data The contents of the file.
+ * @param size The size of the file.
+ * @param image Receives the prepared contents.
+ * @return True if the file can be read; false if it is a corrupt binary file.
+ */
+bool open_history_image(const char *data, size_t size, history_image_t *image){
+    memset(image,0,sizeof(*image));
+    image->data=data;
+    image->size=size;
+    if(history_file_format(data,size)==HISTORY_TEXT){
+        image->format=HISTORY_TEXT;
+        return true;
+    }
+    image->format=HISTORY_BINARY;
+    image->appended=size;
+    if(size<BINARY_HEADER_SIZE||data[4]!=BINARY_VERSION){
+        return false;
+    }
+    int codec=(unsigned char)data[5];
+    uint64_t footer_offset=get_u64(data+8);
+    image->appended=BINARY_HEADER_SIZE;
+    if(footer_offset==0){
+        return true;
+    }
+    if(footer_offset<BINARY_HEADER_SIZE||size<FOOTER_SIZE||footer_offset>size-FOOTER_SIZE||
+       memcmp(data+footer_offset,FOOTER_MAGIC,sizeof(FOOTER_MAGIC))!=0){
+        image->appended=size;
+        return false;
+    }
+    uint32_t count=get_u32(data+footer_offset+4);
+    uint64_t raw_size=get_u64(data+footer_offset+8);
+    size_t index_size=(size_t)count*4;
+    if(index_size>size-footer_offset-FOOTER_SIZE){
+        image->appended=size;
+        return false;
+    }
+    image->archive_index=data+footer_offset+FOOTER_SIZE;
+    image->appended=footer_offset+FOOTER_SIZE+index_size;
+    const char *archive=data+BINARY_HEADER_SIZE;
+    size_t archive_size=footer_offset-BINARY_HEADER_SIZE;
+    if(codec==HISTORY_CODEC_NONE){
+        if(raw_size!=archive_size){
+            return false;
+        }
+        image->archive_base=BINARY_HEADER_SIZE;
+        image->archive_count=count;
+        return true;
+    }
+    // The archive is decompressed into a copy followed by the appended records, so that
+    // every record is found from the same base
+    size_t appended_size=size-image->appended;
+    char *owned=raw_size<=SIZE_MAX-appended_size?malloc(raw_size+appended_size+1):NULL;
+    if(owned==NULL||!decompress_archive(codec,archive,archive_size,owned,raw_size)){
+        // Without the codec only the records appended since the archive can be read
+        free(owned);
+        return true;
+    }
+    memcpy(owned+raw_size,data+image->appended,appended_size);
+    image->owned=owned;
+    image->data=owned;
+    image->size=raw_size+appended_size;
+    image->archive_base=0;
+    image->appended=raw_size;
+    image->archive_count=count;
+    return true;
+}
+
+/**
+ * Finds a record of the archive through the footer index.
+ *
+ * @param image The history image.
+ * @param i The position of the record in the archive.
+ * @return The offset of the record in image->data.
+ */
+size_t archive_record_offset(const history_image_t *image, int i){
+    return image->archive_base+get_u32(image->archive_index+4*(size_t)i);
+}
+
+/**
+ * Releases the decompressed copy of an image.
+ *
+ * @param image The history image.
+ */
+void close_history_image(history_image_t *image){
+    free(image->owned);
+    image->owned=NULL;
+}
+
+/**
+ * Collects every record of a history image in order.
+ *
+ * @param image The history image.
+ * @param count Receives the number of records.
+ * @return The records, to be freed by the caller; NULL if allocation fails.
+ */
+history_record_t *read_history_records(const history_image_t *image, int *count){
+    int capacity=64;
+    history_record_t *records=malloc(sizeof(history_record_t)*capacity);
+    *count=0;
+    if(records==NULL){
+        return NULL;
+    }
+    const char *data=image->data;
+    size_t offset=image->format==HISTORY_BINARY?image->appended:0;
+    int archived=0;
+    size_t joined=0;
+    while(true){
+        history_record_t record;
+        if(archived<image->archive_count){
+            size_t start=archive_record_offset(image,archived++);
+            if(start>=image->size||parse_binary_record(data+start,image->size-start,&record)==0){
+                continue;
+            }
+        }
+        else if(offset>=image->size){
+            break;
+        }
+        else if(image->format==HISTORY_BINARY){
+            size_t n=parse_binary_record(data+offset,image->size-offset,&record);
+            if(n==0){
+                break;
+            }
+            offset+=n;
+        }
+        else{
+            // Text: a timing line applies to the command on the next line
+            const char *newline=memchr(data+offset,'\n',image->size-offset);
+            size_t len=(newline==NULL?data+image->size:newline)-(data+offset);
+            history_timing_t timing;
+            bool timed=parse_text_record(data+offset,len,&timing);
+            record.line=data+offset;
+            record.len=len;
+            offset+=len+1;
+            if(timed){
+                if(offset>=image->size){
+                    break;
+                }
+                newline=memchr(data+offset,'\n',image->size-offset);
+                record.line=data+offset;
+                record.len=(newline==NULL?data+image->size:newline)-(data+offset);
+                offset+=record.len+1;
+                record.timing=timing;
+            }
+            else{
+                memset(&record.timing,0,sizeof(record.timing));
+            }
+            if(record.len==0){
+                continue;
+            }
+            if(joined_text_line(record.line,record.len)){
+                joined+=record.len;
+            }
+        }
+        if(*count==capacity){
+            capacity*=2;
+            history_record_t *grown=realloc(records,sizeof(history_record_t)*capacity);
+            if(grown==NULL){
+                free(records);
+                return NULL;
+            }
+            records=grown;
+        }
+        records[(*count)++]=record;
+    }
+    if(image->format==HISTORY_TEXT){
+        // Joined commands are decoded after the records, so freeing the records frees them too
+        if(joined>0){
+            history_record_t *grown=realloc(records,sizeof(history_record_t)*(*count)+joined);
+            if(grown==NULL){
+                free(records);
+                return NULL;
+            }
+            records=grown;
+        }
+        char *decoded=(char*)(records+*count);
+        for(int i=0;i<*count;i++){
+            if(joined_text_line(records[i].line,records[i].len)){
+                size_t len=decode_text_line(decoded,records[i].line,records[i].len);
+                records[i].line=decoded;
+                records[i].len=len;
+                decoded+=len;
+            }
+            else{
+                unescape_text_line(&records[i].line,&records[i].len);
+            }
+        }
+    }
+    return records;
+}
+
+/**
+ * Writes a buffer completely, retrying after interruptions and short writes.
+ *
+ * @param fd The file to write.
+ * @param iov The buffers to write; modified as they are written.
+ * @param count The number of buffers.
+ * @return True if everything was written; otherwise, false.
+ */
+static bool write_all(int fd, struct iovec *iov, int count){
+    while(count>0){
+        ssize_t written=writev(fd,iov,count);
+        if(written<0){
+            if(errno==EINTR){
+                continue;
+            }
+            return false;
+        }
+        while(count>0&&(size_t)written>=iov->iov_len){
+            written-=iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count>0){
+            iov->iov_base=(char*)iov->iov_base+written;
+            iov->iov_len-=written;
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes a complete history file in the given format.
+ *
+ * @param fd The file to write.
+ * @param format HISTORY_TEXT or HISTORY_BINARY.
+ * @param records The records to write.
+ * @param count The number of records.
+ * @return True if the whole file was written; otherwise, false.
+ */
+bool write_history_records(int fd, int format, const history_record_t *records, int count){
+    size_t capacity=1;
+    for(int i=0;i<count;i++){
+        size_t len=format==HISTORY_TEXT?encode_text_line(NULL,records[i].line,records[i].len):records[i].len;
+        capacity+=len+RECORD_MAX;
+    }
+    char *body=malloc(capacity);
+    char *index=format==HISTORY_BINARY?malloc((size_t)count*4+1):NULL;
+    if(body==NULL||(format==HISTORY_BINARY&&index==NULL)){
+        free(body);
+        free(index);
+        return false;
+    }
+    size_t size=0;
+    for(int i=0;i<count;i++){
+        const history_timing_t *timing=&records[i].timing;
+        if(format==HISTORY_BINARY){
+            put_u32(index+4*(size_t)i,(uint32_t)size);
+            size+=format_binary_record(body+size,records[i].len,timing);
+        }
+        else{
+            if(timing->start_us!=0){
+                size+=format_text_record(body+size,timing);
+            }
+            size+=encode_text_line(body+size,records[i].line,records[i].len);
+            body[size++]='\n';
+            continue;
+        }
+        memcpy(body+size,records[i].line,records[i].len);
+        size+=records[i].len;
+    }
+    bool ok;
+    if(format==HISTORY_TEXT){
+        struct iovec iov[1]={{body,size}};
+        ok=write_all(fd,iov,1);
+    }
+    else{
+        char header[BINARY_HEADER_SIZE];
+        char footer[FOOTER_SIZE];
+        if(count==0){
+            format_binary_header(header,HISTORY_CODEC_NONE,0);
+            struct iovec iov[1]={{header,sizeof(header)}};
+            ok=write_all(fd,iov,1);
+        }
+        else{
+            int codec=HISTORY_CODEC;
+            size_t stored_size=size;
+            char *compressed=compress_archive(codec,body,size,&stored_size);
+            if(compressed==NULL){
+                codec=HISTORY_CODEC_NONE;
+                stored_size=size;
+            }
+            format_binary_header(header,codec,BINARY_HEADER_SIZE+stored_size);
+            memcpy(footer,FOOTER_MAGIC,sizeof(FOOTER_MAGIC));
+            put_u32(footer+4,(uint32_t)count);
+            put_u64(footer+8,size);
+            struct iovec iov[4]={{header,sizeof(header)},{compressed!=NULL?compressed:body,stored_size},
+                                 {footer,sizeof(footer)},{index,(size_t)count*4}};
+            ok=write_all(fd,iov,4);
+            free(compressed);
+        }
+    }
+    free(body);
+    free(index);
+    return ok;
+}
+
+/**
+ * Converts a history file to the given format.
+ *
+ * @param from The path of the file to convert.
+ * @param to The path of the file to write; it must not be the same file.
+ * @param format HISTORY_TEXT or HISTORY_BINARY.
+ * @return The number of commands converted; -1 if a file could not be read or written.
+ */
+int convert_history_file(const char *from, const char *to, int format){
+    int fd=open(from,O_RDONLY|O_CLOEXEC);
+    struct stat st;
+    if(fd==-1||fstat(fd,&st)==-1){
+        if(fd!=-1){
+            close(fd);
+        }
+        return -1;
+    }
+    const char *map="";
+    if(st.st_size>0){
+        map=mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    }
+    close(fd);
+    if(map==MAP_FAILED){
+        return -1;
+    }
+    history_image_t image;
+    int count=-1;
+    history_record_t *records=NULL;
+    if(open_history_image(map,st.st_size,&image)){
+        records=read_history_records(&image,&count);
+    }
+    if(records!=NULL){
+        int out=open(to,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+        bool ok=out!=-1&&write_history_records(out,format,records,count)&&fsync(out)==0;
+        if(out!=-1&&close(out)!=0){
+            ok=false;
+        }
+        if(!ok){
+            count=-1;
+        }
+    }
+    else{
+        count=-1;
+    }
+    free(records);
+    close_history_image(&image);
+    if(st.st_size>0){
+        munmap((void*)map,st.st_size);
+    }
+    return count;
+}
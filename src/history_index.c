@@ -0,0 +1,182 @@
+#include "../include/history_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 1024
+#define INITIAL_IDS 4
+
+/**
+ * Packs three bytes into a table key. Keys are offset by one so that 0 marks
+ * an empty slot.
+ *
+ * @param p The first of the three bytes.
+ * @return The key of the trigram.
+ */
+static uint32_t trigram_key(const char *p){
+    const unsigned char *u=(const unsigned char *)p;
+    return ((uint32_t)u[0]<<16|(uint32_t)u[1]<<8|u[2])+1;
+}
+
+/**
+ * Finds the slot of a key, or the empty slot where it would go.
+ *
+ * @param table The table to search.
+ * @param capacity The number of slots, a power of two.
+ * @param key The trigram key.
+ * @return A pointer to the slot.
+ */
+static posting_t *find_slot(posting_t *table, int capacity, uint32_t key){
+    uint32_t slot=(key*2654435761u)&(capacity-1);
+    while(table[slot].key!=0&&table[slot].key!=key){
+        slot=(slot+1)&(capacity-1);
+    }
+    return &table[slot];
+}
+
+/**
+ * Doubles the table and reinserts every posting.
+ *
+ * @param index A pointer to the index.
+ */
+static void grow_table(history_index_t *index){
+    int capacity=index->capacity*2;
+    posting_t *table=calloc(capacity,sizeof(posting_t));
+    if(table==NULL){
+        return;
+    }
+    for(int i=0;i<index->capacity;i++){
+        if(index->table[i].key!=0){
+            *find_slot(table,capacity,index->table[i].key)=index->table[i];
+        }
+    }
+    free(index->table);
+    index->table=table;
+    index->capacity=capacity;
+}
+
+/**
+ * Allocates an empty trigram index.
+ *
+ * @return A pointer to the new index; NULL if allocation fails.
+ */
+history_index_t *alloc_history_index(){
+    history_index_t *index=malloc(sizeof(history_index_t));
+    if(index==NULL){
+        return NULL;
+    }
+    index->table=calloc(INITIAL_CAPACITY,sizeof(posting_t));
+    if(index->table==NULL){
+        free(index);
+        return NULL;
+    }
+    index->capacity=INITIAL_CAPACITY;
+    index->count=0;
+    return index;
+}
+
+/**
+ * Appends a command number to the posting of every trigram of a line. A
+ * trigram repeated within the line is recorded once.
+ *
+ * @param index A pointer to the index.
+ * @param id The command number of the line.
+ * @param line The line.
+ * @param len The length of the line.
+ */
+void index_add_line(history_index_t *index, int id, const char *line, size_t len){
+    for(size_t i=0;i+3<=len;i++){
+        if(index->count*2>=index->capacity){
+            grow_table(index);
+        }
+        uint32_t key=trigram_key(line+i);
+        posting_t *posting=find_slot(index->table,index->capacity,key);
+        if(posting->key==0){
+            posting->key=key;
+            index->count++;
+        }
+        if(posting->len>posting->start&&posting->ids[posting->len-1]==id){
+            continue;
+        }
+        if(posting->len==posting->capacity){
+            // Reclaim the evicted prefix before growing
+            if(posting->start>0){
+                memmove(posting->ids,posting->ids+posting->start,sizeof(int)*(posting->len-posting->start));
+                posting->len-=posting->start;
+                posting->start=0;
+            }
+            if(posting->len==posting->capacity){
+                int capacity=posting->capacity==0?INITIAL_IDS:posting->capacity*2;
+                int *ids=realloc(posting->ids,sizeof(int)*capacity);
+                if(ids==NULL){
+                    continue;
+                }
+                posting->ids=ids;
+                posting->capacity=capacity;
+            }
+        }
+        posting->ids[posting->len++]=id;
+    }
+}
+
+/**
+ * Drops an evicted line from its postings. Lines are evicted oldest first, so
+ * the line is at the front of each of its postings.
+ *
+ * @param index A pointer to the index.
+ * @param id The command number of the line.
+ * @param line The line.
+ * @param len The length of the line.
+ */
+void index_remove_line(history_index_t *index, int id, const char *line, size_t len){
+    for(size_t i=0;i+3<=len;i++){
+        posting_t *posting=find_slot(index->table,index->capacity,trigram_key(line+i));
+        if(posting->key!=0&&posting->start<posting->len&&posting->ids[posting->start]==id){
+            posting->start++;
+        }
+    }
+}
+
+/**
+ * Returns the live command numbers of the pattern's rarest trigram.
+ *
+ * @param index A pointer to the index.
+ * @param pattern The pattern.
+ * @param len The length of the pattern, at least 3.
+ * @param ids Receives the candidates.
+ * @param num_ids Receives the number of candidates.
+ */
+void index_lookup(history_index_t *index, const char *pattern, size_t len, const int **ids, int *num_ids){
+    *ids=NULL;
+    *num_ids=0;
+    posting_t *rarest=NULL;
+    for(size_t i=0;i+3<=len;i++){
+        posting_t *posting=find_slot(index->table,index->capacity,trigram_key(pattern+i));
+        if(posting->key==0||posting->len==posting->start){
+            // A trigram no line contains: nothing can match
+            return;
+        }
+        if(rarest==NULL||posting->len-posting->start<rarest->len-rarest->start){
+            rarest=posting;
+        }
+    }
+    if(rarest!=NULL){
+        *ids=rarest->ids+rarest->start;
+        *num_ids=rarest->len-rarest->start;
+    }
+}
+
+/**
+ * Deallocates the index and its postings.
+ *
+ * @param index A pointer to the index to be deallocated.
+ */
+void free_history_index(history_index_t *index){
+    if(index==NULL){
+        return;
+    }
+    for(int i=0;i<index->capacity;i++){
+        free(index->table[i].ids);
+    }
+    free(index->table);
+    free(index);
+}
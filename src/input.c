@@ -0,0 +1,142 @@
+#include "../include/input.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define INITIAL_CAPACITY 4096
+
+/**
+ * Allocates a line reader for a descriptor.
+ *
+ * @param fd The descriptor to read from.
+ * @param capacity The initial size of the buffer; 0 for the default.
+ * @return A pointer to the new reader; NULL if allocation fails.
+ */
+input_t *alloc_input(int fd, size_t capacity){
+    input_t *in=malloc(sizeof(input_t));
+    if(in==NULL){
+        return NULL;
+    }
+    if(capacity<2){
+        capacity=INITIAL_CAPACITY;
+    }
+    in->buffer=malloc(capacity);
+    if(in->buffer==NULL){
+        free(in);
+        return NULL;
+    }
+    in->fd=fd;
+    in->capacity=capacity;
+    in->line=0;
+    in->start=0;
+    in->end=0;
+    in->eof=false;
+    return in;
+}
+
+/**
+ * Finds the end of the next complete line and terminates it in place.
+ *
+ * @param in A pointer to the reader.
+ * @return The offset of the terminator; -1 if no complete line is buffered.
+ */
+static long terminate_line(input_t *in){
+    char *newline=memchr(in->buffer+in->start,'\n',in->end-in->start);
+    if(newline==NULL){
+        if(!in->eof||in->start==in->end){
+            return -1;
+        }
+        // The last line of the input has no newline; terminate it in the spare byte
+        newline=in->buffer+in->end;
+        in->end++;
+    }
+    *newline='\0';
+    in->start=newline-in->buffer+1;
+    return newline-in->buffer;
+}
+
+/**
+ * Returns the next buffered line, if a complete one is available.
+ *
+ * @param in A pointer to the reader.
+ * @param len Receives the length of the line.
+ * @return The line, terminated in place; NULL if no complete line is buffered.
+ */
+char *next_line(input_t *in, size_t *len){
+    in->line=in->start;
+    long end=terminate_line(in);
+    if(end==-1){
+        return NULL;
+    }
+    *len=end-in->line;
+    return in->buffer+in->line;
+}
+
+/**
+ * Joins the next buffered line to the line returned last, if a complete one
+ * is available, by putting the newline that ended the first line back.
+ *
+ * @param in A pointer to the reader.
+ * @param len Receives the length of the joined line.
+ * @return The joined line; NULL if no complete line is buffered.
+ */
+char *continue_line(input_t *in, size_t *len){
+    size_t joint=in->start-1;
+    long end=terminate_line(in);
+    if(end==-1){
+        return NULL;
+    }
+    in->buffer[joint]='\n';
+    *len=end-in->line;
+    return in->buffer+in->line;
+}
+
+/**
+ * Reads more input once. Consumed bytes (up to the line returned last, which
+ * may still be continued) are dropped first and the buffer doubles when it
+ * is full, so a line of any length fits.
+ *
+ * @param in A pointer to the reader.
+ * @return The number of bytes read; 0 at end of file; -1 on error.
+ */
+long fill_input(input_t *in){
+    if(in->line>0){
+        memmove(in->buffer,in->buffer+in->line,in->end-in->line);
+        in->end-=in->line;
+        in->start-=in->line;
+        in->line=0;
+    }
+    // Keep one spare byte to terminate a last line that has no newline
+    if(in->capacity-in->end<2){
+        char *buffer=realloc(in->buffer,in->capacity*2);
+        if(buffer==NULL){
+            errno=ENOMEM;
+            return -1;
+        }
+        in->buffer=buffer;
+        in->capacity*=2;
+    }
+    ssize_t n=read(in->fd,in->buffer+in->end,in->capacity-in->end-1);
+    if(n==0){
+        in->eof=true;
+    }
+    else if(n>0){
+        in->end+=n;
+    }
+    return n;
+}
+
+/**
+ * Deallocates a line reader.
+ *
+ * @param in A pointer to the reader to be deallocated.
+ */
+void free_input(input_t *in){
+    if(in==NULL){
+        return;
+    }
+    free(in->buffer);
+    free(in);
+}
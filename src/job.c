@@ -2,146 +2,431 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include<stdio.h>
+#include <errno.h>
+
+#define MIN_PID_CAPACITY 32
 
 /**
- * Adds a new job to the job array.
+ * Computes the home bucket of a process ID in the pid index.
  *
- * @param jobs A pointer to the first element of the job array.
- * @param max_jobs The maximum number of jobs the array can hold.
- * @param pid The process ID of the new job.
- * @param state The state of the new job (e.g., BACKGROUND, FOREGROUND).
- * @param cmd_line The command line string associated with the new job.
- * @return True if the job was successfully added; otherwise, false.
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID to hash.
+ * @return The bucket index.
  */
-bool add_job(job_t *jobs, int max_jobs, pid_t pid, job_state_t state, const char *cmd_line) {
-    for (int i = 0; i < max_jobs; i++) {
-        if (jobs[i].cmd_line == NULL) {
-            jobs[i].cmd_line = strdup(cmd_line);
-            jobs[i].state = state;
-            jobs[i].pid = pid;
-            jobs[i].jid = i + 1;
-            return true;
+static int pid_bucket(job_table_t *jobs, pid_t pid){
+    return (int)(((uint32_t)pid*2654435761u)&(uint32_t)(jobs->pid_capacity-1));
+}
+
+/**
+ * Finds the bucket holding a process ID in the pid index.
+ *
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID to look for.
+ * @return The bucket index; -1 if the process ID is not indexed.
+ */
+static int pid_find(job_table_t *jobs, pid_t pid){
+    if(pid<=0){
+        return -1;
+    }
+    for(int i=pid_bucket(jobs,pid);jobs->pid_keys[i]!=0;i=(i+1)&(jobs->pid_capacity-1)){
+        if(jobs->pid_keys[i]==pid){
+            return i;
         }
     }
-    return false;
+    return -1;
 }
 
 /**
- * Removes a job from the job array based on its PID.
+ * Maps a process ID to a job slot, doubling the pid index when it is half full.
  *
- * @param jobs A pointer to the first element of the job array.
- * @param max_jobs The maximum number of jobs the array can hold.
- * @param pid The process ID of the job to be removed.
- * @return True if the job was found and removed; otherwise, false.
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID to index.
+ * @param slot The slot of the job that contains the process.
+ * @return True if the process ID was indexed; otherwise, false.
  */
-bool delete_job(job_t *jobs, int max_jobs, pid_t pid) {
-    for (int i = 0; i < max_jobs; i++) {
-        if (jobs[i].pid == pid) {
-            free(jobs[i].cmd_line);
-            jobs[i].cmd_line = NULL;
-            jobs[i].pid = 0;
-            return true;
+static bool pid_insert(job_table_t *jobs, pid_t pid, int slot){
+    if((jobs->num_pids+1)*2>jobs->pid_capacity){
+        int old_capacity=jobs->pid_capacity;
+        pid_t *old_keys=jobs->pid_keys;
+        int *old_slots=jobs->pid_slots;
+        pid_t *keys=calloc(old_capacity*2,sizeof(pid_t));
+        int *slots=malloc(sizeof(int)*old_capacity*2);
+        if(keys==NULL||slots==NULL){
+            free(keys);
+            free(slots);
+            return false;
+        }
+        jobs->pid_keys=keys;
+        jobs->pid_slots=slots;
+        jobs->pid_capacity=old_capacity*2;
+        jobs->num_pids=0;
+        for(int i=0;i<old_capacity;i++){
+            if(old_keys[i]!=0){
+                pid_insert(jobs,old_keys[i],old_slots[i]);
+            }
         }
+        free(old_keys);
+        free(old_slots);
+    }
+    int i=pid_bucket(jobs,pid);
+    while(jobs->pid_keys[i]!=0&&jobs->pid_keys[i]!=pid){
+        i=(i+1)&(jobs->pid_capacity-1);
     }
-    return false;
+    if(jobs->pid_keys[i]==0){
+        jobs->num_pids++;
+    }
+    jobs->pid_keys[i]=pid;
+    jobs->pid_slots[i]=slot;
+    return true;
 }
 
 /**
- * Frees all allocated memory for the jobs and their command lines.
+ * Removes a process ID from the pid index. Later entries of the probe run are
+ * shifted back so lookups never need tombstones.
  *
- * @param jobs A pointer to the first element of the job array.
- * @param max_jobs The maximum number of jobs the array can hold.
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID to remove.
  */
-void free_jobs(job_t *jobs, int max_jobs) {
-    for (int i = 0; i < max_jobs; i++) {
-        if (jobs[i].cmd_line != NULL) {
-            free(jobs[i].cmd_line);
-            jobs[i].cmd_line=NULL;
+static void pid_remove(job_table_t *jobs, pid_t pid){
+    int i=pid_find(jobs,pid);
+    if(i==-1){
+        return;
+    }
+    int mask=jobs->pid_capacity-1;
+    jobs->pid_keys[i]=0;
+    jobs->num_pids--;
+    for(int j=(i+1)&mask;jobs->pid_keys[j]!=0;j=(j+1)&mask){
+        int home=pid_bucket(jobs,jobs->pid_keys[j]);
+        // The entry can stay if its home bucket lies cyclically in (i, j]
+        bool stays=i<=j?(i<home&&home<=j):(i<home||home<=j);
+        if(!stays){
+            jobs->pid_keys[i]=jobs->pid_keys[j];
+            jobs->pid_slots[i]=jobs->pid_slots[j];
+            jobs->pid_keys[j]=0;
+            i=j;
         }
     }
-    free(jobs);
 }
 
 /**
- * Checks if the job array is full.
+ * Finds the job that contains a process.
  *
- * @param jobs A pointer to the first element of the job array.
- * @param max_jobs The maximum number of jobs the array can hold.
- * @return True if no available slots are found (i.e., the job array is full); otherwise, false.
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID of any process in the job (or its process group ID).
+ * @return A pointer to the job; NULL if no job contains the process.
  */
-bool jobs_full(job_t *jobs, int max_jobs){
-    for(int i=0;i<max_jobs;i++){
-        if(jobs[i].cmd_line==NULL){
-            return false;
+static job_t *find_job(job_table_t *jobs, pid_t pid){
+    int i=pid_find(jobs,pid);
+    return i==-1?NULL:&jobs->slots[jobs->pid_slots[i]];
+}
+
+/**
+ * Doubles the number of job slots and puts the new slots on the free list.
+ * Running out of memory is the only way to fail, and it is reported here.
+ *
+ * @param jobs A pointer to the job table.
+ * @return True if the table grew; otherwise, false.
+ */
+static bool grow_jobs(job_table_t *jobs){
+    int capacity=jobs->capacity*2;
+    job_t *slots=realloc(jobs->slots,sizeof(job_t)*capacity);
+    if(slots==NULL){
+        printf("error: cannot grow the job table: %s\n",strerror(errno));
+        return false;
+    }
+    jobs->slots=slots;
+    int *free_slots=realloc(jobs->free_slots,sizeof(int)*capacity);
+    if(free_slots==NULL){
+        printf("error: cannot grow the job table: %s\n",strerror(errno));
+        return false;
+    }
+    jobs->free_slots=free_slots;
+    memset(&jobs->slots[jobs->capacity],0,sizeof(job_t)*(capacity-jobs->capacity));
+    // Pushed in reverse so the lowest job IDs are handed out first
+    for(int i=capacity-1;i>=jobs->capacity;i--){
+        jobs->free_slots[jobs->num_free++]=i;
+    }
+    jobs->capacity=capacity;
+    return true;
+}
+
+/**
+ * Releases the resources held by a job, drops its processes from the pid
+ * index and returns its slot to the free list.
+ *
+ * @param jobs A pointer to the job table.
+ * @param job A pointer to the job to clear.
+ */
+static void clear_job(job_table_t *jobs, job_t *job){
+    for(int i=0;i<job->num_pids;i++){
+        pid_remove(jobs,job->pids[i]);
+    }
+    pid_remove(jobs,job->pid);
+    if(job->state<UNDEFINED){
+        jobs->state_counts[job->state]--;
+    }
+    free(job->cmd_line);
+    free(job->pids);
+    job->cmd_line = NULL;
+    job->pids = NULL;
+    job->num_pids = 0;
+    job->pid = 0;
+    jobs->free_slots[jobs->num_free++]=job->jid-1;
+}
+
+/**
+ * Allocates an empty job table.
+ *
+ * @param capacity The number of job slots to allocate up front.
+ * @return A pointer to the new job table; NULL if allocation fails.
+ */
+job_table_t *alloc_jobs(int capacity){
+    if(capacity<1){
+        capacity=1;
+    }
+    job_table_t *jobs=calloc(1,sizeof(job_table_t));
+    if(jobs==NULL){
+        return NULL;
+    }
+    jobs->pid_capacity=MIN_PID_CAPACITY;
+    while(jobs->pid_capacity<capacity*2){
+        jobs->pid_capacity*=2;
+    }
+    jobs->slots=calloc(capacity,sizeof(job_t));
+    jobs->free_slots=malloc(sizeof(int)*capacity);
+    jobs->pid_keys=calloc(jobs->pid_capacity,sizeof(pid_t));
+    jobs->pid_slots=malloc(sizeof(int)*jobs->pid_capacity);
+    if(jobs->slots==NULL||jobs->free_slots==NULL||jobs->pid_keys==NULL||jobs->pid_slots==NULL){
+        free(jobs->slots);
+        free(jobs->free_slots);
+        free(jobs->pid_keys);
+        free(jobs->pid_slots);
+        free(jobs);
+        return NULL;
+    }
+    jobs->capacity=capacity;
+    for(int i=capacity-1;i>=0;i--){
+        jobs->free_slots[jobs->num_free++]=i;
+    }
+    return jobs;
+}
+
+/**
+ * Adds a new job to the job table, growing the table if every slot is in use.
+ *
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID of the new job; also the job's process group ID.
+ * @param state The state of the new job (e.g., BACKGROUND, FOREGROUND).
+ * @param cmd_line The command line string associated with the new job.
+ * @return True if the job was successfully added; otherwise, false.
+ */
+bool add_job(job_table_t *jobs, pid_t pid, job_state_t state, const char *cmd_line) {
+    if (jobs->num_free == 0 && !grow_jobs(jobs)) {
+        return false;
+    }
+    int slot = jobs->free_slots[jobs->num_free - 1];
+    job_t *job = &jobs->slots[slot];
+    job->pids = malloc(sizeof(pid_t));
+    if (job->pids == NULL || !pid_insert(jobs, pid, slot)) {
+        free(job->pids);
+        job->pids = NULL;
+        return false;
+    }
+    jobs->num_free--;
+    job->pids[0] = pid;
+    job->num_pids = 1;
+    job->cmd_line = strdup(cmd_line);
+    job->state = state;
+    job->pid = pid;
+    job->jid = slot + 1;
+    if (state < UNDEFINED) {
+        jobs->state_counts[state]++;
+    }
+    return true;
+}
+
+/**
+ * Adds another process to an existing job, such as a later stage of a pipeline.
+ *
+ * @param jobs A pointer to the job table.
+ * @param pgid The process ID the job was added with (its process group ID).
+ * @param pid The process ID of the process joining the job.
+ * @return True if the process was added; otherwise, false.
+ */
+bool add_job_process(job_table_t *jobs, pid_t pgid, pid_t pid) {
+    job_t *job = find_job(jobs, pgid);
+    if (job == NULL || job->pid != pgid) {
+        return false;
+    }
+    pid_t *pids = realloc(job->pids, sizeof(pid_t) * (job->num_pids + 1));
+    if (pids == NULL) {
+        return false;
+    }
+    job->pids = pids;
+    if (!pid_insert(jobs, pid, job->jid - 1)) {
+        return false;
+    }
+    pids[job->num_pids++] = pid;
+    return true;
+}
+
+/**
+ * Removes a terminated process from its job; the job is deleted once it has no processes left.
+ * The process group ID stays indexed until then so the job can still be named by it.
+ *
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID of the terminated process.
+ * @return The job's process group ID if the job was deleted; 0 if it still has processes; -1 if not found.
+ */
+pid_t delete_job_process(job_table_t *jobs, pid_t pid) {
+    job_t *job = find_job(jobs, pid);
+    if (job == NULL) {
+        return -1;
+    }
+    for (int k = 0; k < job->num_pids; k++) {
+        if (job->pids[k] == pid) {
+            job->pids[k] = job->pids[--job->num_pids];
+            break;
+        }
+    }
+    if (job->num_pids > 0) {
+        if (pid != job->pid) {
+            pid_remove(jobs, pid);
         }
+        return 0;
+    }
+    pid_t pgid = job->pid;
+    pid_remove(jobs, pid);
+    clear_job(jobs, job);
+    return pgid;
+}
+
+/**
+ * Removes a job from the job table based on its PID.
+ *
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID of any process in the job to be removed.
+ * @return True if the job was found and removed; otherwise, false.
+ */
+bool delete_job(job_table_t *jobs, pid_t pid) {
+    job_t *job = find_job(jobs, pid);
+    if (job == NULL) {
+        return false;
     }
+    clear_job(jobs, job);
     return true;
 }
 
 /**
- * Checks for the existence of any background jobs in the job array.
+ * Frees the job table, its jobs and their command lines.
  *
- * @param jobs A pointer to the first element of the job array.
- * @param max_jobs The maximum number of jobs the array can hold.
- * @return True if at least one background job is found; otherwise, false.
+ * @param jobs A pointer to the job table.
  */
-bool has_background_job(job_t *jobs, int max_jobs){
-    for(int i=0;i<max_jobs;i++){
-        if(jobs[i].cmd_line!=NULL&&jobs[i].state==BACKGROUND){
-            return true;
+void free_jobs(job_table_t *jobs) {
+    if (jobs == NULL) {
+        return;
+    }
+    for (int i = 0; i < jobs->capacity; i++) {
+        if (jobs->slots[i].cmd_line != NULL) {
+            free(jobs->slots[i].cmd_line);
+            free(jobs->slots[i].pids);
         }
     }
-    return false;
+    free(jobs->slots);
+    free(jobs->free_slots);
+    free(jobs->pid_keys);
+    free(jobs->pid_slots);
+    free(jobs);
+}
+
+/**
+ * Checks if the job table is full, growing it first when every slot is in use.
+ *
+ * @param jobs A pointer to the job table.
+ * @return True if no slot is free and the table could not grow; otherwise, false.
+ */
+bool jobs_full(job_table_t *jobs){
+    return jobs->num_free==0&&!grow_jobs(jobs);
+}
+
+/**
+ * Checks for the existence of any background jobs in the job table.
+ *
+ * @param jobs A pointer to the job table.
+ * @return True if at least one background job is found; otherwise, false.
+ */
+bool has_background_job(job_table_t *jobs){
+    return jobs->state_counts[BACKGROUND]>0;
+}
+
+/**
+ * Counts the jobs that are in a given state.
+ *
+ * @param jobs A pointer to the job table.
+ * @param state The state to count.
+ * @return The number of jobs in that state.
+ */
+int count_jobs(job_table_t *jobs, job_state_t state){
+    return state<UNDEFINED?jobs->state_counts[state]:0;
 }
 
 /**
  * Updates the state of a specific job identified by its PID.
  *
- * @param jobs A pointer to the first element of the job array.
- * @param max_jobs The maximum number of jobs the array can hold.
- * @param pid The process ID of the job to update.
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID of any process in the job to update.
  * @param new_state The new state to set for the job.
  */
-void update_job_state(job_t* jobs,int max_jobs,pid_t pid,job_state_t new_state){
-    for(int i=0;i<max_jobs;i++){
-        if(jobs[i].cmd_line!=NULL&&jobs[i].pid==pid){
-            jobs[i].state=new_state;
-            break;
-        }
+void update_job_state(job_table_t* jobs,pid_t pid,job_state_t new_state){
+    job_t *job=find_job(jobs,pid);
+    if(job==NULL){
+        return;
+    }
+    if(job->state<UNDEFINED){
+        jobs->state_counts[job->state]--;
     }
+    if(new_state<UNDEFINED){
+        jobs->state_counts[new_state]++;
+    }
+    job->state=new_state;
 }
 
 /**
  * Retrieves the job ID of a specific job identified by its PID.
  *
- * @param jobs A pointer to the first element of the job array.
- * @param max_jobs The maximum number of jobs the array can hold.
- * @param pid The process ID of the job whose job ID is to be retrieved.
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID of any process in the job whose job ID is to be retrieved.
  * @return The job ID of the specified job; 0 if the job is not found.
  */
-int get_job_id_by_pid(job_t* jobs,int max_jobs,pid_t pid){
-    for(int i=0;i<max_jobs;i++){
-        if(jobs[i].cmd_line!=NULL&&jobs[i].pid==pid){
-            return jobs[i].jid;
-        }
-    }
-    return 0;
+int get_job_id_by_pid(job_table_t* jobs,pid_t pid){
+    job_t *job=find_job(jobs,pid);
+    return job==NULL?0:job->jid;
+}
+
+/**
+ * Retrieves the process group ID of the job that contains a process.
+ *
+ * @param jobs A pointer to the job table.
+ * @param pid The process ID of any process in the job.
+ * @return The job's process group ID; -1 if the job is not found.
+ */
+pid_t get_pgid_by_pid(job_table_t* jobs,pid_t pid){
+    job_t *job=find_job(jobs,pid);
+    return job==NULL?-1:job->pid;
 }
 
 /**
  * Retrieves the process ID of a specific job identified by its job ID.
  *
- * @param jobs A pointer to the first element of the job array.
- * @param max_jobs The maximum number of jobs the array can hold.
+ * @param jobs A pointer to the job table.
  * @param jid The job ID of the job whose process ID is to be retrieved.
  * @return The process ID of the specified job; -1 if the job is not found.
  */
-pid_t get_pid_by_job_id(job_t* jobs,int max_jobs,int jid){
-    for(int i=0;i<max_jobs;i++){
-        if(jobs[i].cmd_line!=NULL&&jobs[i].jid==jid){
-            return jobs[i].pid;
-        }
+pid_t get_pid_by_job_id(job_table_t* jobs,int jid){
+    if(jid<1||jid>jobs->capacity||jobs->slots[jid-1].cmd_line==NULL){
+        return -1;
     }
-    return -1;
+    return jobs->slots[jid-1].pid;
 }
@@ -0,0 +1,359 @@
+#include "../include/job_queue.h"
+#include "../include/shell.h"
+#include "../include/pipeline.h"
+#include "../include/builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+/**
+ * Allocates an empty job queue.
+ *
+ * @param max_running The cap on running background jobs; 0 for the number of online CPUs.
+ * @return A pointer to the new queue; NULL if allocation fails.
+ */
+job_queue_t *alloc_job_queue(int max_running){
+    job_queue_t *queue=malloc(sizeof(job_queue_t));
+    if(queue==NULL){
+        return NULL;
+    }
+    if(max_running<=0){
+        long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+        max_running=cpus>0?(int)cpus:1;
+    }
+    queue->head=NULL;
+    queue->tail=NULL;
+    queue->count=0;
+    queue->max_running=max_running;
+    return queue;
+}
+
+/**
+ * Tells whether another background job may start right now.
+ *
+ * @param shell A pointer to the shell instance.
+ * @return True if a background job can be launched; otherwise, false.
+ */
+static bool has_free_slot(msh_t *shell){
+    return count_jobs(shell->jobs,BACKGROUND)<shell->queue->max_running&&!jobs_full(shell->jobs);
+}
+
+/**
+ * Deallocates a pipeline copied by expand_pipeline.
+ *
+ * @param pipeline The pipeline; NULL is ignored.
+ */
+static void free_pipeline(pipeline_t *pipeline){
+    if(pipeline==NULL){
+        return;
+    }
+    command_t *command=pipeline->commands;
+    while(command!=NULL){
+        command_t *next=command->next;
+        for(int i=0;command->argv!=NULL&&i<command->argc;i++){
+            free(command->argv[i]);
+        }
+        free(command->argv);
+        assignment_t *assignment=command->assignments;
+        while(assignment!=NULL){
+            assignment_t *next_assignment=assignment->next;
+            free(assignment->value);
+            free(assignment);
+            assignment=next_assignment;
+        }
+        redirect_t *redirect=command->redirects;
+        while(redirect!=NULL){
+            redirect_t *next_redirect=redirect->next;
+            free(redirect->target);
+            free(redirect);
+            redirect=next_redirect;
+        }
+        free(command);
+        command=next;
+    }
+    free(pipeline);
+}
+
+/**
+ * Copies a simple command with its words, assignments and redirections
+ * expanded. The copy has nothing left to expand.
+ *
+ * @param shell A pointer to the shell instance.
+ * @param command The command.
+ * @param copy The zeroed copy, which receives what was copied even on failure.
+ * @return False if allocation fails.
+ */
+static bool expand_command(msh_t *shell, const command_t *command, command_t *copy){
+    copy->type=COMMAND_SIMPLE;
+    int argc;
+    char **argv=expand_words(shell,command->argc,command->argv,command->expand,&argc);
+    if((copy->argv=calloc(argc+1,sizeof(char*)))==NULL){
+        return false;
+    }
+    for(int i=0;i<argc;i++){
+        if((copy->argv[i]=strdup(argv[i]))==NULL){
+            return false;
+        }
+        copy->argc++;
+    }
+    // A name that came from an expansion is looked up now, as run_single would have
+    copy->builtin=command->expand!=NULL&&command->expand[0]!=NULL?(argc>0?find_builtin(argv[0]):NULL):command->builtin;
+    assignment_t **last_assignment=&copy->assignments;
+    for(const assignment_t *assignment=command->assignments;assignment!=NULL;assignment=assignment->next){
+        if((*last_assignment=calloc(1,sizeof(assignment_t)))==NULL){
+            return false;
+        }
+        (*last_assignment)->symbol=assignment->symbol;
+        if(((*last_assignment)->value=strdup(expand_word(shell,assignment->value,assignment->expand)))==NULL){
+            return false;
+        }
+        last_assignment=&(*last_assignment)->next;
+    }
+    redirect_t **last_redirect=&copy->redirects;
+    for(const redirect_t *redirect=command->redirects;redirect!=NULL;redirect=redirect->next){
+        if((*last_redirect=calloc(1,sizeof(redirect_t)))==NULL){
+            return false;
+        }
+        (*last_redirect)->type=redirect->type;
+        (*last_redirect)->fd=redirect->fd;
+        if(((*last_redirect)->target=strdup(expand_word(shell,redirect->target,redirect->expand)))==NULL){
+            return false;
+        }
+        last_redirect=&(*last_redirect)->next;
+    }
+    return true;
+}
+
+/**
+ * Copies a pipeline of simple commands with everything in it expanded, as
+ * it would be if it were launched now. Command substitutions in it run now.
+ *
+ * @param shell A pointer to the shell instance.
+ * @param pipeline The pipeline.
+ * @return The copy, to be freed with free_pipeline; NULL if allocation fails.
+ */
+static pipeline_t *expand_pipeline(msh_t *shell, const pipeline_t *pipeline){
+    pipeline_t *copy=calloc(1,sizeof(pipeline_t));
+    if(copy==NULL){
+        return NULL;
+    }
+    copy->num_commands=pipeline->num_commands;
+    copy->connector=pipeline->connector;
+    expand_mark_t mark=expand_mark(shell);
+    bool copied=true;
+    command_t **last=&copy->commands;
+    for(const command_t *command=pipeline->commands;command!=NULL&&copied;command=command->next){
+        copied=(*last=calloc(1,sizeof(command_t)))!=NULL&&expand_command(shell,command,*last);
+        if(*last!=NULL){
+            last=&(*last)->next;
+        }
+    }
+    expand_release(shell,mark);
+    if(!copied){
+        free_pipeline(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+/**
+ * Holds back a background job when the cap is reached. Jobs already waiting
+ * are started first, so a new job never overtakes them.
+ *
+ * @param shell A pointer to the shell instance.
+ * @param job The and-or list of the job.
+ * @return True if the job was queued; false if it should be launched now.
+ */
+bool queue_job(msh_t *shell, const and_or_t *job){
+    job_queue_t *queue=shell->queue;
+    dispatch_jobs(shell);
+    if(queue->head==NULL&&has_free_slot(shell)){
+        return false;
+    }
+    queued_job_t *entry=malloc(sizeof(queued_job_t));
+    if(entry==NULL){
+        return false;
+    }
+    entry->pipeline=NULL;
+    entry->pid=0;
+    if((entry->cmd_line=strdup(job->text))==NULL){
+        free(entry);
+        return false;
+    }
+    // A single pipeline is launched as it is; anything else runs in a copy of the shell, forked now so
+    // it expands its words (and runs each pipeline, or not) with the variables as they are now
+    if(job->num_pipelines==1&&job->program==NULL){
+        entry->pipeline=expand_pipeline(shell,job->pipelines);
+    }
+    else{
+        entry->pid=fork_subshell(shell,job,true);
+    }
+    if(entry->pipeline==NULL&&entry->pid<=0){
+        free(entry->cmd_line);
+        free(entry);
+        return false;
+    }
+    entry->next=NULL;
+    if(queue->tail==NULL){
+        queue->head=entry;
+    }
+    else{
+        queue->tail->next=entry;
+    }
+    queue->tail=entry;
+    queue->count++;
+    return true;
+}
+
+/**
+ * Launches one queued job in the background.
+ *
+ * @param shell A pointer to the shell instance.
+ * @param job The queued job.
+ */
+static void launch_queued(msh_t *shell, const queued_job_t *job){
+    if(job->pipeline!=NULL){
+        run_pipeline(shell,job->pipeline,job->cmd_line,BACKGROUND);
+        return;
+    }
+    // The held subshell becomes the job; has_free_slot made room for it
+    if(release_subshell(job->pid)){
+        add_job(shell->jobs,job->pid,BACKGROUND,job->cmd_line);
+        shell->last_background_pid=job->pid;
+    }
+}
+
+/**
+ * Starts queued jobs until the cap is reached again. This may run while the
+ * shell waits for a foreground job, so the exit status it tracks is kept.
+ *
+ * @param shell A pointer to the shell instance.
+ */
+void dispatch_jobs(msh_t *shell){
+    job_queue_t *queue=shell->queue;
+    if(queue==NULL||queue->head==NULL){
+        return;
+    }
+    pid_t status_pid=shell->status_pid;
+    int last_status=shell->last_status;
+    while(queue->head!=NULL&&has_free_slot(shell)){
+        queued_job_t *entry=queue->head;
+        queue->head=entry->next;
+        if(queue->head==NULL){
+            queue->tail=NULL;
+        }
+        queue->count--;
+        launch_queued(shell,entry);
+        free_pipeline(entry->pipeline);
+        free(entry->cmd_line);
+        free(entry);
+    }
+    shell->status_pid=status_pid;
+    shell->last_status=last_status;
+}
+
+/**
+ * Prints a summary line and the queued jobs in the order they will start.
+ *
+ * @param shell A pointer to the shell instance.
+ */
+void print_job_queue(msh_t *shell){
+    job_queue_t *queue=shell->queue;
+    printf("running %d/%d, queued %d\n",count_jobs(shell->jobs,BACKGROUND),queue->max_running,queue->count);
+    int position=1;
+    for(queued_job_t *entry=queue->head;entry!=NULL;entry=entry->next){
+        printf("[%d] %s\n",position++,entry->cmd_line);
+    }
+}
+
+/**
+ * Drops every queued job.
+ *
+ * @param queue A pointer to the job queue.
+ * @param cancel True to kill the held subshells (they are reaped as usual).
+ * @return The number of jobs dropped.
+ */
+static int drop_jobs(job_queue_t *queue, bool cancel){
+    int count=queue->count;
+    queued_job_t *entry=queue->head;
+    while(entry!=NULL){
+        queued_job_t *next=entry->next;
+        if(cancel&&entry->pid>0){
+            kill(entry->pid,SIGKILL);
+        }
+        free_pipeline(entry->pipeline);
+        free(entry->cmd_line);
+        free(entry);
+        entry=next;
+    }
+    queue->head=NULL;
+    queue->tail=NULL;
+    queue->count=0;
+    return count;
+}
+
+/**
+ * Drops every queued job, killing the held subshells.
+ *
+ * @param queue A pointer to the job queue.
+ * @return The number of jobs dropped.
+ */
+int clear_job_queue(job_queue_t *queue){
+    return drop_jobs(queue,true);
+}
+
+/**
+ * Drops every queued job in a forked child, which must not kill the held
+ * subshells of the shell it was forked from.
+ *
+ * @param queue A pointer to the job queue.
+ */
+void forget_job_queue(job_queue_t *queue){
+    drop_jobs(queue,false);
+}
+
+/**
+ * Drops the queued job of a held subshell that has already exited.
+ *
+ * @param queue A pointer to the job queue; NULL is ignored.
+ * @param pid The process ID that was reaped.
+ */
+void forget_queued_job(job_queue_t *queue, pid_t pid){
+    if(queue==NULL||pid<=0){
+        return;
+    }
+    queued_job_t *prev=NULL;
+    for(queued_job_t *entry=queue->head;entry!=NULL;prev=entry,entry=entry->next){
+        if(entry->pid!=pid){
+            continue;
+        }
+        if(prev==NULL){
+            queue->head=entry->next;
+        }
+        else{
+            prev->next=entry->next;
+        }
+        if(queue->tail==entry){
+            queue->tail=prev;
+        }
+        queue->count--;
+        free(entry->cmd_line);
+        free(entry);
+        return;
+    }
+}
+
+/**
+ * Deallocates the job queue.
+ *
+ * @param queue A pointer to the job queue to be deallocated.
+ */
+void free_job_queue(job_queue_t *queue){
+    if(queue==NULL){
+        return;
+    }
+    clear_job_queue(queue);
+    free(queue);
+}
@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include "../include/launch.h"
+#include "../include/output.h"
+#include "../include/shell.h"
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Moves the given descriptors onto standard input and output in a child process.
+ *
+ * @param in_fd The new standard input; -1 to keep the current one.
+ * @param out_fd The new standard output; -1 to keep the current one.
+ */
+static void redirect_stdio(int in_fd, int out_fd){
+    if(in_fd!=-1&&in_fd!=STDIN_FILENO){
+        dup2(in_fd,STDIN_FILENO);
+    }
+    if(out_fd!=-1&&out_fd!=STDOUT_FILENO){
+        dup2(out_fd,STDOUT_FILENO);
+    }
+}
+
+/**
+ * Closes the descriptors a forked builtin inherits above standard error,
+ * except those its redirections set up.
+ *
+ * @param redirects The redirections of the builtin; NULL for none.
+ */
+static void close_other_fds(const redirections_t *redirects){
+    unsigned int first=STDERR_FILENO+1;
+    while(true){
+        // The lowest redirected descriptor left at or above first
+        unsigned int keep=~0U;
+        for(int i=0;redirects!=NULL&&i<redirects->num_actions;i++){
+            unsigned int fd=redirects->actions[i].fd;
+            if(fd>=first&&fd<keep&&redirects->actions[i].source!=-1){
+                keep=fd;
+            }
+        }
+        if(keep==~0U){
+            close_range(first,~0U,0);
+            return;
+        }
+        if(keep>first){
+            close_range(first,keep-1,0);
+        }
+        first=keep+1;
+    }
+}
+
+/**
+ * Launches a program with posix_spawn.
+ *
+ * The child shares the parent's memory until it calls execve, so the cost of
+ * a launch does not depend on the size of the shell's heap. Process group,
+ * signal mask and standard descriptors are applied by the spawn attributes
+ * and file actions, which gives the same child state as the fork path.
+ *
+ * @param path The path of the executable to run.
+ * @param argv A NULL-terminated argument array passed to the program.
+ * @param envp The NULL-terminated environment of the program.
+ * @param redirects The redirections of the command; NULL for none.
+ * @param child_mask The signal mask the child should start with.
+ * @param pgid The process group to join; 0 to lead a new group.
+ * @param in_fd The child's standard input; -1 to inherit.
+ * @param out_fd The child's standard output; -1 to inherit.
+ * @return The child's process ID; -1 if the program could not be launched.
+ */
+pid_t spawn_process(const char *path, char **argv, char **envp, const redirections_t *redirects, const sigset_t *child_mask, pid_t pgid, int in_fd, int out_fd){
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t default_signals;
+    pid_t pid;
+    int err;
+
+    if((err=posix_spawnattr_init(&attr))!=0){
+        fprintf(stderr,"posix_spawnattr_init: %s\n",strerror(err));
+        return -1;
+    }
+    posix_spawn_file_actions_init(&actions);
+    // The shell's handlers must not run in the child before it execs
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals,SIGINT);
+    sigaddset(&default_signals,SIGTSTP);
+    sigaddset(&default_signals,SIGCHLD);
+
+    posix_spawnattr_setflags(&attr,POSIX_SPAWN_SETPGROUP|POSIX_SPAWN_SETSIGMASK|POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr,pgid);
+    posix_spawnattr_setsigmask(&attr,child_mask);
+    posix_spawnattr_setsigdefault(&attr,&default_signals);
+    // Pipe descriptors are close-on-exec; dup2 gives the child inheritable copies
+    if(in_fd!=-1&&in_fd!=STDIN_FILENO){
+        posix_spawn_file_actions_adddup2(&actions,in_fd,STDIN_FILENO);
+    }
+    if(out_fd!=-1&&out_fd!=STDOUT_FILENO){
+        posix_spawn_file_actions_adddup2(&actions,out_fd,STDOUT_FILENO);
+    }
+    add_spawn_redirections(&actions,redirects);
+
+    err=posix_spawn(&pid,path,&actions,&attr,argv,envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if(err!=0){
+        fprintf(stderr,"execve: %s\n",strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+/**
+ * Launches a program with fork and execve.
+ *
+ * @param path The path of the executable to run.
+ * @param argv A NULL-terminated argument array passed to the program.
+ * @param envp The NULL-terminated environment of the program.
+ * @param redirects The redirections of the command; NULL for none.
+ * @param child_mask The signal mask the child should start with.
+ * @param pgid The process group to join; 0 to lead a new group.
+ * @param in_fd The child's standard input; -1 to inherit.
+ * @param out_fd The child's standard output; -1 to inherit.
+ * @return The child's process ID; -1 if fork failed.
+ */
+pid_t fork_process(const char *path, char **argv, char **envp, const redirections_t *redirects, const sigset_t *child_mask, pid_t pgid, int in_fd, int out_fd){
+    pid_t pid=fork();
+    if(pid==-1){
+        perror("fork");
+        return -1;
+    }
+    else if(pid==0){
+        // Child process
+        sigprocmask(SIG_SETMASK,child_mask,NULL);
+        setpgid(0,pgid);
+        redirect_stdio(in_fd,out_fd);
+        apply_redirections(redirects);
+        if(execve(path,argv,envp)==-1){
+            perror("execve");
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+    setpgid(pid,pgid==0?pid:pgid);
+    return pid;
+}
+
+/**
+ * Runs a builtin in a forked child of the shell.
+ *
+ * @param builtin The function implementing the builtin.
+ * @param shell The shell state passed to the builtin.
+ * @param argc The number of arguments in argv.
+ * @param argv A NULL-terminated argument array passed to the builtin.
+ * @param redirects The redirections of the command; NULL for none.
+ * @param child_mask The signal mask the child should start with.
+ * @param pgid The process group to join; 0 to lead a new group.
+ * @param in_fd The child's standard input; -1 to inherit.
+ * @param out_fd The child's standard output; -1 to inherit.
+ * @return The child's process ID; -1 if fork failed.
+ */
+pid_t fork_builtin(builtin_main_t *builtin, struct msh *shell, int argc, char **argv, const redirections_t *redirects, const sigset_t *child_mask, pid_t pgid, int in_fd, int out_fd){
+    pid_t pid=fork();
+    if(pid==-1){
+        perror("fork");
+        return -1;
+    }
+    else if(pid==0){
+        // Child process: nothing is exec'd, so undo the shell's process state by hand
+        signal(SIGINT,SIG_DFL);
+        signal(SIGTSTP,SIG_DFL);
+        signal(SIGCHLD,SIG_DFL);
+        sigprocmask(SIG_SETMASK,child_mask,NULL);
+        setpgid(0,pgid);
+        redirect_stdio(in_fd,out_fd);
+        apply_redirections(redirects);
+        close_other_fds(redirects);
+        // The event loop's descriptors are gone and queued jobs belong to the parent
+        if(shell!=NULL){
+            shell->signal_fd=-1;
+            shell->epoll_fd=-1;
+            shell->input_fd=-1;
+            if(shell->queue!=NULL){
+                forget_job_queue(shell->queue);
+            }
+        }
+        int status=builtin(shell,argc,argv);
+        out_flush();
+        fflush(stdout);
+        // _exit so atexit handlers and other parent state are not run twice
+        _exit(status);
+    }
+    setpgid(pid,pgid==0?pid:pgid);
+    return pid;
+}
@@ -0,0 +1,322 @@
+#include "../include/line_editor.h"
+#include "../include/shell.h"
+#include "../include/event_loop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define KEY_CTRL(c) ((c)&0x1f)
+#define KEY_ESCAPE 27
+#define KEY_DELETE 127
+
+/**
+ * Writes a string to the terminal.
+ *
+ * @param text The text to write.
+ * @param len The number of bytes to write.
+ */
+static void put(const char *text, size_t len){
+    while(len>0){
+        ssize_t n=write(STDOUT_FILENO,text,len);
+        if(n<0){
+            if(errno==EINTR){
+                continue;
+            }
+            return;
+        }
+        text+=n;
+        len-=n;
+    }
+}
+
+/**
+ * Appends a byte to a growable buffer.
+ *
+ * @param buffer The buffer.
+ * @param len The length of its contents.
+ * @param capacity Its size.
+ * @param c The byte to append.
+ */
+static void append(char **buffer, size_t *len, size_t *capacity, char c){
+    if(*len+1>=*capacity){
+        size_t grown=*capacity*2;
+        char *resized=realloc(*buffer,grown);
+        if(resized==NULL){
+            return;
+        }
+        *buffer=resized;
+        *capacity=grown;
+    }
+    (*buffer)[(*len)++]=c;
+    (*buffer)[*len]='\0';
+}
+
+/**
+ * Allocates a line editor for a terminal.
+ *
+ * @param fd The terminal to read from.
+ * @return A pointer to the new editor; NULL if fd is not a terminal or allocation fails.
+ */
+line_editor_t *alloc_line_editor(int fd){
+    if(!isatty(fd)){
+        return NULL;
+    }
+    line_editor_t *editor=malloc(sizeof(line_editor_t));
+    if(editor==NULL){
+        return NULL;
+    }
+    if(tcgetattr(fd,&editor->saved)==-1){
+        free(editor);
+        return NULL;
+    }
+    editor->fd=fd;
+    editor->capacity=128;
+    editor->buffer=malloc(editor->capacity);
+    editor->pattern_capacity=64;
+    editor->pattern=malloc(editor->pattern_capacity);
+    if(editor->buffer==NULL||editor->pattern==NULL){
+        // The shell then reads lines without editing
+        free(editor->buffer);
+        free(editor->pattern);
+        free(editor);
+        return NULL;
+    }
+    editor->pending_start=0;
+    editor->pending_end=0;
+    return editor;
+}
+
+/**
+ * Redraws the current line: the prompt and buffer, or the search status.
+ *
+ * @param editor A pointer to the editor.
+ * @param shell A pointer to the shell instance.
+ * @param prompt The prompt.
+ */
+static void redraw(line_editor_t *editor, msh_t *shell, const char *prompt){
+    put("\r\x1b[K",4);
+    if(!editor->searching){
+        put(prompt,strlen(prompt));
+        put(editor->buffer,editor->len);
+        return;
+    }
+    // A negative match is the last one found before the pattern stopped matching
+    int match=editor->match<0?-editor->match:editor->match;
+    bool failed=editor->match<0||(editor->match==0&&editor->pattern_len>0);
+    const char *status=failed?"(failed reverse-i-search)`":"(reverse-i-search)`";
+    put(status,strlen(status));
+    put(editor->pattern,editor->pattern_len);
+    put("': ",3);
+    if(match!=0){
+        const char *line=find_line_history(shell->history,match);
+        put(line,strlen(line));
+    }
+}
+
+/**
+ * Searches the history for the pattern, starting below a command number.
+ * A failed search keeps the previous match, as in bash.
+ *
+ * @param editor A pointer to the editor.
+ * @param shell A pointer to the shell instance.
+ * @param before Only commands numbered below this are searched.
+ */
+static void search(line_editor_t *editor, msh_t *shell, int before){
+    int match=search_history(shell->history,editor->pattern,false,before);
+    if(match!=0||editor->pattern_len==0){
+        editor->match=match;
+    }
+    else if(editor->match!=0){
+        // Mark the failure, but keep showing the last match
+        editor->match=-editor->match;
+    }
+}
+
+/**
+ * Leaves search mode, keeping the match as the line being edited.
+ *
+ * @param editor A pointer to the editor.
+ * @param shell A pointer to the shell instance.
+ */
+static void accept_match(line_editor_t *editor, msh_t *shell){
+    int match=editor->match<0?-editor->match:editor->match;
+    editor->searching=false;
+    if(match==0){
+        return;
+    }
+    const char *line=find_line_history(shell->history,match);
+    editor->len=0;
+    editor->buffer[0]='\0';
+    for(const char *p=line;*p!='\0';p++){
+        append(&editor->buffer,&editor->len,&editor->capacity,*p);
+    }
+}
+
+/**
+ * Returns the next key, waiting on the event loop when none is buffered.
+ *
+ * @param editor A pointer to the editor.
+ * @param shell A pointer to the shell instance.
+ * @return The key; -1 at end of input.
+ */
+static int next_key(line_editor_t *editor, msh_t *shell){
+    while(editor->pending_start==editor->pending_end){
+        wait_for_input(shell);
+        ssize_t n=read(editor->fd,editor->pending,sizeof(editor->pending));
+        if(n==0){
+            return -1;
+        }
+        if(n<0){
+            if(errno==EINTR||errno==EAGAIN){
+                continue;
+            }
+            return -1;
+        }
+        editor->pending_start=0;
+        editor->pending_end=n;
+    }
+    return (unsigned char)editor->pending[editor->pending_start++];
+}
+
+/**
+ * Skips the rest of an escape sequence (e.g., an arrow key) after ESC.
+ *
+ * @param editor A pointer to the editor.
+ */
+static void skip_escape_sequence(line_editor_t *editor){
+    if(editor->pending_start==editor->pending_end||editor->pending[editor->pending_start]!='['){
+        return;
+    }
+    editor->pending_start++;
+    while(editor->pending_start<editor->pending_end){
+        char c=editor->pending[editor->pending_start++];
+        if(c>=0x40&&c<=0x7e){
+            break;
+        }
+    }
+}
+
+/**
+ * Reads and edits one line. The terminal is only in raw mode while the line
+ * is edited, so commands run with the settings the user had.
+ *
+ * @param editor A pointer to the editor.
+ * @param shell A pointer to the shell instance.
+ * @param prompt The prompt to show.
+ * @return The line; NULL at end of input.
+ */
+char *edit_line(line_editor_t *editor, msh_t *shell, const char *prompt){
+    struct termios raw=editor->saved;
+    // Keys arrive one at a time and unechoed; ctrl-c and ctrl-z are plain keys at the prompt
+    raw.c_lflag&=~(ICANON|ECHO|ISIG|IEXTEN);
+    raw.c_iflag&=~(IXON|ICRNL);
+    raw.c_cc[VMIN]=1;
+    raw.c_cc[VTIME]=0;
+    tcsetattr(editor->fd,TCSANOW,&raw);
+
+    editor->len=0;
+    editor->buffer[0]='\0';
+    editor->searching=false;
+    fflush(stdout);
+    put(prompt,strlen(prompt));
+    char *line=NULL;
+    while(line==NULL){
+        int key=next_key(editor,shell);
+        if(key==-1||(key==KEY_CTRL('D')&&editor->len==0&&!editor->searching)){
+            break;
+        }
+        if(key=='\r'||key=='\n'){
+            if(editor->searching){
+                accept_match(editor,shell);
+                redraw(editor,shell,prompt);
+            }
+            put("\r\n",2);
+            line=editor->buffer;
+        }
+        else if(key==KEY_CTRL('C')){
+            put("^C\r\n",4);
+            editor->len=0;
+            editor->buffer[0]='\0';
+            editor->searching=false;
+            put(prompt,strlen(prompt));
+        }
+        else if(key==KEY_CTRL('R')){
+            if(!editor->searching){
+                editor->searching=true;
+                editor->pattern_len=0;
+                editor->pattern[0]='\0';
+                editor->match=0;
+            }
+            else if(editor->match>0){
+                search(editor,shell,editor->match);
+            }
+            redraw(editor,shell,prompt);
+        }
+        else if(key==KEY_CTRL('G')&&editor->searching){
+            editor->searching=false;
+            redraw(editor,shell,prompt);
+        }
+        else if(key==KEY_ESCAPE){
+            skip_escape_sequence(editor);
+            if(editor->searching){
+                accept_match(editor,shell);
+                redraw(editor,shell,prompt);
+            }
+        }
+        else if(key==KEY_DELETE||key==KEY_CTRL('H')){
+            if(editor->searching){
+                if(editor->pattern_len>0){
+                    editor->pattern[--editor->pattern_len]='\0';
+                    search(editor,shell,INT_MAX);
+                }
+                redraw(editor,shell,prompt);
+            }
+            else if(editor->len>0){
+                editor->buffer[--editor->len]='\0';
+                put("\b \b",3);
+            }
+        }
+        else if(key==KEY_CTRL('U')){
+            editor->len=0;
+            editor->buffer[0]='\0';
+            redraw(editor,shell,prompt);
+        }
+        else if(key>=' '){
+            char c=(char)key;
+            if(editor->searching){
+                append(&editor->pattern,&editor->pattern_len,&editor->pattern_capacity,c);
+                // A longer pattern may still match the current line
+                int current=editor->match<0?-editor->match:editor->match;
+                search(editor,shell,current==0?INT_MAX:current+1);
+                redraw(editor,shell,prompt);
+            }
+            else{
+                append(&editor->buffer,&editor->len,&editor->capacity,c);
+                put(&c,1);
+            }
+        }
+    }
+    tcsetattr(editor->fd,TCSANOW,&editor->saved);
+    if(line==NULL){
+        put("\r\n",2);
+    }
+    return line;
+}
+
+/**
+ * Deallocates the editor, leaving the terminal as it was found.
+ *
+ * @param editor A pointer to the editor to be deallocated.
+ */
+void free_line_editor(line_editor_t *editor){
+    if(editor==NULL){
+        return;
+    }
+    tcsetattr(editor->fd,TCSANOW,&editor->saved);
+    free(editor->buffer);
+    free(editor->pattern);
+    free(editor);
+}
@@ -4,19 +4,80 @@
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
 #include "../include/shell.h"
+#include "../include/event_loop.h"
+#include "../include/input.h"
+#include "../include/line_editor.h"
+
+/**
+ * Reads the next line of input, or the next line of a line that is being
+ * continued, waiting for input and handling signals meanwhile.
+ *
+ * @param shell The current shell state.
+ * @param in The input reader.
+ * @param len Receives the length of the line.
+ * @param continued True to join the next line to the line read last.
+ * @return The line, in the reader's buffer; NULL at end of input.
+ */
+static char *read_line(msh_t *shell, input_t *in, size_t *len, bool continued) {
+    char *line;
+    while ((line = continued ? continue_line(in, len) : next_line(in, len)) == NULL && !in->eof) {
+        wait_for_input(shell);
+        if (fill_input(in) < 0 && errno != EAGAIN && errno != EINTR) {
+            perror("read");
+            in->eof = true;
+        }
+    }
+    return line;
+}
+
+/**
+ * Appends text to the buffer that lines continued in the line editor are joined in.
+ *
+ * @param buffer The buffer; grown as needed and reused for every line.
+ * @param capacity The capacity of the buffer.
+ * @param len The length of the text in the buffer.
+ * @param text The text to append.
+ */
+static void append_text(char **buffer, size_t *capacity, size_t *len, const char *text) {
+    size_t text_len = strlen(text);
+    if (*len + text_len + 1 > *capacity) {
+        size_t new_capacity = *capacity == 0 ? 256 : *capacity;
+        while (*len + text_len + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *grown = realloc(*buffer, new_capacity);
+        if (grown == NULL) {
+            perror("Failed to allocate memory for a line");
+            exit(EXIT_FAILURE);
+        }
+        *buffer = grown;
+        *capacity = new_capacity;
+    }
+    memcpy(*buffer + *len, text, text_len + 1);
+    *len += text_len;
+}
 
 int main(int argc, char *argv[]) {
     int max_jobs = 16;
-    int max_line = 1024;
+    int max_line = 0;
     int max_history = 10;
+    int max_parallel = 0;
+    int flush_every = 0;
+    bool merge_history_file = false;
+    int dedup = 0;
+    char *command = NULL;
+    bool force_history = false;
 
     int opt;
     char *endptr;
     long val;
     int errors = 0;
 
-    while ((opt = getopt(argc, argv, "s:j:l:")) != -1) {
+    while ((opt = getopt(argc, argv, "s:j:l:p:f:md:c:H")) != -1) {
         switch (opt) {
             case 's':
                 val = strtol(optarg, &endptr, 10);
@@ -42,6 +103,40 @@ int main(int argc, char *argv[]) {
                     errors++;
                 }
                 break;
+            case 'p':
+                val = strtol(optarg, &endptr, 10);
+                if (*endptr == '\0' && val > 0 && val <= INT_MAX) {
+                    max_parallel = (int)val;
+                } else {
+                    errors++;
+                }
+                break;
+            case 'f':
+                val = strtol(optarg, &endptr, 10);
+                if (*endptr == '\0' && val > 0 && val <= INT_MAX) {
+                    flush_every = (int)val;
+                } else {
+                    errors++;
+                }
+                break;
+            case 'm':
+                merge_history_file = true;
+                break;
+            case 'd':
+                if (strcmp(optarg, "ignoredups") == 0) {
+                    dedup |= HISTORY_IGNOREDUPS;
+                } else if (strcmp(optarg, "erasedups") == 0) {
+                    dedup |= HISTORY_ERASEDUPS;
+                } else {
+                    errors++;
+                }
+                break;
+            case 'c':
+                command = optarg;
+                break;
+            case 'H':
+                force_history = true;
+                break;
             case '?':
                 errors++;
                 break;
@@ -49,11 +144,23 @@ int main(int argc, char *argv[]) {
     }
 
     // If there were any errors in parsing options, show usage and exit
-    if (optind<argc||errors > 0) {
-        fprintf(stdout, "usage: msh [-s NUMBER] [-j NUMBER] [-l NUMBER]\n");
+    // At most one script can be given, as a file or with -c; the words after it are its parameters
+    if (errors > 0) {
+        fprintf(stdout, "usage: msh [-s NUMBER] [-j NUMBER] [-l NUMBER] [-p NUMBER] [-f NUMBER] [-m] [-d ignoredups|erasedups] [-H] [-c STRING [NAME [ARG...]] | FILE [ARG...]]\n");
         return 1;
     }
 
+    int input_fd = STDIN_FILENO;
+    if (command == NULL && optind < argc) {
+        input_fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+        if (input_fd == -1) {
+            printf("error: %s: %s\n", argv[optind], strerror(errno));
+            return 127;
+        }
+    }
+    // Without a terminal there is nobody to prompt, and the commands of a script are not history
+    bool interactive = command == NULL && input_fd == STDIN_FILENO && isatty(STDIN_FILENO);
+
     // Allocate and initialize the shell state
     shell = alloc_shell(max_jobs, max_line, max_history);
     if (shell == NULL) {
@@ -61,30 +168,123 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // REPL loop using getline
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t nRead;
+    if (max_parallel > 0) {
+        shell->queue->max_running = max_parallel;
+    }
+    if (flush_every > 0) {
+        shell->history->flush_every = flush_every;
+    }
+    shell->history->merge = merge_history_file;
+    shell->history->dedup = dedup;
+    shell->record_history = interactive || force_history;
+    // $0 is the script (or the name after -c's string), and $1... the words after it
+    shell->num_params = argc - optind;
+    shell->params = shell->num_params > 0 ? argv + optind : NULL;
+
+    if (command != NULL) {
+        // -c runs one script, which may span several lines, and no REPL
+        evaluate(shell, command);
+        int status = shell->last_status;
+        exit_shell(shell);
+        return status;
+    }
+
+    // Scripts are read in large chunks: one read(2) brings in many lines
+    input_t *in = alloc_input(input_fd, interactive ? 0 : INPUT_BATCH_CAPACITY);
+    if (in == NULL) {
+        fprintf(stdout, "Failed to initialize shell\n");
+        exit_shell(shell);
+        return 1;
+    }
+    watch_input(shell, input_fd);
+
+    // Interactive sessions get a line editor (with ctrl-r history search)
+    line_editor_t *editor = interactive ? alloc_line_editor(STDIN_FILENO) : NULL;
+
+    // REPL loop: wait for input and signals together, so children that exit
+    // while the shell sits at the prompt are reaped right away
+    char *line;
+    size_t len;
+    // Continued lines typed in the line editor are joined here; piped input is joined in place
+    char *joined = NULL;
+    size_t joined_capacity = 0;
+    size_t joined_len = 0;
+    bool exited = false;
 
-    printf("msh> ");
-    while ((nRead = getline(&line, &len, stdin)) != -1) {
-        if (nRead > 0 && line[nRead - 1] == '\n') {
-            line[nRead - 1] = '\0';
+    while (true) {
+        // Pick up what other sessions sharing the history file ran since the last prompt
+        if (shell->record_history) {
+            merge_history(shell->history);
         }
-        if(strlen(line)!=0){
-            if(evaluate(shell, line)!=0){
+        if (editor != NULL) {
+            if ((line = edit_line(editor, shell, "msh> ")) == NULL) {
                 break;
             }
+            len = strlen(line);
+        } else {
+            if (interactive) {
+                printf("msh> ");
+                fflush(stdout);
+            }
+            if ((line = read_line(shell, in, &len, false)) == NULL) {
+                break;
+            }
+        }
+        // Buffered lines skip the wait above; reap here so piped input cannot pile up zombies
+        handle_signals(shell);
+        if (len == 0) {
+            continue;
+        }
+        // A line ending inside a quote, after a backslash or after && or | goes on on the next line
+        int result;
+        while ((result = evaluate_partial(shell, line)) == EVALUATE_INCOMPLETE) {
+            char *more;
+            if (editor != NULL) {
+                // The editor reuses its buffer for the next line
+                if (line != joined) {
+                    joined_len = 0;
+                    append_text(&joined, &joined_capacity, &joined_len, line);
+                    line = joined;
+                }
+                if ((more = edit_line(editor, shell, "> ")) == NULL) {
+                    break;
+                }
+                append_text(&joined, &joined_capacity, &joined_len, "\n");
+                append_text(&joined, &joined_capacity, &joined_len, more);
+                line = joined;
+            } else {
+                if (interactive) {
+                    printf("> ");
+                    fflush(stdout);
+                }
+                if ((more = read_line(shell, in, &len, true)) == NULL) {
+                    // Reading may have moved the buffer; the line is still at its start
+                    line = in->buffer + in->line;
+                    break;
+                }
+                line = more;
+            }
+        }
+        // Input ended first: the incomplete line is reported like any other syntax error
+        if (result == EVALUATE_INCOMPLETE) {
+            result = evaluate(shell, line);
+        }
+        if (result != 0) {
+            exited = true;
+            break;
         }
-        free(line);
-        line = NULL;
-        len = 0;
-        printf("msh> ");
     }
 
     // Cleanup
-    free(line);
+    free(joined);
+    free_line_editor(editor);
+    free_input(in);
+    if (input_fd != STDIN_FILENO) {
+        close(input_fd);
+    }
+    // A script exits with the status of its last command, like sh, and exit N with N
+    int status = interactive && !exited ? 0 : shell->last_status;
     exit_shell(shell);
 
-    return 0;
+    return status;
 }
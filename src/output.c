@@ -0,0 +1,141 @@
+#include "../include/output.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+static char buffer[OUTPUT_BUFFER_SIZE];
+static size_t buffer_len = 0;
+//Set while builtin output is captured; nothing is buffered then
+static const capture_t *capture = NULL;
+
+/**
+ * Writes an entire block to standard output, retrying short writes.
+ *
+ * @param data The bytes to write.
+ * @param len The number of bytes to write.
+ * @return 0 on success; -1 on error.
+ */
+static int write_stdout(const char *data, size_t len){
+    while(len>0){
+        ssize_t n=write(STDOUT_FILENO,data,len);
+        if(n<0){
+            if(errno==EINTR){
+                continue;
+            }
+            return -1;
+        }
+        data+=n;
+        len-=n;
+    }
+    return 0;
+}
+
+/**
+ * Appends bytes to the output buffer, flushing it when it fills up.
+ *
+ * @param data The bytes to write.
+ * @param len The number of bytes to write.
+ */
+void out_write(const char *data, size_t len){
+    if(capture!=NULL){
+        memcpy(capture->reserve(capture->context,len),data,len);
+        capture->commit(capture->context,len);
+        return;
+    }
+    if(buffer_len+len>OUTPUT_BUFFER_SIZE){
+        out_flush();
+        // Blocks larger than the buffer skip the copy entirely
+        if(len>=OUTPUT_BUFFER_SIZE){
+            write_stdout(data,len);
+            return;
+        }
+    }
+    memcpy(buffer+buffer_len,data,len);
+    buffer_len+=len;
+}
+
+/**
+ * Appends a string to the output buffer.
+ *
+ * @param str The NUL-terminated string to write.
+ */
+void out_puts(const char *str){
+    out_write(str,strlen(str));
+}
+
+/**
+ * Appends a single character to the output buffer.
+ *
+ * @param c The character to write.
+ */
+void out_putc(char c){
+    if(capture!=NULL){
+        out_write(&c,1);
+        return;
+    }
+    if(buffer_len==OUTPUT_BUFFER_SIZE){
+        out_flush();
+    }
+    buffer[buffer_len++]=c;
+}
+
+/**
+ * Formats a string directly into the output buffer.
+ *
+ * @param format The printf format string.
+ */
+void out_printf(const char *format, ...){
+    va_list args;
+    va_start(args,format);
+    int len=vsnprintf(buffer+buffer_len,OUTPUT_BUFFER_SIZE-buffer_len,format,args);
+    va_end(args);
+    if(len<0){
+        return;
+    }
+    if((size_t)len<OUTPUT_BUFFER_SIZE-buffer_len){
+        if(capture!=NULL){
+            out_write(buffer+buffer_len,len);
+        }
+        else{
+            buffer_len+=len;
+        }
+        return;
+    }
+    // Did not fit in the space left: format into a temporary block instead
+    char *text=malloc(len+1);
+    if(text==NULL){
+        return;
+    }
+    va_start(args,format);
+    vsnprintf(text,len+1,format,args);
+    va_end(args);
+    out_write(text,len);
+    free(text);
+}
+
+/**
+ * Sends the output to a capture, or back to standard output.
+ *
+ * @param to The capture; NULL for standard output.
+ * @return The capture in place before.
+ */
+const capture_t *out_capture(const capture_t *to){
+    out_flush();
+    const capture_t *previous=capture;
+    capture=to;
+    return previous;
+}
+
+/**
+ * Writes the contents of the output buffer to standard output.
+ *
+ * @return 0 on success; -1 if the write failed.
+ */
+int out_flush(){
+    int result=write_stdout(buffer,buffer_len);
+    buffer_len=0;
+    return result;
+}
@@ -0,0 +1,441 @@
+#define _GNU_SOURCE
+#include "../include/parallel.h"
+#include "../include/builtins.h"
+#include "../include/event_loop.h"
+#include "../include/input.h"
+#include "../include/output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define MAX_FAILURES 101
+
+//One argument of a parallel run and the state of the job running it
+typedef struct parallel_item {
+    char *arg;
+    char *cmd_line;
+    pid_t pid;
+    int out_fd;
+    int exit_status;
+    bool started;
+    bool finished;
+    bool stopped;
+} parallel_item_t;
+
+//The state of a parallel run, shared with the reap hook
+typedef struct parallel_run {
+    parallel_item_t *items;
+    int num_items;
+    int *running;
+    int num_running;
+    bool interrupted;
+} parallel_run_t;
+
+/**
+ * Records the exit or stop of an item. Installed as the shell's child hook
+ * for the duration of a run, so it is called from the reap path for every
+ * child status.
+ *
+ * @param shell A pointer to the shell instance.
+ * @param pid The process whose status changed.
+ * @param status The status reported by waitpid.
+ */
+static void item_status_changed(msh_t *shell, pid_t pid, int status){
+    parallel_run_t *run=shell->child_hook_data;
+    if(WIFCONTINUED(status)){
+        return;
+    }
+    for(int i=0;i<run->num_running;i++){
+        parallel_item_t *item=&run->items[run->running[i]];
+        if(item->pid!=pid){
+            continue;
+        }
+        if(WIFSTOPPED(status)){
+            // The stopped job stays in the job table; ctrl-z also stops the rest of the run
+            item->stopped=true;
+            item->exit_status=128+WSTOPSIG(status);
+            run->interrupted=true;
+        }
+        else{
+            item->exit_status=WIFEXITED(status)?WEXITSTATUS(status):128+WTERMSIG(status);
+            if(WIFSIGNALED(status)&&WTERMSIG(status)==SIGINT){
+                run->interrupted=true;
+            }
+        }
+        item->finished=true;
+        run->running[i]=run->running[--run->num_running];
+        return;
+    }
+}
+
+/**
+ * Frees an array of strings and the strings in it.
+ *
+ * @param strings The array; may be NULL.
+ * @param count The number of strings in the array.
+ */
+static void free_strings(char **strings, int count){
+    if(strings==NULL){
+        return;
+    }
+    for(int i=0;i<count;i++){
+        free(strings[i]);
+    }
+    free(strings);
+}
+
+/**
+ * Builds the argument array of an item by replacing every "{}" in the
+ * command with the item, or appending the item if the command has no "{}".
+ *
+ * @param command The command and its arguments, NULL-terminated.
+ * @param num_args The number of strings in command.
+ * @param arg The item.
+ * @return A newly allocated NULL-terminated argument array with newly allocated strings;
+ *         NULL if memory runs out.
+ */
+static char **item_argv(char **command, int num_args, const char *arg){
+    bool replaced=false;
+    char **argv=malloc(sizeof(char*)*(num_args+2));
+    if(argv==NULL){
+        return NULL;
+    }
+    size_t arg_len=strlen(arg);
+    for(int i=0;i<num_args;i++){
+        int count=0;
+        for(const char *p=strstr(command[i],"{}");p!=NULL;p=strstr(p+2,"{}")){
+            count++;
+        }
+        char *out=malloc(strlen(command[i])+count*arg_len+1);
+        if(out==NULL){
+            free_strings(argv,i);
+            return NULL;
+        }
+        char *dst=out;
+        for(const char *src=command[i];*src!='\0';){
+            if(src[0]=='{'&&src[1]=='}'){
+                memcpy(dst,arg,arg_len);
+                dst+=arg_len;
+                src+=2;
+                replaced=true;
+            }
+            else{
+                *dst++=*src++;
+            }
+        }
+        *dst='\0';
+        argv[i]=out;
+    }
+    int argc=num_args;
+    if(!replaced){
+        if((argv[argc]=strdup(arg))==NULL){
+            free_strings(argv,argc);
+            return NULL;
+        }
+        argc++;
+    }
+    argv[argc]=NULL;
+    return argv;
+}
+
+/**
+ * Joins an argument array with spaces into the command line shown by jobs.
+ *
+ * @param argv A NULL-terminated argument array.
+ * @return A newly allocated string; NULL if memory runs out.
+ */
+static char *join_args(char **argv){
+    size_t len=1;
+    for(int i=0;argv[i]!=NULL;i++){
+        len+=strlen(argv[i])+1;
+    }
+    char *line=malloc(len);
+    if(line==NULL){
+        return NULL;
+    }
+    line[0]='\0';
+    for(int i=0;argv[i]!=NULL;i++){
+        if(i>0){
+            strcat(line," ");
+        }
+        strcat(line,argv[i]);
+    }
+    return line;
+}
+
+/**
+ * Starts one item with its output captured in a memfd.
+ *
+ * @param shell A pointer to the shell instance.
+ * @param run The parallel run.
+ * @param index The index of the item to start.
+ * @param command The command template.
+ * @param num_args The number of strings in command.
+ * @param null_fd A descriptor of /dev/null used as every item's standard input.
+ */
+static void start_item(msh_t *shell, parallel_run_t *run, int index, char **command, int num_args, int null_fd){
+    parallel_item_t *item=&run->items[index];
+    char **argv=item_argv(command,num_args,item->arg);
+    item->cmd_line=argv!=NULL?join_args(argv):NULL;
+    item->started=true;
+    if(item->cmd_line==NULL){
+        // The item fails on its own; the rest of the run goes on
+        fprintf(stderr,"error: parallel: %s: out of memory\n",item->arg);
+        if(argv!=NULL){
+            for(int i=0;argv[i]!=NULL;i++){
+                free(argv[i]);
+            }
+            free(argv);
+        }
+        item->finished=true;
+        item->exit_status=1;
+        return;
+    }
+    item->out_fd=memfd_create("parallel",MFD_CLOEXEC);
+    if(item->out_fd==-1){
+        perror("memfd_create");
+    }
+
+    // Inside a forked pipeline stage the items stay in its process group, so ctrl-c reaches them
+    pid_t pgid=shell->signal_fd==-1?getpgrp():0;
+    int argc=0;
+    while(argv[argc]!=NULL){
+        argc++;
+    }
+    const builtin_t *builtin=find_builtin(argv[0]);
+    const char *path=NULL;
+    pid_t pid=-1;
+    if(builtin!=NULL){
+        pid=fork_builtin(builtin->run,shell,argc,argv,NULL,&shell->child_mask,pgid,null_fd,item->out_fd);
+    }
+    else if((path=resolve_command(shell->path_cache,argv[0]))==NULL){
+        fprintf(stderr,"error: %s: command not found\n",argv[0]);
+    }
+    else{
+        pid=spawn_process(path,argv,environment(shell->variables),NULL,&shell->child_mask,pgid,null_fd,item->out_fd);
+    }
+    for(int i=0;argv[i]!=NULL;i++){
+        free(argv[i]);
+    }
+    free(argv);
+
+    if(pid==-1){
+        item->finished=true;
+        item->exit_status=127;
+        return;
+    }
+    item->pid=pid;
+    add_job(shell->jobs,pid,FOREGROUND,item->cmd_line);
+    run->running[run->num_running++]=index;
+}
+
+/**
+ * Writes the captured output of a finished item to standard output and
+ * reports its status if it failed.
+ *
+ * @param item The item to print.
+ * @return True if the item succeeded; otherwise, false.
+ */
+static bool print_item(parallel_item_t *item){
+    if(item->out_fd!=-1){
+        char buffer[8192];
+        ssize_t n;
+        off_t offset=0;
+        while((n=pread(item->out_fd,buffer,sizeof(buffer),offset))>0){
+            offset+=n;
+            for(ssize_t done=0;done<n;){
+                ssize_t written=write(STDOUT_FILENO,buffer+done,n-done);
+                if(written<0){
+                    if(errno==EINTR){
+                        continue;
+                    }
+                    break;
+                }
+                done+=written;
+            }
+        }
+        close(item->out_fd);
+        item->out_fd=-1;
+    }
+    const char *cmd_line=item->cmd_line!=NULL?item->cmd_line:item->arg;
+    if(item->stopped){
+        fprintf(stderr,"parallel: %s: stopped (left in jobs)\n",cmd_line);
+    }
+    else if(item->exit_status!=0){
+        fprintf(stderr,"parallel: %s: exit status %d\n",cmd_line,item->exit_status);
+    }
+    return item->exit_status==0;
+}
+
+/**
+ * Reads the items of a run from standard input, one per line.
+ *
+ * @param num_items Receives the number of items read.
+ * @return A newly allocated array of newly allocated strings; NULL if memory runs out.
+ */
+static char **read_items(int *num_items){
+    input_t *in=alloc_input(STDIN_FILENO,0);
+    int capacity=16;
+    char **items=malloc(sizeof(char*)*capacity);
+    *num_items=0;
+    if(in==NULL||items==NULL){
+        free_input(in);
+        free(items);
+        return NULL;
+    }
+    bool out_of_memory=false;
+    while(true){
+        size_t len;
+        char *line=next_line(in,&len);
+        if(line==NULL){
+            if(in->eof||(fill_input(in)<0&&errno!=EINTR)){
+                break;
+            }
+            continue;
+        }
+        if(len==0){
+            continue;
+        }
+        if(*num_items==capacity){
+            char **grown=realloc(items,sizeof(char*)*capacity*2);
+            if(grown==NULL){
+                out_of_memory=true;
+                break;
+            }
+            items=grown;
+            capacity*=2;
+        }
+        if((items[*num_items]=strdup(line))==NULL){
+            out_of_memory=true;
+            break;
+        }
+        (*num_items)++;
+    }
+    free_input(in);
+    if(out_of_memory){
+        free_strings(items,*num_items);
+        return NULL;
+    }
+    return items;
+}
+
+/**
+ * Runs a command once per item, keeping at most N items running. A new item
+ * starts as soon as the reap path reports that one finished, and output is
+ * printed in item order as soon as every earlier item has been printed.
+ */
+int builtin_parallel(msh_t *shell, int argc, char **argv){
+    int max_running=shell->queue!=NULL?shell->queue->max_running:1;
+    int first=1;
+    if(argc>2&&strcmp(argv[1],"-j")==0){
+        char *end;
+        long value=strtol(argv[2],&end,10);
+        if(*end!='\0'||value<=0||value>100000){
+            printf("error: parallel: %s: invalid number\n",argv[2]);
+            return 1;
+        }
+        max_running=(int)value;
+        first=3;
+    }
+    int separator=first;
+    while(separator<argc&&strcmp(argv[separator],":::")!=0){
+        separator++;
+    }
+    if(separator==first){
+        printf("error: usage: parallel [-j N] COMMAND [ARG...] [::: ITEM...]\n");
+        return 1;
+    }
+
+    char **args;
+    int num_items;
+    if(separator<argc){
+        num_items=argc-separator-1;
+        args=malloc(sizeof(char*)*(num_items>0?num_items:1));
+        for(int i=0;args!=NULL&&i<num_items;i++){
+            if((args[i]=strdup(argv[separator+1+i]))==NULL){
+                free_strings(args,i);
+                args=NULL;
+            }
+        }
+    }
+    else{
+        args=read_items(&num_items);
+    }
+    if(args==NULL){
+        printf("error: parallel: out of memory\n");
+        return 1;
+    }
+
+    parallel_run_t run;
+    run.items=calloc(num_items>0?num_items:1,sizeof(parallel_item_t));
+    run.num_items=num_items;
+    run.running=malloc(sizeof(int)*max_running);
+    if(run.items==NULL||run.running==NULL){
+        printf("error: parallel: out of memory\n");
+        free(run.items);
+        free(run.running);
+        free_strings(args,num_items);
+        return 1;
+    }
+    run.num_running=0;
+    run.interrupted=false;
+    for(int i=0;i<num_items;i++){
+        run.items[i].arg=args[i];
+        run.items[i].out_fd=-1;
+    }
+    int null_fd=open("/dev/null",O_RDONLY|O_CLOEXEC);
+
+    // Items report to this run through the reap path while it lasts
+    void (*prev_hook)(msh_t *,pid_t,int)=shell->child_hook;
+    void *prev_hook_data=shell->child_hook_data;
+    shell->child_hook=item_status_changed;
+    shell->child_hook_data=&run;
+    fflush(stdout);
+    out_flush();
+
+    int next_start=0;
+    int next_print=0;
+    int failures=0;
+    while(next_print<num_items){
+        while(!run.interrupted&&run.num_running<max_running&&next_start<num_items){
+            start_item(shell,&run,next_start++,argv+first,separator-first,null_fd);
+        }
+        while(next_print<num_items&&run.items[next_print].finished){
+            failures+=!print_item(&run.items[next_print++]);
+        }
+        if(next_print<num_items&&run.num_running==0&&(run.interrupted||next_start==num_items)){
+            break;
+        }
+        if(run.num_running>0){
+            wait_for_signals(shell);
+        }
+    }
+    // Items left behind by ctrl-c or ctrl-z: print what finished, count the rest as failed
+    for(int i=next_print;i<num_items;i++){
+        if(run.items[i].finished){
+            failures+=!print_item(&run.items[i]);
+        }
+        else{
+            failures++;
+        }
+    }
+
+    shell->child_hook=prev_hook;
+    shell->child_hook_data=prev_hook_data;
+    if(null_fd!=-1){
+        close(null_fd);
+    }
+    for(int i=0;i<num_items;i++){
+        free(run.items[i].arg);
+        free(run.items[i].cmd_line);
+    }
+    free(run.items);
+    free(run.running);
+    free(args);
+    return failures<MAX_FAILURES?failures:MAX_FAILURES;
+}
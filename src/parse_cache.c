@@ -0,0 +1,324 @@
+#include "../include/parse_cache.h"
+#include "../include/builtins.h"
+#include "../include/compile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_BUCKETS 64
+
+/**
+ * Computes the 64-bit FNV-1a hash of a line.
+ *
+ * @param line The line.
+ * @param len Its length.
+ * @return The hash value.
+ */
+static uint64_t hash_line(const char *line, size_t len){
+    uint64_t hash=14695981039346656037ULL;
+    for(size_t i=0;i<len;i++){
+        hash^=(unsigned char)line[i];
+        hash*=1099511628211ULL;
+    }
+    return hash;
+}
+
+static void resolve_builtins(and_or_t *lists);
+
+/**
+ * Looks up the builtins of the command substitutions in a word, and in the
+ * words of its ${NAME-WORD} expansions.
+ *
+ * @param word The expansions of the word; NULL for a plain word.
+ */
+static void resolve_word(const word_t *word){
+    for(const expansion_t *expansion=word!=NULL?word->expansions:NULL;expansion!=NULL;expansion=expansion->next){
+        if(expansion->type==PARAM_COMMAND){
+            resolve_builtins(expansion->lists);
+        }
+        resolve_word(expansion->word);
+    }
+}
+
+/**
+ * Looks up the builtins of the command substitutions in the words, assignments
+ * and redirections of a command.
+ *
+ * @param command The command.
+ */
+static void resolve_substitutions(const command_t *command){
+    int num_words=command->type==COMMAND_SIMPLE?command->argc:command->compound->num_words;
+    word_t **expand=command->type==COMMAND_SIMPLE?command->expand:command->compound->expand;
+    for(int i=0;expand!=NULL&&i<num_words;i++){
+        resolve_word(expand[i]);
+    }
+    for(const assignment_t *assignment=command->assignments;assignment!=NULL;assignment=assignment->next){
+        resolve_word(assignment->expand);
+    }
+    for(const redirect_t *redirect=command->redirects;redirect!=NULL;redirect=redirect->next){
+        resolve_word(redirect->expand);
+    }
+}
+
+/**
+ * Looks up the builtin of every command of a sequence of lists, including
+ * the commands nested in compound commands and command substitutions, so
+ * running a cached line does not search the builtin registry again.
+ *
+ * @param lists The first list.
+ */
+static void resolve_builtins(and_or_t *lists){
+    for(and_or_t *list=lists;list!=NULL;list=list->next){
+        for(pipeline_t *pipeline=list->pipelines;pipeline!=NULL;pipeline=pipeline->next){
+            for(command_t *command=pipeline->commands;command!=NULL;command=command->next){
+                if(command->type!=COMMAND_SIMPLE){
+                    resolve_builtins(command->compound->condition);
+                    resolve_builtins(command->compound->body);
+                    resolve_builtins(command->compound->else_body);
+                }
+                resolve_substitutions(command);
+                // A name that is expanded is looked up when it runs
+                bool expanded=command->expand!=NULL&&command->expand[0]!=NULL;
+                command->builtin=command->argc>0&&!expanded?find_builtin(command->argv[0]):NULL;
+            }
+        }
+    }
+}
+
+/**
+ * Unlinks an entry from the LRU list.
+ *
+ * @param cache A pointer to the parse cache.
+ * @param entry The entry.
+ */
+static void unlink_lru(parse_cache_t *cache, parse_entry_t *entry){
+    if(entry->newer!=NULL){
+        entry->newer->older=entry->older;
+    }
+    else{
+        cache->newest=entry->older;
+    }
+    if(entry->older!=NULL){
+        entry->older->newer=entry->newer;
+    }
+    else{
+        cache->oldest=entry->newer;
+    }
+}
+
+/**
+ * Links an entry in as the most recently used.
+ *
+ * @param cache A pointer to the parse cache.
+ * @param entry The entry.
+ */
+static void push_lru(parse_cache_t *cache, parse_entry_t *entry){
+    entry->newer=NULL;
+    entry->older=cache->newest;
+    if(cache->newest!=NULL){
+        cache->newest->newer=entry;
+    }
+    else{
+        cache->oldest=entry;
+    }
+    cache->newest=entry;
+}
+
+/**
+ * Removes an entry from the cache and releases its tree.
+ *
+ * @param cache A pointer to the parse cache.
+ * @param entry The entry.
+ */
+static void remove_entry(parse_cache_t *cache, parse_entry_t *entry){
+    parse_entry_t **link=&cache->buckets[entry->hash&(cache->num_buckets-1)];
+    while(*link!=entry){
+        link=&(*link)->next;
+    }
+    *link=entry->next;
+    unlink_lru(cache,entry);
+    cache->bytes-=entry->bytes;
+    cache->count--;
+    release_parse_tree(entry->tree);
+    free(entry->line);
+    free(entry);
+}
+
+/**
+ * Doubles the number of buckets and rehashes every entry.
+ *
+ * @param cache A pointer to the parse cache.
+ */
+static void grow_buckets(parse_cache_t *cache){
+    int num_buckets=cache->num_buckets*2;
+    parse_entry_t **buckets=calloc(num_buckets,sizeof(parse_entry_t*));
+    if(buckets==NULL){
+        return;
+    }
+    for(int i=0;i<cache->num_buckets;i++){
+        parse_entry_t *entry=cache->buckets[i];
+        while(entry!=NULL){
+            parse_entry_t *next=entry->next;
+            uint64_t bucket=entry->hash&(num_buckets-1);
+            entry->next=buckets[bucket];
+            buckets[bucket]=entry;
+            entry=next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets=buckets;
+    cache->num_buckets=num_buckets;
+}
+
+/**
+ * Allocates an empty parse cache.
+ *
+ * @param max_bytes The most memory the cached lines and trees may hold; 0 disables caching.
+ * @return A pointer to the newly allocated cache; NULL if allocation fails.
+ */
+parse_cache_t *alloc_parse_cache(size_t max_bytes){
+    parse_cache_t *cache=malloc(sizeof(parse_cache_t));
+    if(cache==NULL){
+        return NULL;
+    }
+    cache->buckets=calloc(INITIAL_BUCKETS,sizeof(parse_entry_t*));
+    if(cache->buckets==NULL){
+        free(cache);
+        return NULL;
+    }
+    cache->num_buckets=INITIAL_BUCKETS;
+    cache->count=0;
+    cache->newest=NULL;
+    cache->oldest=NULL;
+    cache->bytes=0;
+    cache->max_bytes=max_bytes;
+    cache->hits=0;
+    cache->misses=0;
+    return cache;
+}
+
+/**
+ * Finds the tree of a line in the cache, or parses the line (compiling its
+ * compound commands) and caches its tree. The least recently used lines are evicted to keep the cache under its
+ * memory bound; a line that would take more than a quarter of it is not cached.
+ *
+ * @param cache A pointer to the parse cache; NULL parses without caching.
+ * @param line The command line; it is not modified.
+ * @param tree Receives the tree, to be given back with release_parse_tree.
+ * @param error Receives a description of a syntax error; may be NULL.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+int acquire_parse_tree(parse_cache_t *cache, const char *line, parse_tree_t **tree, const char **error){
+    size_t len=strlen(line);
+    uint64_t hash=0;
+    // A line too long to be cached is not hashed either
+    bool cacheable=cache!=NULL&&len<cache->max_bytes/4;
+    if(cacheable){
+        hash=hash_line(line,len);
+        for(parse_entry_t *entry=cache->buckets[hash&(cache->num_buckets-1)];entry!=NULL;entry=entry->next){
+            if(entry->hash==hash&&entry->len==len&&memcmp(entry->line,line,len)==0){
+                cache->hits++;
+                unlink_lru(cache,entry);
+                push_lru(cache,entry);
+                entry->tree->refs++;
+                *tree=entry->tree;
+                if(error!=NULL){
+                    *error=NULL;
+                }
+                return PARSE_OK;
+            }
+        }
+        cache->misses++;
+    }
+
+    int result=parse_line(line,tree,error);
+    if(result!=PARSE_OK){
+        return result;
+    }
+    resolve_builtins((*tree)->lists);
+    // Lists with compound commands are compiled once, and their bytecode is cached with the tree
+    compile_tree(*tree);
+    if(!cacheable){
+        return PARSE_OK;
+    }
+    size_t bytes=sizeof(parse_entry_t)+len+1+parse_tree_size(*tree);
+    if(bytes>cache->max_bytes/4){
+        return PARSE_OK;
+    }
+    parse_entry_t *entry=malloc(sizeof(parse_entry_t));
+    char *copy=malloc(len+1);
+    if(entry==NULL||copy==NULL){
+        free(entry);
+        free(copy);
+        return PARSE_OK;
+    }
+    while(cache->oldest!=NULL&&cache->bytes+bytes>cache->max_bytes){
+        remove_entry(cache,cache->oldest);
+    }
+    if(cache->count>=cache->num_buckets){
+        grow_buckets(cache);
+    }
+    memcpy(copy,line,len+1);
+    entry->hash=hash;
+    entry->line=copy;
+    entry->len=len;
+    entry->tree=*tree;
+    entry->bytes=bytes;
+    // The cache holds its own reference, besides the caller's
+    (*tree)->refs++;
+    uint64_t bucket=hash&(cache->num_buckets-1);
+    entry->next=cache->buckets[bucket];
+    cache->buckets[bucket]=entry;
+    push_lru(cache,entry);
+    cache->bytes+=bytes;
+    cache->count++;
+    return PARSE_OK;
+}
+
+/**
+ * Gives back a tree from acquire_parse_tree, freeing it if nothing else holds it.
+ *
+ * @param tree The tree; NULL is ignored.
+ */
+void release_parse_tree(parse_tree_t *tree){
+    if(tree!=NULL&&--tree->refs==0){
+        free_parse_tree(tree);
+    }
+}
+
+/**
+ * Prints the number of cached lines, the memory they hold and the hit and miss counts.
+ *
+ * @param cache A pointer to the parse cache.
+ */
+void print_parse_cache(parse_cache_t *cache){
+    long long lookups=cache->hits+cache->misses;
+    printf("parse cache: %d lines, %zu of %zu bytes\n",cache->count,cache->bytes,cache->max_bytes);
+    printf("hits: %lld, misses: %lld (%.1f%% hit rate)\n",cache->hits,cache->misses,
+           lookups==0?0.0:100.0*cache->hits/lookups);
+}
+
+/**
+ * Removes every entry from the cache.
+ *
+ * @param cache A pointer to the parse cache to clear.
+ */
+void clear_parse_cache(parse_cache_t *cache){
+    while(cache->oldest!=NULL){
+        remove_entry(cache,cache->oldest);
+    }
+}
+
+/**
+ * Deallocates the cache and releases its trees.
+ *
+ * @param cache A pointer to the parse cache; NULL is ignored.
+ */
+void free_parse_cache(parse_cache_t *cache){
+    if(cache==NULL){
+        return;
+    }
+    clear_parse_cache(cache);
+    free(cache->buckets);
+    free(cache);
+}
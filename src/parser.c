@@ -0,0 +1,1746 @@
+#include "../include/parser.h"
+#include "../include/job.h"
+#include "../include/scan.h"
+#include "../include/variables.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Lines up to this long are classified into a bitmap on the stack
+#define SMALL_LINE 1024
+
+//Nodes are carved out of blocks of at least this size; the first block is smaller, since most
+//lines are short and their trees may be kept in the parse cache
+#define ARENA_FIRST_BLOCK_SIZE 512
+#define ARENA_BLOCK_SIZE 4096
+
+//A block of the arena a parse tree lives in
+struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+//Kinds of tokens
+typedef enum token_type {
+    TOKEN_END,
+    TOKEN_WORD,
+    TOKEN_NEWLINE,
+    TOKEN_SEMI,
+    TOKEN_AMP,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_PIPE,
+    TOKEN_REDIRECT
+} token_type_t;
+
+//A token; a word is in parser->word, and its expansions in parser->expansions, until the next
+//token is read. quoted is set for a word with quotes, backslashes or expansions in it, which is
+//never a reserved word; has_quotes only for quotes and backslashes. plain_len is the length of
+//the text before the first of them.
+typedef struct token {
+    token_type_t type;
+    const char *start;
+    redirect_type_t redirect;
+    int fd;
+    bool quoted;
+    bool has_quotes;
+    size_t plain_len;
+    bool strip_tabs;
+} token_t;
+
+//A here-document whose body is still to be read, after the line its redirection is on
+typedef struct heredoc {
+    redirect_t *redirect;
+    char *delimiter;
+    bool quoted;
+    bool strip_tabs;
+    struct heredoc *next;
+} heredoc_t;
+
+//A word of a command being parsed
+typedef struct word_node {
+    char *text;
+    word_t *expand;
+    struct word_node *next;
+} word_node_t;
+
+//What a line that ends inside a here-document is reported as
+#define HEREDOC_UNTERMINATED "syntax error: here-document not terminated"
+
+//What a syntax error near each kind of token is reported as
+static const char *UNEXPECTED[]={
+    [TOKEN_END]="syntax error: unexpected end of line",
+    [TOKEN_WORD]="syntax error near unexpected word",
+    [TOKEN_NEWLINE]="syntax error near unexpected newline",
+    [TOKEN_SEMI]="syntax error near unexpected `;'",
+    [TOKEN_AMP]="syntax error near unexpected `&'",
+    [TOKEN_AND]="syntax error near unexpected `&&'",
+    [TOKEN_OR]="syntax error near unexpected `||'",
+    [TOKEN_PIPE]="syntax error near unexpected `|'",
+    [TOKEN_REDIRECT]="syntax error near unexpected redirection",
+};
+
+//The reserved words that end a part of a compound command, and the error reported when one starts
+//a command where nothing it could end is open
+static const struct {
+    const char *word;
+    const char *error;
+} CLOSING_WORDS[]={
+    {"then","syntax error near unexpected `then'"},
+    {"elif","syntax error near unexpected `elif'"},
+    {"else","syntax error near unexpected `else'"},
+    {"fi","syntax error near unexpected `fi'"},
+    {"do","syntax error near unexpected `do'"},
+    {"done","syntax error near unexpected `done'"},
+    {"}","syntax error near unexpected `}'"},
+};
+
+//The reserved words each part of a compound command may end at
+static const char *const THEN[]={"then",NULL};
+static const char *const ELSE[]={"elif","else","fi",NULL};
+static const char *const FI[]={"fi",NULL};
+static const char *const DO[]={"do",NULL};
+static const char *const DONE[]={"done",NULL};
+static const char *const CLOSE_BRACE[]={"}",NULL};
+
+static int parse_sequence(parser_t *parser, token_t *token, const char *list_start, const char *const *terminators,
+                          and_or_t **lists, int *num_lists);
+
+/**
+ * Allocates memory from the arena of a parse tree. It is freed with the tree.
+ *
+ * @param tree The parse tree.
+ * @param size The number of bytes needed.
+ * @return The memory, aligned for any node.
+ */
+static void *arena_alloc(parse_tree_t *tree, size_t size){
+    size=(size+sizeof(void*)-1)&~(sizeof(void*)-1);
+    struct arena_block *block=tree->arena;
+    if(block==NULL||block->size-block->used<size){
+        size_t block_size=block==NULL?ARENA_FIRST_BLOCK_SIZE:ARENA_BLOCK_SIZE;
+        if(size>block_size){
+            block_size=size;
+        }
+        block=malloc(sizeof(struct arena_block)+block_size);
+        if(block==NULL){
+            perror("Failed to allocate memory for the parse tree");
+            exit(EXIT_FAILURE);
+        }
+        block->next=tree->arena;
+        block->used=0;
+        block->size=block_size;
+        tree->arena=block;
+    }
+    void *p=block->data+block->used;
+    block->used+=size;
+    return p;
+}
+
+/**
+ * Copies a string of known length into the arena.
+ *
+ * @param tree The parse tree.
+ * @param s The string.
+ * @param len Its length.
+ * @return The NUL-terminated copy.
+ */
+static char *arena_strndup(parse_tree_t *tree, const char *s, size_t len){
+    char *copy=arena_alloc(tree,len+1);
+    memcpy(copy,s,len);
+    copy[len]='\0';
+    return copy;
+}
+
+/**
+ * Appends a character to the word being read.
+ *
+ * @param parser The parser.
+ * @param len The length of the word so far.
+ * @param c The character.
+ */
+static void word_append(parser_t *parser, size_t len, char c){
+    if(len+1>=parser->word_cap){
+        parser->word_cap=parser->word_cap==0?64:parser->word_cap*2;
+        parser->word=realloc(parser->word,parser->word_cap);
+        if(parser->word==NULL){
+            perror("Failed to allocate memory for a word");
+            exit(EXIT_FAILURE);
+        }
+    }
+    parser->word[len]=c;
+    parser->word[len+1]='\0';
+}
+
+/**
+ * Appends a run of characters to the word being read.
+ *
+ * @param parser The parser.
+ * @param len The length of the word so far.
+ * @param s The characters.
+ * @param n The number of characters.
+ */
+static void word_append_run(parser_t *parser, size_t len, const char *s, size_t n){
+    if(len+n+1>parser->word_cap){
+        while(len+n+1>parser->word_cap){
+            parser->word_cap=parser->word_cap==0?64:parser->word_cap*2;
+        }
+        parser->word=realloc(parser->word,parser->word_cap);
+        if(parser->word==NULL){
+            perror("Failed to allocate memory for a word");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(parser->word+len,s,n);
+    parser->word[len+n]='\0';
+}
+
+/**
+ * Finds the next byte a word may end or change quoting at.
+ *
+ * @param parser The parser.
+ * @param p A position in the line.
+ * @return The first special byte at or after p; the end of the line if there is none.
+ */
+static const char *skip_plain(const parser_t *parser, const char *p){
+    return parser->line+next_special(parser->special,parser->len,p-parser->line);
+}
+
+/**
+ * Checks whether a character ends an unquoted word.
+ *
+ * @param c The character.
+ * @return True for blanks, newlines, the end of the line and operator characters.
+ */
+static bool ends_word(char c){
+    return c=='\0'||c==' '||c=='\t'||c=='\n'||c==';'||c=='&'||c=='|'||c=='<'||c=='>';
+}
+
+/**
+ * Notes that the word being read stops being plain text at its current length.
+ *
+ * @param token The word.
+ * @param len The length of its text so far.
+ * @param quote True for a quote or backslash; false for an expansion.
+ */
+static void end_plain(token_t *token, size_t len, bool quote){
+    if(token->plain_len==SIZE_MAX){
+        token->plain_len=len;
+    }
+    token->quoted=true;
+    if(quote){
+        token->has_quotes=true;
+    }
+}
+
+/**
+ * Checks whether a character may start a variable name.
+ *
+ * @param c The character.
+ * @return True for letters and underscore.
+ */
+static bool is_name_start(char c){
+    return c=='_'||(c>='a'&&c<='z')||(c>='A'&&c<='Z');
+}
+
+/**
+ * Checks whether a character may be part of a variable name.
+ *
+ * @param c The character.
+ * @return True for letters, digits and underscore.
+ */
+static bool is_name_char(char c){
+    return is_name_start(c)||(c>='0'&&c<='9');
+}
+
+/**
+ * Finds the special parameter a character names.
+ *
+ * @param c The character after $.
+ * @param type Receives the kind of parameter.
+ * @return True if c names a special parameter.
+ */
+static bool special_param(char c, param_type_t *type){
+    switch(c){
+        case '#': *type=PARAM_COUNT; return true;
+        case '@': *type=PARAM_ALL; return true;
+        case '*': *type=PARAM_ALL_JOINED; return true;
+        case '?': *type=PARAM_STATUS; return true;
+        case '!': *type=PARAM_BACKGROUND_PID; return true;
+        case '$': *type=PARAM_PID; return true;
+        default: return false;
+    }
+}
+
+static int read_text(parser_t *parser, const char **pos, size_t *len, bool in_braces, token_t *token);
+static word_t *word_expand(parser_t *parser, const token_t *token);
+static int parse_text(parse_tree_t *tree, const char *line, size_t len, and_or_t **lists, int *num_lists, const char **error);
+
+/**
+ * Reads the parameter of an expansion: a name, a number (one digit unless
+ * in braces) or a special parameter.
+ *
+ * @param p The first character of the parameter; receives the one after it.
+ * @param expansion Receives the parameter.
+ * @param braced True inside ${...}.
+ * @return False if there is no parameter there.
+ */
+static bool read_param(const char **p, expansion_t *expansion, bool braced){
+    const char *start=*p;
+    if(is_name_start(*start)){
+        const char *end=start+1;
+        while(is_name_char(*end)){
+            end++;
+        }
+        expansion->type=PARAM_VARIABLE;
+        expansion->symbol=intern_symbol(start,end-start);
+        *p=end;
+        return true;
+    }
+    if(*start>='0'&&*start<='9'){
+        const char *end=start+1;
+        int index=*start-'0';
+        while(braced&&*end>='0'&&*end<='9'&&index<100000){
+            index=index*10+(*end++-'0');
+        }
+        expansion->type=PARAM_POSITIONAL;
+        expansion->index=index;
+        *p=end;
+        return true;
+    }
+    if(special_param(*start,&expansion->type)){
+        *p=start+1;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Reads the inside of ${...}, after the opening brace: an optional # for
+ * the length, the parameter, and an operator with its word.
+ *
+ * @param parser The parser.
+ * @param p The character after the brace; receives the one after the closing brace.
+ * @param len The length of the word being read; its text is kept as it is.
+ * @param expansion Receives the expansion.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int read_braced(parser_t *parser, const char **p, size_t *len, expansion_t *expansion){
+    const char *q=*p;
+    if(*q=='#'&&q[1]!='}'){
+        expansion->op='#';
+        q++;
+    }
+    if(!read_param(&q,expansion,true)){
+        parser->error=*q=='\0'?"syntax error: unterminated ${":"syntax error: bad substitution";
+        return *q=='\0'?PARSE_INCOMPLETE:PARSE_ERROR;
+    }
+    if(*q!='}'){
+        if(expansion->op=='#'){
+            parser->error=*q=='\0'?"syntax error: unterminated ${":"syntax error: bad substitution";
+            return *q=='\0'?PARSE_INCOMPLETE:PARSE_ERROR;
+        }
+        if(*q==':'){
+            expansion->colon=true;
+            q++;
+        }
+        if(*q!='-'&&*q!='='&&*q!='+'){
+            parser->error=*q=='\0'?"syntax error: unterminated ${":"syntax error: bad substitution";
+            return *q=='\0'?PARSE_INCOMPLETE:PARSE_ERROR;
+        }
+        if(*q=='='&&expansion->type!=PARAM_VARIABLE){
+            parser->error="syntax error: bad substitution";
+            return PARSE_ERROR;
+        }
+        expansion->op=*q++;
+        // The word is read after the text of the word it is in, then cut off again
+        size_t base=*len;
+        expansion_t *outer=parser->expansions;
+        expansion_t **outer_last=parser->last_expansion;
+        parser->expansions=NULL;
+        parser->last_expansion=&parser->expansions;
+        token_t inner={TOKEN_WORD,q,REDIRECT_IN,-1,false,false,SIZE_MAX,false};
+        int result=read_text(parser,&q,len,true,&inner);
+        if(result!=PARSE_OK){
+            return result;
+        }
+        expansion->word_text=arena_strndup(parser->tree,parser->word+base,*len-base);
+        expansion->word=arena_alloc(parser->tree,sizeof(word_t));
+        expansion->word->expansions=parser->expansions;
+        expansion->word->quoted=inner.has_quotes;
+        expansion->word->assignment=false;
+        for(expansion_t *nested=parser->expansions;nested!=NULL;nested=nested->next){
+            nested->offset-=base;
+        }
+        parser->expansions=outer;
+        parser->last_expansion=outer_last;
+        *len=base;
+        parser->word[base]='\0';
+    }
+    *p=q+1;
+    return PARSE_OK;
+}
+
+/**
+ * Finds the backquote that closes a command substitution.
+ *
+ * @param p The character after the opening backquote.
+ * @return The closing backquote; the end of the line if there is none.
+ */
+static const char *skip_backquoted(const char *p){
+    while(*p!='\0'&&*p!='`'){
+        p+=*p=='\\'&&p[1]!='\0'?2:1;
+    }
+    return p;
+}
+
+static const char *skip_command(const char *p);
+
+/**
+ * Finds the quote that closes "..." inside a command substitution.
+ *
+ * @param p The character after the opening quote.
+ * @return The closing quote; the end of the line if there is none.
+ */
+static const char *skip_double_quoted(const char *p){
+    while(*p!='\0'&&*p!='"'){
+        if(*p=='\\'&&p[1]!='\0'){
+            p+=2;
+            continue;
+        }
+        if(*p=='$'&&p[1]=='('){
+            p=skip_command(p+2);
+        }
+        else if(*p=='`'){
+            p=skip_backquoted(p+1);
+        }
+        if(*p!='\0'){
+            p++;
+        }
+    }
+    return p;
+}
+
+/**
+ * Finds the parenthesis that closes a command substitution, passing over
+ * quotes, nested substitutions, comments and the parentheses that are closed
+ * inside it (as in "NAME()").
+ *
+ * @param p The character after "$(".
+ * @return The closing parenthesis; the end of the line if there is none.
+ */
+static const char *skip_command(const char *p){
+    int depth=0;
+    bool word_start=true;
+    while(*p!='\0'){
+        char c=*p;
+        if(c=='\\'&&p[1]!='\0'){
+            p++;
+        }
+        else if(c=='\''){
+            const char *close=strchr(p+1,'\'');
+            if(close==NULL){
+                return p+strlen(p);
+            }
+            p=close;
+        }
+        else if(c=='"'){
+            p=skip_double_quoted(p+1);
+        }
+        else if(c=='`'){
+            p=skip_backquoted(p+1);
+        }
+        else if(c=='$'&&p[1]=='('){
+            p=skip_command(p+2);
+        }
+        else if(c=='#'&&word_start){
+            p+=strcspn(p,"\n");
+            continue;
+        }
+        else if(c=='('){
+            depth++;
+        }
+        else if(c==')'&&depth--==0){
+            return p;
+        }
+        if(*p=='\0'){
+            return p;
+        }
+        p++;
+        word_start=strchr(" \t\n;&|()",c)!=NULL;
+    }
+    return p;
+}
+
+/**
+ * Parses the list of a command substitution into the tree of the line.
+ *
+ * @param parser The parser.
+ * @param text The list, with the quoting of the substitution removed.
+ * @param len Its length.
+ * @param expansion Receives the lists.
+ * @return PARSE_OK or PARSE_ERROR.
+ */
+static int parse_substitution(parser_t *parser, const char *text, size_t len, expansion_t *expansion){
+    const char *error;
+    int num_lists=0;
+    expansion->type=PARAM_COMMAND;
+    expansion->tree=parser->tree;
+    if(parse_text(parser->tree,text,len,&expansion->lists,&num_lists,&error)!=PARSE_OK){
+        // The substitution is closed, so no line after this one can finish its list
+        parser->error=error;
+        return PARSE_ERROR;
+    }
+    return PARSE_OK;
+}
+
+/**
+ * Reads the list of $(LIST), after the "$(".
+ *
+ * @param parser The parser.
+ * @param p The character after "$("; receives the one after the closing parenthesis.
+ * @param expansion Receives the lists.
+ * @return PARSE_OK, PARSE_ERROR, or PARSE_INCOMPLETE if the parenthesis is not closed.
+ */
+static int read_command(parser_t *parser, const char **p, expansion_t *expansion){
+    const char *close=skip_command(*p);
+    if(*close=='\0'){
+        parser->error="syntax error: unterminated $(";
+        return PARSE_INCOMPLETE;
+    }
+    size_t len=close-*p;
+    char *text=malloc(len+1);
+    if(text==NULL){
+        perror("Failed to allocate memory for a command substitution");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(text,*p,len);
+    text[len]='\0';
+    int result=parse_substitution(parser,text,len,expansion);
+    free(text);
+    *p=close+1;
+    return result;
+}
+
+/**
+ * Records an expansion at the current end of the word being read.
+ *
+ * @param parser The parser.
+ * @param token The word being read.
+ * @param len The length of its text so far.
+ * @param expansion The expansion.
+ */
+static void add_expansion(parser_t *parser, token_t *token, size_t len, const expansion_t *expansion){
+    end_plain(token,len,false);
+    expansion_t *node=arena_alloc(parser->tree,sizeof(expansion_t));
+    *node=*expansion;
+    node->offset=len;
+    *parser->last_expansion=node;
+    parser->last_expansion=&node->next;
+}
+
+/**
+ * Reads `LIST`, a command substitution. A backslash in it only escapes $, `,
+ * itself and, inside "...", a double quote; anywhere else it is kept for the
+ * list.
+ *
+ * @param parser The parser.
+ * @param p The opening backquote; receives the character after the closing one.
+ * @param len The length of the word being read.
+ * @param quoted True inside "...".
+ * @param token The word being read.
+ * @return PARSE_OK, PARSE_ERROR, or PARSE_INCOMPLETE if the backquote is not closed.
+ */
+static int read_backquoted(parser_t *parser, const char **p, size_t len, bool quoted, token_t *token){
+    const char *close=skip_backquoted(*p+1);
+    if(*close=='\0'){
+        parser->pos=close;
+        parser->error="syntax error: unterminated `";
+        return PARSE_INCOMPLETE;
+    }
+    char *text=malloc(close-*p);
+    if(text==NULL){
+        perror("Failed to allocate memory for a command substitution");
+        exit(EXIT_FAILURE);
+    }
+    size_t n=0;
+    for(const char *q=*p+1;q<close;q++){
+        if(*q=='\\'&&(q[1]=='$'||q[1]=='`'||q[1]=='\\'||(quoted&&q[1]=='"'))){
+            q++;
+        }
+        text[n++]=*q;
+    }
+    text[n]='\0';
+    expansion_t expansion;
+    memset(&expansion,0,sizeof(expansion));
+    expansion.quoted=quoted;
+    int result=parse_substitution(parser,text,n,&expansion);
+    free(text);
+    if(result!=PARSE_OK){
+        return result;
+    }
+    add_expansion(parser,token,len,&expansion);
+    *p=close+1;
+    return PARSE_OK;
+}
+
+/**
+ * Reads a $ and what follows it. If it starts an expansion (a parameter or
+ * $(LIST)), the expansion is recorded at the current end of the word;
+ * otherwise, the $ is a plain character.
+ *
+ * @param parser The parser.
+ * @param p The $; receives the character after what was read.
+ * @param len The length of the word being read; updated.
+ * @param quoted True inside "...".
+ * @param token The word being read.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int read_dollar(parser_t *parser, const char **p, size_t *len, bool quoted, token_t *token){
+    const char *q=*p+1;
+    expansion_t expansion;
+    memset(&expansion,0,sizeof(expansion));
+    expansion.quoted=quoted;
+    if(*q=='{'||*q=='('){
+        bool braced=*q++=='{';
+        int result=braced?read_braced(parser,&q,len,&expansion):read_command(parser,&q,&expansion);
+        if(result!=PARSE_OK){
+            return result;
+        }
+    }
+    else if(!read_param(&q,&expansion,false)){
+        word_append(parser,(*len)++,'$');
+        *p=q;
+        return PARSE_OK;
+    }
+    add_expansion(parser,token,*len,&expansion);
+    *p=q;
+    return PARSE_OK;
+}
+
+/**
+ * Reads the text of a word into parser->word, removing its quotes and
+ * backslashes and recording its expansions. Runs of plain characters,
+ * outside and inside quotes, are found with the special byte bitmap and
+ * copied at once.
+ *
+ * @param parser The parser.
+ * @param pos The start of the text; receives its end.
+ * @param len The length of parser->word so far; updated.
+ * @param in_braces True for the word of ${NAME-WORD}, which ends at an unquoted } instead of a blank or an operator.
+ * @param token The word being read; its quoting is noted.
+ * @return PARSE_OK, PARSE_ERROR, or PARSE_INCOMPLETE if a quote or brace is not closed or the line ends with a backslash.
+ */
+static int read_text(parser_t *parser, const char **pos, size_t *len, bool in_braces, token_t *token){
+    const char *p=*pos;
+    int result;
+    while(in_braces?*p!='}':!ends_word(*p)){
+        if(*p=='\''||*p=='"'||*p=='\\'){
+            end_plain(token,*len,true);
+        }
+        if(*p=='\0'){
+            parser->pos=p;
+            parser->error="syntax error: unterminated ${";
+            return PARSE_INCOMPLETE;
+        }
+        else if(*p=='\''){
+            const char *close=strchr(p+1,'\'');
+            if(close==NULL){
+                parser->pos=parser->line+parser->len;
+                parser->error="syntax error: unterminated quote";
+                return PARSE_INCOMPLETE;
+            }
+            word_append_run(parser,*len,p+1,close-p-1);
+            *len+=close-p-1;
+            p=close+1;
+        }
+        else if(*p=='"'){
+            for(p++;*p!='"';){
+                const char *run=skip_plain(parser,p);
+                word_append_run(parser,*len,p,run-p);
+                *len+=run-p;
+                p=run;
+                if(*p=='"'){
+                    break;
+                }
+                if(*p=='\0'){
+                    parser->pos=p;
+                    parser->error="syntax error: unterminated quote";
+                    return PARSE_INCOMPLETE;
+                }
+                if(*p=='$'||*p=='`'){
+                    result=*p=='$'?read_dollar(parser,&p,len,true,token):read_backquoted(parser,&p,*len,true,token);
+                    if(result!=PARSE_OK){
+                        return result;
+                    }
+                    continue;
+                }
+                if(*p=='\\'&&(p[1]=='\\'||p[1]=='"'||p[1]=='$'||p[1]=='`')){
+                    p++;
+                }
+                else if(*p=='\\'&&p[1]=='\n'){
+                    p+=2;
+                    continue;
+                }
+                word_append(parser,(*len)++,*p);
+                p++;
+            }
+            p++;
+        }
+        else if(*p=='\\'){
+            if(p[1]=='\0'){
+                parser->pos=p+1;
+                parser->error=UNEXPECTED[TOKEN_END];
+                return PARSE_INCOMPLETE;
+            }
+            // A backslash before a newline joins the lines
+            if(p[1]!='\n'){
+                word_append(parser,(*len)++,p[1]);
+            }
+            p+=2;
+        }
+        else if(*p=='$'){
+            if((result=read_dollar(parser,&p,len,false,token))!=PARSE_OK){
+                return result;
+            }
+        }
+        else if(*p=='`'){
+            if((result=read_backquoted(parser,&p,*len,false,token))!=PARSE_OK){
+                return result;
+            }
+        }
+        else{
+            // A plain character, and every one after it up to the next special byte (in braces,
+            // blanks and operators are plain too, and the word ends at a brace instead)
+            const char *run=in_braces?p+1+strcspn(p+1,"}'\"\\$`"):skip_plain(parser,p+1);
+            word_append_run(parser,*len,p,run-p);
+            *len+=run-p;
+            p=run;
+        }
+    }
+    *pos=p;
+    return PARSE_OK;
+}
+
+/**
+ * Reads a word into parser->word, and its expansions into parser->expansions.
+ *
+ * @param parser The parser, positioned at the start of the word.
+ * @param token The word; receives its quoting.
+ * @return PARSE_OK, PARSE_ERROR, or PARSE_INCOMPLETE if a quote is not closed or the line ends with a backslash.
+ */
+static int read_word(parser_t *parser, token_t *token){
+    size_t len=0;
+    word_append(parser,0,'\0');
+    parser->word[0]='\0';
+    parser->expansions=NULL;
+    parser->last_expansion=&parser->expansions;
+    const char *p=parser->pos;
+    int result=read_text(parser,&p,&len,false,token);
+    if(result!=PARSE_OK){
+        return result;
+    }
+    if(token->plain_len==SIZE_MAX){
+        token->plain_len=len;
+    }
+    parser->pos=p;
+    return PARSE_OK;
+}
+
+/**
+ * Reads the body of a here-document, from the start of the line after its
+ * redirection up to the line that is its delimiter. Unless the delimiter was
+ * quoted, the body is read like the inside of "...", except that quotes are
+ * plain: $ and ` start expansions and a backslash escapes $, ` and itself.
+ *
+ * @param parser The parser.
+ * @param pos The start of the body; receives the start of the line after the delimiter.
+ * @param heredoc The here-document; its redirection gets the body.
+ * @return PARSE_OK, PARSE_ERROR, or PARSE_INCOMPLETE if the line ends before the delimiter.
+ */
+static int read_heredoc(parser_t *parser, const char **pos, heredoc_t *heredoc){
+    const char *p=*pos;
+    size_t delimiter_len=strlen(heredoc->delimiter);
+    size_t len=0;
+    word_append(parser,0,'\0');
+    parser->expansions=NULL;
+    parser->last_expansion=&parser->expansions;
+    token_t body={TOKEN_WORD,p,REDIRECT_IN,-1,false,false,SIZE_MAX,false};
+    while(true){
+        if(heredoc->strip_tabs){
+            p+=strspn(p,"\t");
+        }
+        size_t line_len=strcspn(p,"\n");
+        if(line_len==delimiter_len&&memcmp(p,heredoc->delimiter,line_len)==0){
+            p+=line_len;
+            break;
+        }
+        if(*p=='\0'){
+            parser->pos=p;
+            parser->error=HEREDOC_UNTERMINATED;
+            return PARSE_INCOMPLETE;
+        }
+        if(heredoc->quoted){
+            word_append_run(parser,len,p,line_len);
+            len+=line_len;
+            p+=line_len;
+        }
+        while(*p!='\n'&&*p!='\0'){
+            if(*p=='$'||*p=='`'){
+                int result=*p=='$'?read_dollar(parser,&p,&len,true,&body):read_backquoted(parser,&p,len,true,&body);
+                if(result!=PARSE_OK){
+                    return result;
+                }
+            }
+            else if(*p=='\\'&&(p[1]=='$'||p[1]=='`'||p[1]=='\\')){
+                word_append(parser,len++,p[1]);
+                p+=2;
+            }
+            else if(*p=='\\'&&p[1]=='\n'){
+                // The line goes on on the next one, which is never the delimiter
+                p+=2;
+            }
+            else{
+                // Newlines are special bytes too, so a run never crosses a line
+                const char *run=skip_plain(parser,p+1);
+                word_append_run(parser,len,p,run-p);
+                len+=run-p;
+                p=run;
+            }
+        }
+        if(*p=='\n'){
+            word_append(parser,len++,'\n');
+            p++;
+        }
+    }
+    if(*p=='\n'){
+        p++;
+    }
+    redirect_t *redirect=heredoc->redirect;
+    redirect->target=arena_strndup(parser->tree,parser->word,len);
+    redirect->expand=heredoc->quoted?NULL:word_expand(parser,&body);
+    *pos=p;
+    return PARSE_OK;
+}
+
+/**
+ * Reads the bodies of the here-documents started on the line that just ended, one after the other.
+ *
+ * @param parser The parser.
+ * @param pos The start of the first body; receives the end of the last.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int read_heredocs(parser_t *parser, const char **pos){
+    while(parser->heredocs!=NULL){
+        int result=read_heredoc(parser,pos,parser->heredocs);
+        if(result!=PARSE_OK){
+            return result;
+        }
+        parser->heredocs=parser->heredocs->next;
+    }
+    parser->last_heredoc=&parser->heredocs;
+    return PARSE_OK;
+}
+
+/**
+ * Reads the next token, skipping blanks, comments and escaped newlines.
+ *
+ * @param parser The parser.
+ * @param token Receives the token.
+ * @return PARSE_OK; PARSE_INCOMPLETE if a word is not complete.
+ */
+static int next_token(parser_t *parser, token_t *token){
+    const char *p=parser->pos;
+    while(true){
+        if(*p==' '||*p=='\t'){
+            p++;
+        }
+        else if(*p=='\\'&&p[1]=='\n'){
+            p+=2;
+        }
+        else if(*p=='#'){
+            while(*p!='\0'&&*p!='\n'){
+                p++;
+            }
+        }
+        else{
+            break;
+        }
+    }
+    token->start=p;
+    token->fd=-1;
+    token->quoted=false;
+    token->has_quotes=false;
+    token->plain_len=SIZE_MAX;
+    token->strip_tabs=false;
+    // A descriptor number is part of the redirection it is written against
+    const char *digits=p;
+    while(*digits>='0'&&*digits<='9'){
+        digits++;
+    }
+    if(digits>p&&digits-p<=9&&(*digits=='<'||*digits=='>')){
+        token->fd=atoi(p);
+        p=digits;
+    }
+    switch(*p){
+        case '\0':
+            token->type=TOKEN_END;
+            if(parser->heredocs!=NULL){
+                parser->pos=p;
+                parser->error=HEREDOC_UNTERMINATED;
+                return PARSE_INCOMPLETE;
+            }
+            break;
+        case '\n':
+            token->type=TOKEN_NEWLINE;
+            p++;
+            if(parser->heredocs!=NULL){
+                int result=read_heredocs(parser,&p);
+                if(result!=PARSE_OK){
+                    return result;
+                }
+            }
+            break;
+        case ';':
+            token->type=TOKEN_SEMI;
+            p++;
+            break;
+        case '&':
+            token->type=p[1]=='&'?TOKEN_AND:TOKEN_AMP;
+            p+=token->type==TOKEN_AND?2:1;
+            break;
+        case '|':
+            token->type=p[1]=='|'?TOKEN_OR:TOKEN_PIPE;
+            p+=token->type==TOKEN_OR?2:1;
+            break;
+        case '<':
+        case '>':
+            token->type=TOKEN_REDIRECT;
+            if(*p=='>'&&p[1]=='>'){
+                token->redirect=REDIRECT_APPEND;
+                p+=2;
+            }
+            else if(*p=='<'&&p[1]=='<'&&p[2]=='<'){
+                token->redirect=REDIRECT_HERE_STRING;
+                p+=3;
+            }
+            else if(*p=='<'&&p[1]=='<'){
+                token->redirect=REDIRECT_HERE_DOC;
+                token->strip_tabs=p[2]=='-';
+                p+=token->strip_tabs?3:2;
+            }
+            else if(p[1]=='&'){
+                token->redirect=*p=='<'?REDIRECT_DUP_IN:REDIRECT_DUP_OUT;
+                p+=2;
+            }
+            else{
+                token->redirect=*p=='<'?REDIRECT_IN:REDIRECT_OUT;
+                p++;
+            }
+            if(token->fd==-1){
+                token->fd=token->redirect==REDIRECT_OUT||token->redirect==REDIRECT_APPEND||
+                          token->redirect==REDIRECT_DUP_OUT?1:0;
+            }
+            break;
+        default:
+            token->type=TOKEN_WORD;
+            parser->pos=p;
+            return read_word(parser,token);
+    }
+    parser->pos=p;
+    return PARSE_OK;
+}
+
+/**
+ * Reports a syntax error at a token.
+ *
+ * @param parser The parser.
+ * @param token The unexpected token.
+ * @return PARSE_INCOMPLETE if the line just ended too early; otherwise, PARSE_ERROR.
+ */
+static int unexpected(parser_t *parser, const token_t *token){
+    parser->error=UNEXPECTED[token->type];
+    return token->type==TOKEN_END?PARSE_INCOMPLETE:PARSE_ERROR;
+}
+
+/**
+ * Reads the token after an operator that must be followed by a command, which may be on the next line.
+ *
+ * @param parser The parser.
+ * @param token Receives the token.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int token_after_operator(parser_t *parser, token_t *token){
+    int result;
+    while((result=next_token(parser,token))==PARSE_OK&&token->type==TOKEN_NEWLINE){
+    }
+    return result;
+}
+
+static int parse_command(parser_t *parser, token_t *token, command_t **command);
+
+/**
+ * Checks whether a token is a given reserved word.
+ *
+ * @param parser The parser.
+ * @param token The token.
+ * @param word The reserved word.
+ * @return True if the token is the word, unquoted.
+ */
+static bool is_word(const parser_t *parser, const token_t *token, const char *word){
+    return token->type==TOKEN_WORD&&!token->quoted&&strcmp(parser->word,word)==0;
+}
+
+/**
+ * Checks whether a token is one of the reserved words a part of a compound command ends at.
+ *
+ * @param parser The parser.
+ * @param token The token.
+ * @param terminators The reserved words, NULL-terminated.
+ * @return True if the token is one of them.
+ */
+static bool is_terminator(const parser_t *parser, const token_t *token, const char *const *terminators){
+    for(int i=0;terminators[i]!=NULL;i++){
+        if(is_word(parser,token,terminators[i])){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Finds the error for a reserved word that ends a part of a compound command.
+ *
+ * @param word The word.
+ * @return The error reported when it starts a command; NULL if it is not such a word.
+ */
+static const char *closing_word_error(const char *word){
+    for(size_t i=0;i<sizeof(CLOSING_WORDS)/sizeof(CLOSING_WORDS[0]);i++){
+        if(strcmp(word,CLOSING_WORDS[i].word)==0){
+            return CLOSING_WORDS[i].error;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds the kind of command an unquoted word starts.
+ *
+ * @param word The first word of the command.
+ * @return The compound command it opens; COMMAND_FUNCTION for "NAME()"; otherwise, COMMAND_SIMPLE.
+ */
+static command_type_t command_type(const char *word){
+    size_t len=strlen(word);
+    if(strcmp(word,"if")==0){
+        return COMMAND_IF;
+    }
+    if(strcmp(word,"while")==0){
+        return COMMAND_WHILE;
+    }
+    if(strcmp(word,"until")==0){
+        return COMMAND_UNTIL;
+    }
+    if(strcmp(word,"for")==0){
+        return COMMAND_FOR;
+    }
+    if(strcmp(word,"{")==0){
+        return COMMAND_GROUP;
+    }
+    if(len>2&&strcmp(word+len-2,"()")==0){
+        return COMMAND_FUNCTION;
+    }
+    return COMMAND_SIMPLE;
+}
+
+/**
+ * Keeps what the word just read needs at run time.
+ *
+ * @param parser The parser.
+ * @param token The word.
+ * @return Its expansions, in the arena; NULL if it has none.
+ */
+static word_t *word_expand(parser_t *parser, const token_t *token){
+    if(parser->expansions==NULL){
+        return NULL;
+    }
+    word_t *word=arena_alloc(parser->tree,sizeof(word_t));
+    word->expansions=parser->expansions;
+    word->quoted=token->has_quotes;
+    word->assignment=false;
+    return word;
+}
+
+/**
+ * Checks whether the word just read is an assignment: an unquoted name and
+ * '=' at its start.
+ *
+ * @param parser The parser.
+ * @param token The word.
+ * @return The length of the name; 0 if it is not an assignment.
+ */
+static size_t assignment_name(const parser_t *parser, const token_t *token){
+    const char *equals=memchr(parser->word,'=',token->plain_len);
+    if(equals==NULL||!is_variable_name(parser->word,equals-parser->word)){
+        return 0;
+    }
+    return equals-parser->word;
+}
+
+/**
+ * Allocates a command with no words.
+ *
+ * @param tree The parse tree.
+ * @param type The kind of command; a compound command gets its (empty) parts.
+ * @return The command.
+ */
+static command_t *new_command(parse_tree_t *tree, command_type_t type){
+    command_t *node=arena_alloc(tree,sizeof(command_t));
+    node->type=type;
+    node->assignments=NULL;
+    node->argc=0;
+    node->argv=NULL;
+    node->expand=NULL;
+    node->redirects=NULL;
+    node->compound=NULL;
+    node->builtin=NULL;
+    node->next=NULL;
+    if(type!=COMMAND_SIMPLE){
+        node->argv=arena_alloc(tree,sizeof(char*));
+        node->argv[0]=NULL;
+        node->compound=arena_alloc(tree,sizeof(compound_t));
+        memset(node->compound,0,sizeof(compound_t));
+        node->compound->num_words=-1;
+    }
+    return node;
+}
+
+/**
+ * Makes an and-or list of a single command, for the parts of compound commands that hold one.
+ *
+ * @param tree The parse tree.
+ * @param command The command.
+ * @param start The start of the command as typed.
+ * @param end The end of the command as typed.
+ * @return The list.
+ */
+static and_or_t *wrap_command(parse_tree_t *tree, command_t *command, const char *start, const char *end){
+    pipeline_t *pipeline=arena_alloc(tree,sizeof(pipeline_t));
+    pipeline->num_commands=1;
+    pipeline->commands=command;
+    pipeline->connector=CONNECT_NONE;
+    pipeline->next=NULL;
+    and_or_t *list=arena_alloc(tree,sizeof(and_or_t));
+    list->num_pipelines=1;
+    list->pipelines=pipeline;
+    list->job_type=FOREGROUND;
+    while(end>start&&(end[-1]==' '||end[-1]=='\t'||end[-1]=='\n')){
+        end--;
+    }
+    list->text=arena_strndup(tree,start,end-start);
+    list->program=NULL;
+    list->next=NULL;
+    return list;
+}
+
+/**
+ * Parses a redirection: its operator, which is the current token, and the word after it.
+ *
+ * @param parser The parser.
+ * @param token The operator; receives the word naming the target.
+ * @param last The link the redirection is stored at; receives the link for the next one.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_redirect(parser_t *parser, token_t *token, redirect_t ***last){
+    parse_tree_t *tree=parser->tree;
+    redirect_t *redirect=arena_alloc(tree,sizeof(redirect_t));
+    redirect->type=token->redirect;
+    redirect->fd=token->fd;
+    redirect->next=NULL;
+    bool strip_tabs=token->strip_tabs;
+    int result;
+    if((result=next_token(parser,token))!=PARSE_OK){
+        return result;
+    }
+    if(token->type==TOKEN_END){
+        // Unlike after && or |, a missing file name is not continued on the next line
+        parser->error=UNEXPECTED[TOKEN_NEWLINE];
+        return PARSE_ERROR;
+    }
+    if(token->type!=TOKEN_WORD){
+        return unexpected(parser,token);
+    }
+    if(redirect->type==REDIRECT_HERE_DOC){
+        // The body is read once the line ends; the delimiter is the word with its quotes removed
+        heredoc_t *heredoc=arena_alloc(tree,sizeof(heredoc_t));
+        heredoc->redirect=redirect;
+        heredoc->delimiter=arena_strndup(tree,parser->word,strlen(parser->word));
+        heredoc->quoted=token->has_quotes;
+        heredoc->strip_tabs=strip_tabs;
+        heredoc->next=NULL;
+        *parser->last_heredoc=heredoc;
+        parser->last_heredoc=&heredoc->next;
+        redirect->target=NULL;
+        redirect->expand=NULL;
+    }
+    else{
+        redirect->target=arena_strndup(tree,parser->word,strlen(parser->word));
+        redirect->expand=word_expand(parser,token);
+    }
+    **last=redirect;
+    *last=&redirect->next;
+    return PARSE_OK;
+}
+
+/**
+ * Parses one part of a compound command: the lists after the reserved word
+ * that opens it, up to one of the words that may end it.
+ *
+ * @param parser The parser.
+ * @param token The reserved word that opens the part; receives the word that ends it.
+ * @param terminators The reserved words the part may end at.
+ * @param lists Receives the lists.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_part(parser_t *parser, token_t *token, const char *const *terminators, and_or_t **lists){
+    int result;
+    if((result=next_token(parser,token))!=PARSE_OK){
+        return result;
+    }
+    int num_lists=0;
+    if((result=parse_sequence(parser,token,token->start,terminators,lists,&num_lists))!=PARSE_OK){
+        return result;
+    }
+    if(num_lists==0){
+        parser->error=closing_word_error(parser->word);
+        return PARSE_ERROR;
+    }
+    return PARSE_OK;
+}
+
+/**
+ * Parses the rest of an if command, from its if (or elif) to its fi.
+ *
+ * @param parser The parser.
+ * @param token The word "if" or "elif"; receives the token after the fi.
+ * @param node The command.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_if(parser_t *parser, token_t *token, command_t *node){
+    compound_t *compound=node->compound;
+    int result;
+    if((result=parse_part(parser,token,THEN,&compound->condition))!=PARSE_OK||
+       (result=parse_part(parser,token,ELSE,&compound->body))!=PARSE_OK){
+        return result;
+    }
+    if(is_word(parser,token,"elif")){
+        // An elif is an if nested in the else part, and ends at the same fi
+        const char *start=token->start;
+        command_t *nested=new_command(parser->tree,COMMAND_IF);
+        if((result=parse_if(parser,token,nested))!=PARSE_OK){
+            return result;
+        }
+        compound->else_body=wrap_command(parser->tree,nested,start,token->start);
+        return PARSE_OK;
+    }
+    if(is_word(parser,token,"else")&&(result=parse_part(parser,token,FI,&compound->else_body))!=PARSE_OK){
+        return result;
+    }
+    return next_token(parser,token);
+}
+
+/**
+ * Parses the rest of a for command, from its variable to its done.
+ *
+ * @param parser The parser.
+ * @param token The word "for"; receives the token after the done.
+ * @param node The command.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_for(parser_t *parser, token_t *token, command_t *node){
+    parse_tree_t *tree=parser->tree;
+    compound_t *compound=node->compound;
+    int result;
+    if((result=next_token(parser,token))!=PARSE_OK){
+        return result;
+    }
+    if(token->type!=TOKEN_WORD){
+        return unexpected(parser,token);
+    }
+    if(token->quoted||!is_variable_name(parser->word,strlen(parser->word))){
+        parser->error="syntax error: bad for loop variable";
+        return PARSE_ERROR;
+    }
+    compound->name=arena_strndup(tree,parser->word,strlen(parser->word));
+    compound->symbol=intern_symbol(parser->word,strlen(parser->word));
+    if((result=next_token(parser,token))!=PARSE_OK){
+        return result;
+    }
+    if(is_word(parser,token,"in")){
+        word_node_t *words=NULL;
+        bool expands=false;
+        compound->num_words=0;
+        while((result=next_token(parser,token))==PARSE_OK&&token->type==TOKEN_WORD){
+            word_node_t *word=arena_alloc(tree,sizeof(word_node_t));
+            word->text=arena_strndup(tree,parser->word,strlen(parser->word));
+            word->expand=word_expand(parser,token);
+            expands|=word->expand!=NULL;
+            word->next=words;
+            words=word;
+            compound->num_words++;
+        }
+        if(result!=PARSE_OK){
+            return result;
+        }
+        if(token->type!=TOKEN_SEMI&&token->type!=TOKEN_NEWLINE){
+            return unexpected(parser,token);
+        }
+        compound->words=arena_alloc(tree,sizeof(char*)*(compound->num_words+1));
+        compound->words[compound->num_words]=NULL;
+        compound->expand=expands?arena_alloc(tree,sizeof(word_t*)*compound->num_words):NULL;
+        for(int i=compound->num_words-1;i>=0;i--){
+            compound->words[i]=words->text;
+            if(expands){
+                compound->expand[i]=words->expand;
+            }
+            words=words->next;
+        }
+    }
+    else if(token->type!=TOKEN_SEMI&&token->type!=TOKEN_NEWLINE&&!is_word(parser,token,"do")){
+        return unexpected(parser,token);
+    }
+    while(!is_word(parser,token,"do")){
+        if(token->type!=TOKEN_SEMI&&token->type!=TOKEN_NEWLINE){
+            return unexpected(parser,token);
+        }
+        if((result=next_token(parser,token))!=PARSE_OK){
+            return result;
+        }
+        // Only newlines may follow the separator
+        if(token->type==TOKEN_SEMI){
+            return unexpected(parser,token);
+        }
+    }
+    if((result=parse_part(parser,token,DONE,&compound->body))!=PARSE_OK){
+        return result;
+    }
+    return next_token(parser,token);
+}
+
+/**
+ * Parses a function definition: its name, then the compound command it runs.
+ *
+ * @param parser The parser.
+ * @param token The word "NAME()", or the word "()" after the name; receives the token after the body.
+ * @param name The name, when it was a word of its own; NULL to take it from "NAME()".
+ * @param command Receives the command.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_function(parser_t *parser, token_t *token, const char *name, command_t **command){
+    parse_tree_t *tree=parser->tree;
+    command_t *node=new_command(tree,COMMAND_FUNCTION);
+    size_t len=name!=NULL?strlen(name):strlen(parser->word)-2;
+    node->compound->name=arena_strndup(tree,name!=NULL?name:parser->word,len);
+    int result;
+    if((result=token_after_operator(parser,token))!=PARSE_OK){
+        return result;
+    }
+    if(token->type==TOKEN_END){
+        return unexpected(parser,token);
+    }
+    command_type_t type=token->type==TOKEN_WORD&&!token->quoted?command_type(parser->word):COMMAND_SIMPLE;
+    if(type==COMMAND_SIMPLE||type==COMMAND_FUNCTION){
+        parser->error="syntax error: a function body must be a compound command";
+        return PARSE_ERROR;
+    }
+    const char *start=token->start;
+    command_t *body;
+    if((result=parse_command(parser,token,&body))!=PARSE_OK){
+        return result;
+    }
+    node->compound->body=wrap_command(tree,body,start,token->start);
+    *command=node;
+    return PARSE_OK;
+}
+
+/**
+ * Parses a compound command, and the redirections after it.
+ *
+ * @param parser The parser.
+ * @param token The reserved word that opens the command; receives the token after it.
+ * @param type The kind of command.
+ * @param command Receives the command.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_compound(parser_t *parser, token_t *token, command_type_t type, command_t **command){
+    command_t *node=new_command(parser->tree,type);
+    compound_t *compound=node->compound;
+    int result;
+    switch(type){
+        case COMMAND_IF:
+            result=parse_if(parser,token,node);
+            break;
+        case COMMAND_WHILE:
+        case COMMAND_UNTIL:
+            if((result=parse_part(parser,token,DO,&compound->condition))==PARSE_OK&&
+               (result=parse_part(parser,token,DONE,&compound->body))==PARSE_OK){
+                result=next_token(parser,token);
+            }
+            break;
+        case COMMAND_FOR:
+            result=parse_for(parser,token,node);
+            break;
+        default:
+            if((result=parse_part(parser,token,CLOSE_BRACE,&compound->body))==PARSE_OK){
+                result=next_token(parser,token);
+            }
+            break;
+    }
+    redirect_t **last_redirect=&node->redirects;
+    while(result==PARSE_OK&&token->type==TOKEN_REDIRECT){
+        if((result=parse_redirect(parser,token,&last_redirect))==PARSE_OK){
+            result=next_token(parser,token);
+        }
+    }
+    if(result!=PARSE_OK){
+        return result;
+    }
+    if(token->type==TOKEN_WORD){
+        return unexpected(parser,token);
+    }
+    *command=node;
+    return PARSE_OK;
+}
+
+/**
+ * Parses a command: a compound command or function definition if it starts
+ * with a reserved word or "NAME()"; otherwise, a simple command, with words
+ * and redirections up to the next operator.
+ *
+ * @param parser The parser.
+ * @param token The first token of the command; receives the token after it.
+ * @param command Receives the command.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_command(parser_t *parser, token_t *token, command_t **command){
+    parse_tree_t *tree=parser->tree;
+    if(token->type==TOKEN_WORD&&!token->quoted){
+        const char *error=closing_word_error(parser->word);
+        if(error!=NULL){
+            parser->error=error;
+            return PARSE_ERROR;
+        }
+        command_type_t type=command_type(parser->word);
+        if(type==COMMAND_FUNCTION){
+            return parse_function(parser,token,NULL,command);
+        }
+        if(type!=COMMAND_SIMPLE){
+            return parse_compound(parser,token,type,command);
+        }
+    }
+    command_t *node=new_command(tree,COMMAND_SIMPLE);
+    // Words are linked in reverse, then laid out as argv once the command ends
+    word_node_t *words=NULL;
+    bool expands=false;
+    bool is_export=false;
+    assignment_t **last_assignment=&node->assignments;
+    redirect_t **last_redirect=&node->redirects;
+    int result;
+    while(token->type==TOKEN_WORD||token->type==TOKEN_REDIRECT){
+        size_t name_len;
+        if(token->type==TOKEN_WORD&&node->argc==0&&(name_len=assignment_name(parser,token))>0){
+            assignment_t *assignment=arena_alloc(tree,sizeof(assignment_t));
+            assignment->symbol=intern_symbol(parser->word,name_len);
+            assignment->value=arena_strndup(tree,parser->word+name_len+1,strlen(parser->word)-name_len-1);
+            assignment->expand=word_expand(parser,token);
+            for(expansion_t *expansion=parser->expansions;expansion!=NULL;expansion=expansion->next){
+                expansion->offset-=name_len+1;
+            }
+            assignment->next=NULL;
+            *last_assignment=assignment;
+            last_assignment=&assignment->next;
+        }
+        else if(token->type==TOKEN_WORD){
+            // "NAME ()" defines a function too
+            if(node->argc==1&&node->redirects==NULL&&node->assignments==NULL&&is_word(parser,token,"()")){
+                return parse_function(parser,token,words->text,command);
+            }
+            word_node_t *word=arena_alloc(tree,sizeof(word_node_t));
+            word->text=arena_strndup(tree,parser->word,strlen(parser->word));
+            word->expand=word_expand(parser,token);
+            // The NAME=VALUE arguments of export are assignments too, and are not split
+            if(word->expand!=NULL&&is_export&&assignment_name(parser,token)>0){
+                word->expand->assignment=true;
+            }
+            if(node->argc==0){
+                is_export=!token->quoted&&strcmp(parser->word,"export")==0;
+            }
+            expands|=word->expand!=NULL;
+            word->next=words;
+            words=word;
+            node->argc++;
+        }
+        else if((result=parse_redirect(parser,token,&last_redirect))!=PARSE_OK){
+            return result;
+        }
+        if((result=next_token(parser,token))!=PARSE_OK){
+            return result;
+        }
+    }
+    if(node->argc==0&&node->redirects==NULL&&node->assignments==NULL){
+        return unexpected(parser,token);
+    }
+    node->argv=arena_alloc(tree,sizeof(char*)*(node->argc+1));
+    node->argv[node->argc]=NULL;
+    node->expand=expands?arena_alloc(tree,sizeof(word_t*)*node->argc):NULL;
+    for(int i=node->argc-1;i>=0;i--){
+        node->argv[i]=words->text;
+        if(expands){
+            node->expand[i]=words->expand;
+        }
+        words=words->next;
+    }
+    *command=node;
+    return PARSE_OK;
+}
+
+/**
+ * Parses commands connected by pipes.
+ *
+ * @param parser The parser.
+ * @param token The first token of the pipeline; receives the token after it.
+ * @param pipeline Receives the pipeline.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_pipeline(parser_t *parser, token_t *token, pipeline_t **pipeline){
+    pipeline_t *node=arena_alloc(parser->tree,sizeof(pipeline_t));
+    node->num_commands=0;
+    node->commands=NULL;
+    node->connector=CONNECT_NONE;
+    node->next=NULL;
+    command_t **last=&node->commands;
+    int result;
+    while(true){
+        if((result=parse_command(parser,token,last))!=PARSE_OK){
+            return result;
+        }
+        last=&(*last)->next;
+        node->num_commands++;
+        if(token->type!=TOKEN_PIPE){
+            break;
+        }
+        if((result=token_after_operator(parser,token))!=PARSE_OK){
+            return result;
+        }
+    }
+    *pipeline=node;
+    return PARSE_OK;
+}
+
+/**
+ * Parses pipelines joined by && and ||.
+ *
+ * @param parser The parser.
+ * @param token The first token of the list; receives the token after it.
+ * @param list Receives the list.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_and_or(parser_t *parser, token_t *token, and_or_t **list){
+    and_or_t *node=arena_alloc(parser->tree,sizeof(and_or_t));
+    node->num_pipelines=0;
+    node->pipelines=NULL;
+    node->job_type=FOREGROUND;
+    node->text=NULL;
+    node->program=NULL;
+    node->next=NULL;
+    pipeline_t **last=&node->pipelines;
+    connector_t connector=CONNECT_NONE;
+    int result;
+    while(true){
+        if((result=parse_pipeline(parser,token,last))!=PARSE_OK){
+            return result;
+        }
+        (*last)->connector=connector;
+        last=&(*last)->next;
+        node->num_pipelines++;
+        if(token->type!=TOKEN_AND&&token->type!=TOKEN_OR){
+            break;
+        }
+        connector=token->type==TOKEN_AND?CONNECT_AND:CONNECT_OR;
+        if((result=token_after_operator(parser,token))!=PARSE_OK){
+            return result;
+        }
+    }
+    *list=node;
+    return PARSE_OK;
+}
+
+/**
+ * Parses and-or lists up to the end of the line or, inside a compound
+ * command, up to a reserved word that may end the part being parsed.
+ *
+ * @param parser The parser.
+ * @param token The first token; receives the token the lists end at.
+ * @param list_start Where the text of the first list starts.
+ * @param terminators The reserved words the lists may end at, NULL-terminated; NULL at the top level.
+ * @param lists Receives the lists.
+ * @param num_lists Receives the number of lists.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE (also if the line ends before a terminator).
+ */
+static int parse_sequence(parser_t *parser, token_t *token, const char *list_start, const char *const *terminators,
+                          and_or_t **lists, int *num_lists){
+    parse_tree_t *tree=parser->tree;
+    and_or_t **last=lists;
+    int result;
+    while(token->type!=TOKEN_END){
+        if(terminators!=NULL&&is_terminator(parser,token,terminators)){
+            return PARSE_OK;
+        }
+        // Separators with no command before them are skipped
+        if(token->type==TOKEN_SEMI||token->type==TOKEN_AMP||token->type==TOKEN_NEWLINE){
+            list_start=parser->pos;
+            if((result=next_token(parser,token))!=PARSE_OK){
+                return result;
+            }
+            continue;
+        }
+        and_or_t *list;
+        if((result=parse_and_or(parser,token,&list))!=PARSE_OK){
+            return result;
+        }
+        if(token->type!=TOKEN_END&&token->type!=TOKEN_SEMI&&token->type!=TOKEN_AMP&&token->type!=TOKEN_NEWLINE){
+            return unexpected(parser,token);
+        }
+        list->job_type=token->type==TOKEN_AMP?BACKGROUND:FOREGROUND;
+        // A trailing comment is part of the list as typed; the terminator is not
+        const char *list_end=token->type==TOKEN_END?parser->line+parser->len:token->start;
+        list->text=arena_strndup(tree,list_start,list_end-list_start);
+        *last=list;
+        last=&list->next;
+        (*num_lists)++;
+        list_start=parser->pos;
+        if(token->type!=TOKEN_END&&(result=next_token(parser,token))!=PARSE_OK){
+            return result;
+        }
+    }
+    // The line ended inside a compound command
+    if(terminators!=NULL){
+        return unexpected(parser,token);
+    }
+    return PARSE_OK;
+}
+
+/**
+ * Parses text into and-or lists: a whole line, or the list of a command
+ * substitution in it, with a parser of its own.
+ *
+ * @param tree The tree the nodes are allocated in.
+ * @param line The text; it is not modified.
+ * @param len Its length.
+ * @param lists Receives the lists.
+ * @param num_lists Receives the number of lists.
+ * @param error Receives a description of a syntax error.
+ * @return PARSE_OK, PARSE_ERROR or PARSE_INCOMPLETE.
+ */
+static int parse_text(parse_tree_t *tree, const char *line, size_t len, and_or_t **lists, int *num_lists, const char **error){
+    uint64_t small[SMALL_LINE/64];
+    uint64_t *special=len<=SMALL_LINE?small:malloc((len+63)/64*sizeof(uint64_t));
+    if(special==NULL){
+        perror("Failed to allocate memory for the line bitmap");
+        exit(EXIT_FAILURE);
+    }
+    classify_line(line,len,special);
+    parser_t parser={line,len,special,line,tree,NULL,0,NULL,NULL,NULL,NULL,NULL};
+    parser.last_heredoc=&parser.heredocs;
+    token_t token;
+    int result=next_token(&parser,&token);
+    if(result==PARSE_OK){
+        result=parse_sequence(&parser,&token,line,NULL,lists,num_lists);
+    }
+    free(parser.word);
+    if(special!=small){
+        free(special);
+    }
+    *error=parser.error;
+    return result;
+}
+
+/**
+ * Parses a command line into a tree of and-or lists, pipelines and commands.
+ * The parser keeps all of its state in a context on the stack, so a command
+ * run from one parsed line can parse another line.
+ *
+ * @param line The command line; it is not modified.
+ * @param tree Receives the parse tree; NULL unless PARSE_OK is returned.
+ * @param error Receives a description of a syntax error; may be NULL.
+ * @return PARSE_OK, PARSE_ERROR, or PARSE_INCOMPLETE if the line ends too early.
+ */
+int parse_line(const char *line, parse_tree_t **tree, const char **error){
+    *tree=NULL;
+    if(error!=NULL){
+        *error=NULL;
+    }
+    parse_tree_t *node=malloc(sizeof(parse_tree_t));
+    if(node==NULL){
+        perror("Failed to allocate memory for the parse tree");
+        exit(EXIT_FAILURE);
+    }
+    node->num_lists=0;
+    node->lists=NULL;
+    node->arena=NULL;
+    node->refs=1;
+    const char *parse_error;
+    int result=parse_text(node,line,strlen(line),&node->lists,&node->num_lists,&parse_error);
+    if(result!=PARSE_OK){
+        if(error!=NULL){
+            *error=parse_error;
+        }
+        free_parse_tree(node);
+        return result;
+    }
+    *tree=node;
+    return PARSE_OK;
+}
+
+/**
+ * Allocates memory that is freed with a parse tree.
+ *
+ * @param tree The parse tree.
+ * @param size The number of bytes needed.
+ * @return The memory, aligned for any node.
+ */
+void *parse_tree_alloc(parse_tree_t *tree, size_t size){
+    return arena_alloc(tree,size);
+}
+
+/**
+ * Adds up the memory a parse tree holds.
+ *
+ * @param tree The tree.
+ * @return The number of bytes allocated for the tree and its arena blocks.
+ */
+size_t parse_tree_size(const parse_tree_t *tree){
+    size_t size=sizeof(parse_tree_t);
+    for(const struct arena_block *block=tree->arena;block!=NULL;block=block->next){
+        size+=sizeof(struct arena_block)+block->size;
+    }
+    return size;
+}
+
+/**
+ * Frees a parse tree and every string in it.
+ *
+ * @param tree The tree to free; NULL is ignored.
+ */
+void free_parse_tree(parse_tree_t *tree){
+    if(tree==NULL){
+        return;
+    }
+    struct arena_block *block=tree->arena;
+    while(block!=NULL){
+        struct arena_block *next=block->next;
+        free(block);
+        block=next;
+    }
+    free(tree);
+}
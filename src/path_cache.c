@@ -0,0 +1,348 @@
+#include "../include/path_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define INITIAL_BUCKETS 64
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+#define DIR_EVENTS (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB|IN_DELETE_SELF|IN_MOVE_SELF)
+
+/**
+ * Computes the FNV-1a hash of a command name.
+ *
+ * @param name The command name to hash.
+ * @return The 32-bit hash value.
+ */
+static uint32_t hash_name(const char *name){
+    uint32_t hash=2166136261u;
+    for(const unsigned char *p=(const unsigned char *)name;*p!='\0';p++){
+        hash^=*p;
+        hash*=16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Releases the directory list (and inotify watches) the cache was built against.
+ *
+ * @param cache A pointer to the path cache.
+ */
+static void free_dirs(path_cache_t *cache){
+    for(int i=0;i<cache->num_dirs;i++){
+        free(cache->dirs[i]);
+    }
+    free(cache->dirs);
+    free(cache->dir_mtimes);
+    free(cache->path_env);
+    cache->dirs=NULL;
+    cache->dir_mtimes=NULL;
+    cache->path_env=NULL;
+    cache->num_dirs=0;
+    if(cache->inotify_fd!=-1){
+        close(cache->inotify_fd);
+        cache->inotify_fd=-1;
+    }
+}
+
+/**
+ * Splits PATH into its directories and starts watching them for changes.
+ * Directories are watched with inotify when it is available; otherwise their
+ * modification times are recorded and compared on every lookup. If memory runs
+ * out, no directory is loaded (so every command is not found) and PATH is
+ * loaded again on the next lookup.
+ *
+ * @param cache A pointer to the path cache.
+ * @param path_env The value of PATH to load.
+ */
+static void load_dirs(path_cache_t *cache, const char *path_env){
+    free_dirs(cache);
+    int count=1;
+    for(const char *p=path_env;*p!='\0';p++){
+        if(*p==':'){
+            count++;
+        }
+    }
+    cache->path_env=strdup(path_env);
+    cache->dirs=malloc(sizeof(char*)*count);
+    cache->dir_mtimes=calloc(count,sizeof(struct timespec));
+    if(cache->path_env==NULL||cache->dirs==NULL||cache->dir_mtimes==NULL){
+        free_dirs(cache);
+        return;
+    }
+    cache->inotify_fd=inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+
+    const char *start=path_env;
+    while(true){
+        const char *end=strchr(start,':');
+        size_t len=end==NULL?strlen(start):(size_t)(end-start);
+        // An empty PATH entry means the current directory
+        char *dir=len==0?strdup("."):strndup(start,len);
+        if(dir==NULL){
+            free_dirs(cache);
+            return;
+        }
+        struct stat st;
+        if(stat(dir,&st)==0){
+            cache->dir_mtimes[cache->num_dirs]=st.st_mtim;
+        }
+        if(cache->inotify_fd!=-1){
+            inotify_add_watch(cache->inotify_fd,dir,DIR_EVENTS);
+        }
+        cache->dirs[cache->num_dirs++]=dir;
+        if(end==NULL){
+            break;
+        }
+        start=end+1;
+    }
+}
+
+/**
+ * Drops every cached entry if PATH or one of its directories changed since the
+ * entries were resolved.
+ *
+ * @param cache A pointer to the path cache.
+ */
+static void validate_cache(path_cache_t *cache){
+    const char *path_env=getenv("PATH");
+    if(path_env==NULL){
+        path_env=DEFAULT_PATH;
+    }
+    if(cache->path_env==NULL||strcmp(cache->path_env,path_env)!=0){
+        clear_path_cache(cache);
+        load_dirs(cache,path_env);
+        return;
+    }
+
+    bool stale=false;
+    if(cache->inotify_fd!=-1){
+        char events[4096];
+        while(read(cache->inotify_fd,events,sizeof(events))>0){
+            stale=true;
+        }
+    }
+    else{
+        for(int i=0;i<cache->num_dirs;i++){
+            struct stat st;
+            struct timespec mtime={0,0};
+            if(stat(cache->dirs[i],&st)==0){
+                mtime=st.st_mtim;
+            }
+            if(mtime.tv_sec!=cache->dir_mtimes[i].tv_sec||mtime.tv_nsec!=cache->dir_mtimes[i].tv_nsec){
+                cache->dir_mtimes[i]=mtime;
+                stale=true;
+            }
+        }
+    }
+    if(stale){
+        clear_path_cache(cache);
+    }
+}
+
+/**
+ * Doubles the number of buckets and rehashes every entry.
+ *
+ * @param cache A pointer to the path cache.
+ */
+static void grow_buckets(path_cache_t *cache){
+    int num_buckets=cache->num_buckets*2;
+    path_entry_t **buckets=calloc(num_buckets,sizeof(path_entry_t*));
+    if(buckets==NULL){
+        return;
+    }
+    for(int i=0;i<cache->num_buckets;i++){
+        path_entry_t *entry=cache->buckets[i];
+        while(entry!=NULL){
+            path_entry_t *next=entry->next;
+            uint32_t bucket=hash_name(entry->name)&(num_buckets-1);
+            entry->next=buckets[bucket];
+            buckets[bucket]=entry;
+            entry=next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets=buckets;
+    cache->num_buckets=num_buckets;
+}
+
+/**
+ * Searches the PATH directories for an executable regular file with the given name.
+ *
+ * @param cache A pointer to the path cache holding the PATH directories.
+ * @param name The command name to search for.
+ * @return A newly allocated path; NULL if the command was not found or memory ran out.
+ */
+static char *search_path(path_cache_t *cache, const char *name){
+    size_t name_len=strlen(name);
+    for(int i=0;i<cache->num_dirs;i++){
+        size_t dir_len=strlen(cache->dirs[i]);
+        char *path=malloc(dir_len+name_len+2);
+        if(path==NULL){
+            return NULL;
+        }
+        memcpy(path,cache->dirs[i],dir_len);
+        path[dir_len]='/';
+        memcpy(path+dir_len+1,name,name_len+1);
+        struct stat st;
+        if(stat(path,&st)==0&&S_ISREG(st.st_mode)&&access(path,X_OK)==0){
+            return path;
+        }
+        free(path);
+    }
+    return NULL;
+}
+
+/**
+ * Allocates and initializes an empty command path cache.
+ *
+ * @return A pointer to the newly allocated cache; NULL if allocation fails.
+ */
+path_cache_t *alloc_path_cache(){
+    path_cache_t *cache=malloc(sizeof(path_cache_t));
+    if(cache==NULL){
+        return NULL;
+    }
+    cache->buckets=calloc(INITIAL_BUCKETS,sizeof(path_entry_t*));
+    if(cache->buckets==NULL){
+        free(cache);
+        return NULL;
+    }
+    cache->num_buckets=INITIAL_BUCKETS;
+    cache->count=0;
+    cache->path_env=NULL;
+    cache->dirs=NULL;
+    cache->dir_mtimes=NULL;
+    cache->num_dirs=0;
+    cache->inotify_fd=-1;
+    return cache;
+}
+
+/**
+ * Finds the executable a command name refers to, consulting the cache first.
+ *
+ * @param cache A pointer to the path cache.
+ * @param name The command name; names containing a '/' are returned unchanged.
+ * @return The path of the executable (owned by the cache or the caller's name); NULL if not found
+ *         or if memory ran out while looking it up.
+ */
+const char *resolve_command(path_cache_t *cache, const char *name){
+    if(strchr(name,'/')!=NULL){
+        return name;
+    }
+    validate_cache(cache);
+
+    uint32_t hash=hash_name(name);
+    for(path_entry_t *entry=cache->buckets[hash&(cache->num_buckets-1)];entry!=NULL;entry=entry->next){
+        if(strcmp(entry->name,name)==0){
+            entry->hits++;
+            return entry->path;
+        }
+    }
+
+    char *path=search_path(cache,name);
+    if(path==NULL){
+        return NULL;
+    }
+    if(cache->count>=cache->num_buckets){
+        grow_buckets(cache);
+    }
+    path_entry_t *entry=malloc(sizeof(path_entry_t));
+    char *entry_name=strdup(name);
+    if(entry==NULL||entry_name==NULL){
+        // A command that cannot be cached is reported as not found rather than leaked
+        free(entry);
+        free(entry_name);
+        free(path);
+        return NULL;
+    }
+    entry->name=entry_name;
+    entry->path=path;
+    entry->hits=1;
+    uint32_t bucket=hash&(cache->num_buckets-1);
+    entry->next=cache->buckets[bucket];
+    cache->buckets[bucket]=entry;
+    cache->count++;
+    return entry->path;
+}
+
+/**
+ * Resolves a command and stores it in the cache without counting it as a use.
+ *
+ * @param cache A pointer to the path cache.
+ * @param name The command name to look up.
+ * @return True if the command was found; otherwise, false.
+ */
+bool hash_command(path_cache_t *cache, const char *name){
+    if(strchr(name,'/')!=NULL){
+        return access(name,X_OK)==0;
+    }
+    if(resolve_command(cache,name)==NULL){
+        return false;
+    }
+    uint32_t hash=hash_name(name);
+    for(path_entry_t *entry=cache->buckets[hash&(cache->num_buckets-1)];entry!=NULL;entry=entry->next){
+        if(strcmp(entry->name,name)==0){
+            entry->hits--;
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * Prints every cached command and the number of times it was used.
+ *
+ * @param cache A pointer to the path cache to print.
+ */
+void print_path_cache(path_cache_t *cache){
+    validate_cache(cache);
+    if(cache->count==0){
+        printf("hash: hash table empty\n");
+        return;
+    }
+    printf("hits\tcommand\n");
+    for(int i=0;i<cache->num_buckets;i++){
+        for(path_entry_t *entry=cache->buckets[i];entry!=NULL;entry=entry->next){
+            printf("%4d\t%s\n",entry->hits,entry->path);
+        }
+    }
+}
+
+/**
+ * Removes every entry from the cache.
+ *
+ * @param cache A pointer to the path cache to clear.
+ */
+void clear_path_cache(path_cache_t *cache){
+    for(int i=0;i<cache->num_buckets;i++){
+        path_entry_t *entry=cache->buckets[i];
+        while(entry!=NULL){
+            path_entry_t *next=entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry=next;
+        }
+        cache->buckets[i]=NULL;
+    }
+    cache->count=0;
+}
+
+/**
+ * Deallocates the cache and all of its entries.
+ *
+ * @param cache A pointer to the path cache to be deallocated.
+ */
+void free_path_cache(path_cache_t *cache){
+    if(cache==NULL){
+        return;
+    }
+    clear_path_cache(cache);
+    free_dirs(cache);
+    free(cache->buckets);
+    free(cache);
+}
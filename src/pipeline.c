@@ -0,0 +1,526 @@
+#define _GNU_SOURCE
+#include "../include/pipeline.h"
+#include "../include/launch.h"
+#include "../include/builtins.h"
+#include "../include/vm.h"
+#include "../include/expand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PIPE_CHUNK (64*1024)
+
+/**
+ * Checks whether a descriptor refers to a pipe.
+ *
+ * @param fd The descriptor to check.
+ * @return True if fd is a pipe or FIFO; otherwise, false.
+ */
+static bool is_pipe(int fd){
+    struct stat st;
+    return fstat(fd,&st)==0&&S_ISFIFO(st.st_mode);
+}
+
+/**
+ * Writes an entire buffer, retrying short writes.
+ *
+ * @param fd The descriptor to write to.
+ * @param buf The data to write.
+ * @param len The number of bytes to write.
+ * @return 0 on success; -1 on error.
+ */
+static int write_all(int fd, const char *buf, size_t len){
+    while(len>0){
+        ssize_t n=write(fd,buf,len);
+        if(n<0){
+            if(errno==EINTR){
+                continue;
+            }
+            return -1;
+        }
+        buf+=n;
+        len-=n;
+    }
+    return 0;
+}
+
+/**
+ * Copies a descriptor to one or more outputs through a user-space buffer.
+ * This is the fallback when splice(2) cannot be used.
+ *
+ * @param in_fd The descriptor to read until end of file.
+ * @param out_fds The descriptors to write every byte to.
+ * @param num_out The number of descriptors in out_fds.
+ * @return 0 on success; -1 on error.
+ */
+static int copy_buffered(int in_fd, const int *out_fds, int num_out){
+    char buf[PIPE_CHUNK];
+    while(true){
+        ssize_t n=read(in_fd,buf,sizeof(buf));
+        if(n==0){
+            return 0;
+        }
+        if(n<0){
+            if(errno==EINTR){
+                continue;
+            }
+            return -1;
+        }
+        for(int i=0;i<num_out;i++){
+            if(write_all(out_fds[i],buf,n)==-1){
+                return -1;
+            }
+        }
+    }
+}
+
+/**
+ * Copies a descriptor to another, moving pages with splice(2) when either side is a pipe.
+ *
+ * @param in_fd The descriptor to read until end of file.
+ * @param out_fd The descriptor to write to.
+ * @return 0 on success; -1 on error.
+ */
+static int copy_fd(int in_fd, int out_fd){
+    if(is_pipe(in_fd)||is_pipe(out_fd)){
+        while(true){
+            ssize_t n=splice(in_fd,NULL,out_fd,NULL,PIPE_CHUNK,SPLICE_F_MOVE|SPLICE_F_MORE);
+            if(n==0){
+                return 0;
+            }
+            if(n<0){
+                if(errno==EINTR){
+                    continue;
+                }
+                // The other side (e.g. a terminal) does not support splice; copy the rest instead
+                if(errno==EINVAL){
+                    break;
+                }
+                return -1;
+            }
+        }
+    }
+    return copy_buffered(in_fd,&out_fd,1);
+}
+
+/**
+ * Replaces the current (forked) process with the real program of a builtin
+ * stage. Used when a stage asks for options the builtin does not implement.
+ *
+ * @param shell The current shell state.
+ * @param argv The arguments of the stage.
+ * @return 127 if the program could not be run; otherwise, does not return.
+ */
+static int exec_real_program(msh_t *shell, char **argv){
+    const char *path=resolve_command(shell->path_cache,argv[0]);
+    if(path==NULL){
+        fprintf(stderr,"error: %s: command not found\n",argv[0]);
+        return 127;
+    }
+    execve(path,argv,environment(shell->variables));
+    fprintf(stderr,"execve: %s\n",strerror(errno));
+    return 127;
+}
+
+/**
+ * Checks a builtin stage's arguments for options other than the allowed one.
+ *
+ * @param argc The number of arguments in argv.
+ * @param argv The arguments of the stage.
+ * @param allowed The only option accepted as the first argument; NULL for none.
+ * @return True if an unsupported option is present; otherwise, false.
+ */
+static bool has_other_options(int argc, char **argv, const char *allowed){
+    for(int i=1;i<argc;i++){
+        bool is_allowed=i==1&&allowed!=NULL&&strcmp(argv[i],allowed)==0;
+        if(argv[i][0]=='-'&&argv[i][1]!='\0'&&!is_allowed){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Copies the named files, or standard input, to standard output.
+ *
+ * @param shell The current shell state.
+ * @param argc The number of arguments in argv.
+ * @param argv "cat" followed by file names; "-" means standard input.
+ * @return 0 on success; 1 if any file could not be copied.
+ */
+int splice_cat(msh_t *shell, int argc, char **argv){
+    int status=0;
+    if(has_other_options(argc,argv,NULL)){
+        return exec_real_program(shell,argv);
+    }
+    if(argc==1){
+        if(copy_fd(STDIN_FILENO,STDOUT_FILENO)==-1){
+            fprintf(stderr,"cat: %s\n",strerror(errno));
+            status=1;
+        }
+        return status;
+    }
+    for(int i=1;i<argc;i++){
+        int fd=STDIN_FILENO;
+        if(strcmp(argv[i],"-")!=0&&(fd=open(argv[i],O_RDONLY|O_CLOEXEC))==-1){
+            fprintf(stderr,"cat: %s: %s\n",argv[i],strerror(errno));
+            status=1;
+            continue;
+        }
+        if(copy_fd(fd,STDOUT_FILENO)==-1){
+            fprintf(stderr,"cat: %s: %s\n",argv[i],strerror(errno));
+            status=1;
+        }
+        if(fd!=STDIN_FILENO){
+            close(fd);
+        }
+    }
+    return status;
+}
+
+/**
+ * Moves exactly len bytes from the front of the standard input pipe into a file.
+ *
+ * @param fd The file descriptor to write to.
+ * @param len The number of bytes to move.
+ * @return 0 on success; -1 on error.
+ */
+static int drain_to_file(int fd, size_t len){
+    while(len>0){
+        ssize_t n=splice(STDIN_FILENO,NULL,fd,NULL,len,SPLICE_F_MOVE);
+        if(n<0&&errno==EINTR){
+            continue;
+        }
+        if(n<0&&errno==EINVAL){
+            // The file system cannot splice; read the bytes we already duplicated instead
+            char buf[PIPE_CHUNK];
+            n=read(STDIN_FILENO,buf,len<sizeof(buf)?len:sizeof(buf));
+            if(n>0&&write_all(fd,buf,n)==-1){
+                return -1;
+            }
+        }
+        if(n<=0){
+            return -1;
+        }
+        len-=n;
+    }
+    return 0;
+}
+
+/**
+ * Copies standard input to standard output and to the named files.
+ *
+ * @param shell The current shell state.
+ * @param argc The number of arguments in argv.
+ * @param argv "tee", an optional "-a", and file names.
+ * @return 0 on success; 1 if any file could not be written.
+ */
+int splice_tee(msh_t *shell, int argc, char **argv){
+    if(has_other_options(argc,argv,"-a")){
+        return exec_real_program(shell,argv);
+    }
+    int flags=O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC;
+    int first=1;
+    int status=0;
+    if(argc>1&&strcmp(argv[1],"-a")==0){
+        flags=O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC;
+        first=2;
+    }
+    int *out_fds=malloc(sizeof(int)*(argc+1));
+    if(out_fds==NULL){
+        fprintf(stderr,"tee: %s\n",strerror(errno));
+        return 1;
+    }
+    int num_out=0;
+    out_fds[num_out++]=STDOUT_FILENO;
+    for(int i=first;i<argc;i++){
+        int fd=open(argv[i],flags,0666);
+        if(fd==-1){
+            fprintf(stderr,"tee: %s: %s\n",argv[i],strerror(errno));
+            status=1;
+            continue;
+        }
+        out_fds[num_out++]=fd;
+    }
+
+    if(num_out==1){
+        if(copy_fd(STDIN_FILENO,STDOUT_FILENO)==-1){
+            fprintf(stderr,"tee: %s\n",strerror(errno));
+            status=1;
+        }
+    }
+    else if(num_out==2&&is_pipe(STDIN_FILENO)&&is_pipe(STDOUT_FILENO)){
+        // tee(2) duplicates the pipe's pages to stdout; splice then consumes them into the file
+        while(true){
+            ssize_t n=tee(STDIN_FILENO,STDOUT_FILENO,PIPE_CHUNK,0);
+            if(n==0){
+                break;
+            }
+            if(n<0){
+                if(errno==EINTR){
+                    continue;
+                }
+                if(errno!=EINVAL||copy_buffered(STDIN_FILENO,out_fds,num_out)==-1){
+                    fprintf(stderr,"tee: %s\n",strerror(errno));
+                    status=1;
+                }
+                break;
+            }
+            if(drain_to_file(out_fds[1],n)==-1){
+                fprintf(stderr,"tee: %s: %s\n",argv[argc-1],strerror(errno));
+                status=1;
+                break;
+            }
+        }
+    }
+    else if(copy_buffered(STDIN_FILENO,out_fds,num_out)==-1){
+        fprintf(stderr,"tee: %s\n",strerror(errno));
+        status=1;
+    }
+    for(int i=1;i<num_out;i++){
+        close(out_fds[i]);
+    }
+    free(out_fds);
+    return status;
+}
+
+/**
+ * Launches separated commands connected by pipes as one job in one process group.
+ *
+ * @param shell The current shell state.
+ * @param stages An argv array for every command of the pipeline.
+ * @param stage_argc The number of arguments of every command.
+ * @param stage_envp The environment of every program; NULL for the shell's environment for all.
+ * @param stage_redirects The redirections of every command, opened; NULL if none has any.
+ * @param num_stages The number of commands.
+ * @param cmd_line The command line recorded for the job.
+ * @param job_type FOREGROUND to wait for the job; BACKGROUND to return immediately.
+ * @return 0 if at least one stage was launched; otherwise, -1.
+ */
+int launch_pipeline(msh_t *shell, char ***stages, int *stage_argc, char ***stage_envp, const redirections_t *stage_redirects, int num_stages, const char *cmd_line, int job_type){
+    const char **paths=malloc(sizeof(char*)*num_stages);
+    const builtin_t **builtins=malloc(sizeof(builtin_t*)*num_stages);
+    if(paths==NULL||builtins==NULL){
+        perror("Failed to allocate memory for a pipeline");
+        free(paths);
+        free(builtins);
+        return -1;
+    }
+    for(int i=0;i<num_stages;i++){
+        // Builtins inside a pipeline run in a forked shell process, like a subshell
+        builtins[i]=num_stages>1?find_builtin(stages[i][0]):NULL;
+        paths[i]=NULL;
+        if(builtins[i]==NULL&&(paths[i]=resolve_command(shell->path_cache,stages[i][0]))==NULL){
+            printf("error: %s: command not found\n",stages[i][0]);
+            free(paths);
+            free(builtins);
+            return -1;
+        }
+    }
+
+    // SIGCHLD stays blocked (it is read from the signalfd), so no child is reaped before it joins the job
+    // Forked builtins must not inherit (and later repeat) output the shell has not written yet
+    fflush(stdout);
+    shell->status_pid=0;
+    shell->last_status=127;
+
+    pid_t pgid=0;
+    int in_fd=-1;
+    for(int i=0;i<num_stages;i++){
+        int fds[2]={-1,-1};
+        if(i<num_stages-1&&pipe2(fds,O_CLOEXEC)==-1){
+            perror("pipe2");
+            break;
+        }
+        pid_t pid;
+        const redirections_t *redirects=stage_redirects!=NULL?&stage_redirects[i]:NULL;
+        if(builtins[i]!=NULL){
+            pid=fork_builtin(builtins[i]->run,shell,stage_argc[i],stages[i],redirects,&shell->child_mask,pgid,in_fd,fds[1]);
+        }
+        else{
+            char **envp=stage_envp!=NULL?stage_envp[i]:environment(shell->variables);
+            pid=spawn_process(paths[i],stages[i],envp,redirects,&shell->child_mask,pgid,in_fd,fds[1]);
+        }
+        if(in_fd!=-1){
+            close(in_fd);
+        }
+        if(fds[1]!=-1){
+            close(fds[1]);
+        }
+        // A stage that failed to start leaves its reader with end of file
+        in_fd=fds[0];
+        if(pid==-1){
+            continue;
+        }
+        // The exit status of a foreground pipeline is the status of its last command
+        if(i==num_stages-1&&job_type==FOREGROUND){
+            shell->status_pid=pid;
+        }
+        if(pgid==0){
+            pgid=pid;
+            add_job(shell->jobs,pid,job_type,cmd_line);
+        }
+        else{
+            add_job_process(shell->jobs,pgid,pid);
+        }
+    }
+    if(in_fd!=-1){
+        close(in_fd);
+    }
+    free(paths);
+    free(builtins);
+
+    if(pgid!=0&&job_type==FOREGROUND){
+        shell->curr_foreground_pid=pgid;
+        waitfg(shell);
+    }
+    if(job_type==BACKGROUND&&pgid!=0){
+        shell->last_status=0;
+        shell->last_background_pid=pgid;
+    }
+    return pgid!=0?0:-1;
+}
+
+/**
+ * Runs a function or builtin inside the shell, with the variables assigned
+ * before its name set and its redirections applied while it runs.
+ *
+ * @param shell The current shell state.
+ * @param command The command.
+ * @param function The function; NULL to run builtin.
+ * @param builtin The builtin.
+ * @param argc The number of expanded arguments.
+ * @param argv The expanded arguments.
+ * @param redirects The redirections of the command, opened.
+ */
+static void run_in_shell(msh_t *shell, const command_t *command, const function_t *function, const builtin_t *builtin,
+                         int argc, char **argv, const redirections_t *redirects){
+    int depth=push_redirections(shell,redirects);
+    if(depth==-1){
+        shell->last_status=1;
+        return;
+    }
+    int num_saved=0;
+    saved_variable_t *saved=command->assignments!=NULL?push_assignments(shell,command->assignments,&num_saved):NULL;
+    if(function!=NULL){
+        call_function(shell,function,argc,argv);
+    }
+    else{
+        shell->last_status=run_builtin(shell,builtin,argc,argv);
+    }
+    if(saved!=NULL){
+        pop_assignments(shell,saved,num_saved);
+    }
+    pop_redirections(shell,depth);
+}
+
+/**
+ * Runs a command that is a pipeline on its own inside the shell, if it is
+ * a function or builtin, or only assignments.
+ *
+ * @param shell The current shell state.
+ * @param command The command.
+ * @param argc The number of expanded arguments.
+ * @param argv The expanded arguments.
+ * @param redirects The redirections of the command, opened; closed if the command ran.
+ * @param substitutions The number of command substitutions run before the command was expanded.
+ * @return True if the command ran; false if it is a program to launch.
+ */
+static bool run_single(msh_t *shell, const command_t *command, int argc, char **argv, const redirections_t *redirects,
+                       unsigned int substitutions){
+    if(argc==0){
+        // Only assignments (or words that expanded to nothing): they set shell variables, and
+        // redirections only create or open their files. The exit status is that of the last command
+        // substitution in them, if there is one.
+        close_redirections(redirects);
+        assign_variables(shell,command->assignments);
+        if(shell->num_substitutions==substitutions){
+            shell->last_status=0;
+        }
+        return true;
+    }
+    // A function on its own runs in the shell, before any builtin or program of the same name
+    const function_t *function=find_function(shell->functions,argv[0]);
+    // A name that came from an expansion is only known now
+    const builtin_t *builtin=command->expand!=NULL&&command->expand[0]!=NULL?find_builtin(argv[0]):command->builtin;
+    if(function==NULL&&(builtin==NULL||(builtin->flags&BUILTIN_STAGE_ONLY))){
+        return false;
+    }
+    run_in_shell(shell,command,function,builtin,argc,argv,redirects);
+    return true;
+}
+
+/**
+ * Runs a parsed pipeline, once the words of its commands are expanded and
+ * their redirections opened. A function or builtin on its own runs inside
+ * the shell, in the foreground; anything else is launched as one job.
+ *
+ * @param shell The current shell state.
+ * @param pipeline The pipeline.
+ * @param cmd_line The command line recorded for the job.
+ * @param job_type FOREGROUND to wait for the job; BACKGROUND to return immediately.
+ * @return 0 if the pipeline ran or at least one stage was launched; otherwise, -1.
+ */
+int run_pipeline(msh_t *shell, const pipeline_t *pipeline, const char *cmd_line, int job_type){
+    int num_stages=pipeline->num_commands;
+    for(const command_t *command=pipeline->commands;command!=NULL;command=command->next){
+        if(command->type!=COMMAND_SIMPLE){
+            printf("error: compound commands in pipelines are not supported\n");
+            shell->last_status=1;
+            return -1;
+        }
+    }
+    // Everything expanded and opened for the pipeline is popped (and closed) once it has started, or,
+    // in the foreground, finished
+    expand_mark_t mark=expand_mark(shell);
+    char ***stages=expand_alloc(shell,sizeof(char**)*num_stages*2);
+    char ***stage_envp=stages+num_stages;
+    int *stage_argc=expand_alloc(shell,sizeof(int)*num_stages);
+    redirections_t *stage_redirects=expand_alloc(shell,sizeof(redirections_t)*num_stages);
+    int num_open=0;
+    int result=0;
+    unsigned int substitutions=shell->num_substitutions;
+    for(const command_t *command=pipeline->commands;command!=NULL;command=command->next){
+        int i=num_open;
+        stages[i]=expand_words(shell,command->argc,command->argv,command->expand,&stage_argc[i]);
+        if(stage_argc[i]==0&&num_stages>1){
+            printf("error: empty command in pipeline\n");
+            shell->last_status=1;
+            result=-1;
+            break;
+        }
+        if(open_redirections(shell,command->redirects,&stage_redirects[i])==-1){
+            shell->last_status=1;
+            result=-1;
+            break;
+        }
+        num_open++;
+    }
+    if(result==0&&num_stages==1&&run_single(shell,pipeline->commands,stage_argc[0],stages[0],&stage_redirects[0],substitutions)){
+        num_open=0;
+    }
+    else if(result==0&&jobs_full(shell->jobs)){
+        shell->last_status=1;
+        result=-1;
+    }
+    else if(result==0){
+        int i=0;
+        for(const command_t *command=pipeline->commands;command!=NULL;command=command->next){
+            stage_envp[i++]=command_environment(shell,command->assignments);
+        }
+        result=launch_pipeline(shell,stages,stage_argc,stage_envp,stage_redirects,num_stages,cmd_line,job_type);
+        if(result==-1){
+            shell->last_status=127;
+        }
+    }
+    while(num_open>0){
+        close_redirections(&stage_redirects[--num_open]);
+    }
+    expand_release(shell,mark);
+    return result;
+}
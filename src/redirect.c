@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include "../include/redirect.h"
+#include "../include/shell.h"
+#include "../include/expand.h"
+#include "../include/output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//Copies of the shell's descriptors, and files that must not land on a descriptor being redirected,
+//are moved to this descriptor or above
+#define FIRST_HIGH_FD 10
+
+/**
+ * Reads the descriptor number of a "<&" or ">&" redirection.
+ *
+ * @param target The word after the operator.
+ * @param fd Receives the number.
+ * @return False if the word is not a number.
+ */
+static bool parse_fd(const char *target, int *fd){
+    if(*target=='\0'||strspn(target,"0123456789")!=strlen(target)||strlen(target)>9){
+        return false;
+    }
+    *fd=atoi(target);
+    return true;
+}
+
+/**
+ * Puts text into an anonymous memory file, for a here-document to read from
+ * the start. Nothing is written to disk.
+ *
+ * @param text The text.
+ * @param newline True to add a newline after it, as for a here-string.
+ * @return The descriptor, close-on-exec; -1 on error.
+ */
+static int open_memory(const char *text, bool newline){
+    int fd=memfd_create("msh-heredoc",MFD_CLOEXEC);
+    if(fd==-1){
+        return -1;
+    }
+    size_t len=strlen(text);
+    // A here-string is its word and a newline
+    const char *parts[2]={text,"\n"};
+    size_t sizes[2]={len,newline?1:0};
+    for(int i=0;i<2;i++){
+        size_t written=0;
+        while(written<sizes[i]){
+            ssize_t n=write(fd,parts[i]+written,sizes[i]-written);
+            if(n==-1){
+                if(errno==EINTR){
+                    continue;
+                }
+                close(fd);
+                return -1;
+            }
+            written+=n;
+        }
+    }
+    if(lseek(fd,0,SEEK_SET)==-1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Opens the file a redirection reads or writes.
+ *
+ * @param type The kind of redirection.
+ * @param target The expanded file name.
+ * @return The descriptor, close-on-exec; -1 on error.
+ */
+static int open_file(redirect_type_t type, const char *target){
+    switch(type){
+        case REDIRECT_OUT:
+            return open(target,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0666);
+        case REDIRECT_APPEND:
+            return open(target,O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC,0666);
+        default:
+            return open(target,O_RDONLY|O_CLOEXEC);
+    }
+}
+
+/**
+ * Opens what the redirections of a command read and write.
+ *
+ * @param shell The current shell state.
+ * @param redirects The redirections, in order.
+ * @param out Receives the actions.
+ * @return 0 on success; -1 on error, which is printed.
+ */
+int open_redirections(msh_t *shell, const redirect_t *redirects, redirections_t *out){
+    int count=0;
+    for(const redirect_t *redirect=redirects;redirect!=NULL;redirect=redirect->next){
+        count++;
+    }
+    out->num_actions=0;
+    out->actions=count>0?expand_alloc(shell,sizeof(fd_action_t)*count):NULL;
+    for(const redirect_t *redirect=redirects;redirect!=NULL;redirect=redirect->next){
+        fd_action_t *action=&out->actions[out->num_actions];
+        action->fd=redirect->fd;
+        action->owned=false;
+        const char *target=expand_word(shell,redirect->target,redirect->expand);
+        switch(redirect->type){
+            case REDIRECT_DUP_IN:
+            case REDIRECT_DUP_OUT:
+                if(strcmp(target,"-")==0){
+                    action->source=-1;
+                }
+                else if(!parse_fd(target,&action->source)){
+                    printf("error: %s: bad file descriptor\n",target);
+                    close_redirections(out);
+                    return -1;
+                }
+                break;
+            case REDIRECT_HERE_DOC:
+            case REDIRECT_HERE_STRING:
+                action->source=open_memory(target,redirect->type==REDIRECT_HERE_STRING);
+                if(action->source==-1){
+                    printf("error: here-document: %s\n",strerror(errno));
+                    close_redirections(out);
+                    return -1;
+                }
+                action->owned=true;
+                break;
+            default:
+                action->source=open_file(redirect->type,target);
+                if(action->source==-1){
+                    printf("error: %s: %s\n",target,strerror(errno));
+                    close_redirections(out);
+                    return -1;
+                }
+                action->owned=true;
+                break;
+        }
+        out->num_actions++;
+    }
+    // A file the shell opened must not sit on a descriptor the command redirects, or it would be
+    // replaced before it is copied
+    for(int i=0;i<out->num_actions;i++){
+        fd_action_t *action=&out->actions[i];
+        for(int j=0;action->owned&&j<out->num_actions;j++){
+            if(out->actions[j].fd==action->source){
+                int moved=fcntl(action->source,F_DUPFD_CLOEXEC,FIRST_HIGH_FD);
+                if(moved==-1){
+                    printf("error: %d: %s\n",action->fd,strerror(errno));
+                    close_redirections(out);
+                    return -1;
+                }
+                close(action->source);
+                action->source=moved;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Closes the descriptors the shell opened for redirections.
+ *
+ * @param redirections The redirections.
+ */
+void close_redirections(const redirections_t *redirections){
+    for(int i=0;i<redirections->num_actions;i++){
+        if(redirections->actions[i].owned){
+            close(redirections->actions[i].source);
+        }
+    }
+}
+
+/**
+ * Applies redirections in a child process.
+ *
+ * @param redirections The redirections; NULL for none.
+ */
+void apply_redirections(const redirections_t *redirections){
+    if(redirections==NULL){
+        return;
+    }
+    for(int i=0;i<redirections->num_actions;i++){
+        const fd_action_t *action=&redirections->actions[i];
+        if(action->source==-1){
+            close(action->fd);
+        }
+        else if(action->source!=action->fd&&dup2(action->source,action->fd)==-1){
+            fprintf(stderr,"msh: %d: %s\n",action->source,strerror(errno));
+            _exit(EXIT_FAILURE);
+        }
+    }
+    close_redirections(redirections);
+}
+
+/**
+ * Adds redirections to the file actions of posix_spawn.
+ *
+ * @param actions The file actions.
+ * @param redirections The redirections; NULL for none.
+ */
+void add_spawn_redirections(posix_spawn_file_actions_t *actions, const redirections_t *redirections){
+    if(redirections==NULL){
+        return;
+    }
+    // The sources the shell opened are close-on-exec, so the program only keeps its copies
+    for(int i=0;i<redirections->num_actions;i++){
+        const fd_action_t *action=&redirections->actions[i];
+        if(action->source==-1){
+            posix_spawn_file_actions_addclose(actions,action->fd);
+        }
+        else if(action->source!=action->fd){
+            posix_spawn_file_actions_adddup2(actions,action->source,action->fd);
+        }
+    }
+}
+
+/**
+ * Writes out what the shell has buffered for standard output and error.
+ */
+static void flush_output(){
+    out_flush();
+    fflush(stdout);
+    fflush(stderr);
+}
+
+/**
+ * Moves a saved copy off a descriptor that is about to be redirected.
+ *
+ * @param stack The descriptor stack.
+ * @param fd The descriptor.
+ * @return False if the copy could not be moved.
+ */
+static bool evict_copy(fd_stack_t *stack, int fd){
+    for(int i=0;i<stack->count;i++){
+        if(stack->saved[i].copy==fd){
+            int moved=fcntl(fd,F_DUPFD_CLOEXEC,FIRST_HIGH_FD);
+            if(moved==-1){
+                return false;
+            }
+            stack->saved[i].copy=moved;
+        }
+    }
+    return true;
+}
+
+/**
+ * Saves a descriptor of the shell on its descriptor stack.
+ *
+ * @param stack The descriptor stack.
+ * @param fd The descriptor.
+ * @return False if it could not be copied.
+ */
+static bool save_fd(fd_stack_t *stack, int fd){
+    if(stack->count==stack->capacity){
+        int capacity=stack->capacity==0?8:stack->capacity*2;
+        saved_fd_t *saved=realloc(stack->saved,sizeof(saved_fd_t)*capacity);
+        if(saved==NULL){
+            return false;
+        }
+        stack->saved=saved;
+        stack->capacity=capacity;
+    }
+    int copy=fcntl(fd,F_DUPFD_CLOEXEC,FIRST_HIGH_FD);
+    if(copy==-1&&errno!=EBADF){
+        return false;
+    }
+    stack->saved[stack->count].fd=fd;
+    stack->saved[stack->count++].copy=copy;
+    return true;
+}
+
+/**
+ * Applies redirections to the shell itself, saving each descriptor first.
+ *
+ * @param shell The current shell state.
+ * @param redirections The redirections; their owned sources are closed.
+ * @return The depth of the descriptor stack before; -1 on error.
+ */
+int push_redirections(msh_t *shell, const redirections_t *redirections){
+    fd_stack_t *stack=&shell->fd_stack;
+    int depth=stack->count;
+    flush_output();
+    for(int i=0;i<redirections->num_actions;i++){
+        const fd_action_t *action=&redirections->actions[i];
+        int failed=-1;
+        if(!evict_copy(stack,action->fd)||!save_fd(stack,action->fd)){
+            failed=action->fd;
+        }
+        else if(action->source==-1){
+            close(action->fd);
+        }
+        else if(action->source!=action->fd&&dup2(action->source,action->fd)==-1){
+            failed=action->source;
+        }
+        if(failed!=-1){
+            printf("error: %d: %s\n",failed,strerror(errno));
+            close_redirections(redirections);
+            pop_redirections(shell,depth);
+            return -1;
+        }
+    }
+    close_redirections(redirections);
+    return depth;
+}
+
+/**
+ * Puts back the descriptors saved above a depth.
+ *
+ * @param shell The current shell state.
+ * @param depth The depth, from push_redirections.
+ */
+void pop_redirections(msh_t *shell, int depth){
+    fd_stack_t *stack=&shell->fd_stack;
+    if(stack->count<=depth){
+        return;
+    }
+    flush_output();
+    while(stack->count>depth){
+        const saved_fd_t *saved=&stack->saved[--stack->count];
+        if(saved->copy==-1){
+            close(saved->fd);
+        }
+        else{
+            dup2(saved->copy,saved->fd);
+            close(saved->copy);
+        }
+    }
+}
+
+/**
+ * Frees the descriptor stack.
+ *
+ * @param stack The stack.
+ */
+void free_fd_stack(fd_stack_t *stack){
+    free(stack->saved);
+    stack->saved=NULL;
+    stack->count=0;
+    stack->capacity=0;
+}
@@ -0,0 +1,195 @@
+#include "../include/scan.h"
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(SCAN_SCALAR)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Checks whether a byte is special, as the vector classifiers see it.
+ *
+ * @param c The byte.
+ * @return True for bytes up to ' ', quotes, backquote, backslash, $ and operator characters.
+ */
+static inline bool is_special(unsigned char c){
+    return c<=' '||c=='\''||c=='"'||c=='`'||c=='\\'||c=='$'||c==';'||c=='&'||c=='|'||c=='<'||c=='>';
+}
+
+/**
+ * Classifies the bytes of a line one at a time. Also finishes the last,
+ * partial block of the vector classifiers.
+ *
+ * @param line The line.
+ * @param len The number of bytes to classify.
+ * @param bitmap Receives (len + 63) / 64 words.
+ */
+static void classify_scalar(const char *line, size_t len, uint64_t *bitmap){
+    for(size_t block=0;block*64<len;block++){
+        size_t end=len-block*64<64?len-block*64:64;
+        uint64_t bits=0;
+        for(size_t i=0;i<end;i++){
+            bits|=(uint64_t)is_special((unsigned char)line[block*64+i])<<i;
+        }
+        bitmap[block]=bits;
+    }
+}
+
+#ifdef SCAN_X86
+/**
+ * Classifies 16 bytes with SSE2.
+ *
+ * @param p The bytes.
+ * @return A 16-bit mask of the special ones.
+ */
+static inline uint64_t special_sse2(const char *p){
+    __m128i v=_mm_loadu_si128((const __m128i *)p);
+    // Unsigned v <= ' ' is min(v, ' ') == v
+    __m128i mask=_mm_cmpeq_epi8(_mm_min_epu8(v,_mm_set1_epi8(' ')),v);
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(v,_mm_set1_epi8('\'')));
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(v,_mm_set1_epi8('"')));
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(v,_mm_set1_epi8('`')));
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(v,_mm_set1_epi8('\\')));
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(v,_mm_set1_epi8('$')));
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(v,_mm_set1_epi8(';')));
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(v,_mm_set1_epi8('&')));
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(v,_mm_set1_epi8('|')));
+    // '<' (0x3c) and '>' (0x3e) differ only in bit 1
+    mask=_mm_or_si128(mask,_mm_cmpeq_epi8(_mm_or_si128(v,_mm_set1_epi8(2)),_mm_set1_epi8('>')));
+    return (uint32_t)_mm_movemask_epi8(mask);
+}
+
+/**
+ * Classifies a line 64 bytes at a time with SSE2.
+ */
+static void classify_sse2(const char *line, size_t len, uint64_t *bitmap){
+    size_t block=0;
+    for(;block*64+64<=len;block++){
+        const char *p=line+block*64;
+        bitmap[block]=special_sse2(p)|special_sse2(p+16)<<16|special_sse2(p+32)<<32|special_sse2(p+48)<<48;
+    }
+    classify_scalar(line+block*64,len-block*64,bitmap+block);
+}
+
+/**
+ * Classifies 32 bytes with AVX2.
+ *
+ * @param p The bytes.
+ * @return A 32-bit mask of the special ones.
+ */
+__attribute__((target("avx2")))
+static inline uint64_t special_avx2(const char *p){
+    __m256i v=_mm256_loadu_si256((const __m256i *)p);
+    __m256i mask=_mm256_cmpeq_epi8(_mm256_min_epu8(v,_mm256_set1_epi8(' ')),v);
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\'')));
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('"')));
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('`')));
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\\')));
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('$')));
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(v,_mm256_set1_epi8(';')));
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('&')));
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(v,_mm256_set1_epi8('|')));
+    mask=_mm256_or_si256(mask,_mm256_cmpeq_epi8(_mm256_or_si256(v,_mm256_set1_epi8(2)),_mm256_set1_epi8('>')));
+    return (uint32_t)_mm256_movemask_epi8(mask);
+}
+
+/**
+ * Classifies a line 64 bytes at a time with AVX2.
+ */
+__attribute__((target("avx2")))
+static void classify_avx2(const char *line, size_t len, uint64_t *bitmap){
+    size_t block=0;
+    for(;block*64+64<=len;block++){
+        const char *p=line+block*64;
+        bitmap[block]=special_avx2(p)|special_avx2(p+32)<<32;
+    }
+    classify_scalar(line+block*64,len-block*64,bitmap+block);
+}
+#endif
+
+static const scan_impl_t IMPLS[]={
+#ifdef SCAN_X86
+    {"avx2",classify_avx2},
+    {"sse2",classify_sse2},
+#endif
+    {"scalar",classify_scalar},
+};
+
+//The implementation classify_line uses; chosen on its first call
+static classify_fn_t *classify_impl=NULL;
+
+/**
+ * Lists the classifiers this CPU can run, fastest first.
+ *
+ * @param impls Receives the list.
+ * @return The number of implementations.
+ */
+int scan_implementations(const scan_impl_t **impls){
+    const scan_impl_t *first=IMPLS;
+#ifdef SCAN_X86
+    if(!__builtin_cpu_supports("avx2")){
+        first++;
+    }
+#endif
+    *impls=first;
+    return IMPLS+sizeof(IMPLS)/sizeof(IMPLS[0])-first;
+}
+
+/**
+ * Makes classify_line use the named implementation.
+ *
+ * @param name The name of the implementation.
+ * @return True if this CPU supports it; otherwise, false.
+ */
+bool select_scan_implementation(const char *name){
+    const scan_impl_t *impls;
+    int count=scan_implementations(&impls);
+    for(int i=0;i<count;i++){
+        if(strcmp(impls[i].name,name)==0){
+            classify_impl=impls[i].classify;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Builds the bitmap of the special bytes of a line with the fastest
+ * implementation the CPU supports.
+ *
+ * @param line The line.
+ * @param len The number of bytes to classify.
+ * @param bitmap Receives (len + 63) / 64 words.
+ */
+void classify_line(const char *line, size_t len, uint64_t *bitmap){
+    if(classify_impl==NULL){
+        const scan_impl_t *impls;
+        scan_implementations(&impls);
+        classify_impl=impls[0].classify;
+    }
+    classify_impl(line,len,bitmap);
+}
+
+/**
+ * Finds the first special byte at or after a position.
+ *
+ * @param bitmap A bitmap from classify_line.
+ * @param len The length of the line it was built for.
+ * @param pos The position to start at.
+ * @return The position of the next special byte; len if there is none.
+ */
+size_t next_special(const uint64_t *bitmap, size_t len, size_t pos){
+    if(pos>=len){
+        return len;
+    }
+    size_t word=pos/64;
+    uint64_t bits=bitmap[word]&(~0ULL<<(pos%64));
+    size_t words=(len+63)/64;
+    while(bits==0){
+        if(++word==words){
+            return len;
+        }
+        bits=bitmap[word];
+    }
+    return word*64+__builtin_ctzll(bits);
+}
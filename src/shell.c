@@ -1,24 +1,39 @@
 #include "../include/shell.h"
+#include "../include/pipeline.h"
+#include "../include/builtins.h"
+#include "../include/event_loop.h"
+#include "../include/vm.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <signal.h>
 #include <unistd.h>
 
 msh_t* shell=NULL;
 
+extern char **environ;
+
+//The clocks read when a command starts, for timing it in the history
+typedef struct command_clock {
+    struct timespec started;
+    struct timespec monotonic;
+    struct rusage self;
+} command_clock_t;
+
 /**
  * Allocate and initialize the shell's state.
  *
- * @param max_jobs The max number of jobs that can exist at any time.
- * @param max_line The max number of characters in a command line.
+ * @param max_jobs The number of job slots allocated up front; the job table grows on demand.
+ * @param max_line The max number of characters in a command line; 0 for no limit.
  * @param max_history The max number of commands stored in history.
  * @return A pointer to the newly allocated shell state; Returns NULL if memory allocation fails.
  */
 msh_t *alloc_shell(int max_jobs, int max_line, int max_history) {
     if (max_history == 0) max_history = 10;
-    if (max_line == 0) max_line = 1024;
     if (max_jobs == 0) max_jobs = 16;
 
     msh_t *shell = (msh_t *)malloc(sizeof(msh_t));
@@ -28,46 +43,79 @@ msh_t *alloc_shell(int max_jobs, int max_line, int max_history) {
     }
 
     // Initialize the shell state with the provided values
-    shell->max_jobs = max_jobs;
     shell->max_line = max_line;
     shell->max_history = max_history;
-    shell->jobs = (job_t *)calloc(max_jobs, sizeof(job_t)); // Use calloc to initialize to zero
+    shell->jobs = alloc_jobs(max_jobs);
     if (shell->jobs == NULL) {
         fprintf(stderr, "Failed to allocate memory for jobs\n");
         free(shell); // Make sure to free previously allocated memory
         return NULL;
     }
-    for(int i=0;i<max_jobs;i++){
-        shell->jobs[i].cmd_line=NULL;
-    }
+    shell->queue=alloc_job_queue(0);
     shell->history=alloc_history(shell->max_history);
-    initialize_signal_handlers();
+    // Every command is journaled with its timing once it finishes
+    shell->history->timed=true;
+    shell->record_history=true;
+    shell->path_cache=alloc_path_cache();
+    shell->parse_cache=alloc_parse_cache(PARSE_CACHE_BYTES);
+    shell->variables=alloc_variables();
+    // Variables start out as the environment the shell was started with, all exported
+    if(shell->variables!=NULL){
+        import_environment(shell->variables,environ);
+    }
+    shell->expand_stack.top=NULL;
+    shell->expand_stack.spare=NULL;
+    shell->fd_stack.saved=NULL;
+    shell->fd_stack.count=0;
+    shell->fd_stack.capacity=0;
+    shell->functions=alloc_functions();
+    shell->num_params=0;
+    shell->params=NULL;
+    shell->exiting=false;
+    shell->curr_foreground_pid=0;
+    shell->status_pid=0;
+    shell->last_status=0;
+    shell->num_substitutions=0;
+    shell->pid=getpid();
+    shell->last_background_pid=0;
+    timerclear(&shell->fg_user_time);
+    timerclear(&shell->fg_sys_time);
+    shell->input_fd=-1;
+    shell->child_hook=NULL;
+    shell->child_hook_data=NULL;
+    shell->signal_fd=initialize_signal_handlers(&shell->child_mask);
+    shell->epoll_fd=shell->signal_fd<0?-1:alloc_event_loop(shell);
     return shell;
 }
 
+//The and-or list a background subshell runs, and whether it waits to be released first; set just
+//before the subshell is forked
+static const and_or_t *subshell_list;
+static bool subshell_held;
+
+//The signal that starts a held subshell
+#define RELEASE_SIGNAL SIGUSR1
+
 /**
  * Parses a command line into jobs, distinguishing between foreground and background jobs.
+ * The position in the line is kept by the caller, so several lines can be split at once.
  *
- * @param line The command line to parse.
+ * @param line The command line to parse; NULL to continue with the line in *saveptr.
  * @param job_type Pointer (1 for foreground store, 0 for background store).
+ * @param saveptr Keeps the position in the line between calls.
  * @return Command line's following job; NULL if there are no more jobs.
  */
-char *parse_tok(char *line, int *job_type) {
-    static char *current;
-    if (line != NULL) {
-        current = line;
-    }
+char *parse_tok_r(char *line, int *job_type, char **saveptr) {
+    char *current = line != NULL ? line : *saveptr;
 
     if (current == NULL||*current == '\0') {
         *job_type = -1;
-        current = NULL;
+        *saveptr = NULL;
         return NULL;
     }
 
     char *job_start = current;
-    while (*current != '\0' && *current != '&' && *current != ';') {
-        current++;
-    }
+    current += strcspn(current, "&;");
 
     // Determine job type
     if (*current == '&') {
@@ -95,11 +143,29 @@ char *parse_tok(char *line, int *job_type) {
         current=current_copy;
     }
 
+    *saveptr = current;
     return job_start;
 }
 
 /**
- * Separate the arguments of a command and store them in an array.
+ * Parses a command line into jobs like parse_tok_r, keeping the position in
+ * the line between calls itself.
+ *
+ * @param line The command line to parse; NULL to continue with the previous line.
+ * @param job_type Pointer (1 for foreground store, 0 for background store).
+ * @return Command line's following job; NULL if there are no more jobs.
+ */
+char *parse_tok(char *line, int *job_type) {
+    static char *current;
+    return parse_tok_r(line, job_type, &current);
+}
+
+/**
+ * Separate the arguments of a command and store them in an array. The array
+ * and the argument strings share a single allocation: the pointers come
+ * first, sized for the most arguments the line could hold, and the
+ * arguments are copied after them in one pass over the line. Freeing the
+ * array frees everything, and the line itself is left unchanged.
  *
  * @param line The command line that we are going to separate.
  * @param argc Stores the number of arguments produced.
@@ -107,132 +173,356 @@ char *parse_tok(char *line, int *job_type) {
  * @return An array of strings representing the command arguments; NULL if no arguments.
  */
 char **separate_args(char *line, int *argc,bool* is_builtin) {
-    if (*line == '\0' || line == NULL) {
+    if (line == NULL || *line == '\0') {
         *argc = 0;
         return NULL;
     }
 
-    // Temporary copy of line to use with strtok
-    char *line_copy = strdup(line);
-    if (!line_copy) {
-        perror("Failed to duplicate line for argument separation");
+    // Arguments are separated by at least one blank, so a line of len bytes has at most (len + 1) / 2
+    size_t len = strlen(line);
+    size_t max_args = (len + 1) / 2;
+    char **argv = (char **)malloc((max_args + 1) * sizeof(char *) + len + 1);
+    if (!argv) {
+        perror("Failed to allocate memory for argument array");
         exit(EXIT_FAILURE);
     }
 
+    char *arena = (char *)(argv + max_args + 1);
     int count = 0;
-    char *temp = strtok(line_copy, " \t\n");
-    while (temp != NULL) {
-        temp = strtok(NULL, " \t\n");
-        count++;
+    const char *p = line;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == '\n') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        argv[count++] = arena;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\n') {
+            *arena++ = *p++;
+        }
+        *arena++ = '\0';
+    }
+    argv[count] = NULL;
+    *argc = count;
+    if (is_builtin != NULL) {
+        *is_builtin = count > 0 && find_builtin(argv[0]) != NULL;
     }
+    return argv;
+}
 
-    // Allocate memory for the argument array
-    char **argv = (char **)malloc((count + 1) * sizeof(char *));
-    if (!argv) {
-        perror("Failed to allocate memory for argument array");
-        exit(EXIT_FAILURE);
+/**
+ * Waits for a foreground process to complete.
+ *
+ * @param shell A pointer to the shell instance.
+ */
+void waitfg(msh_t *shell){
+    while(shell->curr_foreground_pid!=0){
+        wait_for_signals(shell);
     }
+}
 
-    // Reset line_copy for actual tokenization
-    free(line_copy);
-    line_copy = strdup(line);
-    if (!line_copy) {
-        perror("Failed to duplicate lines for argument separation");
-        exit(EXIT_FAILURE);
+/**
+ * Reads the clocks as a command starts.
+ *
+ * @param shell The current shell state.
+ * @param clock Receives the clocks.
+ */
+static void start_clock(msh_t *shell, command_clock_t *clock){
+    clock_gettime(CLOCK_REALTIME,&clock->started);
+    clock_gettime(CLOCK_MONOTONIC,&clock->monotonic);
+    getrusage(RUSAGE_SELF,&clock->self);
+    timerclear(&shell->fg_user_time);
+    timerclear(&shell->fg_sys_time);
+}
+
+/**
+ * Gives the history the timing of the command added last. Its CPU time is
+ * the shell's own (which is all a builtin uses) plus that of the foreground
+ * processes reaped while it ran.
+ *
+ * @param shell The current shell state.
+ * @param clock The clocks read when the command started.
+ * @param background True if the command was started as a background job; only its start is known.
+ */
+static void stop_clock(msh_t *shell, const command_clock_t *clock, bool background){
+    struct timespec now;
+    struct rusage self;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    getrusage(RUSAGE_SELF,&self);
+    struct timeval user;
+    struct timeval sys;
+    timersub(&self.ru_utime,&clock->self.ru_utime,&user);
+    timersub(&self.ru_stime,&clock->self.ru_stime,&sys);
+    timeradd(&user,&shell->fg_user_time,&user);
+    timeradd(&sys,&shell->fg_sys_time,&sys);
+
+    history_timing_t timing;
+    timing.start_us=clock->started.tv_sec*1000000LL+clock->started.tv_nsec/1000;
+    timing.wall_us=background?-1:(now.tv_sec-clock->monotonic.tv_sec)*1000000LL+(now.tv_nsec-clock->monotonic.tv_nsec)/1000;
+    timing.user_us=background?0:user.tv_sec*1000000LL+user.tv_usec;
+    timing.sys_us=background?0:sys.tv_sec*1000000LL+sys.tv_usec;
+    timing.status=background?0:shell->last_status;
+    time_line_history(shell->history,&timing);
+}
+
+/**
+ * Checks whether a pipeline is the exit command, and if so sets the exit
+ * status the shell leaves with from its argument.
+ *
+ * @param shell The current shell state.
+ * @param pipeline The pipeline.
+ * @return True if it is a single command named exit.
+ */
+static bool is_exit(msh_t *shell, const pipeline_t *pipeline){
+    const command_t *command=pipeline->commands;
+    if(pipeline->num_commands!=1||command->argc==0||strcmp(command->argv[0],"exit")!=0){
+        return false;
     }
+    shell->last_status=argument_status(shell,command);
+    return true;
+}
 
-    int i = 0;
-    temp = strtok(line_copy, " \t\n");
-    while (temp != NULL) {
-        argv[i++] = strdup(temp);
-        temp = strtok(NULL, " \t\n");
+/**
+ * Runs the pipelines of an and-or list in the foreground. A pipeline after
+ * && only runs if the exit status so far is 0, and one after || only if it
+ * is not.
+ *
+ * @param shell The current shell state.
+ * @param list The and-or list.
+ * @return -1 if the list ran exit (or called a function that did); otherwise, 0.
+ */
+static int run_and_or(msh_t *shell, const and_or_t *list){
+    for(const pipeline_t *pipeline=list->pipelines;pipeline!=NULL;pipeline=pipeline->next){
+        if((pipeline->connector==CONNECT_AND&&shell->last_status!=0)||
+           (pipeline->connector==CONNECT_OR&&shell->last_status==0)){
+            continue;
+        }
+        if(is_exit(shell,pipeline)){
+            return -1;
+        }
+        run_pipeline(shell,pipeline,list->text,FOREGROUND);
+        if(shell->exiting){
+            return -1;
+        }
     }
-    argv[i] = NULL;
-    *argc = count;
+    return 0;
+}
 
-    free(line_copy);
-    return argv;
+/**
+ * The body of a background subshell: runs subshell_list in the forked copy of
+ * the shell, which waits for each of its pipelines in turn. A held subshell
+ * first waits for RELEASE_SIGNAL, which it was forked with blocked.
+ *
+ * @return The exit status of the list.
+ */
+static int run_subshell(msh_t *shell, int argc, char **argv){
+    if(subshell_held){
+        sigset_t release;
+        sigemptyset(&release);
+        sigaddset(&release,RELEASE_SIGNAL);
+        int sig;
+        sigwait(&release,&sig);
+        sigprocmask(SIG_SETMASK,&shell->child_mask,NULL);
+    }
+    if(subshell_list->program!=NULL){
+        run_program(shell,subshell_list->program,0);
+    }
+    else{
+        run_and_or(shell,subshell_list);
+    }
+    return shell->last_status;
 }
 
 /**
- * Determine if a given command is a built-in shell operation and set appropriate command type and parameters.
+ * Forks the copy of the shell that runs an and-or list in the background, in
+ * a process group of its own. A held copy does not run the list until
+ * release_subshell; as it is forked now, it still sees the variables as they
+ * are now.
  *
- * @param shell A pointer to the shell instance, which contains job lists and history for the session.
- * @param argv An array of strings representing the parsed command line arguments.
- * @param argc The number of arguments in argv.
- * @param cmd_type A pointer to an integer to set the command type (1 for 'jobs', 2 for 'history', 3 for 'history' invocation with '!number', 4 for 'bg', 5 for 'fg', 6 for 'kill').
- * @param history_to_evaluate A pointer to a string. 
- * @param pid_to_update A pointer to a PID (Process ID).
- * @param sig_num A pointer to an integer to store the signal number when the 'kill' command is used.
- * @param pid_to_kill A pointer to a PID (Process ID) to be killed when the 'kill' command is used.
- * @return True if the command is a built-in shell operation and was successfully identified; False otherwise.
+ * @param shell The current shell state.
+ * @param list The and-or list.
+ * @param held True to have the subshell wait for release_subshell.
+ * @return The process ID of the subshell; -1 if fork failed.
  */
-bool is_builtin(msh_t *shell,char** argv,int argc,int* cmd_type,char** history_to_evaluate,pid_t* pid_to_update,int* sig_num,pid_t* pid_to_kill){
-    if(argc==1&&strcmp(argv[0],"jobs")==0){
-        *cmd_type=1;
-        return true;
-    }
-    else if(argc==1&&strcmp(argv[0],"history")==0){
-        *cmd_type=2;
-        return true;
-    }
-    else if(argc==1&&argv[0][0]=='!'){
-        int index=atoi(&argv[0][1]);
-        *history_to_evaluate=find_line_history(shell->history,index);
-        if(*history_to_evaluate!=NULL){
-            *cmd_type=3;
-            return true;
-        }
+pid_t fork_subshell(msh_t *shell, const and_or_t *list, bool held){
+    // The subshell must not inherit (and later repeat) output the shell has not written yet
+    fflush(stdout);
+    subshell_list=list;
+    subshell_held=held;
+    sigset_t mask=shell->child_mask;
+    sigset_t release;
+    sigset_t saved;
+    sigemptyset(&release);
+    sigaddset(&release,RELEASE_SIGNAL);
+    if(held){
+        // Blocked from the fork on, so a release sent before the subshell waits is not lost
+        sigaddset(&mask,RELEASE_SIGNAL);
+        sigprocmask(SIG_BLOCK,&release,&saved);
+    }
+    char *argv[]={list->text,NULL};
+    pid_t pid=fork_builtin(run_subshell,shell,1,argv,NULL,&mask,0,-1,-1);
+    if(held){
+        sigprocmask(SIG_SETMASK,&saved,NULL);
+    }
+    return pid;
+}
+
+/**
+ * Lets a subshell forked held by fork_subshell run its list.
+ *
+ * @param pid The process ID of the subshell.
+ * @return True if the subshell was released; false if it is gone.
+ */
+bool release_subshell(pid_t pid){
+    return kill(pid,RELEASE_SIGNAL)==0;
+}
+
+/**
+ * Starts an and-or list as a background job. A single pipeline is launched
+ * directly; a list of several, or a compound command, runs in a forked copy
+ * of the shell, which is the job.
+ *
+ * @param shell The current shell state.
+ * @param list The and-or list.
+ */
+void launch_background(msh_t *shell, const and_or_t *list){
+    if(list->num_pipelines==1&&list->program==NULL){
+        run_pipeline(shell,list->pipelines,list->text,BACKGROUND);
+        return;
+    }
+    if(jobs_full(shell->jobs)){
+        shell->last_status=1;
+        return;
+    }
+    pid_t pid=fork_subshell(shell,list,false);
+    if(pid==-1){
+        shell->last_status=127;
+        return;
     }
-    else if(argc==2&&(strcmp(argv[0],"bg")==0||strcmp(argv[0],"fg")==0)){
-        char* token=argv[1];
+    add_job(shell->jobs,pid,BACKGROUND,list->text);
+    shell->last_status=0;
+    shell->last_background_pid=pid;
+}
 
-        if(token[0]=='%'){
-            int job_id=atoi(token+1);
-            if((*pid_to_update=get_pid_by_job_id(shell->jobs,shell->max_jobs,job_id))!=-1){
-                *cmd_type=strcmp(argv[0],"bg")==0?4:5;
-                return true;
-            }
+/**
+ * Runs and-or lists in the shell, without recording them in the history.
+ *
+ * @param shell The current shell state.
+ * @param lists The lists.
+ * @return -1 if a list ran exit; otherwise, 0.
+ */
+int run_lists(msh_t *shell, const and_or_t *lists){
+    for(const and_or_t *list=lists;list!=NULL;list=list->next){
+        int result=0;
+        if(list->job_type==BACKGROUND){
+            launch_background(shell,list);
+        }
+        else if(list->program!=NULL){
+            result=run_program(shell,list->program,0);
         }
         else{
-            *pid_to_update=atoi(token);
-            int job_id=get_job_id_by_pid(shell->jobs,shell->max_jobs,*pid_to_update);
-            if(job_id!=0){
-                *cmd_type=strcmp(argv[0],"bg")==0?4:5;
-                return true;
-            }
+            result=run_and_or(shell,list);
+        }
+        if(result!=0){
+            return result;
         }
     }
-    else if(argc==3&&strcmp(argv[0],"kill")==0){
-        *sig_num=atoi(argv[1]);
-        *pid_to_kill=atoi(argv[2]);
-        if(*sig_num!=2&&*sig_num!=9&&*sig_num!=18&&*sig_num!=19){
-            printf("error: invalid signal number\n");
-            return false;
+    return 0;
+}
+
+/**
+ * Runs one and-or list of a parsed line: records it in the history, runs it
+ * (or queues it, in the background) and times it. Only running it is left
+ * when the shell does not record its history. A list with compound commands
+ * runs its bytecode, in the shell unless it is sent to the background.
+ *
+ * @param shell The current shell state.
+ * @param list The and-or list.
+ * @return -1 if the list ran exit; otherwise, 0.
+ */
+static int execute_list(msh_t *shell, const and_or_t *list){
+    const pipeline_t *first=list->pipelines;
+    bool compiled=list->program!=NULL;
+    if(!compiled&&is_exit(shell,first)){
+        return -1;
+    }
+    const command_t *command=first->commands;
+    const builtin_t *builtin=first->num_commands==1&&!compiled?command->builtin:NULL;
+    // Builtins always run in the shell, in the foreground
+    bool in_shell=list->num_pipelines==1&&builtin!=NULL&&!(builtin->flags&BUILTIN_STAGE_ONLY);
+    bool background=list->job_type==BACKGROUND&&!in_shell;
+    int result=0;
+    // Scripts are not recorded (or timed) unless asked to be
+    bool record=shell->record_history;
+    command_clock_t clock;
+    if(record){
+        start_clock(shell,&clock);
+    }
+    if(background&&queue_job(shell,list)){
+        // Background jobs past the parallelism cap wait in the job queue
+        if(record){
+            add_line_history(shell->history,list->text);
         }
-        *cmd_type=6;
-        return true;
     }
     else{
-        return false;
+        // Re-executed history lines are recorded by the evaluation they trigger
+        if(record&&!(in_shell&&command->argv[0][0]=='!')){
+            add_line_history(shell->history,list->text);
+        }
+        if(background){
+            launch_background(shell,list);
+        }
+        else if(compiled){
+            result=run_program(shell,list->program,0);
+        }
+        else{
+            result=run_and_or(shell,list);
+        }
+    }
+    if(record){
+        stop_clock(shell,&clock,background);
     }
+    return result;
 }
 
 /**
- * Waits for a foreground process to complete.
+ * Parses and runs a command line.
  *
- * @param shell A pointer to the shell instance.
+ * @param shell The current shell state.
+ * @param line The command line string that we are going to evaluate.
+ * @param partial True if more input may still complete the line.
+ * @return EVALUATE_INCOMPLETE if partial is set and the line is incomplete; otherwise, as evaluate.
  */
-void waitfg(msh_t *shell){
-    sigset_t empty_signal_set;
-    sigemptyset(&empty_signal_set);
-    while(shell->curr_foreground_pid!=0){
-        sigsuspend(&empty_signal_set);
+static int evaluate_line(msh_t *shell, char *line, bool partial) {
+    // Lines are only limited in length when -l asks for it
+    if (!line || (shell->max_line > 0 && strlen(line) > (size_t)shell->max_line)) {
+        printf("error: reached the maximum line limit\n");
+        return -1;
+    }
+    parse_tree_t *tree;
+    const char *error;
+    int parsed = acquire_parse_tree(shell->parse_cache, line, &tree, &error);
+    if (parsed == PARSE_INCOMPLETE && partial) {
+        return EVALUATE_INCOMPLETE;
+    }
+    if (parsed != PARSE_OK) {
+        printf("error: %s\n", error);
+        shell->last_status = 2;
+        return 0;
+    }
+    int result = 0;
+    for (const and_or_t *list = tree->lists; list != NULL && result == 0; list = list->next) {
+        result = execute_list(shell, list);
     }
+    release_parse_tree(tree);
+    return result;
 }
 
 /**
- * Evaluate the command line string provided.
+ * Evaluate the command line string provided. The line is parsed as a whole
+ * first, so a syntax error anywhere runs none of it. Lines run before (from
+ * the history or a loop) reuse their tree from the parse cache.
  *
  * @param shell The current shell state.
  * @param line The command line string that we are going to evaluate.
@@ -240,119 +530,19 @@ void waitfg(msh_t *shell){
  *         0 to indicate that the shell should continue running.
  */
 int evaluate(msh_t *shell, char *line) {
-    if (!line || strlen(line) > shell->max_line) {
-        printf("error: reached the maximum line limit\n");
-        return -1;
-    }
-    //printf("*****\n");
-    int job_type;
-    char *job = parse_tok(line, &job_type);
-    while (job != NULL) {
-        if(strstr(job,"exit")!=0){
-            return -1;
-        }
-        int argc;
-        char **argv = separate_args(job, &argc,NULL);
-        if (argv != NULL) {
-            if(jobs_full(shell->jobs,shell->max_jobs)){
-                printf("error: reached the maximum jobs limit\n");
-                free(argv); // Assuming argv was dynamically allocated
-                job = parse_tok(NULL, &job_type);
-                continue;
-            }
-            int cmd_type;
-            char* history_to_evaluate;
-            pid_t pid_to_update;
-            int sig_num;
-            pid_t pid_to_kill;
-            if(is_builtin(shell,argv,argc,&cmd_type,&history_to_evaluate,&pid_to_update,&sig_num,&pid_to_kill)){
-                if(cmd_type!=3){
-                    add_line_history(shell->history,job);
-                }
-                if(cmd_type==1){
-
-                    for(int i=0;i<shell->max_jobs;i++){
-                        job_t* j=&(shell->jobs[i]);
-                        if(j->cmd_line!=NULL&&j->pid!=0){
-                            printf("[%d] %d %s %s\n",j->jid,j->pid,j->state==SUSPENDED?"Stopped":"RUNNING",j->cmd_line);
-                        }
-                    }
-                }
-                else if(cmd_type==2){
-
-                    print_history(shell->history);
-                }
-                else if(cmd_type==3){
-                    printf("%s\n",history_to_evaluate);
-                    evaluate(shell,history_to_evaluate);
-                }
-                else if(cmd_type==4){
-                    update_job_state(shell->jobs,shell->max_jobs,pid_to_update,BACKGROUND);
-                    kill(-pid_to_update,SIGCONT);
-                }
-                else if(cmd_type==5){
-                    update_job_state(shell->jobs,shell->max_jobs,pid_to_update,FOREGROUND);
-                    kill(-pid_to_update,SIGCONT);
-                }
-                else if(cmd_type==6){
-                    if(sig_num==2){
-                        kill(-pid_to_kill,SIGINT);
-                    }
-                    else if(sig_num==9){
-                        kill(-pid_to_kill,SIGKILL);
-                    }
-                    else if(sig_num==18){
-                        kill(-pid_to_kill,SIGCONT);
-                    }
-                    else{
-                        kill(-pid_to_kill,SIGSTOP);
-                    }
-                }
-            }
-            else{
-                add_line_history(shell->history,job);
-                sigset_t signal_set1;
-                sigset_t prev_signal_set1;
-                sigset_t signal_set2;
-                sigset_t prev_signal_set2;
-                sigfillset(&signal_set2);
-                sigemptyset(&signal_set1);
-                sigaddset(&signal_set1,SIGCHLD);
-                sigprocmask(SIG_BLOCK,&signal_set1,&prev_signal_set1);
-
-                pid_t pid = fork();
-                if (pid == -1) {
-                    // Fork failed
-                    perror("fork");
-                    return -1;
-                }
-
-                else if (pid == 0) {
-                    // Child process
-                    sigprocmask(SIG_SETMASK,&prev_signal_set1,NULL);
-                    setpgid(0,0);
-                    if (execve(argv[0], argv, NULL) == -1) {
-                        perror("execve");
-                        exit(EXIT_FAILURE);
-                    }
-                    exit(EXIT_SUCCESS);
-                } else {
-                    // Parent process
-                    sigprocmask(SIG_BLOCK,&signal_set2,&prev_signal_set2);
-                    add_job(shell->jobs,shell->max_jobs,pid,job_type,job);
-                    if (job_type == FOREGROUND) {
-                        // For foreground jobs, wait for the job to complete
-                        shell->curr_foreground_pid=pid;
-                        waitfg(shell);
-                    }
-                    sigprocmask(SIG_SETMASK,&prev_signal_set1,NULL);
-                }
-            }
-        }
-        free(argv); // Assuming argv was dynamically allocated
-        job = parse_tok(NULL, &job_type);
-    }
-    return 0;
+    return evaluate_line(shell, line, false);
+}
+
+/**
+ * Evaluate a command line that the next line of input may still complete.
+ *
+ * @param shell The current shell state.
+ * @param line The command line string that we are going to evaluate.
+ * @return EVALUATE_INCOMPLETE, without running or reporting anything, if the line ends inside a
+ *         quote, after a backslash or after an operator that needs another command; otherwise, as evaluate.
+ */
+int evaluate_partial(msh_t *shell, char *line) {
+    return evaluate_line(shell, line, true);
 }
 
 /**
@@ -361,16 +551,21 @@ int evaluate(msh_t *shell, char *line) {
  * @param shell The current shell state value; If NULL, the function performs no operation.
  */
 void exit_shell(msh_t *shell) {
-int status;
-    while(has_background_job(shell->jobs,shell->max_jobs)){
-        pid_t term_pid = wait(&status);
-        if (term_pid > 0) {
-            // Remove the completed background job from the jobs array here
-            delete_job(shell->jobs,shell->max_jobs,term_pid);
-        }
-    }
     if (shell != NULL) {
-        free_jobs(shell->jobs, shell->max_jobs); // Ensure jobs are freed
+        // Queued jobs still run: they start as the running ones finish
+        while (shell->queue->count > 0 || has_background_job(shell->jobs)) {
+            wait_for_signals(shell);
+        }
+        free_jobs(shell->jobs); // Ensure jobs are freed
+        free_job_queue(shell->queue);
+        free_history(shell->history);
+        free_path_cache(shell->path_cache);
+        free_functions(shell->functions);
+        free_variables(shell->variables);
+        free_expand_stack(&shell->expand_stack);
+        free_fd_stack(&shell->fd_stack);
+        free_parse_cache(shell->parse_cache);
+        free_event_loop(shell);
         free(shell);
     }
 }
@@ -7,121 +7,135 @@
 #include <errno.h>
 #include <stdio.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
 #include"job.h"
 #include"shell.h"
 
 /*
-* sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
-*     a child job terminates (becomes a zombie), or stops because it
-*     received a SIGSTOP or SIGTSTP signal. The handler reaps all
-*     available zombie children, but doesn't wait for any other
-*     currently running children to terminate.
+* reap_children - Reaps every child that has terminated, stopped or
+*     continued, updating the job table for each one. Called from the event
+*     loop after the signalfd reports SIGCHLD; since several SIGCHLDs
+*     coalesce into one, it loops until wait4 has nothing left to report.
+*     The CPU time wait4 reports for foreground processes is added up for
+*     the history.
 * Citation: Bryant and O’Hallaron, Computer Systems: A Programmer’s Perspective, Third Edition
 */
-void sigchld_handler(int sig)
+static void reap_children(msh_t *shell)
 {
-    int last_errno=errno;
-    sigset_t signal_set;
-    sigset_t old_signal_set;
     int status;
-    pid_t pid=waitpid(-1,&status,WNOHANG|WUNTRACED|WCONTINUED);
-    if(pid>0){
-        sigprocmask(SIG_BLOCK,&signal_set,&old_signal_set);
+    pid_t pid;
+    struct rusage usage;
+    while((pid=wait4(-1,&status,WNOHANG|WUNTRACED|WCONTINUED,&usage))>0){
+        // Jobs are tracked by process group; pid may be any stage of a pipeline
+        pid_t pgid=get_pgid_by_pid(shell->jobs,pid);
+        int jid=get_job_id_by_pid(shell->jobs,pid);
+        if((WIFSIGNALED(status)||WIFEXITED(status))&&jid!=0&&shell->jobs->slots[jid-1].state==FOREGROUND){
+            // The CPU time of the command being timed
+            timeradd(&shell->fg_user_time,&usage.ru_utime,&shell->fg_user_time);
+            timeradd(&shell->fg_sys_time,&usage.ru_stime,&shell->fg_sys_time);
+        }
         if(WIFSTOPPED(status)){
-            update_job_state(shell->jobs,shell->max_jobs,pid,SUSPENDED);
-            sigprocmask(SIG_SETMASK,&old_signal_set,NULL);
-            if(pid==shell->curr_foreground_pid){
+            if(pid==shell->status_pid){
+                shell->last_status=128+WSTOPSIG(status);
+            }
+            update_job_state(shell->jobs,pid,SUSPENDED);
+            if(pgid==shell->curr_foreground_pid){
                 shell->curr_foreground_pid=0;
             }
         }
-        else if(WIFSIGNALED(status)){
-            delete_job(shell->jobs,shell->max_jobs,pid);
-            sigprocmask(SIG_SETMASK,&old_signal_set,NULL);
-            if(pid==shell->curr_foreground_pid){
+        else if(WIFSIGNALED(status)||WIFEXITED(status)){
+            if(pid==shell->status_pid){
+                shell->last_status=WIFEXITED(status)?WEXITSTATUS(status):128+WTERMSIG(status);
+            }
+            pgid=delete_job_process(shell->jobs,pid);
+            if(pgid>0&&pgid==shell->curr_foreground_pid){
                 shell->curr_foreground_pid=0;
             }
+            if(jid==0){
+                // A held subshell of the job queue that was killed before it could start
+                forget_queued_job(shell->queue,pid);
+            }
         }
         else if(WIFCONTINUED(status)){
-            shell->curr_foreground_pid=pid;
-            update_job_state(shell->jobs,shell->max_jobs,pid,FOREGROUND);
-            sigprocmask(SIG_SETMASK,&old_signal_set,NULL);
+            shell->curr_foreground_pid=pgid;
+            update_job_state(shell->jobs,pid,FOREGROUND);
         }
-        else if(WIFEXITED(status)){
-            delete_job(shell->jobs,shell->max_jobs,pid);
-            sigprocmask(SIG_SETMASK,&old_signal_set,NULL);
-            if(pid==shell->curr_foreground_pid){
-                shell->curr_foreground_pid=0;
-            }
+        // Builtins that manage their own children (e.g., parallel) watch their statuses here
+        if(shell->child_hook!=NULL){
+            shell->child_hook(shell,pid,status);
         }
     }
-
 }
 
 /*
-* sigint_handler - The kernel sends a SIGINT to the shell whenver the
-*    user types ctrl-c at the keyboard.  Catch it and send it along
-*    to the foreground job.
+* forward_signal - The kernel sends a SIGINT (ctrl-c) or SIGTSTP (ctrl-z)
+*    to the shell whenever the user types it at the keyboard. Send it
+*    along to the foreground job, or to every job in the FOREGROUND state
+*    when several run at once (e.g., the items of parallel). Without any
+*    the signal takes its default action on the shell's own process group.
 * Citation: Bryant and O’Hallaron, Computer Systems: A Programmer’s Perspective, Third Edition
 */
-void sigint_handler(int sig)
+static void forward_signal(msh_t *shell, int sig)
 {
-    if(shell->curr_foreground_pid==0){
-        pid_t pid=getpid();
-        signal(SIGINT,SIG_DFL);
-        kill(-pid,SIGINT);
+    if(shell->curr_foreground_pid==0&&count_jobs(shell->jobs,FOREGROUND)>0){
+        for(int i=0;i<shell->jobs->capacity;i++){
+            job_t *job=&shell->jobs->slots[i];
+            if(job->pid!=0&&job->state==FOREGROUND){
+                kill(-job->pid,sig);
+            }
+        }
+    }
+    else if(shell->curr_foreground_pid==0){
+        sigset_t signal_set;
+        sigemptyset(&signal_set);
+        sigaddset(&signal_set,sig);
+        signal(sig,SIG_DFL);
+        sigprocmask(SIG_UNBLOCK,&signal_set,NULL);
+        kill(-getpid(),sig);
+        // Only reached after ctrl-z: the shell was stopped and has been continued
+        sigprocmask(SIG_BLOCK,&signal_set,NULL);
     }
     else{
-        kill(-shell->curr_foreground_pid,SIGINT);
+        kill(-shell->curr_foreground_pid,sig);
     }
 }
 
 /*
-* sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
-*     the user types ctrl-z at the keyboard. Catch it and suspend the
-*     foreground job by sending it a SIGTSTP.
-* Citation: Bryant and O’Hallaron, Computer Systems: A Programmer’s Perspective, Third Edition
+* handle_signals - Drains the signalfd, forwards keyboard signals,
+*     reaps children and starts queued jobs in the slots they free. Reaping runs even without a SIGCHLD record, since it
+*     costs a single waitpid when nothing is pending.
 */
-void sigtstp_handler(int sig)
+void handle_signals(msh_t *shell)
 {
-    if(shell->curr_foreground_pid==0){
-        pid_t pid=getpid();
-        signal(SIGINT,SIG_DFL);
-        kill(-pid,SIGTSTP);
-    }
-    else{
-        kill(-shell->curr_foreground_pid,SIGTSTP);
+    struct signalfd_siginfo info[16];
+    ssize_t n;
+    while((n=read(shell->signal_fd,info,sizeof(info)))>0){
+        for(size_t i=0;i<n/sizeof(info[0]);i++){
+            if(info[i].ssi_signo==SIGINT||info[i].ssi_signo==SIGTSTP){
+                forward_signal(shell,info[i].ssi_signo);
+            }
+        }
     }
-
+    reap_children(shell);
+    // Slots freed by the children just reaped go to queued jobs
+    dispatch_jobs(shell);
 }
 
-/*
-* setup_handler - wrapper for the sigaction function
-*
-* Citation: Bryant and O’Hallaron, Computer Systems: A Programmer’s Perspective, Third Edition
-*/
-typedef void handler_t(int);
-handler_t *setup_handler(int signum, handler_t *handler)
-{
-    struct sigaction action, old_action;
-
-    action.sa_handler = handler;
-    sigemptyset(&action.sa_mask); /* block sigs of type being handled */
-    action.sa_flags = SA_RESTART; /* restart syscalls if possible */
-
-    if (sigaction(signum, &action, &old_action) < 0) {
-        perror("Signal error");
+int initialize_signal_handlers(sigset_t *child_mask) {
+    sigset_t signal_set;
+    sigemptyset(&signal_set);
+    // SIGINT: ctrl-c, SIGTSTP: ctrl-z, SIGCHLD: terminated or stopped child
+    sigaddset(&signal_set,SIGINT);
+    sigaddset(&signal_set,SIGTSTP);
+    sigaddset(&signal_set,SIGCHLD);
+    if(sigprocmask(SIG_BLOCK,&signal_set,child_mask)<0){
+        perror("sigprocmask");
         exit(1);
     }
-    return (old_action.sa_handler);
-}
-
-
-void initialize_signal_handlers() {
-
-    // sigint handler: Catches SIGINT (ctrl-c) signals.
-    setup_handler(SIGINT,  sigint_handler);   /* ctrl-c */
-    // sigtstp handler: Catches SIGTSTP (ctrl-z) signals.
-    setup_handler(SIGTSTP, sigtstp_handler);  /* ctrl-z */
-    // sigchld handler: Catches SIGCHILD signals.
-    setup_handler(SIGCHLD, sigchld_handler);  /* Terminated or stopped child */
+    int signal_fd=signalfd(-1,&signal_set,SFD_NONBLOCK|SFD_CLOEXEC);
+    if(signal_fd<0){
+        perror("signalfd");
+    }
+    return signal_fd;
 }
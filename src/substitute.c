@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include "../include/substitute.h"
+#include "../include/builtins.h"
+#include "../include/compile.h"
+#include "../include/launch.h"
+#include "../include/vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+//The pipe is read this many bytes at a time at first; reads double while they fill up, to this many
+#define FIRST_READ_SIZE 4096
+#define MAX_READ_SIZE (1<<20)
+
+//The lists a forked copy of the shell runs; set just before it is forked
+static const and_or_t *substitution_lists;
+
+/**
+ * Checks whether expanding a word assigns a variable, with ${NAME=WORD}.
+ *
+ * @param word The expansions of the word; NULL for a plain word.
+ * @return True if it may assign one.
+ */
+static bool assigns(const word_t *word){
+    for(const expansion_t *expansion=word!=NULL?word->expansions:NULL;expansion!=NULL;expansion=expansion->next){
+        if(expansion->op=='='||assigns(expansion->word)){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Checks whether the lists of a command substitution may run in the shell
+ * itself: they are only builtins that change nothing but what they write,
+ * so a subshell would not keep anything they do anyway.
+ *
+ * @param shell The current shell state.
+ * @param lists The lists.
+ * @return True if no subshell is needed.
+ */
+static bool runs_in_shell(msh_t *shell, const and_or_t *lists){
+    for(const and_or_t *list=lists;list!=NULL;list=list->next){
+        if(list->job_type!=FOREGROUND||list->program!=NULL){
+            return false;
+        }
+        for(const pipeline_t *pipeline=list->pipelines;pipeline!=NULL;pipeline=pipeline->next){
+            const command_t *command=pipeline->commands;
+            if(pipeline->num_commands!=1||command->argc==0||command->assignments!=NULL||command->redirects!=NULL||
+               (command->expand!=NULL&&command->expand[0]!=NULL)){
+                return false;
+            }
+            // The builtin is the one the parse cache found; without one, the command would run as a program
+            const builtin_t *builtin=command->builtin;
+            if(builtin==NULL||!(builtin->flags&BUILTIN_OUTPUT_ONLY)||find_function(shell->functions,command->argv[0])!=NULL){
+                return false;
+            }
+            for(int i=1;command->expand!=NULL&&i<command->argc;i++){
+                if(assigns(command->expand[i])){
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * The body of the forked copy of the shell: runs substitution_lists with
+ * standard output on the pipe.
+ *
+ * @return The exit status of the lists.
+ */
+static int run_substitution(msh_t *shell, int argc, char **argv){
+    // The output goes to the pipe, even if the shell was capturing it for a substitution of its own
+    out_capture(NULL);
+    run_lists(shell,substitution_lists);
+    return shell->last_status;
+}
+
+/**
+ * Reads the output of a forked substitution into a capture until the end of
+ * the pipe. Signals are handled meanwhile, so ctrl-c reaches the substitution
+ * and children are reaped as they finish.
+ *
+ * @param shell The current shell state.
+ * @param fd The end of the pipe to read.
+ * @param capture Where the output goes.
+ */
+static void read_output(msh_t *shell, int fd, const capture_t *capture){
+    // A forked copy of the shell has no signalfd; poll passes over it then
+    struct pollfd fds[2]={{.fd=fd,.events=POLLIN},{.fd=shell->signal_fd,.events=POLLIN}};
+    size_t size=FIRST_READ_SIZE;
+    while(true){
+        if(poll(fds,2,-1)<0){
+            if(errno==EINTR){
+                continue;
+            }
+            break;
+        }
+        if(fds[1].revents&POLLIN){
+            handle_signals(shell);
+        }
+        if(fds[0].revents==0){
+            continue;
+        }
+        ssize_t n=read(fd,capture->reserve(capture->context,size),size);
+        if(n<0&&errno==EINTR){
+            continue;
+        }
+        if(n<=0){
+            break;
+        }
+        capture->commit(capture->context,n);
+        if((size_t)n==size&&size<MAX_READ_SIZE){
+            size*=2;
+        }
+    }
+}
+
+/**
+ * Runs a command substitution and captures its output.
+ *
+ * @param shell The current shell state.
+ * @param expansion The command substitution.
+ * @param capture Where the output goes.
+ */
+void substitute(msh_t *shell, const expansion_t *expansion, const capture_t *capture){
+    shell->num_substitutions++;
+    and_or_t *lists=expansion->lists;
+    if(lists==NULL){
+        shell->last_status=0;
+        return;
+    }
+    // Lists with compound commands are compiled the first time they run
+    for(and_or_t *list=lists;list!=NULL;list=list->next){
+        if(list->program==NULL&&needs_program(list)){
+            compile_list(expansion->tree,list);
+        }
+    }
+    if(runs_in_shell(shell,lists)){
+        const capture_t *outer=out_capture(capture);
+        run_lists(shell,lists);
+        out_capture(outer);
+        return;
+    }
+    if(jobs_full(shell->jobs)){
+        shell->last_status=1;
+        return;
+    }
+    int fds[2];
+    if(pipe2(fds,O_CLOEXEC)==-1){
+        perror("pipe2");
+        shell->last_status=1;
+        return;
+    }
+    // The child must not inherit (and later repeat) output the shell has not written yet
+    out_flush();
+    fflush(stdout);
+    substitution_lists=lists;
+    char *argv[]={lists->text,NULL};
+    pid_t pid=fork_builtin(run_substitution,shell,1,argv,NULL,&shell->child_mask,0,-1,fds[1]);
+    close(fds[1]);
+    if(pid==-1){
+        close(fds[0]);
+        shell->last_status=127;
+        return;
+    }
+    // The substitution is a foreground job while it runs: ctrl-c goes to it, and it is reaped with the others
+    add_job(shell->jobs,pid,FOREGROUND,lists->text);
+    shell->status_pid=pid;
+    shell->curr_foreground_pid=pid;
+    read_output(shell,fds[0],capture);
+    close(fds[0]);
+    waitfg(shell);
+}
@@ -0,0 +1,405 @@
+#include "../include/variables.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_BUCKETS 64
+
+//The symbols of every name interned so far: a hash table, and each symbol by its id
+static struct {
+    symbol_t **buckets;
+    int num_buckets;
+    symbol_t **by_id;
+    int count;
+} symbols;
+
+//The symbol of PATH, which is kept in the process environment as well
+static const symbol_t *path_symbol;
+
+/**
+ * Computes the FNV-1a hash of a name.
+ *
+ * @param name The name to hash.
+ * @param len The length of the name.
+ * @return The 32-bit hash value.
+ */
+static uint32_t hash_name(const char *name, size_t len){
+    uint32_t hash=2166136261u;
+    for(size_t i=0;i<len;i++){
+        hash^=(unsigned char)name[i];
+        hash*=16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Doubles the number of buckets of the symbol table and rehashes every symbol.
+ */
+static void grow_symbols(){
+    int num_buckets=symbols.num_buckets*2;
+    symbol_t **buckets=calloc(num_buckets,sizeof(symbol_t*));
+    symbol_t **by_id=realloc(symbols.by_id,sizeof(symbol_t*)*num_buckets);
+    if(buckets==NULL||by_id==NULL){
+        perror("Failed to allocate memory for symbols");
+        exit(EXIT_FAILURE);
+    }
+    symbols.by_id=by_id;
+    for(int i=0;i<symbols.num_buckets;i++){
+        symbol_t *symbol=symbols.buckets[i];
+        while(symbol!=NULL){
+            symbol_t *next=symbol->next;
+            uint32_t bucket=symbol->hash&(num_buckets-1);
+            symbol->next=buckets[bucket];
+            buckets[bucket]=symbol;
+            symbol=next;
+        }
+    }
+    free(symbols.buckets);
+    symbols.buckets=buckets;
+    symbols.num_buckets=num_buckets;
+}
+
+/**
+ * Finds the symbol of a name, creating it the first time the name is seen.
+ *
+ * @param name The name; it need not be NUL-terminated.
+ * @param len The length of the name.
+ * @return The symbol.
+ */
+const symbol_t *intern_symbol(const char *name, size_t len){
+    if(symbols.buckets==NULL){
+        symbols.buckets=calloc(INITIAL_BUCKETS,sizeof(symbol_t*));
+        symbols.by_id=malloc(sizeof(symbol_t*)*INITIAL_BUCKETS);
+        if(symbols.buckets==NULL||symbols.by_id==NULL){
+            perror("Failed to allocate memory for symbols");
+            exit(EXIT_FAILURE);
+        }
+        symbols.num_buckets=INITIAL_BUCKETS;
+    }
+    uint32_t hash=hash_name(name,len);
+    for(symbol_t *symbol=symbols.buckets[hash&(symbols.num_buckets-1)];symbol!=NULL;symbol=symbol->next){
+        if(symbol->hash==hash&&symbol->len==len&&memcmp(symbol->name,name,len)==0){
+            return symbol;
+        }
+    }
+    if(symbols.count>=symbols.num_buckets){
+        grow_symbols();
+    }
+    // The name is stored right after the symbol
+    symbol_t *symbol=malloc(sizeof(symbol_t)+len+1);
+    if(symbol==NULL){
+        perror("Failed to allocate memory for symbols");
+        exit(EXIT_FAILURE);
+    }
+    char *copy=(char *)(symbol+1);
+    memcpy(copy,name,len);
+    copy[len]='\0';
+    symbol->name=copy;
+    symbol->len=len;
+    symbol->hash=hash;
+    symbol->id=symbols.count;
+    uint32_t bucket=hash&(symbols.num_buckets-1);
+    symbol->next=symbols.buckets[bucket];
+    symbols.buckets[bucket]=symbol;
+    symbols.by_id[symbols.count++]=symbol;
+    return symbol;
+}
+
+/**
+ * Checks whether a string is a valid variable name.
+ *
+ * @param name The string.
+ * @param len Its length.
+ * @return True if it is a letter or underscore followed by letters, digits and underscores.
+ */
+bool is_variable_name(const char *name, size_t len){
+    if(len==0||!(name[0]=='_'||(name[0]>='a'&&name[0]<='z')||(name[0]>='A'&&name[0]<='Z'))){
+        return false;
+    }
+    for(size_t i=1;i<len;i++){
+        char c=name[i];
+        if(!(c=='_'||(c>='a'&&c<='z')||(c>='A'&&c<='Z')||(c>='0'&&c<='9'))){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Finds the variable of a symbol, making room for it if the table has none yet.
+ *
+ * @param table A pointer to the variable table.
+ * @param symbol The name of the variable.
+ * @return The variable; NULL if allocation failed.
+ */
+static variable_t *variable_of(variable_table_t *table, const symbol_t *symbol){
+    if(symbol->id>=table->num_variables){
+        int num_variables=table->num_variables*2;
+        while(num_variables<=symbol->id){
+            num_variables*=2;
+        }
+        variable_t *variables=realloc(table->variables,sizeof(variable_t)*num_variables);
+        if(variables==NULL){
+            return NULL;
+        }
+        memset(variables+table->num_variables,0,sizeof(variable_t)*(num_variables-table->num_variables));
+        table->variables=variables;
+        table->num_variables=num_variables;
+    }
+    return &table->variables[symbol->id];
+}
+
+/**
+ * Drops the cached environment after an exported variable changed.
+ *
+ * @param table A pointer to the variable table.
+ */
+static void invalidate_environment(variable_table_t *table){
+    free(table->envp);
+    table->envp=NULL;
+}
+
+/**
+ * Copies PATH into the process environment, where the path cache looks for it.
+ *
+ * @param symbol The variable that changed.
+ * @param value Its value; NULL if it was unset.
+ */
+static void sync_path(const symbol_t *symbol, const char *value){
+    if(path_symbol==NULL){
+        path_symbol=intern_symbol("PATH",4);
+    }
+    if(symbol!=path_symbol){
+        return;
+    }
+    if(value!=NULL){
+        setenv("PATH",value,1);
+    }
+    else{
+        unsetenv("PATH");
+    }
+}
+
+/**
+ * Allocates an empty variable table.
+ *
+ * @return A pointer to the newly allocated table; NULL if allocation fails.
+ */
+variable_table_t *alloc_variables(){
+    variable_table_t *table=malloc(sizeof(variable_table_t));
+    if(table==NULL){
+        return NULL;
+    }
+    table->variables=calloc(INITIAL_BUCKETS,sizeof(variable_t));
+    if(table->variables==NULL){
+        free(table);
+        return NULL;
+    }
+    table->num_variables=INITIAL_BUCKETS;
+    table->num_exported=0;
+    table->envp=NULL;
+    return table;
+}
+
+/**
+ * Sets and exports a variable for every entry of an environment.
+ *
+ * @param table A pointer to the variable table.
+ * @param envp The environment, NULL-terminated.
+ */
+void import_environment(variable_table_t *table, char **envp){
+    for(int i=0;envp[i]!=NULL;i++){
+        const char *equals=strchr(envp[i],'=');
+        if(equals==NULL||!is_variable_name(envp[i],equals-envp[i])){
+            continue;
+        }
+        const symbol_t *symbol=intern_symbol(envp[i],equals-envp[i]);
+        assign_symbol(table,symbol,equals+1,strlen(equals+1));
+        export_symbol(table,symbol);
+    }
+}
+
+/**
+ * Looks up the value of a variable.
+ *
+ * @param table A pointer to the variable table.
+ * @param symbol The name of the variable.
+ * @return The value; NULL if the variable is not set.
+ */
+const char *symbol_value(const variable_table_t *table, const symbol_t *symbol){
+    return symbol->id<table->num_variables?table->variables[symbol->id].value:NULL;
+}
+
+/**
+ * Gives a variable a value. A value that fits the buffer of the old one
+ * (e.g. the next word of a loop) is copied into it, without allocating.
+ *
+ * @param table A pointer to the variable table.
+ * @param symbol The name of the variable.
+ * @param value The value.
+ * @param len The length of the value.
+ * @return True if the variable was set; false if allocation failed.
+ */
+bool assign_symbol(variable_table_t *table, const symbol_t *symbol, const char *value, size_t len){
+    variable_t *variable=variable_of(table,symbol);
+    if(variable==NULL){
+        return false;
+    }
+    // The same value again leaves the cached environment as it is
+    if(variable->value!=NULL&&variable->len==len&&memcmp(variable->value,value,len)==0){
+        return true;
+    }
+    if(len+1>variable->capacity){
+        char *buffer=malloc(len+1);
+        if(buffer==NULL){
+            return false;
+        }
+        free(variable->value);
+        variable->value=buffer;
+        variable->capacity=len+1;
+    }
+    memcpy(variable->value,value,len);
+    variable->value[len]='\0';
+    variable->len=len;
+    if(variable->flags&VARIABLE_EXPORTED){
+        invalidate_environment(table);
+    }
+    sync_path(symbol,variable->value);
+    return true;
+}
+
+/**
+ * Marks a variable as exported.
+ *
+ * @param table A pointer to the variable table.
+ * @param symbol The name of the variable.
+ * @return True on success; false if allocation failed.
+ */
+bool export_symbol(variable_table_t *table, const symbol_t *symbol){
+    variable_t *variable=variable_of(table,symbol);
+    if(variable==NULL){
+        return false;
+    }
+    if(!(variable->flags&VARIABLE_EXPORTED)){
+        variable->flags|=VARIABLE_EXPORTED;
+        table->num_exported++;
+        invalidate_environment(table);
+    }
+    return true;
+}
+
+/**
+ * Removes a variable and its export mark.
+ *
+ * @param table A pointer to the variable table.
+ * @param symbol The name of the variable.
+ */
+void unset_symbol(variable_table_t *table, const symbol_t *symbol){
+    if(symbol->id>=table->num_variables){
+        return;
+    }
+    variable_t *variable=&table->variables[symbol->id];
+    if(variable->flags&VARIABLE_EXPORTED){
+        table->num_exported--;
+        invalidate_environment(table);
+    }
+    free(variable->value);
+    memset(variable,0,sizeof(variable_t));
+    sync_path(symbol,NULL);
+}
+
+/**
+ * Gets the flags of a variable.
+ *
+ * @param table A pointer to the variable table.
+ * @param symbol The name of the variable.
+ * @return VARIABLE_EXPORTED if it is exported; otherwise, 0.
+ */
+int variable_flags(const variable_table_t *table, const symbol_t *symbol){
+    return symbol->id<table->num_variables?table->variables[symbol->id].flags:0;
+}
+
+/**
+ * Gets the environment of the programs the shell runs, building it if an
+ * exported variable changed since it was last built. The array and its
+ * strings share one allocation.
+ *
+ * @param table A pointer to the variable table.
+ * @return The NULL-terminated environment.
+ */
+char **environment(variable_table_t *table){
+    if(table->envp!=NULL){
+        return table->envp;
+    }
+    int count=0;
+    size_t bytes=0;
+    for(int id=0;id<table->num_variables&&id<symbols.count;id++){
+        const variable_t *variable=&table->variables[id];
+        if((variable->flags&VARIABLE_EXPORTED)&&variable->value!=NULL){
+            count++;
+            bytes+=symbols.by_id[id]->len+variable->len+2;
+        }
+    }
+    char **envp=malloc(sizeof(char*)*(count+1)+bytes);
+    if(envp==NULL){
+        perror("Failed to allocate memory for the environment");
+        exit(EXIT_FAILURE);
+    }
+    char *p=(char *)(envp+count+1);
+    int i=0;
+    for(int id=0;id<table->num_variables&&id<symbols.count;id++){
+        const variable_t *variable=&table->variables[id];
+        if((variable->flags&VARIABLE_EXPORTED)&&variable->value!=NULL){
+            const symbol_t *symbol=symbols.by_id[id];
+            envp[i++]=p;
+            memcpy(p,symbol->name,symbol->len);
+            p+=symbol->len;
+            *p++='=';
+            memcpy(p,variable->value,variable->len+1);
+            p+=variable->len+1;
+        }
+    }
+    envp[i]=NULL;
+    table->envp=envp;
+    return envp;
+}
+
+/**
+ * Gives a variable a value, by name.
+ *
+ * @param table A pointer to the variable table.
+ * @param name The name of the variable.
+ * @param value The value.
+ * @return True if the variable was set; false if allocation failed.
+ */
+bool set_variable(variable_table_t *table, const char *name, const char *value){
+    return assign_symbol(table,intern_symbol(name,strlen(name)),value,strlen(value));
+}
+
+/**
+ * Looks up the value of a variable, by name.
+ *
+ * @param table A pointer to the variable table.
+ * @param name The name of the variable.
+ * @return The value; NULL if the variable is not set.
+ */
+const char *get_variable(variable_table_t *table, const char *name){
+    return symbol_value(table,intern_symbol(name,strlen(name)));
+}
+
+/**
+ * Deallocates the table and every variable in it.
+ *
+ * @param table A pointer to the variable table; NULL is ignored.
+ */
+void free_variables(variable_table_t *table){
+    if(table==NULL){
+        return;
+    }
+    for(int i=0;i<table->num_variables;i++){
+        free(table->variables[i].value);
+    }
+    free(table->variables);
+    free(table->envp);
+    free(table);
+}
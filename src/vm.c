@@ -0,0 +1,411 @@
+#include "../include/vm.h"
+#include "../include/pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+
+#define INITIAL_BUCKETS 16
+
+//Programs with up to this many loops keep their slots on the stack
+#define SMALL_SLOTS 16
+
+//What a loop keeps while a program runs: the saved exit status of a while loop, or the number of
+//words a for loop went through (value) and its words. Expanded words are on the expansion stack,
+//above mark, which is taken each time the loop starts and popped back to when it ends.
+typedef struct slot {
+    int value;
+    int num_words;
+    char **words;
+    expand_mark_t mark;
+} slot_t;
+
+/**
+ * Computes the FNV-1a hash of a function name.
+ *
+ * @param name The name to hash.
+ * @return The 32-bit hash value.
+ */
+static uint32_t hash_name(const char *name){
+    uint32_t hash=2166136261u;
+    for(const unsigned char *p=(const unsigned char *)name;*p!='\0';p++){
+        hash^=*p;
+        hash*=16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Starts a list in the background, or queues it past the parallelism cap.
+ *
+ * @param shell The current shell state.
+ * @param list The and-or list.
+ */
+static void start_background(msh_t *shell, const and_or_t *list){
+    if(queue_job(shell,list)){
+        return;
+    }
+    launch_background(shell,list);
+}
+
+/**
+ * Starts a for loop: finds the words it goes through, expanding them if needed.
+ *
+ * @param shell The current shell state.
+ * @param command The for command.
+ * @param slot The slot of the loop.
+ */
+static void start_for(msh_t *shell, const command_t *command, slot_t *slot){
+    const compound_t *compound=command->compound;
+    slot->value=0;
+    slot->mark=expand_mark(shell);
+    // Without "in", the loop goes through the positional parameters
+    if(compound->num_words==-1){
+        slot->num_words=shell->num_params>0?shell->num_params-1:0;
+        slot->words=shell->params+1;
+        return;
+    }
+    slot->words=expand_words(shell,compound->num_words,compound->words,compound->expand,&slot->num_words);
+}
+
+/**
+ * Sets the variable of a for loop to its next word.
+ *
+ * @param shell The current shell state.
+ * @param command The for command.
+ * @param slot The slot of the loop; its word counter is incremented.
+ * @return False once every word has been gone through.
+ */
+static bool next_word(msh_t *shell, const command_t *command, slot_t *slot){
+    if(slot->value>=slot->num_words){
+        return false;
+    }
+    const char *word=slot->words[slot->value++];
+    assign_symbol(shell->variables,command->compound->symbol,word,strlen(word));
+    return true;
+}
+
+/**
+ * Finds the exit status return or exit gives, once its argument is expanded.
+ *
+ * @param shell The current shell state.
+ * @param command The return or exit command.
+ * @return The status; the last one if there is no argument.
+ */
+int argument_status(msh_t *shell, const command_t *command){
+    expand_mark_t mark=expand_mark(shell);
+    int argc;
+    char **argv=expand_words(shell,command->argc,command->argv,command->expand,&argc);
+    int status=shell->last_status;
+    if(argc>=2){
+        char *end;
+        long value=strtol(argv[1],&end,10);
+        if(*end!='\0'||end==argv[1]){
+            printf("error: %s: %s: numeric argument required\n",command->argv[0],argv[1]);
+            status=2;
+        }
+        else{
+            status=(int)(value&0xff);
+        }
+    }
+    expand_release(shell,mark);
+    return status;
+}
+
+/**
+ * Applies the redirections of a compound command to the shell.
+ *
+ * @param shell The current shell state.
+ * @param command The compound command.
+ * @param slot The slot that receives the depth of the descriptor stack to go back to.
+ * @return False if a redirection failed; the exit status is then 1.
+ */
+static bool redirect_compound(msh_t *shell, const command_t *command, slot_t *slot){
+    // The opened files are only needed until the shell has its copies, so a loop around the
+    // command does not pile them up on the expansion stack
+    expand_mark_t mark=expand_mark(shell);
+    redirections_t redirects;
+    slot->value=-1;
+    if(open_redirections(shell,command->redirects,&redirects)==0){
+        slot->value=push_redirections(shell,&redirects);
+    }
+    expand_release(shell,mark);
+    if(slot->value==-1){
+        shell->last_status=1;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Runs bytecode. Each run has its own slots, so a function may call itself
+ * from inside a loop.
+ *
+ * @param shell The current shell state.
+ * @param program The program.
+ * @param entry The instruction to start at.
+ * @return -1 if exit ran; otherwise, 0.
+ */
+int run_program(msh_t *shell, const program_t *program, int entry){
+    slot_t small[SMALL_SLOTS];
+    slot_t *slots=program->num_slots<=SMALL_SLOTS?small:malloc(sizeof(slot_t)*program->num_slots);
+    if(slots==NULL){
+        perror("Failed to allocate memory for a program");
+        exit(EXIT_FAILURE);
+    }
+    // The words of for loops left by return (or exit) are popped when the program is done, and
+    // descriptors redirected for its compound commands are put back then
+    expand_mark_t mark=expand_mark(shell);
+    int fd_depth=shell->fd_stack.count;
+    const instruction_t *code=program->code;
+    int pc=entry;
+    int result=0;
+    bool running=true;
+    while(running){
+        const instruction_t *instruction=&code[pc++];
+        switch(instruction->op){
+            case OP_PIPELINE:
+                run_pipeline(shell,instruction->pipeline,instruction->text,FOREGROUND);
+                if(shell->exiting){
+                    result=-1;
+                    running=false;
+                }
+                // ctrl-c stops the loop around the command, not just the command
+                else if(shell->last_status==128+SIGINT){
+                    running=false;
+                }
+                break;
+            case OP_BACKGROUND:
+                start_background(shell,instruction->list);
+                break;
+            case OP_JUMP:
+                pc=instruction->target;
+                break;
+            case OP_JUMP_TRUE:
+                if(shell->last_status==0){
+                    pc=instruction->target;
+                }
+                break;
+            case OP_JUMP_FALSE:
+                if(shell->last_status!=0){
+                    pc=instruction->target;
+                }
+                break;
+            case OP_STATUS:
+                shell->last_status=instruction->value;
+                break;
+            case OP_SAVE:
+                slots[instruction->slot].value=shell->last_status;
+                break;
+            case OP_LOAD:
+                shell->last_status=slots[instruction->slot].value;
+                break;
+            case OP_FOR_INIT:
+                start_for(shell,instruction->command,&slots[instruction->slot]);
+                shell->last_status=0;
+                break;
+            case OP_FOR_NEXT:
+                if(!next_word(shell,instruction->command,&slots[instruction->slot])){
+                    pc=instruction->target;
+                }
+                break;
+            case OP_FOR_DONE:
+                expand_release(shell,slots[instruction->slot].mark);
+                break;
+            case OP_FUNCTION:
+                define_function(shell->functions,instruction->command->compound->name,program,pc);
+                pc=instruction->target;
+                shell->last_status=0;
+                break;
+            case OP_RETURN:
+                if(instruction->command!=NULL){
+                    shell->last_status=argument_status(shell,instruction->command);
+                }
+                else if(instruction->value!=-1){
+                    shell->last_status=instruction->value;
+                }
+                running=false;
+                break;
+            case OP_REDIRECT:
+                if(!redirect_compound(shell,instruction->command,&slots[instruction->slot])){
+                    pc=instruction->target;
+                }
+                break;
+            case OP_RESTORE:
+                pop_redirections(shell,slots[instruction->slot].value);
+                break;
+            case OP_EXIT:
+                shell->last_status=argument_status(shell,instruction->command);
+                shell->exiting=true;
+                result=-1;
+                running=false;
+                break;
+        }
+    }
+    pop_redirections(shell,fd_depth);
+    expand_release(shell,mark);
+    if(slots!=small){
+        free(slots);
+    }
+    return result;
+}
+
+/**
+ * Allocates an empty function table.
+ *
+ * @return A pointer to the newly allocated table; NULL if allocation fails.
+ */
+function_table_t *alloc_functions(){
+    function_table_t *table=malloc(sizeof(function_table_t));
+    if(table==NULL){
+        return NULL;
+    }
+    table->buckets=calloc(INITIAL_BUCKETS,sizeof(function_t*));
+    if(table->buckets==NULL){
+        free(table);
+        return NULL;
+    }
+    table->num_buckets=INITIAL_BUCKETS;
+    table->count=0;
+    table->depth=0;
+    return table;
+}
+
+/**
+ * Doubles the number of buckets and rehashes every function.
+ *
+ * @param table A pointer to the function table.
+ */
+static void grow_buckets(function_table_t *table){
+    int num_buckets=table->num_buckets*2;
+    function_t **buckets=calloc(num_buckets,sizeof(function_t*));
+    if(buckets==NULL){
+        return;
+    }
+    for(int i=0;i<table->num_buckets;i++){
+        function_t *function=table->buckets[i];
+        while(function!=NULL){
+            function_t *next=function->next;
+            uint32_t bucket=hash_name(function->name)&(num_buckets-1);
+            function->next=buckets[bucket];
+            buckets[bucket]=function;
+            function=next;
+        }
+    }
+    free(table->buckets);
+    table->buckets=buckets;
+    table->num_buckets=num_buckets;
+}
+
+/**
+ * Defines a function. Its body stays in the tree of the line that defined
+ * it, which is kept for as long as the function is.
+ *
+ * @param table A pointer to the function table.
+ * @param name The name of the function.
+ * @param program The program the body is in.
+ * @param entry The first instruction of the body.
+ */
+void define_function(function_table_t *table, const char *name, const program_t *program, int entry){
+    program->tree->refs++;
+    uint32_t bucket=hash_name(name)&(table->num_buckets-1);
+    for(function_t *function=table->buckets[bucket];function!=NULL;function=function->next){
+        if(strcmp(function->name,name)==0){
+            release_parse_tree(function->program->tree);
+            function->program=program;
+            function->entry=entry;
+            return;
+        }
+    }
+    if(table->count>=table->num_buckets){
+        grow_buckets(table);
+        bucket=hash_name(name)&(table->num_buckets-1);
+    }
+    function_t *function=malloc(sizeof(function_t));
+    if(function==NULL||(function->name=strdup(name))==NULL){
+        free(function);
+        release_parse_tree(program->tree);
+        return;
+    }
+    function->program=program;
+    function->entry=entry;
+    function->next=table->buckets[bucket];
+    table->buckets[bucket]=function;
+    table->count++;
+}
+
+/**
+ * Looks up a function.
+ *
+ * @param table A pointer to the function table.
+ * @param name The name of the function.
+ * @return The function; NULL if no function has that name.
+ */
+const function_t *find_function(function_table_t *table, const char *name){
+    if(table->count==0){
+        return NULL;
+    }
+    for(function_t *function=table->buckets[hash_name(name)&(table->num_buckets-1)];function!=NULL;function=function->next){
+        if(strcmp(function->name,name)==0){
+            return function;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Runs a function with the arguments of the command that called it as its
+ * positional parameters. The tree of its body is held while it runs, since
+ * the function may be redefined meanwhile.
+ *
+ * @param shell The current shell state.
+ * @param function The function.
+ * @param argc The number of arguments.
+ * @param argv The arguments, starting with the name of the function.
+ * @return -1 if the function ran exit; otherwise, 0.
+ */
+int call_function(msh_t *shell, const function_t *function, int argc, char **argv){
+    function_table_t *table=shell->functions;
+    if(table->depth>=MAX_CALL_DEPTH){
+        printf("error: %s: maximum function nesting level exceeded\n",argv[0]);
+        shell->last_status=1;
+        return 0;
+    }
+    const program_t *program=function->program;
+    int num_params=shell->num_params;
+    char **params=shell->params;
+    shell->num_params=argc;
+    shell->params=argv;
+    program->tree->refs++;
+    table->depth++;
+    int result=run_program(shell,program,function->entry);
+    table->depth--;
+    release_parse_tree(program->tree);
+    shell->num_params=num_params;
+    shell->params=params;
+    return result;
+}
+
+/**
+ * Deallocates the table and releases the trees of the functions in it.
+ *
+ * @param table A pointer to the function table; NULL is ignored.
+ */
+void free_functions(function_table_t *table){
+    if(table==NULL){
+        return;
+    }
+    for(int i=0;i<table->num_buckets;i++){
+        function_t *function=table->buckets[i];
+        while(function!=NULL){
+            function_t *next=function->next;
+            release_parse_tree(function->program->tree);
+            free(function->name);
+            free(function);
+            function=next;
+        }
+    }
+    free(table->buckets);
+    free(table);
+}
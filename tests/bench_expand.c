@@ -0,0 +1,63 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Measures commands per second run from a compiled loop whose commands
+ * expand variables, against the same loop with plain words: the cost of
+ * expansion on top of running a builtin.
+ *
+ * usage: bench_expand [ITERATIONS]  (rounded down to a power of 10, at least 10)
+ */
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs body iterations times, from nested loops of 10 words each
+double loop_per_sec(msh_t *shell, long iterations, const char *body) {
+    char line[4096] = "";
+    int depth = 0;
+    for (long n = iterations; n > 1; n /= 10) {
+        snprintf(line + strlen(line), sizeof(line) - strlen(line), "for v%d in 0 1 2 3 4 5 6 7 8 9; do ", depth++);
+    }
+    strcat(line, body);
+    for (int i = 0; i < depth; i++) {
+        strcat(line, "; done");
+    }
+    double start = now_sec();
+    evaluate(shell, line);
+    return iterations / (now_sec() - start);
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    long rounded = 10;
+    while (rounded * 10 <= iterations) {
+        rounded *= 10;
+    }
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    evaluate(shell, "name='some text' path=/usr/local/bin");
+
+    const char *bodies[][2] = {
+        {"plain words", "true some text /usr/local/bin"},
+        {"assignment", "x=$v0"},
+        {"split variable", "true $name $path"},
+        {"quoted, joined", "true \"$name:$path/${v0}\""},
+        {"operators", "true ${unset:-default} ${#path} ${name:+set}"},
+    };
+    printf("%ld iterations of a builtin\n", rounded);
+    for (size_t i = 0; i < sizeof(bodies) / sizeof(bodies[0]); i++) {
+        double start = now_sec();
+        double rate = loop_per_sec(shell, rounded, bodies[i][1]);
+        printf("%-24s %12.0f commands/s (%.1f ms)\n", bodies[i][0], rate, (now_sec() - start) * 1000);
+    }
+    exit_shell(shell);
+    return 0;
+}
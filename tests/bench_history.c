@@ -0,0 +1,231 @@
+#include "history.h"
+#include "history_format.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/*
+ * Measures history adds per second once the history is full, for the ring
+ * buffer and for the array shift it replaced, at several history sizes. The
+ * ring is measured journaling every command (the default) and in batches of
+ * 256 commands per writev.
+ *
+ * It then measures startup: loading a history file of LINES lines with the
+ * mmap index and with the getline loop it replaced, reporting the time and
+ * the page faults (a proxy for memory touched) of each.
+ *
+ * Finally it times searches over a history of LINES commands: the one-time
+ * build of the trigram index, then a search through the index against a
+ * strstr scan of every line.
+ *
+ * Last it compares the text and binary formats of a history file of LINES
+ * commands: the size of the file and the time to load all of it.
+ *
+ * usage: bench_history [ADDS] [LINES]
+ */
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The former add_line_history: drop lines[0] and shift everything down by one
+void shift_add(char **lines, int *next, int max_history, const char *cmd_line) {
+    if (*next == max_history) {
+        free(lines[0]);
+        for (int i = 0; i < *next - 1; i++) {
+            lines[i] = lines[i + 1];
+        }
+        *next = max_history - 1;
+    }
+    lines[(*next)++] = strdup(cmd_line);
+}
+
+double ring_adds_per_sec(int max_history, int adds, int flush_every) {
+    remove(HISTORY_FILE_PATH);
+    history_t *history = alloc_history(max_history);
+    history->flush_every = flush_every;
+    for (int i = 0; i < max_history; i++) {
+        add_line_history(history, "echo fill");
+    }
+    double start = now_sec();
+    for (int i = 0; i < adds; i++) {
+        add_line_history(history, "ls -la /tmp");
+    }
+    double rate = adds / (now_sec() - start);
+    free_history(history);
+    return rate;
+}
+
+double shift_adds_per_sec(int max_history, int adds) {
+    char **lines = malloc(sizeof(char *) * max_history);
+    int next = 0;
+    for (int i = 0; i < max_history; i++) {
+        shift_add(lines, &next, max_history, "echo fill");
+    }
+    double start = now_sec();
+    for (int i = 0; i < adds; i++) {
+        shift_add(lines, &next, max_history, "ls -la /tmp");
+    }
+    double rate = adds / (now_sec() - start);
+    for (int i = 0; i < next; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    return rate;
+}
+
+long minor_faults() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+void write_history_file(int lines) {
+    FILE *fout = fopen(HISTORY_FILE_PATH, "w");
+    for (int i = 0; i < lines; i++) {
+        fprintf(fout, "make -j8 target_%d && ./run_tests --filter=case_%d\n", i, i);
+    }
+    fclose(fout);
+}
+
+// The former loader: read every line with getline and keep the last max_history copies
+void getline_load(int max_history) {
+    char **lines = calloc(max_history, sizeof(char *));
+    int next = 0;
+    FILE *fin = fopen(HISTORY_FILE_PATH, "r");
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+    while ((n = getline(&line, &len, fin)) != -1) {
+        if (line[n - 1] == '\n') {
+            line[n - 1] = '\0';
+        }
+        free(lines[next]);
+        lines[next] = strdup(line);
+        next = (next + 1) % max_history;
+    }
+    free(line);
+    fclose(fin);
+    for (int i = 0; i < max_history; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+}
+
+void run_startup(int max_history, int file_lines) {
+    write_history_file(file_lines);
+    long faults = minor_faults();
+    double start = now_sec();
+    getline_load(max_history);
+    double old_ms = (now_sec() - start) * 1000;
+    long old_faults = minor_faults() - faults;
+
+    // A journal over twice the history size is compacted, which rewrites the file: time a fresh one
+    write_history_file(file_lines);
+    faults = minor_faults();
+    start = now_sec();
+    history_t *history = alloc_history(max_history);
+    double new_ms = (now_sec() - start) * 1000;
+    long new_faults = minor_faults() - faults;
+    free_history(history);
+    printf("startup -s %-8d %d lines   mmap: %8.2f ms %7ld faults   getline: %8.2f ms %7ld faults\n",
+           max_history, file_lines, new_ms, new_faults, old_ms, old_faults);
+}
+
+// Finds the newest line containing the pattern by checking every line
+int linear_search(history_t *history, const char *pattern) {
+    for (int number = history->count; number > history->count - history->size; number--) {
+        if (strstr(find_line_history(history, number), pattern) != NULL) {
+            return number;
+        }
+    }
+    return 0;
+}
+
+void run_search(int lines) {
+    write_history_file(lines);
+    history_t *history = alloc_history(lines);
+    // Materialize every line so the linear scan is not charged for page faults
+    for (int number = 1; number <= history->count; number++) {
+        find_line_history(history, number);
+    }
+    double start = now_sec();
+    search_history(history, "warm", false, history->count + 1);
+    double build_ms = (now_sec() - start) * 1000;
+
+    const char *patterns[] = {"target_12345 ", "case_999999", "--filter=case_5000", "no such command"};
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        start = now_sec();
+        int indexed = search_history(history, patterns[i], false, history->count + 1);
+        double indexed_ms = (now_sec() - start) * 1000;
+        start = now_sec();
+        int linear = linear_search(history, patterns[i]);
+        double linear_ms = (now_sec() - start) * 1000;
+        printf("search %-22s index: %8.3f ms   strstr: %8.3f ms   %s\n", patterns[i], indexed_ms, linear_ms,
+               indexed == linear ? "same match" : "DIFFERENT MATCH");
+    }
+    printf("search index build over %d lines: %.2f ms (first search only)\n", lines, build_ms);
+    free_history(history);
+}
+
+long file_size() {
+    FILE *file = fopen(HISTORY_FILE_PATH, "r");
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+double load_ms(int lines) {
+    double start = now_sec();
+    history_t *history = alloc_history(lines);
+    // Read every command so both formats are charged for decoding it
+    for (int number = 1; number <= history->count; number++) {
+        find_line_history(history, number);
+    }
+    double ms = (now_sec() - start) * 1000;
+    free_history(history);
+    return ms;
+}
+
+void run_format(int lines) {
+    write_history_file(lines);
+    long text_size = file_size();
+    double text_ms = load_ms(lines);
+    const char *binary_path = "/tmp/msh_bench_history.bin";
+    convert_history_file(HISTORY_FILE_PATH, binary_path, HISTORY_BINARY);
+    rename(binary_path, HISTORY_FILE_PATH);
+    long binary_size = file_size();
+    double binary_ms = load_ms(lines);
+    printf("format %d lines   text: %10ld bytes %8.2f ms   binary (codec %d): %10ld bytes %8.2f ms\n", lines,
+           text_size, text_ms, HISTORY_CODEC, binary_size, binary_ms);
+}
+
+int main(int argc, char *argv[]) {
+    int adds = argc > 1 ? atoi(argv[1]) : 20000;
+    int file_lines = argc > 2 ? atoi(argv[2]) : 1000000;
+    int sizes[] = {10, 1000, 100000, 1000000};
+    // Keep the benchmark away from the real history file
+    HISTORY_FILE_PATH = "/tmp/msh_bench_history";
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        // The shift is O(size), so fewer adds keep the large sizes quick
+        int shift_adds = sizes[i] >= 100000 ? adds / 100 : adds;
+        double journaled = ring_adds_per_sec(sizes[i], adds, 1);
+        double batched = ring_adds_per_sec(sizes[i], adds, 256);
+        double shift = shift_adds_per_sec(sizes[i], shift_adds);
+        printf("-s %-8d ring: %10.0f adds/s (flush 1) %10.0f adds/s (flush 256)   shift: %10.0f adds/s\n",
+               sizes[i], journaled, batched, shift);
+    }
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run_startup(sizes[i], file_lines);
+    }
+    run_search(file_lines);
+    run_format(file_lines);
+    remove(HISTORY_FILE_PATH);
+    return 0;
+}
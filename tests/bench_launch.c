@@ -0,0 +1,69 @@
+#include "launch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/*
+ * Compares commands launched per second for the fork path and the posix_spawn
+ * path. Each round launches /bin/true and waits for it, first with a small
+ * heap and then after the process has touched a large heap (to mimic a shell
+ * holding big history and job tables).
+ *
+ * usage: bench_launch [LAUNCHES] [HEAP_MB]
+ */
+
+typedef pid_t (*launch_fn)(const char *path, char **argv, char **envp, const redirections_t *redirects, const sigset_t *child_mask, pid_t pgid, int in_fd, int out_fd);
+
+extern char **environ;
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double launches_per_sec(launch_fn launch, int launches) {
+    char *argv[] = {"/bin/true", NULL};
+    sigset_t mask;
+    sigemptyset(&mask);
+    double start = now_sec();
+    for (int i = 0; i < launches; i++) {
+        int status;
+        pid_t pid = launch(argv[0], argv, environ, NULL, &mask, 0, -1, -1);
+        if (pid == -1) {
+            return -1;
+        }
+        waitpid(pid, &status, 0);
+    }
+    return launches / (now_sec() - start);
+}
+
+void run_round(const char *label, int launches) {
+    double forked = launches_per_sec(fork_process, launches);
+    double spawned = launches_per_sec(spawn_process, launches);
+    printf("%-12s fork: %10.0f launches/s   spawn: %10.0f launches/s   speedup: %.2fx\n",
+           label, forked, spawned, spawned / forked);
+}
+
+int main(int argc, char *argv[]) {
+    int launches = argc > 1 ? atoi(argv[1]) : 2000;
+    int heap_mb = argc > 2 ? atoi(argv[2]) : 512;
+
+    run_round("small heap", launches);
+
+    size_t heap_size = (size_t)heap_mb * 1024 * 1024;
+    char *heap = malloc(heap_size);
+    if (heap == NULL) {
+        printf("could not allocate %d MB heap\n", heap_mb);
+        return 1;
+    }
+    memset(heap, 1, heap_size);
+    char label[32];
+    snprintf(label, sizeof(label), "%d MB heap", heap_mb);
+    run_round(label, launches);
+    free(heap);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Measures tokens per second for separate_args and for the strtok/strdup
+ * tokenizer it replaced, over a short command, a long argument list and a
+ * line padded with blanks. The old tokenizer's strings are freed here, which
+ * evaluate() never did. Then measures lines per second for parse_line and for
+ * lookups in the parse cache, as when a loop runs the same lines again.
+ *
+ * usage: bench_parse [ROUNDS]
+ */
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The former separate_args: count with strtok on one copy, then strdup every token of another
+char **strtok_separate_args(char *line, int *argc) {
+    char *line_copy = strdup(line);
+    int count = 0;
+    char *temp = strtok(line_copy, " \t\n");
+    while (temp != NULL) {
+        temp = strtok(NULL, " \t\n");
+        count++;
+    }
+    char **argv = malloc((count + 1) * sizeof(char *));
+    free(line_copy);
+    line_copy = strdup(line);
+    int i = 0;
+    temp = strtok(line_copy, " \t\n");
+    while (temp != NULL) {
+        argv[i++] = strdup(temp);
+        temp = strtok(NULL, " \t\n");
+    }
+    argv[i] = NULL;
+    *argc = count;
+    free(line_copy);
+    return argv;
+}
+
+double tokens_per_sec(const char *line, int rounds, bool old) {
+    char *copy = strdup(line);
+    long tokens = 0;
+    double start = now_sec();
+    for (int i = 0; i < rounds; i++) {
+        int argc;
+        char **argv = old ? strtok_separate_args(copy, &argc) : separate_args(copy, &argc, NULL);
+        tokens += argc;
+        if (old) {
+            for (int j = 0; j < argc; j++) {
+                free(argv[j]);
+            }
+        }
+        free(argv);
+    }
+    double rate = tokens / (now_sec() - start);
+    free(copy);
+    return rate;
+}
+
+double lines_per_sec(const char *line, int rounds, parse_cache_t *cache) {
+    double start = now_sec();
+    for (int i = 0; i < rounds; i++) {
+        parse_tree_t *tree;
+        acquire_parse_tree(cache, line, &tree, NULL);
+        release_parse_tree(tree);
+    }
+    return rounds / (now_sec() - start);
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 1000000;
+    char long_line[4096] = "gcc";
+    for (int i = 0; i < 100; i++) {
+        snprintf(long_line + strlen(long_line), sizeof(long_line) - strlen(long_line), " -I./include/dir%d", i);
+    }
+    const char *lines[] = {"ls -la /tmp", long_line, "    echo   bob \t sally   joe \n"};
+    const char *names[] = {"short", "100 args", "blanks"};
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        int n = i == 1 ? rounds / 20 : rounds;
+        double arena = tokens_per_sec(lines[i], n, false);
+        double old = tokens_per_sec(lines[i], n, true);
+        printf("%-9s separate_args: %12.0f tokens/s   strtok+strdup: %12.0f tokens/s   %.1fx\n", names[i], arena, old,
+               arena / old);
+    }
+
+    const char *scripted[] = {"ls -la /tmp", "grep -q \"$x\" 'file name' && echo found || echo missing", long_line};
+    parse_cache_t *cache = alloc_parse_cache(PARSE_CACHE_BYTES);
+    for (size_t i = 0; i < sizeof(scripted) / sizeof(scripted[0]); i++) {
+        int n = i == 2 ? rounds / 20 : rounds;
+        double parsed = lines_per_sec(scripted[i], n, NULL);
+        double cached = lines_per_sec(scripted[i], n, cache);
+        printf("%-9s parse_line: %12.0f lines/s   parse cache: %12.0f lines/s   %.1fx\n", i == 2 ? "100 args" : "line",
+               parsed, cached, cached / parsed);
+    }
+    printf("%lld hits, %lld misses\n", cache->hits, cache->misses);
+    free_parse_cache(cache);
+    return 0;
+}
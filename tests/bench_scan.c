@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+#include "scan.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Measures the throughput of every byte classifier this CPU supports, and of
+ * parse_line on top of each, over generated command lines of 1KB to 1MB:
+ * long option lists with some quoted arguments, joined by pipes and &&.
+ *
+ * usage: bench_scan [MEGABYTES]
+ */
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A line of at least size bytes, ending after a whole argument
+char *generate_line(size_t size) {
+    char *line = malloc(size + 128);
+    size_t len = 0;
+    int i = 0;
+    while (len < size) {
+        if (i % 200 == 0) {
+            len += sprintf(line + len, "%s/usr/bin/gcc", i == 0 ? "" : " && ");
+        }
+        else if (i % 50 == 0) {
+            len += sprintf(line + len, " | /usr/bin/grep -v 'warning: unused variable'");
+        }
+        else if (i % 7 == 0) {
+            len += sprintf(line + len, " -DNAME%d=\"value with spaces\"", i);
+        }
+        else {
+            len += sprintf(line + len, " -I./include/generated/module%d", i);
+        }
+        i++;
+    }
+    return line;
+}
+
+int main(int argc, char *argv[]) {
+    double megabytes = argc > 1 ? atof(argv[1]) : 256;
+    const scan_impl_t *impls;
+    int count = scan_implementations(&impls);
+    size_t sizes[] = {1 << 10, 16 << 10, 256 << 10, 1 << 20};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        char *line = generate_line(sizes[s]);
+        size_t len = strlen(line);
+        uint64_t *bitmap = malloc((len + 63) / 64 * sizeof(uint64_t));
+        int rounds = megabytes * (1 << 20) / len;
+        printf("%7zu bytes:", len);
+        for (int k = 0; k < count; k++) {
+            double start = now_sec();
+            for (int i = 0; i < rounds; i++) {
+                impls[k].classify(line, len, bitmap);
+            }
+            printf("  %s %6.2f GB/s", impls[k].name, (double)rounds * len / (now_sec() - start) / 1e9);
+        }
+        printf("\n%14s", "parse_line:");
+        for (int k = 0; k < count; k++) {
+            select_scan_implementation(impls[k].name);
+            int parse_rounds = rounds / 8 + 1;
+            double start = now_sec();
+            for (int i = 0; i < parse_rounds; i++) {
+                parse_tree_t *tree;
+                if (parse_line(line, &tree, NULL) != PARSE_OK) {
+                    printf(" parse error\n");
+                    return 1;
+                }
+                free_parse_tree(tree);
+            }
+            printf("  %s %6.0f MB/s", impls[k].name, (double)parse_rounds * len / (now_sec() - start) / 1e6);
+        }
+        printf("\n");
+        select_scan_implementation(impls[0].name);
+        free(bitmap);
+        free(line);
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Measures builtin commands per second run from a compiled loop, against
+ * the same number of lines run one by one with evaluate(), with the parse
+ * cache (a line typed again) and without it (a line parsed every time, as
+ * a loop that re-read its body would).
+ *
+ * usage: bench_vm [ITERATIONS]  (rounded down to a power of 10, at least 10)
+ */
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs `true` iterations times, from nested loops of 10 words each
+double loop_per_sec(msh_t *shell, long iterations) {
+    char line[4096] = "";
+    int depth = 0;
+    for (long n = iterations; n > 1; n /= 10) {
+        snprintf(line + strlen(line), sizeof(line) - strlen(line), "for v%d in 0 1 2 3 4 5 6 7 8 9; do ", depth++);
+    }
+    strcat(line, "true");
+    for (int i = 0; i < depth; i++) {
+        strcat(line, "; done");
+    }
+    double start = now_sec();
+    evaluate(shell, line);
+    return iterations / (now_sec() - start);
+}
+
+// Runs `true` iterations times, one line at a time
+double lines_per_sec(msh_t *shell, long iterations) {
+    char line[] = "true";
+    double start = now_sec();
+    for (long i = 0; i < iterations; i++) {
+        evaluate(shell, line);
+    }
+    return iterations / (now_sec() - start);
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    long rounded = 10;
+    while (rounded * 10 <= iterations) {
+        rounded *= 10;
+    }
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+
+    printf("%ld iterations of a builtin\n", rounded);
+    double start = now_sec();
+    double loop = loop_per_sec(shell, rounded);
+    printf("%-24s %12.0f commands/s (%.1f ms)\n", "compiled loop", loop, (now_sec() - start) * 1000);
+    start = now_sec();
+    double cached = lines_per_sec(shell, rounded);
+    printf("%-24s %12.0f commands/s (%.1f ms)\n", "lines, parse cache", cached, (now_sec() - start) * 1000);
+    parse_cache_t *cache = shell->parse_cache;
+    shell->parse_cache = NULL;
+    start = now_sec();
+    double parsed = lines_per_sec(shell, rounded);
+    printf("%-24s %12.0f commands/s (%.1f ms)\n", "lines, parsed each time", parsed, (now_sec() - start) * 1000);
+    shell->parse_cache = cache;
+    exit_shell(shell);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "input.h"
+#include "shell.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SCRIPT_PATH "/tmp/msh_test_batch"
+
+// Commands of a script are not added to the history unless asked
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    passed &= check(test_num, shell->record_history, "an interactive shell records its history");
+    int count = shell->history->count;
+    shell->record_history = false;
+    evaluate(shell, "true; false");
+    passed &= check(test_num, shell->history->count == count, "the script's commands are not recorded");
+    passed &= check(test_num, shell->last_status == 1, "the commands still run");
+    shell->record_history = true;
+    evaluate(shell, "true");
+    passed &= check(test_num, shell->history->count == count + 1, "with -H they are recorded");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// A batch reader fills many lines with one read, and still grows for a longer line
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    size_t num_lines = 20000;
+    FILE *file = fopen(SCRIPT_PATH, "w");
+    for (size_t i = 0; i < num_lines; i++) {
+        fprintf(file, "echo %zu\n", i);
+    }
+    for (size_t i = 0; i < INPUT_BATCH_CAPACITY; i++) {
+        fputc('y', file);
+    }
+    fclose(file);
+
+    int fd = open(SCRIPT_PATH, O_RDONLY);
+    input_t *in = alloc_input(fd, INPUT_BATCH_CAPACITY);
+    passed &= check(test_num, in != NULL && in->capacity == INPUT_BATCH_CAPACITY, "the buffer has the batch size");
+    int reads = 0;
+    size_t lines = 0;
+    size_t len;
+    char *line;
+    while (true) {
+        while ((line = next_line(in, &len)) == NULL && !in->eof) {
+            fill_input(in);
+            reads++;
+        }
+        if (line == NULL) {
+            break;
+        }
+        if (lines < num_lines) {
+            char expected[32];
+            snprintf(expected, sizeof(expected), "echo %zu", lines);
+            passed &= check(test_num, strcmp(line, expected) == 0, "lines come in order");
+        } else {
+            passed &= check(test_num, len == INPUT_BATCH_CAPACITY, "the last line is read whole");
+        }
+        lines++;
+    }
+    passed &= check(test_num, lines == num_lines + 1, "every line is read");
+    passed &= check(test_num, reads < 8, "lines are read in large chunks");
+    close(fd);
+    free_input(in);
+    unlink(SCRIPT_PATH);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// exit leaves with its argument as the status, which batch mode exits with
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    passed &= check(test_num, evaluate(shell, "exit 3") == -1 && shell->last_status == 3, "exit N sets the status");
+    passed &= check(test_num, evaluate(shell, "false; exit") == -1 && shell->last_status == 1,
+                    "exit alone keeps the last status");
+    passed &= check(test_num, evaluate(shell, "x=300; true && exit $x") == -1 && shell->last_status == 44,
+                    "the argument is expanded and taken modulo 256");
+    passed &= check(test_num, evaluate(shell, "exit abc") == -1 && shell->last_status == 2,
+                    "an argument that is not a number gives 2");
+    passed &= check(test_num, evaluate(shell, "f() { exit 4; }; f; x=no") == -1 && shell->last_status == 4 &&
+                    strcmp(get_variable(shell->variables, "x"), "300") == 0,
+                    "exit in a function leaves the shell");
+    passed &= check(test_num, evaluate(shell, "for i in 1 2; do exit 5$i; done") == -1 && shell->last_status == 51,
+                    "so does exit in a loop");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    return 0;
+}
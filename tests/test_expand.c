@@ -0,0 +1,157 @@
+#include "shell.h"
+#include "expand.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Expands the words of the first command of line and joins its fields with '|'
+void expand_line(msh_t *shell, const char *line, char *out, size_t size) {
+    parse_tree_t *tree;
+    out[0] = '\0';
+    if (parse_line(line, &tree, NULL) != PARSE_OK) {
+        snprintf(out, size, "<error>");
+        return;
+    }
+    const command_t *command = tree->lists->pipelines->commands;
+    expand_mark_t mark = expand_mark(shell);
+    int argc;
+    char **argv = expand_words(shell, command->argc, command->argv, command->expand, &argc);
+    for (int i = 0; i < argc; i++) {
+        snprintf(out + strlen(out), size - strlen(out), "%s%s", i > 0 ? "|" : "", argv[i]);
+    }
+    expand_release(shell, mark);
+    free_parse_tree(tree);
+}
+
+// The parser records expansions only where they are, and rejects bad ones
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    parse_tree_t *tree;
+    const char *error;
+    passed &= check(test_num, parse_line("echo plain '$x' \\$y $x", &tree, NULL) == PARSE_OK, "the line parses");
+    if (tree != NULL) {
+        command_t *command = tree->lists->pipelines->commands;
+        passed &= check(test_num, command->expand != NULL && command->expand[1] == NULL && command->expand[2] == NULL &&
+                        command->expand[3] == NULL && command->expand[4] != NULL,
+                        "only the unquoted $x is expanded");
+        passed &= check(test_num, strcmp(command->argv[2], "$x") == 0 && strcmp(command->argv[3], "$y") == 0,
+                        "quoted dollars are literal");
+        free_parse_tree(tree);
+    }
+    passed &= check(test_num, parse_line("echo a b", &tree, NULL) == PARSE_OK &&
+                    tree->lists->pipelines->commands->expand == NULL,
+                    "a command without expansions has no expand array");
+    free_parse_tree(tree);
+    passed &= check(test_num, parse_line("A=1 B=$A env", &tree, NULL) == PARSE_OK &&
+                    tree->lists->pipelines->commands->argc == 1 &&
+                    tree->lists->pipelines->commands->assignments != NULL &&
+                    tree->lists->pipelines->commands->assignments->next->expand != NULL,
+                    "leading NAME=VALUE words are assignments");
+    free_parse_tree(tree);
+    passed &= check(test_num, parse_line("echo ${x", &tree, NULL) == PARSE_INCOMPLETE, "an open ${ goes on");
+    passed &= check(test_num, parse_line("echo ${1=x}", &tree, &error) == PARSE_ERROR && error != NULL,
+                    "a parameter cannot be assigned");
+    passed &= check(test_num, parse_line("echo ${x!}", &tree, &error) == PARSE_ERROR, "a bad substitution is an error");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Values replace parameters; unquoted ones are split at IFS
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    char out[256];
+    evaluate(shell, "x='a  b' e=");
+    expand_line(shell, "echo $x \"$x\" pre${x}post $e \"$e\"", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|a|b|a  b|prea|bpost|") == 0, "fields are split unless quoted");
+    expand_line(shell, "echo ${#x} ${u:-d e} \"${u-d e}\" ${x:+set} ${e:-empty} ${e-unset}", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|4|d|e|d e|set|empty") == 0, "the operators pick their values");
+    expand_line(shell, "echo ${u:=new}", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|new") == 0 && strcmp(var(shell, "u"), "new") == 0, ":= assigns");
+    evaluate(shell, "IFS=:");
+    evaluate(shell, "p=/bin:/usr/bin");
+    expand_line(shell, "echo $p", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|/bin|/usr/bin") == 0, "IFS sets the separators");
+    evaluate(shell, "false");
+    expand_line(shell, "echo $? $", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|1|$") == 0, "$? is the last status, and a lone $ is literal");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Assignments set variables, alone, or only for the command they come before
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    evaluate(shell, "a=1 b=$a");
+    passed &= check(test_num, strcmp(var(shell, "b"), "1") == 0 && shell->last_status == 0, "assignments run in order");
+    evaluate(shell, "a=2 true");
+    passed &= check(test_num, strcmp(var(shell, "a"), "1") == 0, "a prefix assignment lasts for its command");
+    evaluate(shell, "f() { for seen in $a; do true; done; }; a=3 f");
+    passed &= check(test_num, strcmp(var(shell, "seen"), "3") == 0 && strcmp(var(shell, "a"), "1") == 0,
+                    "a function sees it while it runs");
+
+    char **envp = environment(shell->variables);
+    bool found = false;
+    for (char **entry = envp; *entry != NULL; entry++) {
+        found |= strncmp(*entry, "a=", 2) == 0;
+    }
+    passed &= check(test_num, !found, "variables are not exported until export");
+    evaluate(shell, "export a");
+    found = false;
+    for (char **entry = environment(shell->variables); *entry != NULL; entry++) {
+        found |= strcmp(*entry, "a=1") == 0;
+    }
+    passed &= check(test_num, found, "then they are in the environment");
+    passed &= check(test_num, environment(shell->variables) == environment(shell->variables),
+                    "the environment is only built again after a change");
+
+    evaluate(shell, "unset a");
+    passed &= check(test_num, get_variable(shell->variables, "a") == NULL, "unset removes a variable");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Positional parameters are the arguments of the running function
+void test4() {
+    int test_num = 4;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    evaluate(shell, "count() { n=$#; }; all() { count \"$@\"; }; star() { count \"$*\"; }");
+    evaluate(shell, "all 'a b' c");
+    passed &= check(test_num, strcmp(var(shell, "n"), "2") == 0, "\"$@\" keeps the arguments apart");
+    evaluate(shell, "star 'a b' c");
+    passed &= check(test_num, strcmp(var(shell, "n"), "1") == 0, "\"$*\" joins them");
+    evaluate(shell, "all");
+    passed &= check(test_num, strcmp(var(shell, "n"), "0") == 0, "\"$@\" with no arguments is no field");
+    evaluate(shell, "second() { r=$2; return $1; }; second 5 x");
+    passed &= check(test_num, strcmp(var(shell, "r"), "x") == 0 && shell->last_status == 5,
+                    "$1 and $2 are the arguments, and return expands its status");
+    evaluate(shell, "loop() { for w in $@; do last=$w; done; }; loop 1 2 3");
+    passed &= check(test_num, strcmp(var(shell, "last"), "3") == 0, "a loop goes through expanded words");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    return 0;
+}
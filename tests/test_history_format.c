@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include "history_format.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+bool is_binary() {
+    size_t size;
+    char *data = read_file(HISTORY_FILE_PATH, &size);
+    bool binary = history_file_format(data, size) == HISTORY_BINARY;
+    free(data);
+    return binary;
+}
+
+history_timing_t make_timing(long long wall_us, int status) {
+    history_timing_t timing = {1700000000000000LL + wall_us, wall_us, wall_us / 2, wall_us / 4, status};
+    return timing;
+}
+
+bool same_timing(const history_timing_t *a, const history_timing_t *b) {
+    return a != NULL && b != NULL && a->start_us == b->start_us && a->wall_us == b->wall_us &&
+           a->user_us == b->user_us && a->sys_us == b->sys_us && a->status == b->status;
+}
+
+// Starts an empty history file in the binary format
+void start_binary() {
+    remove(HISTORY_FILE_PATH);
+    history_t *history = alloc_history(10);
+    convert_history(history, HISTORY_BINARY);
+    free_history(history);
+}
+
+// Binary records round-trip every timing field, including negative and large values
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    history_timing_t timings[] = {{1, -1, 0, 0, 0}, {1760000000123456LL, 1LL << 40, 127, 128, -1}, {5, 300, 16384, 2, 255}};
+    char out[RECORD_MAX + 16];
+    for (int i = 0; i < 3; i++) {
+        size_t prefix = format_binary_record(out, 5, &timings[i]);
+        memcpy(out + prefix, "hello", 5);
+        history_record_t record;
+        size_t n = parse_binary_record(out, prefix + 5, &record);
+        passed &= check(test_num, n == prefix + 5, "the whole record is decoded");
+        passed &= check(test_num, record.len == 5 && memcmp(record.line, "hello", 5) == 0, "the command is decoded");
+        passed &= check(test_num, same_timing(&record.timing, &timings[i]), "the timing is decoded");
+        passed &= check(test_num, parse_binary_record(out, prefix + 4, &record) == 0, "a truncated record is rejected");
+    }
+    size_t prefix = format_binary_record(out, 0, NULL);
+    history_record_t record;
+    passed &= check(test_num, prefix <= 2 && parse_binary_record(out, prefix, &record) == prefix &&
+                    record.len == 0 && record.timing.start_us == 0, "an untimed record is two bytes");
+
+    // Text records still parse as before
+    history_timing_t timing;
+    size_t len = format_text_record(out, &timings[1]);
+    passed &= check(test_num, out[len - 1] == '\n' && parse_text_record(out, len - 1, &timing) &&
+                    same_timing(&timing, &timings[1]), "text records round-trip");
+    passed &= check(test_num, !parse_text_record("#+12 abc", 8, &timing), "comments are not records");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// A binary journal is appended to and loads back with its timings and multi-line commands
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    start_binary();
+    passed &= check(test_num, is_binary(), "the converted file is binary");
+    history_t *history = alloc_history(10);
+    passed &= check(test_num, history->format == HISTORY_BINARY, "the format is detected");
+    history->timed = true;
+    add_line_history(history, "make");
+    history_timing_t timing = make_timing(1500000, 2);
+    time_line_history(history, &timing);
+    history->timed = false;
+    add_line_history(history, "printf 'a\nb'");
+    add_line_history(history, "ls");
+    free_history(history);
+
+    history = alloc_history(10);
+    passed &= check(test_num, history->count == 3, "every record is loaded");
+    passed &= check(test_num, strcmp(find_line_history(history, 1), "make") == 0, "the first command is loaded");
+    passed &= check(test_num, strcmp(find_line_history(history, 2), "printf 'a\nb'") == 0,
+                    "newlines are kept inside a command");
+    passed &= check(test_num, strcmp(find_line_history(history, 3), "ls") == 0, "the last command is loaded");
+    passed &= check(test_num, same_timing(find_timing_history(history, 1), &timing), "the timing is loaded");
+    passed &= check(test_num, find_timing_history(history, 3) == NULL, "untimed commands have no timing");
+    passed &= check(test_num, search_history(history, "a\nb", false, 10) == 2, "loaded commands are searched");
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Converting to binary and back gives the same text file
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    history_t *history = alloc_history(100);
+    convert_history(history, HISTORY_TEXT);
+    history->timed = true;
+    char line[32];
+    for (int i = 0; i < 20; i++) {
+        snprintf(line, sizeof(line), "cmd%d", i);
+        add_line_history(history, line);
+        if (i % 3 == 0) {
+            history_timing_t timing = make_timing(i * 1000, i);
+            time_line_history(history, &timing);
+        }
+    }
+    history->timed = false;
+    add_line_history(history, "last");
+    size_t text_size;
+    char *text = read_file(HISTORY_FILE_PATH, &text_size);
+    passed &= check(test_num, convert_history(history, HISTORY_BINARY) == 21, "every command is converted");
+    passed &= check(test_num, is_binary(), "the file is binary");
+    size_t binary_size;
+    free(read_file(HISTORY_FILE_PATH, &binary_size));
+    passed &= check(test_num, binary_size < text_size, "the binary file is smaller");
+
+    // The shell keeps journaling into the converted file
+    add_line_history(history, "after");
+    free_history(history);
+    history = alloc_history(100);
+    passed &= check(test_num, history->count == 22 && strcmp(find_line_history(history, 22), "after") == 0,
+                    "lines added after converting are kept");
+    passed &= check(test_num, convert_history(history, HISTORY_TEXT) == 22, "the file converts back");
+    free_history(history);
+    size_t size;
+    char *data = read_file(HISTORY_FILE_PATH, &size);
+    passed &= check(test_num, size == text_size + 6 && memcmp(data, text, text_size) == 0 &&
+                    strcmp(data + text_size, "after\n") == 0, "the round trip keeps the text file");
+    free(data);
+    free(text);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// A long binary journal is compacted into an archive, whose records are found through its footer
+void test4() {
+    int test_num = 4;
+    bool passed = true;
+    start_binary();
+    history_t *history = alloc_history(3);
+    history->timed = true;
+    char line[32];
+    for (int i = 1; i <= 10; i++) {
+        snprintf(line, sizeof(line), "cmd%d", i);
+        add_line_history(history, line);
+        history_timing_t timing = make_timing(i * 1000, 0);
+        time_line_history(history, &timing);
+    }
+    free_history(history);
+
+    history = alloc_history(3);
+    free_history(history);
+    size_t size;
+    char *data = read_file(HISTORY_FILE_PATH, &size);
+    history_image_t image;
+    passed &= check(test_num, open_history_image(data, size, &image) && image.format == HISTORY_BINARY &&
+                    image.archive_count == 3 && image.appended == image.size, "the journal is compacted to an archive");
+    close_history_image(&image);
+    free(data);
+
+    history = alloc_history(3);
+    add_line_history(history, "new1");
+    free_history(history);
+    history = alloc_history(3);
+    passed &= check(test_num, strcmp(find_line_history(history, history->count - 2), "cmd9") == 0 &&
+                    strcmp(find_line_history(history, history->count - 1), "cmd10") == 0 &&
+                    strcmp(find_line_history(history, history->count), "new1") == 0,
+                    "archived and appended records are loaded together");
+    const history_timing_t *timing = find_timing_history(history, history->count - 1);
+    passed &= check(test_num, timing != NULL && timing->wall_us == 10000, "archived timings are loaded");
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Sessions sharing a binary file merge each other's records, and a session opened before
+// the file was converted moves over to it
+void test5() {
+    int test_num = 5;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    history_t *a = alloc_history(10);
+    a->merge = true;
+    history_t *b = alloc_history(10);
+    add_line_history(a, "a1");
+    passed &= check(test_num, convert_history(b, HISTORY_BINARY) == 1, "b converts the file");
+    merge_history(a);
+    passed &= check(test_num, a->format == HISTORY_BINARY && a->count == 1, "a moves over to the new file");
+    b->timed = true;
+    add_line_history(b, "b1");
+    history_timing_t timing = make_timing(42, 3);
+    time_line_history(b, &timing);
+    merge_history(a);
+    passed &= check(test_num, a->count == 2 && strcmp(find_line_history(a, 2), "b1") == 0, "the record is merged");
+    passed &= check(test_num, same_timing(find_timing_history(a, 2), &timing), "its timing is merged");
+    add_line_history(a, "a2\nsecond line");
+    free_history(b);
+    free_history(a);
+
+    history_t *c = alloc_history(10);
+    passed &= check(test_num, c->count == 3 && strcmp(find_line_history(c, 1), "a1") == 0 &&
+                    strcmp(find_line_history(c, 3), "a2\nsecond line") == 0, "the file holds every command once");
+    free_history(c);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Several binary records appended at once are all merged, each with its own timing
+void test6() {
+    int test_num = 6;
+    bool passed = true;
+    start_binary();
+    history_t *a = alloc_history(10);
+    a->merge = true;
+    history_t *b = alloc_history(10);
+    b->timed = true;
+    add_line_history(b, "b1");
+    add_line_history(b, "b2");
+    history_timing_t timing = make_timing(7, 1);
+    time_line_history(b, &timing);
+    add_line_history(b, "b3\nsecond line");
+    free_history(b);
+    merge_history(a);
+    passed &= check(test_num, a->count == 3, "every record is merged");
+    passed &= check(test_num, a->count == 3 && strcmp(find_line_history(a, 1), "b1") == 0 &&
+                    strcmp(find_line_history(a, 2), "b2") == 0 && strcmp(find_line_history(a, 3), "b3\nsecond line") == 0,
+                    "the commands are whole and in order");
+    passed &= check(test_num, same_timing(find_timing_history(a, 2), &timing), "a record's timing stays with it");
+    free_history(a);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    test5();
+    test6();
+    return 0;
+}
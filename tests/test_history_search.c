@@ -0,0 +1,107 @@
+#define _GNU_SOURCE
+#include "history.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+
+// The newest stored line before ``before`` containing the pattern, by scanning every line
+int brute_force(history_t *history, const char *pattern, bool prefix, int before) {
+    int first = history->count - history->size + 1;
+    for (int number = before - 1; number >= first; number--) {
+        if (number > history->count) {
+            continue;
+        }
+        char *line = find_line_history(history, number);
+        if (prefix ? strncmp(line, pattern, strlen(pattern)) == 0 : strstr(line, pattern) != NULL) {
+            return number;
+        }
+    }
+    return 0;
+}
+
+// Compares every match of a pattern, newest to oldest, against the brute force scan
+bool same_matches(history_t *history, const char *pattern, bool prefix) {
+    int expected = brute_force(history, pattern, prefix, INT_MAX);
+    int got = search_history(history, pattern, prefix, INT_MAX);
+    while (expected == got && got != 0) {
+        expected = brute_force(history, pattern, prefix, got);
+        got = search_history(history, pattern, prefix, got);
+    }
+    return expected == got;
+}
+
+history_t *fresh_history(int max_history) {
+    remove(HISTORY_FILE_PATH);
+    history_t *history = alloc_history(max_history);
+    history->flush_every = INT_MAX;
+    return history;
+}
+
+void add_commands(history_t *history, int from, int to) {
+    char line[64];
+    for (int i = from; i < to; i++) {
+        snprintf(line, sizeof(line), "cmd%d --flag=%d %s", i % 97, i % 13, i % 2 ? "odd" : "even");
+        add_line_history(history, line);
+    }
+}
+
+void test1() {
+    int test_num = 1;
+    // Substring and prefix matches agree with a linear scan
+    history_t *history = fresh_history(5000);
+    add_commands(history, 0, 3000);
+    const char *patterns[] = {"cmd42 ", "flag=7", "odd", "=1", "d4", "nothing here", "cmd9"};
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        passed = passed && check(test_num, same_matches(history, patterns[i], false), patterns[i]);
+        passed = passed && check(test_num, same_matches(history, patterns[i], true), patterns[i]);
+    }
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test2() {
+    int test_num = 2;
+    // The index follows the ring: evicted lines are no longer found, new ones are
+    history_t *history = fresh_history(500);
+    add_commands(history, 0, 400);
+    bool passed = check(test_num, search_history(history, "cmd5 ", false, INT_MAX) != 0, "index not built");
+    add_commands(history, 400, 2000);
+    passed = passed && check(test_num, same_matches(history, "cmd5 ", false), "matches after eviction");
+    passed = passed && check(test_num, same_matches(history, "flag=12 even", false), "matches after eviction");
+    add_line_history(history, "a brand new command");
+    passed = passed && check(test_num, search_history(history, "brand new", false, INT_MAX) == history->count, "new line not indexed");
+    passed = passed && check(test_num, search_history(history, "brand new", false, history->count) == 0, "before is not exclusive");
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test3() {
+    int test_num = 3;
+    // Lines loaded from the file are searchable
+    history_t *history = fresh_history(100);
+    add_commands(history, 0, 150);
+    free_history(history);
+    history = alloc_history(100);
+    bool passed = check(test_num, same_matches(history, "cmd1", false), "loaded lines");
+    passed = passed && check(test_num, search_history(history, "cmd10 --flag=10 ", false, INT_MAX) == 0, "only the newest 100 lines are loaded");
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    remove(HISTORY_FILE_PATH);
+    return 0;
+}
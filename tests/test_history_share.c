@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+#include "history.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Reads the history file into an array of lines
+char **read_file_lines(int *num_lines) {
+    char **lines = NULL;
+    *num_lines = 0;
+    FILE *file = fopen(HISTORY_FILE_PATH, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, file)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        lines = realloc(lines, sizeof(char *) * (*num_lines + 1));
+        lines[(*num_lines)++] = strdup(line);
+    }
+    free(line);
+    fclose(file);
+    return lines;
+}
+
+void free_file_lines(char **lines, int num_lines) {
+    for (int i = 0; i < num_lines; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+}
+
+// The stored lines that are still visible, oldest first, joined with ','
+void visible_lines(history_t *history, char *out, size_t size) {
+    out[0] = '\0';
+    for (int number = history->count - history->size + 1; number <= history->count; number++) {
+        char *line = find_line_history(history, number);
+        if (line != NULL) {
+            strncat(out, line, size - strlen(out) - 2);
+            strcat(out, ",");
+        }
+    }
+}
+
+// Two sessions appending in turn both keep their lines in the shared file
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    history_t *a = alloc_history(10);
+    history_t *b = alloc_history(10);
+    add_line_history(a, "a1");
+    add_line_history(b, "b1");
+    add_line_history(a, "a2");
+    free_history(a);
+    add_line_history(b, "b2");
+    free_history(b);
+
+    int num_lines;
+    char **lines = read_file_lines(&num_lines);
+    const char *expected[] = {"a1", "b1", "a2", "b2"};
+    passed &= check(test_num, num_lines == 4, "every session's lines are in the file");
+    for (int i = 0; i < num_lines && i < 4; i++) {
+        passed &= check(test_num, strcmp(lines[i], expected[i]) == 0, "lines are in the order they were added");
+    }
+    free_file_lines(lines, num_lines);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Merge mode picks up other sessions' lines, once, without the session's own lines
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    history_t *a = alloc_history(10);
+    a->merge = true;
+    history_t *b = alloc_history(10);
+    add_line_history(a, "a1");
+    add_line_history(b, "b1");
+    add_line_history(b, "b2");
+    merge_history(a);
+    char out[256];
+    visible_lines(a, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "a1,b1,b2,") == 0, "merge adds the other session's lines");
+
+    merge_history(a);
+    visible_lines(a, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "a1,b1,b2,") == 0, "a second merge adds nothing");
+
+    // Lines appended while a has pending lines are merged when it flushes
+    a->flush_every = 100;
+    add_line_history(a, "a2");
+    add_line_history(b, "b3");
+    merge_history(a);
+    visible_lines(a, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "a1,b1,b2,a2,b3,") == 0, "pending lines are flushed before merging");
+
+    history_t *c = alloc_history(10);
+    visible_lines(c, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "a1,b1,b2,b3,a2,") == 0, "the file holds every line once");
+    free_history(c);
+
+    free_history(b);
+    free_history(a);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Starts sessions in separate processes that each add per_session lines, restarting (which
+// compacts the journal once it holds more than 2 * max_history lines) every restart_every lines
+void run_sessions(int sessions, int per_session, int max_history, int restart_every) {
+    remove(HISTORY_FILE_PATH);
+    fflush(stdout);
+    for (int s = 0; s < sessions; s++) {
+        if (fork() == 0) {
+            history_t *history = alloc_history(max_history);
+            char line[64];
+            for (int i = 0; i < per_session; i++) {
+                snprintf(line, sizeof(line), "session %d command %d %s", s, i, "padding-padding-padding");
+                add_line_history(history, line);
+                if (i % restart_every == restart_every - 1) {
+                    free_history(history);
+                    history = alloc_history(max_history);
+                }
+            }
+            free_history(history);
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+}
+
+// Checks that the file is a tail of everything the sessions appended: every line is whole,
+// and each session's lines are consecutive and end with its last one
+bool tail_of_appends(int sessions, int per_session, int *num_lines) {
+    char **lines = read_file_lines(num_lines);
+    int last[16];
+    for (int s = 0; s < sessions; s++) {
+        last[s] = -1;
+    }
+    bool ok = true;
+    for (int i = 0; i < *num_lines && ok; i++) {
+        int s, n;
+        char padding[32];
+        ok = sscanf(lines[i], "session %d command %d %31s", &s, &n, padding) == 3 && s >= 0 && s < sessions &&
+             strcmp(padding, "padding-padding-padding") == 0 && (last[s] == -1 || n == last[s] + 1);
+        if (ok) {
+            last[s] = n;
+        }
+    }
+    for (int s = 0; s < sessions && ok; s++) {
+        ok = last[s] == -1 || last[s] == per_session - 1;
+    }
+    free_file_lines(lines, *num_lines);
+    return ok;
+}
+
+// Concurrent sessions in separate processes never lose or interleave lines, even with compaction
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    int num_lines;
+    run_sessions(8, 300, 5000, 300);
+    passed &= check(test_num, tail_of_appends(8, 300, &num_lines), "appends are whole and in order");
+    passed &= check(test_num, num_lines == 8 * 300, "no append is lost");
+
+    run_sessions(8, 300, 50, 25);
+    passed &= check(test_num, tail_of_appends(8, 300, &num_lines), "compaction loses no appended line");
+    passed &= check(test_num, num_lines >= 50 && num_lines <= 8 * 300, "the journal was compacted");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// ignoredups drops repeats of the newest line; erasedups erases older copies
+void test4() {
+    int test_num = 4;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    history_t *history = alloc_history(10);
+    history->dedup = HISTORY_IGNOREDUPS;
+    add_line_history(history, "ls");
+    add_line_history(history, "ls");
+    add_line_history(history, "pwd");
+    add_line_history(history, "ls");
+    char out[256];
+    visible_lines(history, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "ls,pwd,ls,") == 0, "ignoredups drops consecutive repeats");
+    passed &= check(test_num, history->count == 3, "dropped lines are not numbered");
+
+    history->dedup = HISTORY_ERASEDUPS;
+    add_line_history(history, "pwd");
+    add_line_history(history, "make");
+    add_line_history(history, "ls");
+    visible_lines(history, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "pwd,make,ls,") == 0, "erasedups keeps only the newest copy");
+    passed &= check(test_num, find_line_history(history, 1) == NULL, "erased lines are not found by number");
+    passed &= check(test_num, search_history(history, "ls", false, 6) == 0, "erased lines are not searched");
+    passed &= check(test_num, search_history(history, "ls", false, 7) == 6, "the newest copy is searched");
+    free_history(history);
+
+    // Duplicates loaded from the file are erased too, and the ring keeps erasing once it wraps
+    history = alloc_history(10);
+    history->dedup = HISTORY_ERASEDUPS;
+    char line[32];
+    for (int i = 0; i < 200; i++) {
+        snprintf(line, sizeof(line), "cmd%d", i % 7);
+        add_line_history(history, line);
+    }
+    visible_lines(history, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "cmd4,cmd5,cmd6,cmd0,cmd1,cmd2,cmd3,") == 0,
+                    "each command is kept once, in the order last used");
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    return 0;
+}
@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+history_timing_t make_timing(long long wall_us, int status) {
+    history_timing_t timing = {1700000000000000LL + wall_us, wall_us, wall_us / 2, wall_us / 4, status};
+    return timing;
+}
+
+// A timed command is journaled with its record once it is timed, and loads back with its timing
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    history_t *history = alloc_history(10);
+    history->timed = true;
+    add_line_history(history, "make");
+    char *data = read_file(HISTORY_FILE_PATH, NULL);
+    passed &= check(test_num, strcmp(data, "") == 0, "a command is not journaled before its timing");
+    free(data);
+    history_timing_t timing = make_timing(1500000, 2);
+    time_line_history(history, &timing);
+    data = read_file(HISTORY_FILE_PATH, NULL);
+    passed &= check(test_num, strcmp(data, "#+1700000001500000 1500000 750000 375000 2\nmake\n") == 0,
+                    "the record is written before the command");
+    free(data);
+
+    // Dropped duplicates leave nothing to time
+    history->dedup = HISTORY_IGNOREDUPS;
+    add_line_history(history, "make");
+    timing = make_timing(7, 0);
+    time_line_history(history, &timing);
+    passed &= check(test_num, history->count == 1 && find_timing_history(history, 1)->wall_us == 1500000,
+                    "timing a dropped command changes nothing");
+    history->timed = false;
+    add_line_history(history, "untimed");
+    free_history(history);
+
+    history = alloc_history(10);
+    const history_timing_t *loaded = find_timing_history(history, 1);
+    passed &= check(test_num, history->count == 2, "records are not counted as commands");
+    passed &= check(test_num, loaded != NULL && loaded->wall_us == 1500000 && loaded->user_us == 750000 &&
+                    loaded->sys_us == 375000 && loaded->status == 2, "the timing is loaded");
+    passed &= check(test_num, find_timing_history(history, 2) == NULL, "untimed commands have no timing");
+    passed &= check(test_num, strcmp(find_line_history(history, 1), "make") == 0, "loaded lines end before the record");
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Records survive compaction and are merged from other sessions
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    history_t *history = alloc_history(3);
+    history->timed = true;
+    char line[32];
+    for (int i = 1; i <= 10; i++) {
+        snprintf(line, sizeof(line), "cmd%d", i);
+        add_line_history(history, line);
+        history_timing_t timing = make_timing(i * 1000, 0);
+        time_line_history(history, &timing);
+    }
+    free_history(history);
+
+    // Loading compacts the journal to the last three commands and their records
+    history = alloc_history(3);
+    free_history(history);
+    char *data = read_file(HISTORY_FILE_PATH, NULL);
+    passed &= check(test_num, strncmp(data, "#+1700000000008000 8000", 23) == 0, "compaction keeps the oldest record");
+    free(data);
+    history = alloc_history(3);
+    history->merge = true;
+    for (int number = 1; number <= 3; number++) {
+        const history_timing_t *timing = find_timing_history(history, number);
+        passed &= check(test_num, timing != NULL && timing->wall_us == (number + 7) * 1000, "timings survive compaction");
+    }
+
+    history_t *other = alloc_history(3);
+    other->timed = true;
+    add_line_history(other, "remote");
+    history_timing_t timing = make_timing(42, 3);
+    time_line_history(other, &timing);
+    merge_history(history);
+    const history_timing_t *merged = find_timing_history(history, history->count);
+    passed &= check(test_num, strcmp(find_line_history(history, history->count), "remote") == 0, "the line is merged");
+    passed &= check(test_num, merged != NULL && merged->wall_us == 42 && merged->status == 3, "its timing is merged");
+    free_history(other);
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// The shell times its commands: wall clock, the CPU of their processes and the exit status
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    msh_t *shell = alloc_shell(16, 1024, 10);
+    char line[128];
+    strcpy(line, "/bin/sleep 0.2");
+    evaluate(shell, line);
+    const history_timing_t *timing = find_timing_history(shell->history, 1);
+    passed &= check(test_num, timing != NULL && timing->wall_us >= 200000 && timing->status == 0,
+                    "the wall clock time is recorded");
+
+    strcpy(line, "/bin/true");
+    evaluate(shell, line);
+    strcpy(line, "false");
+    evaluate(shell, line);
+    timing = find_timing_history(shell->history, 3);
+    passed &= check(test_num, timing != NULL && timing->status == 1, "the exit status is recorded");
+
+    strcpy(line, "/usr/bin/yes | /usr/bin/head -c 100000000 | /usr/bin/wc -c");
+    evaluate(shell, line);
+    timing = find_timing_history(shell->history, 4);
+    passed &= check(test_num, timing != NULL && timing->user_us + timing->sys_us >= 10000,
+                    "the CPU time of every stage is recorded");
+    passed &= check(test_num, timing != NULL && timing->user_us + timing->sys_us <= timing->wall_us * 3 + 10000,
+                    "the CPU time is plausible");
+
+    strcpy(line, "/bin/sleep 0.1 &");
+    evaluate(shell, line);
+    timing = find_timing_history(shell->history, 5);
+    passed &= check(test_num, timing != NULL && timing->wall_us < 0, "background jobs only record their start");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Commands that look like timing lines are escaped, so they load and merge back unchanged
+void test4() {
+    int test_num = 4;
+    bool passed = true;
+    remove(HISTORY_FILE_PATH);
+    history_t *reader = alloc_history(10);
+    reader->merge = true;
+    history_t *history = alloc_history(10);
+    history->timed = true;
+    add_line_history(history, "#+1700000000000001 1 0 0 0");
+    history_timing_t timing = make_timing(5, 0);
+    time_line_history(history, &timing);
+    add_line_history(history, "next");
+    timing = make_timing(9, 1);
+    time_line_history(history, &timing);
+    history->timed = false;
+    add_line_history(history, "##double");
+    add_line_history(history, "#note");
+    free_history(history);
+    char *data = read_file(HISTORY_FILE_PATH, NULL);
+    passed &= check(test_num, strcmp(data, "#+1700000000000005 5 2 1 0\n##+1700000000000001 1 0 0 0\n"
+                                           "#+1700000000000009 9 4 2 1\nnext\n###double\n#note\n") == 0,
+                    "a command starting with #+ or ## gets a # in front");
+    free(data);
+
+    merge_history(reader);
+    history = alloc_history(10);
+    history_t *both[] = {history, reader};
+    for (int i = 0; i < 2; i++) {
+        const history_timing_t *first = find_timing_history(both[i], 1);
+        const history_timing_t *second = find_timing_history(both[i], 2);
+        passed &= check(test_num, both[i]->count == 4 &&
+                        strcmp(find_line_history(both[i], 1), "#+1700000000000001 1 0 0 0") == 0 &&
+                        strcmp(find_line_history(both[i], 2), "next") == 0 &&
+                        strcmp(find_line_history(both[i], 3), "##double") == 0 &&
+                        strcmp(find_line_history(both[i], 4), "#note") == 0,
+                        i == 0 ? "the commands load back as they were typed" : "and merge back");
+        passed &= check(test_num, first != NULL && first->wall_us == 5 && second != NULL && second->wall_us == 9,
+                        "each keeps its own timing");
+    }
+    free_history(reader);
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// A command typed over several lines is kept on one line of the text file, so it loads back
+// as one command with its own timing, and a here-document line starting with #+ stays in it
+void test5() {
+    int test_num = 5;
+    bool passed = true;
+    const char *commands[] = {"for i in 1 2\ndo echo $i\ndone", "cat <<EOF\n#+1700000000000001 1 0 0 0\nEOF",
+                              "#\\not joined", "printf 'a\\nb\\\\'\necho \\"};
+    remove(HISTORY_FILE_PATH);
+    history_t *reader = alloc_history(10);
+    reader->merge = true;
+    history_t *history = alloc_history(10);
+    history->timed = true;
+    add_line_history(history, commands[0]);
+    history_timing_t timing = make_timing(7, 0);
+    time_line_history(history, &timing);
+    history->timed = false;
+    for (int i = 1; i < 4; i++) {
+        add_line_history(history, commands[i]);
+    }
+    free_history(history);
+    char *data = read_file(HISTORY_FILE_PATH, NULL);
+    passed &= check(test_num, strcmp(data, "#+1700000000000007 7 3 1 0\n#\\for i in 1 2\\ndo echo $i\\ndone\n"
+                                           "#\\cat <<EOF\\n#+1700000000000001 1 0 0 0\\nEOF\n##\\not joined\n"
+                                           "#\\printf 'a\\\\nb\\\\\\\\'\\necho \\\\\n") == 0,
+                    "each command is written on one line");
+    free(data);
+
+    merge_history(reader);
+    history = alloc_history(10);
+    for (int pass = 0; pass < 3; pass++) {
+        history_t *loaded = pass == 0 ? history : reader;
+        if (pass == 2) {
+            // Converting to binary and back keeps the commands whole
+            passed &= check(test_num, convert_history(history, HISTORY_BINARY) == 4 &&
+                            convert_history(history, HISTORY_TEXT) == 4, "the file converts both ways");
+            free_history(history);
+            history = alloc_history(10);
+            loaded = history;
+        }
+        bool same = loaded->count == 4;
+        for (int i = 0; same && i < 4; i++) {
+            same = strcmp(find_line_history(loaded, i + 1), commands[i]) == 0;
+        }
+        const char *what[] = {"the commands load back whole", "and merge back whole", "and survive a conversion"};
+        passed &= check(test_num, same, what[pass]);
+        const history_timing_t *first = find_timing_history(loaded, 1);
+        passed &= check(test_num, first != NULL && first->wall_us == 7 && find_timing_history(loaded, 2) == NULL,
+                        "the timing stays with the whole command");
+    }
+    passed &= check(test_num, search_history(history, "do echo", false, history->count + 1) == 1,
+                    "a joined command is searched as typed");
+    free_history(reader);
+    free_history(history);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    test5();
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "input.h"
+#include "shell.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define INPUT_PATH "/tmp/msh_test_input"
+
+// A reader over a file holding the given text
+input_t *open_input(const char *text, size_t len) {
+    FILE *file = fopen(INPUT_PATH, "w");
+    fwrite(text, 1, len, file);
+    fclose(file);
+    return alloc_input(open(INPUT_PATH, O_RDONLY), 0);
+}
+
+void close_input(input_t *in) {
+    close(in->fd);
+    free_input(in);
+    unlink(INPUT_PATH);
+}
+
+// Reads until a line (or a continued line) is complete
+char *read_line(input_t *in, size_t *len, bool continued) {
+    char *line;
+    while ((line = continued ? continue_line(in, len) : next_line(in, len)) == NULL && !in->eof) {
+        fill_input(in);
+    }
+    return line;
+}
+
+// Lines are read from one buffer that is reused, and that grows for a long line
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    size_t long_len = 300000;
+    char *text = malloc(long_len + 4096);
+    size_t len = 0;
+    for (int i = 0; i < 100; i++) {
+        len += sprintf(text + len, "line %d\n", i);
+    }
+    memset(text + len, 'x', long_len);
+    len += long_len;
+    text[len++] = '\n';
+    len += sprintf(text + len, "last");
+    input_t *in = open_input(text, len);
+
+    size_t line_len;
+    char *line = read_line(in, &line_len, false);
+    char *buffer = in->buffer;
+    for (int i = 0; i < 100; i++) {
+        char expected[16];
+        snprintf(expected, sizeof(expected), "line %d", i);
+        passed &= check(test_num, line != NULL && strcmp(line, expected) == 0 && line_len == strlen(expected),
+                        "the line is read");
+        line = read_line(in, &line_len, false);
+        if (i < 99) {
+            passed &= check(test_num, in->buffer == buffer, "short lines reuse the buffer");
+        }
+    }
+    passed &= check(test_num, line != NULL && line_len == long_len && strspn(line, "x") == long_len,
+                    "a long line is read whole");
+    line = read_line(in, &line_len, false);
+    passed &= check(test_num, line != NULL && strcmp(line, "last") == 0, "a last line needs no newline");
+    passed &= check(test_num, read_line(in, &line_len, false) == NULL, "then the input ends");
+    close_input(in);
+    free(text);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// A continued line is joined in place, across reads that move the buffer
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    size_t long_len = 100000;
+    char *text = malloc(long_len + 64);
+    strcpy(text, "echo 'a\nb' \\\n");
+    size_t len = strlen(text);
+    memset(text + len, 'y', long_len);
+    len += long_len;
+    len += sprintf(text + len, "\nnext\n");
+    input_t *in = open_input(text, len);
+
+    size_t line_len;
+    char *line = read_line(in, &line_len, false);
+    passed &= check(test_num, line != NULL && strcmp(line, "echo 'a") == 0, "the first line is read");
+    line = read_line(in, &line_len, true);
+    passed &= check(test_num, line != NULL && strcmp(line, "echo 'a\nb' \\") == 0, "the second line is joined");
+    line = read_line(in, &line_len, true);
+    passed &= check(test_num, line != NULL && line_len == 13 + long_len && memcmp(line, text, line_len) == 0,
+                    "the third line is joined after the buffer grew");
+    line = read_line(in, &line_len, false);
+    passed &= check(test_num, line != NULL && strcmp(line, "next") == 0, "the next line is separate");
+    passed &= check(test_num, read_line(in, &line_len, true) == NULL, "nothing is left to join");
+    close_input(in);
+    free(text);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// evaluate_partial tells lines that go on apart, and lines are not limited unless asked
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    char *incomplete[] = {"echo 'a", "echo \"a", "echo a \\", "true &&", "true |"};
+    for (size_t i = 0; i < sizeof(incomplete) / sizeof(incomplete[0]); i++) {
+        passed &= check(test_num, evaluate_partial(shell, incomplete[i]) == EVALUATE_INCOMPLETE, "the line goes on");
+    }
+    shell->last_status = 0;
+    passed &= check(test_num, evaluate_partial(shell, "false") == 0 && shell->last_status == 1, "a complete line runs");
+    passed &= check(test_num, evaluate_partial(shell, "echo |; x") == 0 && shell->last_status == 2,
+                    "a syntax error is reported");
+
+    size_t long_len = 200000;
+    char *line = malloc(long_len + 16);
+    strcpy(line, "true ");
+    memset(line + 5, 'z', long_len);
+    line[5 + long_len] = '\0';
+    passed &= check(test_num, evaluate(shell, line) == 0 && shell->last_status == 0, "long lines run");
+    shell->max_line = 1024;
+    passed &= check(test_num, evaluate(shell, line) != 0, "-l still limits lines");
+    free(line);
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    return 0;
+}
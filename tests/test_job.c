@@ -0,0 +1,79 @@
+#include "job.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+void test1() {
+    int test_num = 1;
+    job_table_t *jobs = alloc_jobs(2);
+    bool passed = check(test_num, add_job(jobs, 100, BACKGROUND, "sleep 1"), "add_job(100) failed");
+    passed = passed && check(test_num, add_job(jobs, 200, FOREGROUND, "sleep 2"), "add_job(200) failed");
+    passed = passed && check(test_num, get_job_id_by_pid(jobs, 100) == 1, "job 100 should have jid 1");
+    passed = passed && check(test_num, get_job_id_by_pid(jobs, 200) == 2, "job 200 should have jid 2");
+    passed = passed && check(test_num, get_pid_by_job_id(jobs, 2) == 200, "jid 2 should map to pid 200");
+    passed = passed && check(test_num, get_job_id_by_pid(jobs, 300) == 0, "unknown pid should have jid 0");
+    passed = passed && check(test_num, get_pid_by_job_id(jobs, 3) == -1, "unknown jid should map to -1");
+    free_jobs(jobs);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+void test2() {
+    int test_num = 2;
+    // The table grows past its initial capacity instead of rejecting jobs
+    job_table_t *jobs = alloc_jobs(1);
+    bool passed = true;
+    for (int i = 1; i <= 20000 && passed; i++) {
+        passed = check(test_num, !jobs_full(jobs), "jobs_full() with a growable table") &&
+                 check(test_num, add_job(jobs, i, BACKGROUND, "cmd"), "add_job failed while growing");
+    }
+    passed = passed && check(test_num, count_jobs(jobs, BACKGROUND) == 20000, "background count should be 20000");
+    for (int i = 1; i <= 20000 && passed; i += 2) {
+        passed = check(test_num, delete_job(jobs, i), "delete_job failed");
+    }
+    passed = passed && check(test_num, count_jobs(jobs, BACKGROUND) == 10000, "background count should be 10000");
+    for (int i = 2; i <= 20000 && passed; i += 2) {
+        passed = check(test_num, get_job_id_by_pid(jobs, i) == i, "remaining jobs keep their jid");
+    }
+    for (int i = 1; i <= 20000 && passed; i += 2) {
+        passed = check(test_num, get_job_id_by_pid(jobs, i) == 0, "deleted jobs must not be found");
+    }
+    free_jobs(jobs);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+void test3() {
+    int test_num = 3;
+    // A pipeline is one job; it is deleted when its last process exits
+    job_table_t *jobs = alloc_jobs(4);
+    add_job(jobs, 500, FOREGROUND, "a | b | c");
+    add_job_process(jobs, 500, 501);
+    add_job_process(jobs, 500, 502);
+    bool passed = check(test_num, get_pgid_by_pid(jobs, 502) == 500, "stage 502 should belong to group 500");
+    update_job_state(jobs, 501, SUSPENDED);
+    passed = passed && check(test_num, count_jobs(jobs, SUSPENDED) == 1 && count_jobs(jobs, FOREGROUND) == 0, "state counts after stop");
+    passed = passed && check(test_num, delete_job_process(jobs, 500) == 0, "job should remain after the leader exits");
+    passed = passed && check(test_num, get_job_id_by_pid(jobs, 500) == 1, "job should still be found by its group id");
+    passed = passed && check(test_num, delete_job_process(jobs, 501) == 0, "job should remain while 502 runs");
+    passed = passed && check(test_num, delete_job_process(jobs, 502) == 500, "last exit should delete the job");
+    passed = passed && check(test_num, get_job_id_by_pid(jobs, 500) == 0, "deleted pipeline must not be found");
+    passed = passed && check(test_num, count_jobs(jobs, SUSPENDED) == 0, "state counts after delete");
+    passed = passed && check(test_num, delete_job_process(jobs, 502) == -1, "unknown pid should return -1");
+    // The freed slot is reused
+    add_job(jobs, 600, BACKGROUND, "sleep 1");
+    passed = passed && check(test_num, get_job_id_by_pid(jobs, 600) == 1, "freed jid should be reused");
+    passed = passed && check(test_num, has_background_job(jobs), "has_background_job");
+    free_jobs(jobs);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+int main() {
+    test1();
+    test2();
+    test3();
+    return 0;
+}
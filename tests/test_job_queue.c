@@ -0,0 +1,146 @@
+#include "shell.h"
+#include "event_loop.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// Waits for the queue to drain, returning the most background jobs seen running at once
+int drain(msh_t *shell) {
+    int most = count_jobs(shell->jobs, BACKGROUND);
+    while (shell->queue->count > 0 || has_background_job(shell->jobs)) {
+        wait_for_signals(shell);
+        int running = count_jobs(shell->jobs, BACKGROUND);
+        most = running > most ? running : most;
+    }
+    return most;
+}
+
+void test1(msh_t *shell) {
+    int test_num = 1;
+    // Jobs past the cap are queued in order instead of launched
+    shell->queue->max_running = 2;
+    for (int i = 0; i < 6; i++) {
+        run(shell, "/bin/sleep 0.2 &");
+    }
+    bool passed = check(test_num, count_jobs(shell->jobs, BACKGROUND) == 2, "only 2 jobs should run");
+    passed = passed && check(test_num, shell->queue->count == 4, "4 jobs should be queued");
+    run(shell, "/bin/echo last &");
+    passed = passed && check(test_num, strcmp(shell->queue->tail->cmd_line, "/bin/echo last ") == 0, "new job should be queued last");
+    passed = passed && check(test_num, clear_job_queue(shell->queue) == 5, "clear should drop 5 jobs");
+    passed = passed && check(test_num, shell->queue->head == NULL && shell->queue->count == 0, "queue should be empty");
+    drain(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test2(msh_t *shell) {
+    int test_num = 2;
+    // Every queued job eventually runs, and never more than the cap at once
+    shell->queue->max_running = 3;
+    char path[64], cmd[128];
+    for (int i = 0; i < 40; i++) {
+        snprintf(path, sizeof(path), "/tmp/msh_queue_test_%d", i);
+        unlink(path);
+        snprintf(cmd, sizeof(cmd), "/usr/bin/touch %s &", path);
+        run(shell, cmd);
+    }
+    bool passed = check(test_num, drain(shell) <= 3, "more jobs ran than the cap allows");
+    for (int i = 0; i < 40 && passed; i++) {
+        snprintf(path, sizeof(path), "/tmp/msh_queue_test_%d", i);
+        passed = check(test_num, access(path, F_OK) == 0, "a queued job never ran");
+        unlink(path);
+    }
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test3(msh_t *shell) {
+    int test_num = 3;
+    // Queued pipelines start too, and a foreground job keeps its own exit status
+    shell->queue->max_running = 1;
+    run(shell, "/bin/sleep 0.1 &");
+    run(shell, "/bin/true | /bin/true &");
+    run(shell, "/bin/true | /bin/true &");
+    bool passed = check(test_num, shell->queue->count == 2, "pipelines should be queued");
+    run(shell, "/bin/sleep 0.3");
+    run(shell, "/bin/false");
+    passed = passed && check(test_num, shell->last_status == 1, "foreground status was overwritten");
+    drain(shell);
+    passed = passed && check(test_num, shell->queue->count == 0 && count_jobs(shell->jobs, BACKGROUND) == 0, "queue did not drain");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test4(msh_t *shell) {
+    int test_num = 4;
+    // Jobs queued by a loop run the words they had when they were queued, not the last ones
+    shell->queue->max_running = 1;
+    run(shell, "/bin/sleep 0.1 &");
+    run(shell, "for i in 1 2 3 4; do /bin/echo item $i > /tmp/msh_queue_loop_$i & done");
+    bool passed = check(test_num, shell->queue->count == 4, "the loop's jobs should be queued");
+    drain(shell);
+    char path[64], expected[16];
+    for (int i = 1; i <= 4 && passed; i++) {
+        snprintf(path, sizeof(path), "/tmp/msh_queue_loop_%d", i);
+        snprintf(expected, sizeof(expected), "item %d\n", i);
+        char *out = read_file(path, NULL);
+        passed = check(test_num, strcmp(out, expected) == 0, "a queued job ran with later words");
+        free(out);
+        unlink(path);
+    }
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test5(msh_t *shell) {
+    int test_num = 5;
+    // && lists and { } groups queued by a loop see the loop's values from when they were queued
+    shell->queue->max_running = 1;
+    run(shell, "/bin/sleep 0.1 &");
+    run(shell, "for i in 1 2 3; do /bin/true && /bin/echo and $i > /tmp/msh_queue_and_$i & "
+               "{ x=$i; /bin/echo group $x > /tmp/msh_queue_group_$i; } & done");
+    bool passed = check(test_num, shell->queue->count == 6, "the loop's lists should be queued");
+    passed &= check(test_num, shell->queue->head != NULL && shell->queue->head->pid > 0 &&
+                    shell->queue->head->pipeline == NULL, "a queued list should be held in a forked subshell");
+    drain(shell);
+    char path[64], expected[16];
+    for (int i = 1; i <= 3 && passed; i++) {
+        for (int group = 0; group < 2; group++) {
+            snprintf(path, sizeof(path), group ? "/tmp/msh_queue_group_%d" : "/tmp/msh_queue_and_%d", i);
+            snprintf(expected, sizeof(expected), group ? "group %d\n" : "and %d\n", i);
+            char *out = read_file(path, NULL);
+            passed &= check(test_num, strcmp(out, expected) == 0, "a queued list ran with later values");
+            free(out);
+            unlink(path);
+        }
+    }
+
+    // A cleared list never runs
+    run(shell, "/bin/sleep 0.1 &");
+    run(shell, "{ /bin/echo dropped > /tmp/msh_queue_dropped; } &");
+    passed &= check(test_num, clear_job_queue(shell->queue) == 1, "clear should drop the held list");
+    drain(shell);
+    usleep(100000);
+    passed &= check(test_num, access("/tmp/msh_queue_dropped", F_OK) != 0, "a dropped list should not run");
+    unlink("/tmp/msh_queue_dropped");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    shell = alloc_shell(16, 1024, 10);
+    test1(shell);
+    test2(shell);
+    test3(shell);
+    test4(shell);
+    test5(shell);
+    return 0;
+}
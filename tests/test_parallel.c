@@ -0,0 +1,90 @@
+#include "shell.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Runs a command line and returns what it wrote to standard output
+char *run_output(msh_t *shell, const char *cmd) {
+    static char output[4096];
+    char line[256];
+    strcpy(line, cmd);
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    FILE *capture = tmpfile();
+    dup2(fileno(capture), STDOUT_FILENO);
+    evaluate(shell, line);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    size_t n = pread(fileno(capture), output, sizeof(output) - 1, 0);
+    output[n] = '\0';
+    fclose(capture);
+    return output;
+}
+
+void test1(msh_t *shell) {
+    int test_num = 1;
+    // {} is replaced inside arguments and output keeps item order
+    bool passed = check(test_num, strcmp(run_output(shell, "parallel -j 2 /bin/echo x{}y ::: a b c"), "xay\nxby\nxcy\n") == 0, "wrong output");
+    passed = passed && check(test_num, shell->last_status == 0, "status should be 0");
+    // Without {} the item is appended
+    passed = passed && check(test_num, strcmp(run_output(shell, "parallel echo item ::: 1 2"), "item 1\nitem 2\n") == 0, "item not appended");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test2(msh_t *shell) {
+    int test_num = 2;
+    // Items finishing out of order are still printed in order, each as one group
+    FILE *script = fopen("/tmp/msh_parallel_test.sh", "w");
+    fprintf(script, "echo start $1; sleep $1; echo end $1\n");
+    fclose(script);
+    char *out = run_output(shell, "parallel -j 3 /bin/sh /tmp/msh_parallel_test.sh {} ::: 0.3 0.1 0.2");
+    bool passed = check(test_num, strcmp(out, "start 0.3\nend 0.3\nstart 0.1\nend 0.1\nstart 0.2\nend 0.2\n") == 0, "output not grouped in order");
+    unlink("/tmp/msh_parallel_test.sh");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test3(msh_t *shell) {
+    int test_num = 3;
+    // The status is the number of failed items; no job is left behind
+    run_output(shell, "parallel -j 4 /usr/bin/test {} = b ::: a b c d");
+    bool passed = check(test_num, shell->last_status == 3, "3 items should fail");
+    passed = passed && check(test_num, count_jobs(shell->jobs, FOREGROUND) == 0, "items left in the job table");
+    run_output(shell, "parallel /nonexistent/cmd ::: 1 2");
+    passed = passed && check(test_num, shell->last_status == 2, "items that cannot start count as failed");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test4(msh_t *shell) {
+    int test_num = 4;
+    // Never more than -j items run at once
+    FILE *script = fopen("/tmp/msh_parallel_test.sh", "w");
+    // Each running item holds one of two lock directories; a third concurrent item finds none free
+    fprintf(script, "L=/tmp/msh_parallel_lock; if mkdir $L.0 2>/dev/null; then s=0; elif mkdir $L.1 2>/dev/null; then s=1; else exit 1; fi; sleep 0.05; rmdir $L.$s\n");
+    fclose(script);
+    run_output(shell, "parallel -j 2 /bin/sh /tmp/msh_parallel_test.sh {} ::: 1 2 3 4 5 6 7 8");
+    bool passed = check(test_num, shell->last_status == 0, "more items ran than -j allows");
+    unlink("/tmp/msh_parallel_test.sh");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    shell = alloc_shell(16, 1024, 10);
+    test1(shell);
+    test2(shell);
+    test3(shell);
+    test4(shell);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "shell.h"
+#include "builtins.h"
+#include "signal_handlers.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// A repeated line is a hit that shares the first tree, with its builtins resolved
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    parse_cache_t *cache = alloc_parse_cache(1 << 20);
+    parse_tree_t *first;
+    parse_tree_t *second;
+    passed &= check(test_num, acquire_parse_tree(cache, "echo hi | /bin/cat; jobs", &first, NULL) == PARSE_OK,
+                    "the line parses");
+    passed &= check(test_num, cache->misses == 1 && cache->hits == 0 && cache->count == 1, "the first parse is a miss");
+    command_t *command = first->lists->pipelines->commands;
+    passed &= check(test_num, command->builtin == find_builtin("echo") && command->next->builtin == NULL &&
+                    first->lists->next->pipelines->commands->builtin == find_builtin("jobs"), "builtins are resolved");
+    passed &= check(test_num, acquire_parse_tree(cache, "echo hi | /bin/cat; jobs", &second, NULL) == PARSE_OK &&
+                    second == first, "the tree is shared");
+    passed &= check(test_num, cache->hits == 1 && cache->misses == 1, "the second parse is a hit");
+    release_parse_tree(first);
+    release_parse_tree(second);
+
+    // Lines that differ only in a byte are different entries; errors are not cached
+    passed &= check(test_num, acquire_parse_tree(cache, "echo hi | /bin/cat; jobs ", &first, NULL) == PARSE_OK &&
+                    cache->misses == 2 && cache->count == 2, "a different line is a miss");
+    release_parse_tree(first);
+    const char *error;
+    passed &= check(test_num, acquire_parse_tree(cache, "ls |", &first, &error) == PARSE_INCOMPLETE && first == NULL,
+                    "an incomplete line is reported");
+    passed &= check(test_num, acquire_parse_tree(cache, "ls |", &first, &error) == PARSE_INCOMPLETE && cache->count == 2,
+                    "failed parses are not cached");
+    clear_parse_cache(cache);
+    passed &= check(test_num, cache->count == 0 && cache->bytes == 0 && cache->hits == 1, "clearing keeps the counters");
+    free_parse_cache(cache);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// The cache stays under its memory bound by evicting the least recently used lines
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    parse_cache_t *cache = alloc_parse_cache(16 * 1024);
+    char line[64];
+    parse_tree_t *tree;
+    for (int i = 0; i < 1000; i++) {
+        snprintf(line, sizeof(line), "/bin/echo %d && /bin/true", i);
+        acquire_parse_tree(cache, line, &tree, NULL);
+        release_parse_tree(tree);
+        // Line 0 is used all along, so it is never the least recently used
+        acquire_parse_tree(cache, "/bin/echo 0 && /bin/true", &tree, NULL);
+        release_parse_tree(tree);
+        passed &= check(test_num, cache->bytes <= cache->max_bytes, "the bound is kept");
+    }
+    passed &= check(test_num, cache->count > 1 && cache->count < 1000, "old lines are evicted");
+    long long hits = cache->hits;
+    acquire_parse_tree(cache, "/bin/echo 0 && /bin/true", &tree, NULL);
+    release_parse_tree(tree);
+    acquire_parse_tree(cache, "/bin/echo 999 && /bin/true", &tree, NULL);
+    release_parse_tree(tree);
+    passed &= check(test_num, cache->hits == hits + 2, "recent lines are kept");
+    acquire_parse_tree(cache, "/bin/echo 1 && /bin/true", &tree, NULL);
+    release_parse_tree(tree);
+    passed &= check(test_num, cache->hits == hits + 2, "the oldest lines are gone");
+
+    // A tree evicted while it is held stays valid until it is released
+    parse_tree_t *held;
+    acquire_parse_tree(cache, "/bin/echo held", &held, NULL);
+    for (int i = 0; i < 1000; i++) {
+        snprintf(line, sizeof(line), "/bin/echo other %d", i);
+        acquire_parse_tree(cache, line, &tree, NULL);
+        release_parse_tree(tree);
+    }
+    passed &= check(test_num, held->refs == 1 && strcmp(held->lists->pipelines->commands->argv[1], "held") == 0,
+                    "an evicted tree is kept for its holder");
+    release_parse_tree(held);
+
+    // A line too large for the cache is parsed but not cached
+    char big[8192];
+    strcpy(big, "/bin/echo");
+    while (strlen(big) < sizeof(big) - 8) {
+        strcat(big, " x");
+    }
+    int count = cache->count;
+    passed &= check(test_num, acquire_parse_tree(cache, big, &tree, NULL) == PARSE_OK && cache->count <= count,
+                    "large lines are not cached");
+    release_parse_tree(tree);
+    free_parse_cache(cache);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// The shell reuses the trees of lines it runs again, including lines re-executed with !N
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 1024, 10);
+    for (int i = 0; i < 5; i++) {
+        run(shell, "true && false || true");
+    }
+    passed &= check(test_num, shell->parse_cache->misses == 1 && shell->parse_cache->hits == 4,
+                    "a repeated line is parsed once");
+    passed &= check(test_num, shell->last_status == 0, "the cached line still runs");
+    char line[32];
+    snprintf(line, sizeof(line), "!%d", shell->history->count);
+    run(shell, line);
+    passed &= check(test_num, shell->parse_cache->hits == 5 && shell->parse_cache->misses == 2,
+                    "!N runs the cached tree");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    return 0;
+}
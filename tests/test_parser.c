@@ -0,0 +1,161 @@
+#include "shell.h"
+#include "event_loop.h"
+#include "signal_handlers.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// The words of a command joined with ','
+void joined_argv(const command_t *command, char *out, size_t size) {
+    out[0] = '\0';
+    for (int i = 0; i < command->argc; i++) {
+        strncat(out, command->argv[i], size - strlen(out) - 2);
+        strcat(out, ",");
+    }
+}
+
+// Lists, pipelines, commands and their connectors, with the text each list was typed as
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    parse_tree_t *tree;
+    passed &= check(test_num, parse_line("ls -l | wc && echo ok || echo no & cd ..; cat f\necho end", &tree, NULL) == PARSE_OK,
+                    "the line parses");
+    passed &= check(test_num, tree->num_lists == 4, "four lists");
+    and_or_t *list = tree->lists;
+    passed &= check(test_num, list->num_pipelines == 3 && list->job_type == BACKGROUND, "the first list runs in the background");
+    passed &= check(test_num, strcmp(list->text, "ls -l | wc && echo ok || echo no ") == 0, "the text ends at the terminator");
+    pipeline_t *pipeline = list->pipelines;
+    char out[256];
+    joined_argv(pipeline->commands, out, sizeof(out));
+    passed &= check(test_num, pipeline->num_commands == 2 && strcmp(out, "ls,-l,") == 0 &&
+                    strcmp(pipeline->commands->next->argv[0], "wc") == 0, "the pipeline has two commands");
+    passed &= check(test_num, pipeline->connector == CONNECT_NONE && pipeline->next->connector == CONNECT_AND &&
+                    pipeline->next->next->connector == CONNECT_OR, "the connectors are kept");
+    list = list->next;
+    passed &= check(test_num, list->job_type == FOREGROUND && strcmp(list->text, " cd ..") == 0, "the second list");
+    list = list->next;
+    passed &= check(test_num, strcmp(list->text, " cat f") == 0, "a newline ends a list");
+    passed &= check(test_num, strcmp(list->next->text, "echo end") == 0 && list->next->next == NULL, "the last list");
+    free_parse_tree(tree);
+
+    // Separators with nothing before them are skipped, as parse_tok does
+    passed &= check(test_num, parse_line("cat file.txt     ;   ls    & cd ..      ;", &tree, NULL) == PARSE_OK &&
+                    tree->num_lists == 3 && strcmp(tree->lists->next->text, "   ls    ") == 0 &&
+                    strcmp(tree->lists->next->next->text, " cd ..      ") == 0, "texts match parse_tok");
+    free_parse_tree(tree);
+    passed &= check(test_num, parse_line("  ;; & ", &tree, NULL) == PARSE_OK && tree->num_lists == 0, "no lists");
+    free_parse_tree(tree);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Quoting, comments and redirections
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    parse_tree_t *tree;
+    char out[256];
+    passed &= check(test_num, parse_line("echo 'a  b' \"c \\\"d\\\" \\x $y\" e\\ f '' g\"h\"'i' # not; this", &tree, NULL) == PARSE_OK,
+                    "the quoted line parses");
+    joined_argv(tree->lists->pipelines->commands, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo,a  b,c \"d\" \\x ,e f,,ghi,") == 0, "quotes are removed");
+    passed &= check(test_num, tree->num_lists == 1, "the comment is not parsed");
+    free_parse_tree(tree);
+
+    passed &= check(test_num, parse_line("echo a\\\nb 'x;y' \"|\" && ls", &tree, NULL) == PARSE_OK, "joined lines parse");
+    joined_argv(tree->lists->pipelines->commands, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo,ab,x;y,|,") == 0 && tree->lists->num_pipelines == 2,
+                    "quoted operators are words");
+    free_parse_tree(tree);
+
+    passed &= check(test_num, parse_line("sort <in 2>>err >out 3<&0 2>&1 x", &tree, NULL) == PARSE_OK, "redirections parse");
+    command_t *command = tree->lists->pipelines->commands;
+    joined_argv(command, out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "sort,x,") == 0, "redirections are not arguments");
+    redirect_type_t types[] = {REDIRECT_IN, REDIRECT_APPEND, REDIRECT_OUT, REDIRECT_DUP_IN, REDIRECT_DUP_OUT};
+    int fds[] = {0, 2, 1, 3, 2};
+    const char *targets[] = {"in", "err", "out", "0", "1"};
+    redirect_t *redirect = command->redirects;
+    for (int i = 0; i < 5; i++) {
+        passed &= check(test_num, redirect != NULL && redirect->type == types[i] && redirect->fd == fds[i] &&
+                        strcmp(redirect->target, targets[i]) == 0, "redirections are kept in order");
+        redirect = redirect == NULL ? NULL : redirect->next;
+    }
+    free_parse_tree(tree);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Syntax errors, and lines that are only incomplete
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    const char *errors[] = {"ls |; ls", "| ls", "&& ls", "ls || || ls", "ls >", "ls > | wc"};
+    for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+        parse_tree_t *tree;
+        const char *error = NULL;
+        passed &= check(test_num, parse_line(errors[i], &tree, &error) == PARSE_ERROR && tree == NULL && error != NULL,
+                        "syntax errors are reported");
+    }
+    const char *incomplete[] = {"ls &&", "ls |", "ls ||\n", "echo 'abc", "echo \"abc", "echo abc\\"};
+    for (size_t i = 0; i < sizeof(incomplete) / sizeof(incomplete[0]); i++) {
+        parse_tree_t *tree;
+        passed &= check(test_num, parse_line(incomplete[i], &tree, NULL) == PARSE_INCOMPLETE && tree == NULL,
+                        "incomplete lines are told apart");
+    }
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// The executor runs && and || by exit status, and a line re-executed with !N does not stop the
+// line it is part of
+void test4() {
+    int test_num = 4;
+    bool passed = true;
+    const char *paths[] = {"/tmp/msh_parser_a", "/tmp/msh_parser_b", "/tmp/msh_parser_c", "/tmp/msh_parser_d"};
+    for (int i = 0; i < 4; i++) {
+        unlink(paths[i]);
+    }
+    msh_t *shell = alloc_shell(16, 1024, 10);
+    run(shell, "false && /usr/bin/touch /tmp/msh_parser_a || /usr/bin/touch /tmp/msh_parser_b");
+    passed &= check(test_num, access(paths[0], F_OK) != 0 && access(paths[1], F_OK) == 0, "&& and || follow the status");
+
+    run(shell, "/bin/true");
+    char line[64];
+    snprintf(line, sizeof(line), "!%d; /usr/bin/touch /tmp/msh_parser_c", shell->history->count);
+    run(shell, line);
+    passed &= check(test_num, access(paths[2], F_OK) == 0, "the rest of the line runs after !N");
+
+    run(shell, "/bin/sleep 0.1 && /usr/bin/touch /tmp/msh_parser_d &");
+    passed &= check(test_num, access(paths[3], F_OK) != 0 && count_jobs(shell->jobs, BACKGROUND) == 1,
+                    "a background list is one job");
+    while (has_background_job(shell->jobs)) {
+        wait_for_signals(shell);
+    }
+    passed &= check(test_num, access(paths[3], F_OK) == 0, "the background list runs to the end");
+
+    run(shell, "echo 'unterminated");
+    passed &= check(test_num, shell->last_status == 2, "a syntax error sets the status");
+    exit_shell(shell);
+    for (int i = 0; i < 4; i++) {
+        unlink(paths[i]);
+    }
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    return 0;
+}
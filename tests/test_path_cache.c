@@ -0,0 +1,103 @@
+#include "path_cache.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+char dir_a[] = "/tmp/msh_path_a_XXXXXX";
+char dir_b[] = "/tmp/msh_path_b_XXXXXX";
+
+void make_executable(const char *dir, const char *name) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0755);
+    close(fd);
+}
+
+void remove_file(const char *dir, const char *name) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    unlink(path);
+}
+
+bool check_resolve(int test_num, path_cache_t *cache, const char *name, const char *expected_dir) {
+    const char *got = resolve_command(cache, name);
+    char expected[256];
+    if (expected_dir != NULL) {
+        snprintf(expected, sizeof(expected), "%s/%s", expected_dir, name);
+    }
+    if ((expected_dir == NULL && got != NULL) || (expected_dir != NULL && (got == NULL || strcmp(got, expected) != 0))) {
+        printf("----\n");
+        printf("Test %d failed: resolve_command(cache,%s) returned incorrect value.\n", test_num, name);
+        printf("Expected:%s\n", expected_dir == NULL ? "NULL" : expected);
+        printf("Got:%s\n", got == NULL ? "NULL" : got);
+        printf("----\n");
+        return false;
+    }
+    return true;
+}
+
+void test1() {
+    int test_num = 1;
+    path_cache_t *cache = alloc_path_cache();
+    bool passed = check_resolve(test_num, cache, "tool", dir_a);
+    passed = passed && check_resolve(test_num, cache, "missing", NULL);
+    // Paths with a slash bypass the lookup entirely
+    passed = passed && strcmp(resolve_command(cache, "./tool"), "./tool") == 0;
+    free_path_cache(cache);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+void test2() {
+    int test_num = 2;
+    path_cache_t *cache = alloc_path_cache();
+    make_executable(dir_b, "both");
+    make_executable(dir_a, "both");
+    // The first PATH directory wins
+    bool passed = check_resolve(test_num, cache, "both", dir_a);
+    // Removing the cached executable must invalidate the entry
+    remove_file(dir_a, "both");
+    passed = passed && check_resolve(test_num, cache, "both", dir_b);
+    remove_file(dir_b, "both");
+    passed = passed && check_resolve(test_num, cache, "both", NULL);
+    free_path_cache(cache);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+void test3() {
+    int test_num = 3;
+    path_cache_t *cache = alloc_path_cache();
+    bool passed = hash_command(cache, "tool") && !hash_command(cache, "missing");
+    passed = passed && cache->count == 1;
+    // Changing PATH drops entries resolved against the old value
+    setenv("PATH", dir_b, 1);
+    passed = passed && check_resolve(test_num, cache, "tool", NULL);
+    clear_path_cache(cache);
+    passed = passed && cache->count == 0;
+    free_path_cache(cache);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+int main() {
+    mkdtemp(dir_a);
+    mkdtemp(dir_b);
+    char path_env[128];
+    snprintf(path_env, sizeof(path_env), "%s:%s", dir_a, dir_b);
+    setenv("PATH", path_env, 1);
+    make_executable(dir_a, "tool");
+
+    test1();
+    test2();
+    test3();
+
+    remove_file(dir_a, "tool");
+    rmdir(dir_a);
+    rmdir(dir_b);
+    return 0;
+}
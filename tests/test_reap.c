@@ -0,0 +1,78 @@
+#include "shell.h"
+#include "event_loop.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Waits until every job has been reaped; returns false if some job never is
+bool drain(msh_t *shell) {
+    for (int i = 0; i < 100000 && count_jobs(shell->jobs, BACKGROUND) + count_jobs(shell->jobs, FOREGROUND) > 0; i++) {
+        wait_for_signals(shell);
+    }
+    return count_jobs(shell->jobs, BACKGROUND) + count_jobs(shell->jobs, FOREGROUND) == 0;
+}
+
+bool no_zombies() {
+    int status;
+    return waitpid(-1, &status, WNOHANG) == -1 && errno == ECHILD;
+}
+
+void test1(msh_t *shell) {
+    int test_num = 1;
+    // A storm of short-lived background jobs: coalesced SIGCHLDs must not leave any behind
+    bool passed = true;
+    for (int i = 0; i < 3000 && passed; i++) {
+        passed = check(test_num, run(shell, "/bin/true &") == 0, "evaluate failed");
+    }
+    passed = passed && check(test_num, drain(shell), "background jobs were lost");
+    passed = passed && check(test_num, no_zombies(), "zombie children remain");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test2(msh_t *shell) {
+    int test_num = 2;
+    // Foreground pipelines return once every stage has exited
+    bool passed = true;
+    for (int i = 0; i < 300 && passed; i++) {
+        run(shell, "/bin/true | /bin/true | /bin/true");
+        passed = check(test_num, shell->curr_foreground_pid == 0, "foreground job still set");
+        passed = passed && check(test_num, count_jobs(shell->jobs, FOREGROUND) == 0, "foreground job not reaped");
+    }
+    passed = passed && check(test_num, no_zombies(), "zombie children remain");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+void test3(msh_t *shell) {
+    int test_num = 3;
+    // Background pipelines exiting while foreground jobs run are reaped too
+    bool passed = true;
+    for (int i = 0; i < 500 && passed; i++) {
+        run(shell, "/bin/true | /bin/true &");
+        if (i % 10 == 0) {
+            run(shell, "/bin/false");
+            passed = check(test_num, shell->last_status == 1, "wrong foreground exit status");
+        }
+    }
+    passed = passed && check(test_num, drain(shell), "background pipelines were lost");
+    passed = passed && check(test_num, no_zombies(), "zombie children remain");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    shell = alloc_shell(16, 1024, 10);
+    test1(shell);
+    test2(shell);
+    test3(shell);
+    return 0;
+}
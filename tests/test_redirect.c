@@ -0,0 +1,155 @@
+#include "shell.h"
+#include "redirect.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// Whether a file holds exactly expected
+bool file_is(const char *path, const char *expected) {
+    char *data = read_file(path, NULL);
+    bool same = strcmp(data, expected) == 0;
+    free(data);
+    return same;
+}
+
+// Runs a line that names the scratch file with each %s
+void run_on(msh_t *shell, const char *path, const char *format) {
+    char line[1024];
+    snprintf(line, sizeof(line), format, path, path, path);
+    evaluate(shell, line);
+}
+
+// Here-documents and here-strings are read by the parser, and an unfinished one goes on on the next line
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    parse_tree_t *tree;
+    passed &= check(test_num, parse_line("cat <<EOF >out\none $x\n\tEOF\nEOF\n", &tree, NULL) == PARSE_OK,
+                    "a here-document parses");
+    if (tree != NULL) {
+        redirect_t *redirect = tree->lists->pipelines->commands->redirects;
+        passed &= check(test_num, redirect != NULL && redirect->type == REDIRECT_HERE_DOC && redirect->fd == 0 &&
+                        strncmp(redirect->target, "one ", 4) == 0 && strstr(redirect->target, "\n\tEOF\n") != NULL &&
+                        redirect->expand != NULL,
+                        "its body is the lines up to the delimiter, and it expands");
+        passed &= check(test_num, redirect != NULL && redirect->next != NULL && redirect->next->type == REDIRECT_OUT &&
+                        redirect->next->fd == 1, "the redirections after it keep their order");
+        free_parse_tree(tree);
+    }
+    passed &= check(test_num, parse_line("cat <<-'EOF'\n\t$x\n\tEOF\n", &tree, NULL) == PARSE_OK &&
+                    strcmp(tree->lists->pipelines->commands->redirects->target, "$x\n") == 0 &&
+                    tree->lists->pipelines->commands->redirects->expand == NULL,
+                    "<<- strips tabs and a quoted delimiter keeps the body literal");
+    free_parse_tree(tree);
+    passed &= check(test_num, parse_line("cat <<< 'a b'", &tree, NULL) == PARSE_OK &&
+                    tree->lists->pipelines->commands->redirects->type == REDIRECT_HERE_STRING,
+                    "<<< is a here-string");
+    free_parse_tree(tree);
+    passed &= check(test_num, parse_line("cat <<EOF\nno end\n", &tree, NULL) == PARSE_INCOMPLETE,
+                    "a here-document without its delimiter goes on");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Programs write to files, and descriptors are copied in order
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    char path[] = "/tmp/msh_redirect_XXXXXX";
+    close(mkstemp(path));
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    run_on(shell, path, "/bin/echo first > %s");
+    passed &= check(test_num, file_is(path, "first\n"), "> writes the file");
+    run_on(shell, path, "/bin/echo second >> %s");
+    passed &= check(test_num, file_is(path, "first\nsecond\n"), ">> appends");
+    run_on(shell, path, "ls /nonexistent-msh-path > %s 2>&1");
+    char *out = read_file(path, NULL);
+    passed &= check(test_num, strstr(out, "nonexistent-msh-path") != NULL, "2>&1 sends errors where output goes");
+    free(out);
+    run_on(shell, path, "/bin/sh -c 'read line; echo \"got $line\"' < %s > %s.out");
+    char copy[300];
+    snprintf(copy, sizeof(copy), "%s.out", path);
+    out = read_file(copy, NULL);
+    passed &= check(test_num, strncmp(out, "got ", 4) == 0, "< reads the file");
+    free(out);
+    run_on(shell, path, "/bin/echo x > /nonexistent-msh-path/file");
+    passed &= check(test_num, shell->last_status == 1, "a file that cannot be opened fails the command");
+    exit_shell(shell);
+    unlink(copy);
+    unlink(path);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Builtins, functions and compound commands redirect the shell, which gets its descriptors back
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    char path[] = "/tmp/msh_redirect_XXXXXX";
+    close(mkstemp(path));
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    int before = dup(STDOUT_FILENO);
+    run_on(shell, path, "echo builtin > %s");
+    passed &= check(test_num, file_is(path, "builtin\n"), "a builtin writes the file");
+    run_on(shell, path, "f() { echo in f; }; f > %s");
+    passed &= check(test_num, file_is(path, "in f\n"), "so does a function");
+    run_on(shell, path, "for i in 1 2 3; do echo $i; if [ $i = 2 ]; then break; fi; done > %s");
+    passed &= check(test_num, file_is(path, "1\n2\n"),
+                    "a loop redirects all of its commands, and break leaves it");
+    run_on(shell, path, "while true; do { echo once; break; } > %s; done");
+    passed &= check(test_num, file_is(path, "once\n"),
+                    "break out of a redirected group");
+    passed &= check(test_num, shell->fd_stack.count == 0, "every saved descriptor is put back");
+    int after = dup(STDOUT_FILENO);
+    passed &= check(test_num, after == before + 1, "and no descriptor is left open");
+    close(after);
+    close(before);
+    exit_shell(shell);
+    unlink(path);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Here-documents expand their bodies and programs read them from memory
+void test4() {
+    int test_num = 4;
+    bool passed = true;
+    char path[] = "/tmp/msh_redirect_XXXXXX";
+    close(mkstemp(path));
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    evaluate(shell, "name=world");
+    run_on(shell, path, "/bin/cat <<EOF > %s\nhello $name\n\\$name\nEOF\n");
+    passed &= check(test_num, file_is(path, "hello world\n$name\n"),
+                    "a here-document expands, and \\$ is a dollar");
+    run_on(shell, path, "/bin/cat <<'EOF' > %s\nhello $name\nEOF\n");
+    passed &= check(test_num, file_is(path, "hello $name\n"),
+                    "a quoted delimiter keeps it literal");
+    run_on(shell, path, "/bin/cat <<< \"$name\" > %s");
+    passed &= check(test_num, file_is(path, "world\n"),
+                    "a here-string is its word and a newline");
+    run_on(shell, path, "/bin/cat <<EOF | /bin/cat > %s\npiped\nEOF\n");
+    passed &= check(test_num, file_is(path, "piped\n"),
+                    "a stage of a pipeline reads it");
+    exit_shell(shell);
+    unlink(path);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    return 0;
+}
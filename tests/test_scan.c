@@ -0,0 +1,142 @@
+#include "scan.h"
+#include "parser.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+bool reference_special(unsigned char c) {
+    return c <= ' ' || c == '\'' || c == '"' || c == '`' || c == '\\' || c == '$' || c == ';' || c == '&' || c == '|' || c == '<' || c == '>';
+}
+
+// Every implementation marks exactly the special bytes, at every length and alignment
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    const scan_impl_t *impls;
+    int count = scan_implementations(&impls);
+    passed &= check(test_num, count >= 1 && strcmp(impls[count - 1].name, "scalar") == 0, "the scalar fallback is listed");
+    char *buf = malloc(4096 + 1);
+    uint64_t bitmap[66];
+    srand(19);
+    for (int round = 0; round < 2000; round++) {
+        size_t len = round < 200 ? round : (size_t)rand() % 4096;
+        size_t offset = rand() % 2;
+        for (size_t i = 0; i < len; i++) {
+            // Mostly plain bytes, with every kind of byte (including >= 0x80) mixed in
+            buf[offset + i] = rand() % 4 == 0 ? (char)(rand() % 256) : "abc-_./=$#~\"';&|<> \t`"[rand() % 21];
+        }
+        for (int k = 0; k < count; k++) {
+            // Words past the end must come back clear
+            memset(bitmap, 0xff, sizeof(bitmap));
+            impls[k].classify(buf + offset, len, bitmap);
+            bool same = true;
+            for (size_t i = 0; i < len; i++) {
+                same &= ((bitmap[i / 64] >> (i % 64)) & 1) == reference_special((unsigned char)buf[offset + i]);
+            }
+            if (len % 64 != 0) {
+                same &= bitmap[len / 64] >> (len % 64) == 0;
+            }
+            passed &= check(test_num, same, impls[k].name);
+        }
+    }
+    free(buf);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// next_special finds set bits across words and stops at the end of the line
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    char line[300];
+    memset(line, 'a', sizeof(line));
+    line[5] = ' ';
+    line[64] = ';';
+    line[250] = '|';
+    uint64_t bitmap[5];
+    classify_line(line, sizeof(line), bitmap);
+    passed &= check(test_num, next_special(bitmap, sizeof(line), 0) == 5, "the first special byte");
+    passed &= check(test_num, next_special(bitmap, sizeof(line), 5) == 5, "a special byte at the start");
+    passed &= check(test_num, next_special(bitmap, sizeof(line), 6) == 64, "the next word");
+    passed &= check(test_num, next_special(bitmap, sizeof(line), 65) == 250, "words with no special byte are skipped");
+    passed &= check(test_num, next_special(bitmap, sizeof(line), 251) == 300, "none left");
+    passed &= check(test_num, next_special(bitmap, 0, 0) == 0, "an empty line");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// The joined words of every command of a line
+void flatten(const char *line, char *out, size_t size) {
+    parse_tree_t *tree;
+    out[0] = '\0';
+    if (parse_line(line, &tree, NULL) != PARSE_OK) {
+        strcpy(out, "error");
+        return;
+    }
+    for (and_or_t *list = tree->lists; list != NULL; list = list->next) {
+        for (pipeline_t *pipeline = list->pipelines; pipeline != NULL; pipeline = pipeline->next) {
+            for (command_t *command = pipeline->commands; command != NULL; command = command->next) {
+                for (int i = 0; i < command->argc; i++) {
+                    snprintf(out + strlen(out), size - strlen(out), "[%s]", command->argv[i]);
+                }
+                snprintf(out + strlen(out), size - strlen(out), "%c", list->job_type == 1 ? '&' : ';');
+            }
+        }
+    }
+    free_parse_tree(tree);
+}
+
+// The parser reads long lines the same way with every implementation, with words and quotes
+// that cross the 64-byte blocks of the bitmap
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    size_t size = 1 << 16;
+    char *line = malloc(size);
+    line[0] = '\0';
+    const char *words[] = {"averyveryveryveryveryveryveryveryveryveryveryveryverylongword ",
+                           "'single quoted text with ; and | in it' ", "\"double \\\"quoted\\\" $x\\\\ text\" ",
+                           "mixed'a b'\"c d\"e\\ f ", "x\\\ny ", "2>&1 "};
+    const char *operators[] = {"&& ", "| ", "; ", "|| ", "& "};
+    srand(7);
+    while (strlen(line) < size - 1000) {
+        strcat(line, "/bin/echo ");
+        for (int i = rand() % 6; i >= 0; i--) {
+            strcat(line, words[rand() % 6]);
+        }
+        strcat(line, operators[rand() % 5]);
+    }
+    strcat(line, "end");
+    const scan_impl_t *impls;
+    int count = scan_implementations(&impls);
+    char *expected = malloc(size * 2);
+    char *out = malloc(size * 2);
+    select_scan_implementation("scalar");
+    flatten(line, expected, size * 2);
+    for (int k = 0; k < count; k++) {
+        select_scan_implementation(impls[k].name);
+        flatten(line, out, size * 2);
+        passed &= check(test_num, strcmp(out, expected) == 0, impls[k].name);
+    }
+    passed &= check(test_num, strcmp(expected, "error") != 0 && strstr(expected, "[double \"quoted\" \\ text]") != NULL,
+                    "the line parses");
+    passed &= check(test_num, !select_scan_implementation("neon"), "unknown implementations are refused");
+    select_scan_implementation(impls[0].name);
+    free(line);
+    free(expected);
+    free(out);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    return 0;
+}
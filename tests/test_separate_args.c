@@ -55,5 +55,8 @@ int main() {
     verify_separate_args("   ls -la      ~/mpcs51082-aut23",(const char *[]){"ls","-la","~/mpcs51082-aut23"},3);  
     verify_separate_args("   ls -la      ~/mpcs51082-aut23      ",(const char *[]){"ls","-la","~/mpcs51082-aut23"},3);  
     verify_separate_args("   echo bob sally   joe   tim  ben heather          sam     jane   larry              ",(const char *[]){"echo","bob","sally","joe","tim","ben","heather","sam","jane","larry"},10); 
+    verify_separate_args("\tgrep -n\tfoo\n",(const char *[]){"grep","-n","foo"},3);
+    verify_separate_args("a b c d e f g h i j k l m n o p q r s t u v w x y z",(const char *[]){"a","b","c","d","e","f","g","h","i","j","k","l","m","n","o","p","q","r","s","t","u","v","w","x","y","z"},26);
+    verify_separate_args("     ",(const char *[]){NULL},0);
     return 0; 
 }
\ No newline at end of file
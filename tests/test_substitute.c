@@ -0,0 +1,138 @@
+#include "shell.h"
+#include "expand.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Expands the words of the first command of line and joins its fields with '|'. The line comes from
+// the parse cache, as when the shell runs it, so its builtins are known.
+void expand_line(msh_t *shell, const char *line, char *out, size_t size) {
+    parse_tree_t *tree;
+    const char *error;
+    out[0] = '\0';
+    if (acquire_parse_tree(shell->parse_cache, line, &tree, &error) != PARSE_OK) {
+        snprintf(out, size, "<error>");
+        return;
+    }
+    const command_t *command = tree->lists->pipelines->commands;
+    expand_mark_t mark = expand_mark(shell);
+    int argc;
+    char **argv = expand_words(shell, command->argc, command->argv, command->expand, &argc);
+    for (int i = 0; i < argc; i++) {
+        snprintf(out + strlen(out), size - strlen(out), "%s%s", i > 0 ? "|" : "", argv[i]);
+    }
+    expand_release(shell, mark);
+    release_parse_tree(tree);
+}
+
+// $(...) and `...` are parsed with the line, up to the parenthesis or backquote that closes them
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    parse_tree_t *tree;
+    const char *error;
+    passed &= check(test_num, parse_line("echo $(ls -l | wc) `pwd`", &tree, NULL) == PARSE_OK, "the line parses");
+    if (tree != NULL) {
+        command_t *command = tree->lists->pipelines->commands;
+        expansion_t *first = command->expand != NULL && command->expand[1] != NULL ? command->expand[1]->expansions : NULL;
+        expansion_t *second = command->expand != NULL && command->expand[2] != NULL ? command->expand[2]->expansions : NULL;
+        passed &= check(test_num, command->argc == 3 && first != NULL && first->type == PARAM_COMMAND &&
+                        first->lists->pipelines->num_commands == 2,
+                        "$(...) holds its pipeline");
+        passed &= check(test_num, second != NULL && second->type == PARAM_COMMAND &&
+                        strcmp(second->lists->pipelines->commands->argv[0], "pwd") == 0,
+                        "so does `...`");
+        free_parse_tree(tree);
+    }
+    passed &= check(test_num, parse_line("echo $(echo ')' \")\" \\) $(f() { true; }; f) # )\n)", &tree, NULL) == PARSE_OK &&
+                    tree->num_lists == 1,
+                    "quoted and nested parentheses do not close it");
+    free_parse_tree(tree);
+    passed &= check(test_num, parse_line("echo $(echo a", &tree, NULL) == PARSE_INCOMPLETE, "an open $( goes on");
+    passed &= check(test_num, parse_line("echo `echo a", &tree, NULL) == PARSE_INCOMPLETE, "so does an open `");
+    passed &= check(test_num, parse_line("echo $(echo &&)", &tree, &error) == PARSE_ERROR && error != NULL,
+                    "a list that is closed too early is an error");
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Builtins that only write output are captured in the shell; the output loses its trailing newlines
+// and is split unless quoted
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    char out[256];
+    expand_line(shell, "echo a$(echo b  c)d \"$(printf 'x  y\\n\\n\\n')\" $(true)", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|ab|cd|x  y") == 0, "the output replaces the substitution");
+    expand_line(shell, "echo `echo \\`echo nested\\``", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|nested") == 0, "backquotes nest with backslashes");
+    expand_line(shell, "echo $(echo $(echo deep) ${u:-$(echo default)})", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|deep|default") == 0, "substitutions nest");
+    evaluate(shell, "IFS=:");
+    expand_line(shell, "echo $(echo a:b::c)", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|a|b|c") == 0, "the output is split at IFS");
+    evaluate(shell, "unset IFS; false");
+    expand_line(shell, "echo $(echo $?)", out, sizeof(out));
+    passed &= check(test_num, strcmp(out, "echo|1") == 0, "$? inside is the status before it");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Other commands run in a forked copy of the shell, which is reaped as a job
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    evaluate(shell, "x=$(/bin/echo one; /bin/echo two)");
+    passed &= check(test_num, strcmp(var(shell, "x"), "one\ntwo") == 0, "a program's output is captured");
+    evaluate(shell, "big=$(seq 1 20000)");
+    passed &= check(test_num, strlen(var(shell, "big")) == 108893, "output larger than a pipe is read as it comes");
+    evaluate(shell, "y=$(false)");
+    passed &= check(test_num, shell->last_status == 1, "a command of only assignments has the status of its substitution");
+    evaluate(shell, "z=$(export leak=1; echo $leak)");
+    passed &= check(test_num, strcmp(var(shell, "z"), "1") == 0 && get_variable(shell->variables, "leak") == NULL,
+                    "what the substitution changes stays in it");
+    evaluate(shell, "for i in 1 2 3; do n=$(/bin/echo $i | wc -c); done");
+    passed &= check(test_num, strcmp(var(shell, "n"), "2") == 0 && count_jobs(shell->jobs, FOREGROUND) == 0,
+                    "and every substitution is reaped");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Substitutions work in compound commands, functions, redirections and here-documents
+void test4() {
+    int test_num = 4;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    evaluate(shell, "f() { echo \"<$1>\"; }; r=$(f 'a b')");
+    passed &= check(test_num, strcmp(var(shell, "r"), "<a b>") == 0, "a function runs in the substitution");
+    evaluate(shell, "s=$(for w in x y; do if true; then echo $w; fi; done)");
+    passed &= check(test_num, strcmp(var(shell, "s"), "x\ny") == 0, "so do compound commands");
+    evaluate(shell, "t=$(/bin/cat <<EOF\nbody $(echo sub) `echo tick`\nEOF\n)");
+    passed &= check(test_num, strcmp(var(shell, "t"), "body sub tick") == 0, "here-documents substitute");
+    evaluate(shell, "c=0; for i in $(seq 3); do c=$i$c; done");
+    passed &= check(test_num, strcmp(var(shell, "c"), "3210") == 0, "a loop goes through the fields");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef _TEST_SUPPORT_H_
+#define _TEST_SUPPORT_H_
+
+// Helpers shared by the tests. Each test is built on its own, from its file and the sources of the
+// shell, so they are defined here and a test only keeps the ones it uses.
+
+#include "shell.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Prints what failed unless condition holds, and returns condition
+static inline bool check(int test_num, bool condition, const char *what) {
+    if (!condition) {
+        printf("----\n");
+        printf("Test %d failed: %s\n", test_num, what);
+        printf("----\n");
+    }
+    return condition;
+}
+
+// The value of a variable, or "" if it is not set
+static inline const char *var(msh_t *shell, const char *name) {
+    const char *value = get_variable(shell->variables, name);
+    return value != NULL ? value : "";
+}
+
+// Runs a line as the REPL does: it is evaluated, then finished children are reaped
+static inline int run(msh_t *shell, const char *cmd) {
+    char *line = strdup(cmd);
+    int result = evaluate(shell, line);
+    free(line);
+    handle_signals(shell);
+    return result;
+}
+
+// The contents of a file, NUL-terminated and to be freed; "" if it cannot be read. size, unless
+// NULL, receives the number of bytes, which may include NULs (e.g. in a binary history file).
+static inline char *read_file(const char *path, size_t *size) {
+    size_t len = 0;
+    size_t capacity = 4096;
+    char *data = malloc(capacity);
+    if (data == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    FILE *file = fopen(path, "r");
+    if (file != NULL) {
+        size_t n;
+        while ((n = fread(data + len, 1, capacity - len - 1, file)) > 0) {
+            len += n;
+            if (len == capacity - 1) {
+                capacity *= 2;
+                char *grown = realloc(data, capacity);
+                if (grown == NULL) {
+                    perror("realloc");
+                    exit(1);
+                }
+                data = grown;
+            }
+        }
+        fclose(file);
+    }
+    data[len] = '\0';
+    if (size != NULL) {
+        *size = len;
+    }
+    return data;
+}
+
+#endif
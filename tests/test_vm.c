@@ -0,0 +1,182 @@
+#include "shell.h"
+#include "compile.h"
+#include "vm.h"
+#include "signal_handlers.h"
+#include "expand.h"
+#include "test_support.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Compound commands are parsed only where a command starts, and unfinished ones go on on the next line
+void test1() {
+    int test_num = 1;
+    bool passed = true;
+    parse_tree_t *tree;
+    const char *error;
+    passed &= check(test_num, parse_line("for i in a 'b c'; do echo $i; done", &tree, NULL) == PARSE_OK,
+                    "a for loop parses");
+    if (tree != NULL) {
+        command_t *command = tree->lists->pipelines->commands;
+        passed &= check(test_num, command->type == COMMAND_FOR && strcmp(command->compound->name, "i") == 0 &&
+                        command->compound->num_words == 2 && strcmp(command->compound->words[1], "b c") == 0,
+                        "the loop has its variable and words");
+        passed &= check(test_num, command->compound->body->pipelines->commands->argc == 2, "and its body");
+        passed &= check(test_num, needs_program(tree->lists), "the list is compiled");
+        free_parse_tree(tree);
+    }
+    passed &= check(test_num, parse_line("echo if then fi; 'if' true", &tree, NULL) == PARSE_OK &&
+                    tree->lists->pipelines->commands->argc == 4 && !needs_program(tree->lists) &&
+                    tree->lists->next->pipelines->commands->type == COMMAND_SIMPLE,
+                    "reserved words are only words elsewhere, or quoted");
+    free_parse_tree(tree);
+
+    const char *incomplete[] = {"if true; then", "if true; then echo; else", "while true", "for i in a b",
+                                "for i in a b; do echo", "{ echo", "f() {", "f()", "if true\nthen\necho\n"};
+    for (size_t i = 0; i < sizeof(incomplete) / sizeof(incomplete[0]); i++) {
+        passed &= check(test_num, parse_line(incomplete[i], &tree, NULL) == PARSE_INCOMPLETE, "the command goes on");
+    }
+    const char *errors[] = {"fi", "if true; then fi", "while; do true; done", "for 1 in a; do true; done",
+                            "if true; then true; fi x", "f() echo", "{ true; } }", "done"};
+    for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+        passed &= check(test_num, parse_line(errors[i], &tree, &error) == PARSE_ERROR && error != NULL,
+                        "a misplaced reserved word is an error");
+    }
+    passed &= check(test_num, parse_line("f () { true; }", &tree, NULL) == PARSE_OK &&
+                    tree->lists->pipelines->commands->type == COMMAND_FUNCTION &&
+                    strcmp(tree->lists->pipelines->commands->compound->name, "f") == 0,
+                    "NAME () defines a function");
+    free_parse_tree(tree);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Branches and loops run the right parts and leave the exit status sh would
+void test2() {
+    int test_num = 2;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    // mark WORD sets r to WORD
+    evaluate(shell, "mark() { for r; do true; done; }");
+
+    evaluate(shell, "if false; then mark then; elif true; then mark elif; else mark else; fi");
+    passed &= check(test_num, strcmp(var(shell, "r"), "elif") == 0 && shell->last_status == 0, "elif runs");
+    evaluate(shell, "if false; then true; fi");
+    passed &= check(test_num, shell->last_status == 0, "an if that runs nothing succeeds");
+    evaluate(shell, "if true; then false; fi");
+    passed &= check(test_num, shell->last_status == 1, "an if has the status of its body");
+
+    evaluate(shell, "for i in 1 2 3; do mark x; done");
+    passed &= check(test_num, strcmp(var(shell, "i"), "3") == 0, "a for loop goes through its words");
+    evaluate(shell, "for i in a b c; do if true; then break; fi; mark no; done");
+    passed &= check(test_num, strcmp(var(shell, "i"), "a") == 0 && shell->last_status == 0, "break leaves the loop");
+    evaluate(shell, "mark start; for i in a b; do for j in x y; do continue 2; mark no; done; mark no; done");
+    passed &= check(test_num, strcmp(var(shell, "r"), "start") == 0 && strcmp(var(shell, "j"), "x") == 0,
+                    "continue 2 goes on with the outer loop");
+    evaluate(shell, "while false; do true; done");
+    passed &= check(test_num, shell->last_status == 0, "a loop that never runs succeeds");
+    evaluate(shell, "for i in 1 2; do false; done");
+    passed &= check(test_num, shell->last_status == 1, "a loop has the status of its last command");
+    evaluate(shell, "mark 0; until true; do mark no; done; while true; do mark 1; break; done");
+    passed &= check(test_num, strcmp(var(shell, "r"), "1") == 0, "until and while test their conditions");
+    evaluate(shell, "true && { mark a; false; } || mark b");
+    passed &= check(test_num, strcmp(var(shell, "r"), "b") == 0, "groups join and-or lists");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// Functions take arguments, return statuses, recurse up to a limit and may exit the shell
+void test3() {
+    int test_num = 3;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    evaluate(shell, "last() { for a; do true; done; return 7; }");
+    evaluate(shell, "last x y z");
+    passed &= check(test_num, strcmp(var(shell, "a"), "z") == 0 && shell->last_status == 7,
+                    "a function gets its arguments and returns a status");
+    passed &= check(test_num, shell->num_params == 0, "the arguments are gone after the call");
+    evaluate(shell, "f() { f() { for v in new; do true; done; }; for v in old; do true; done; }; f");
+    passed &= check(test_num, strcmp(var(shell, "v"), "old") == 0, "a function may redefine itself");
+    evaluate(shell, "f");
+    passed &= check(test_num, strcmp(var(shell, "v"), "new") == 0, "then the new body runs");
+    evaluate(shell, "deep() { deep; }; deep");
+    passed &= check(test_num, shell->last_status == 1 && shell->functions->depth == 0, "recursion is bounded");
+    evaluate(shell, "true() { return 3; }; true");
+    passed &= check(test_num, shell->last_status == 3, "functions come before builtins");
+    passed &= check(test_num, evaluate(shell, "leave() { exit; }; leave; for v in after; do true; done") != 0 &&
+                    strcmp(var(shell, "v"), "new") == 0,
+                    "exit in a function ends the line and the shell");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// A loop line is compiled once: running it again reuses its bytecode from the parse cache
+void test4() {
+    int test_num = 4;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    char *line = "for a in 0 1 2 3 4 5 6 7 8 9; do for b in 0 1 2 3 4 5 6 7 8 9; do "
+                 "for c in 0 1 2 3 4 5 6 7 8 9; do for d in 0 1 2 3 4 5 6 7 8 9; do "
+                 "for e in 0 1 2 3 4 5 6 7 8 9; do true; done; done; done; done; done";
+    evaluate(shell, line);
+    passed &= check(test_num, strcmp(var(shell, "a"), "9") == 0 && strcmp(var(shell, "e"), "9") == 0,
+                    "100000 iterations run");
+    parse_tree_t *tree;
+    acquire_parse_tree(shell->parse_cache, line, &tree, NULL);
+    const program_t *program = tree->lists->program;
+    passed &= check(test_num, program != NULL && program->num_slots == 5 && program->tree == tree,
+                    "the compiled loop is cached with its tree");
+    long long hits = shell->parse_cache->hits;
+    evaluate(shell, line);
+    passed &= check(test_num, shell->parse_cache->hits == hits + 1 && tree->lists->program == program,
+                    "running it again does not compile it again");
+    release_parse_tree(tree);
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+// The words of a for loop live until it ends, so nested loops and loops that start again keep theirs
+void test5() {
+    int test_num = 5;
+    bool passed = true;
+    msh_t *shell = alloc_shell(16, 0, 10);
+    shell->record_history = false;
+    expand_mark_t before = expand_mark(shell);
+    evaluate(shell, "x='a b c'; for i in $x; do for j in $x; do s=$s$i$j; done; done");
+    passed &= check(test_num, strcmp(var(shell, "s"), "aaabacbabbbccacbcc") == 0, "nested loops expand their words");
+    evaluate(shell, "for r in 1 2 3; do for i in $x; do for j in $i $r; do t=$t$j; done; done; done");
+    passed &= check(test_num, strcmp(var(shell, "t"), "a1b1c1a2b2c2a3b3c3") == 0,
+                    "an inner loop that starts again gets new words");
+    evaluate(shell, "y=abcdefgh; for r in 1 2 3 4 5 6 7 8 9 10; do y=$y$y; "
+                    "for i in $y $y; do for j in $y; do n=$j; done; done; done");
+    passed &= check(test_num, strlen(var(shell, "n")) == 8192, "even when the words outgrow a block of the stack");
+    evaluate(shell, "while [ \"$c\" != xxx ]; do c=${c}x; for i in $x; do for j in $x; do break 2; done; done; done");
+    passed &= check(test_num, strcmp(var(shell, "c"), "xxx") == 0, "break leaves loops that start again");
+    expand_mark_t after = expand_mark(shell);
+    passed &= check(test_num, after.block == before.block && after.used == before.used,
+                    "and their words are popped");
+    exit_shell(shell);
+    if (passed) {
+        printf("Test %d Passed\n", test_num);
+    }
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    test5();
+    return 0;
+}